@@ -6,10 +6,13 @@
   * comms_can_read outputs this buffer in chunks of a specified length.
     chunks are always the given length, except the last one.
   * comms_can_write reads in this buffer in chunks.
-  * both functions maintain an overflow buffer for a partial CANPacket_t that
-    spans multiple transfers/chunks.
-  * the overflow buffers are reset by a dedicated control transfer handler,
-    which is sent by the host on each start of a connection.
+  * comms_can_write maintains an overflow buffer for a partial CANPacket_t that
+    spans multiple transfers/chunks. comms_can_read leaves the tail of a split
+    CANPacket_t in the RX queue.
+  * the overflow buffer and the split RX tail are reset by a dedicated control
+    transfer handler, which is sent by the host on each start of a connection.
+  * RX frames may carry a microsecond timestamp after their data, flagged in
+    the header. The host opts in per connection.
 */
 
 typedef struct {
@@ -18,59 +21,49 @@ typedef struct {
   uint8_t data[72];
 } asm_buffer;
 
-asm_buffer can_read_buffer = {.ptr = 0U, .tail_size = 0U};
+// bytes of a frame that was split at the end of the last read and are still in can_rx_q
+uint32_t can_read_tail = 0U;
 
-int comms_can_read(uint8_t *data, uint32_t max_len) {
-  uint32_t pos = 0U;
+// comms_can_read that also XORs the bytes into checksum, for SPI responses
+int comms_can_read_checksum(uint8_t *data, uint32_t max_len, uint8_t *checksum) {
+  // can_rx_q holds frames in wire format, so this is a plain copy. a frame that doesn't fit
+  // is split and its tail stays in the queue for the next read
+  uint32_t len = can_packed_read(&can_rx_q, data, max_len, checksum);
 
-  // Send tail of previous message if it is in buffer
-  if (can_read_buffer.ptr > 0U) {
-    uint32_t overflow_len = MIN(max_len - pos, can_read_buffer.ptr);
-    (void)memcpy(&data[pos], can_read_buffer.data, overflow_len);
-    pos += overflow_len;
-    (void)memcpy(can_read_buffer.data, &can_read_buffer.data[overflow_len], can_read_buffer.ptr - overflow_len);
-    can_read_buffer.ptr -= overflow_len;
+  // track frame boundaries, so a reset can drop the tail of a split frame
+  uint32_t pos = can_read_tail;
+  while (pos < len) {
+    pos += can_packed_frame_len(data[pos]);
   }
+  can_read_tail = pos - len;
 
-  if (can_read_buffer.ptr == 0U) {
-    // Fill rest of buffer with new data
-    CANPacket_t can_packet;
-    while ((pos < max_len) && can_pop(&can_rx_q, &can_packet)) {
-      uint32_t pckt_len = CANPACKET_HEAD_SIZE + dlc_to_len[can_packet.data_len_code];
-      if ((pos + pckt_len) <= max_len) {
-        (void)memcpy(&data[pos], &can_packet, pckt_len);
-        pos += pckt_len;
-      } else {
-        (void)memcpy(&data[pos], &can_packet, max_len - pos);
-        can_read_buffer.ptr += pckt_len - (max_len - pos);
-        // cppcheck-suppress objectIndex
-        (void)memcpy(can_read_buffer.data, &((uint8_t*)&can_packet)[(max_len - pos)], can_read_buffer.ptr);
-        pos = max_len;
-      }
-    }
-  }
+  return len;
+}
 
-  return pos;
+int comms_can_read(uint8_t *data, uint32_t max_len) {
+  return comms_can_read_checksum(data, max_len, NULL);
 }
 
 asm_buffer can_write_buffer = {.ptr = 0U, .tail_size = 0U};
 
 // send on CAN
+// the CAN cores are kicked once per bus after the whole transfer is queued
 void comms_can_write(const uint8_t *data, uint32_t len) {
   uint32_t pos = 0U;
+  uint8_t pending_buses = 0U;
 
   // Assembling can message with data from buffer
   if (can_write_buffer.ptr != 0U) {
     if (can_write_buffer.tail_size <= (len - pos)) {
       // we have enough data to complete the buffer
-      CANPacket_t to_push = {0};
       (void)memcpy(&can_write_buffer.data[can_write_buffer.ptr], &data[pos], can_write_buffer.tail_size);
       can_write_buffer.ptr += can_write_buffer.tail_size;
       pos += can_write_buffer.tail_size;
 
       // send out
-      (void)memcpy(&to_push, can_write_buffer.data, can_write_buffer.ptr);
-      can_send(&to_push, to_push.bus, false);
+      if (can_send_raw(can_write_buffer.data, can_write_buffer.ptr)) {
+        pending_buses |= (uint8_t)(1U << can_raw_bus(can_write_buffer.data));
+      }
 
       // reset overflow buffer
       can_write_buffer.ptr = 0U;
@@ -85,13 +78,13 @@ void comms_can_write(const uint8_t *data, uint32_t len) {
     }
   }
 
-  // rest of the message
+  // rest of the message, straight from the transfer into the TX queues
   while (pos < len) {
     uint32_t pckt_len = CANPACKET_HEAD_SIZE + dlc_to_len[(data[pos] >> 4U)];
     if ((pos + pckt_len) <= len) {
-      CANPacket_t to_push = {0};
-      (void)memcpy(&to_push, &data[pos], pckt_len);
-      can_send(&to_push, to_push.bus, false);
+      if (can_send_raw(&data[pos], pckt_len)) {
+        pending_buses |= (uint8_t)(1U << can_raw_bus(&data[pos]));
+      }
       pos += pckt_len;
     } else {
       (void)memcpy(can_write_buffer.data, &data[pos], len - pos);
@@ -101,14 +94,22 @@ void comms_can_write(const uint8_t *data, uint32_t len) {
     }
   }
 
+  for (uint8_t bus_number = 0U; bus_number < PANDA_BUS_CNT; bus_number++) {
+    if ((pending_buses & (1U << bus_number)) != 0U) {
+      process_can(CAN_NUM_FROM_BUS_NUM(bus_number));
+    }
+  }
+
   refresh_can_tx_slots_available();
 }
 
 void comms_can_reset(void) {
   can_write_buffer.ptr = 0U;
   can_write_buffer.tail_size = 0U;
-  can_read_buffer.ptr = 0U;
-  can_read_buffer.tail_size = 0U;
+  can_packed_skip(&can_rx_q, can_read_tail);
+  can_read_tail = 0U;
+  // every connection starts with the compact format
+  can_rx_timestamps = false;
 }
 
 // TODO: make this more general!
@@ -4,9 +4,11 @@ const uint8_t PANDA_CAN_CNT = 3U;
 const uint8_t PANDA_BUS_CNT = 3U;
 
 // bump this when changing the CAN packet
-#define CAN_PACKET_VERSION 4
+#define CAN_PACKET_VERSION 5
 
 #define CANPACKET_HEAD_SIZE 6U
+// RX frames with the timestamped bit set carry a little endian microsecond timestamp right after the data
+#define CANPACKET_TIMESTAMP_SIZE 4U
 
 #if !defined(STM32F4)
   #define CANFD
@@ -16,7 +18,7 @@ const uint8_t PANDA_BUS_CNT = 3U;
 #endif
 
 typedef struct {
-  unsigned char reserved : 1;
+  unsigned char timestamped : 1;
   unsigned char bus : 3;
   unsigned char data_len_code : 4;  // lookup length with dlc_to_len
   unsigned char rejected : 1;
@@ -27,6 +29,16 @@ typedef struct {
   unsigned char data[CANPACKET_DATA_SIZE_MAX];
 } __attribute__((packed, aligned(4))) CANPacket_t;
 
+// TX queue priority levels per bus, process_can drains the lowest level first
+#define CAN_TX_PRIO_HIGH 0U
+#define CAN_TX_PRIO_LOW 1U
+#define CAN_TX_PRIO_CNT 2U
+
+// bus 0 frames ignition_can_hook reads, in every safety mode
+#define CAN_IGNITION_GM_ADDR 0x1F1
+#define CAN_IGNITION_TESLA_ADDR 0x348
+#define CAN_IGNITION_MAZDA_ADDR 0x9E
+
 const unsigned char dlc_to_len[] = {0U, 1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U, 12U, 16U, 20U, 24U, 32U, 48U, 64U};
 
 #define GET_BUS(msg) ((msg)->bus)
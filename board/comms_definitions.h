@@ -9,4 +9,5 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp);
 void comms_endpoint2_write(const uint8_t *data, uint32_t len);
 void comms_can_write(const uint8_t *data, uint32_t len);
 int comms_can_read(uint8_t *data, uint32_t max_len);
+int comms_can_read_checksum(uint8_t *data, uint32_t max_len, uint8_t *checksum);
 void comms_can_reset(void);
@@ -1,19 +1,12 @@
 #pragma once
 
-uint8_t crc_checksum(const uint8_t *dat, int len, const uint8_t poly) {
+#include "obj/crc_tables.h"
+
+// CRC-8/DVB-S2 (poly 0xD5) of dat, from the last byte to the first
+uint8_t crc_checksum(const uint8_t *dat, int len) {
   uint8_t crc = 0xFFU;
-  int i;
-  int j;
-  for (i = len - 1; i >= 0; i--) {
-    crc ^= dat[i];
-    for (j = 0; j < 8; j++) {
-      if ((crc & 0x80U) != 0U) {
-        crc = (uint8_t)((crc << 1) ^ poly);
-      }
-      else {
-        crc <<= 1;
-      }
-    }
+  for (int i = len - 1; i >= 0; i--) {
+    crc = crc8_lut_dvb_s2[crc ^ dat[i]];
   }
   return crc;
 }
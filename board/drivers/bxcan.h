@@ -1,6 +1,6 @@
-// IRQs: CAN1_TX, CAN1_RX0, CAN1_SCE
-//       CAN2_TX, CAN2_RX0, CAN2_SCE
-//       CAN3_TX, CAN3_RX0, CAN3_SCE
+// IRQs: CAN1_TX, CAN1_RX0, CAN1_RX1, CAN1_SCE
+//       CAN2_TX, CAN2_RX0, CAN2_RX1, CAN2_SCE
+//       CAN3_TX, CAN3_RX0, CAN3_RX1, CAN3_SCE
 
 CAN_TypeDef *cans[] = {CAN1, CAN2, CAN3};
 uint8_t can_irq_number[3][3] = {
@@ -47,11 +47,6 @@ void update_can_health_pkt(uint8_t can_number, uint32_t ir_reg) {
   if (ir_reg != 0U) {
     can_health[can_number].total_error_cnt += 1U;
 
-    // RX message lost due to FIFO overrun
-    if ((CANx->RF0R & (CAN_RF0R_FOVR0)) != 0U) {
-      can_health[can_number].total_rx_lost_cnt += 1U;
-      CANx->RF0R &= ~(CAN_RF0R_FOVR0);
-    }
     can_health[can_number].can_core_reset_cnt += 1U;
     llcan_clear_send(CANx);
   }
@@ -63,6 +58,13 @@ void can_sce(uint8_t can_number) {
   update_can_health_pkt(can_number, 1U);
 }
 
+// identifier register of a TX mailbox for the frame, without the TXRQ bit
+#define CAN_TX_MAILBOX_TIR(pkt) (((pkt)->extended != 0U) ? (((uint32_t)(pkt)->addr << 3) | (1UL << 2)) : ((uint32_t)(pkt)->addr << 21))
+
+// a popped frame waiting for the mailbox that holds its ID, see can_tx_hw_mailbox_pick
+CANPacket_t can_tx_held[3];
+bool can_tx_held_valid[3];
+
 // CANx_TX IRQ Handler
 void process_can(uint8_t can_number) {
   if (can_number != 0xffU) {
@@ -72,140 +74,189 @@ void process_can(uint8_t can_number) {
     CAN_TypeDef *CANx = CANIF_FROM_CAN_NUM(can_number);
     uint8_t bus_number = BUS_NUM_FROM_CAN_NUM(can_number);
 
-    // check for empty mailbox
-    CANPacket_t to_send;
-    if ((CANx->TSR & (CAN_TSR_TERR0 | CAN_TSR_ALST0)) != 0U) { // last TX failed due to error arbitration lost
-      can_health[can_number].total_tx_lost_cnt += 1U;
-      CANx->TSR |= (CAN_TSR_TERR0 | CAN_TSR_ALST0);
-    }
-    if ((CANx->TSR & CAN_TSR_TME0) == CAN_TSR_TME0) {
-      // add successfully transmitted message to my fifo
-      if ((CANx->TSR & CAN_TSR_RQCP0) == CAN_TSR_RQCP0) {
-        if ((CANx->TSR & CAN_TSR_TXOK0) == CAN_TSR_TXOK0) {
+    // TSR has a byte of status bits per mailbox, laid out like mailbox 0's. Its flags are cleared by
+    // writing 1, so it's written with just the flags to clear instead of read-modify-write
+    for (uint8_t mb = 0U; mb < CAN_TX_HW_MAILBOX_CNT; mb++) {
+      uint32_t tsr = CANx->TSR >> (8U * mb);
+      if ((tsr & CAN_TSR_RQCP0) == CAN_TSR_RQCP0) {
+        if ((tsr & CAN_TSR_TXOK0) == CAN_TSR_TXOK0) {
+          // add successfully transmitted message to my fifo
           CANPacket_t to_push;
           to_push.returned = 1U;
           to_push.rejected = 0U;
-          to_push.extended = (CANx->sTxMailBox[0].TIR >> 2) & 0x1U;
-          to_push.addr = (to_push.extended != 0U) ? (CANx->sTxMailBox[0].TIR >> 3) : (CANx->sTxMailBox[0].TIR >> 21);
-          to_push.data_len_code = CANx->sTxMailBox[0].TDTR & 0xFU;
+          to_push.extended = (CANx->sTxMailBox[mb].TIR >> 2) & 0x1U;
+          to_push.addr = (to_push.extended != 0U) ? (CANx->sTxMailBox[mb].TIR >> 3) : (CANx->sTxMailBox[mb].TIR >> 21);
+          to_push.data_len_code = CANx->sTxMailBox[mb].TDTR & 0xFU;
           to_push.bus = bus_number;
-          WORD_TO_BYTE_ARRAY(&to_push.data[0], CANx->sTxMailBox[0].TDLR);
-          WORD_TO_BYTE_ARRAY(&to_push.data[4], CANx->sTxMailBox[0].TDHR);
-          can_set_checksum(&to_push);
-
-          rx_buffer_overflow += can_push(&can_rx_q, &to_push) ? 0U : 1U;
+          WORD_TO_BYTE_ARRAY(&to_push.data[0], CANx->sTxMailBox[mb].TDLR);
+          WORD_TO_BYTE_ARRAY(&to_push.data[4], CANx->sTxMailBox[mb].TDHR);
+          can_rx_push(&to_push, microsecond_timer_get());
+        } else {
+          // aborted by llcan_clear_send
+          can_health[can_number].total_tx_lost_cnt += 1U;
         }
 
-        // clear interrupt
-        // careful, this can also be cleared by requesting a transmission
-        CANx->TSR |= CAN_TSR_RQCP0;
+        // clear interrupt, this also clears TXOK, ALST and TERR
+        CANx->TSR = CAN_TSR_RQCP0 << (8U * mb);
       }
+    }
 
-      if (can_pop(can_queues[bus_number], &to_send)) {
-        if (can_check_checksum(&to_send)) {
-          can_health[can_number].total_tx_cnt += 1U;
-          // only send if we have received a packet
-          CANx->sTxMailBox[0].TIR = ((to_send.extended != 0U) ? (to_send.addr << 3) : (to_send.addr << 21)) | (to_send.extended << 2);
-          CANx->sTxMailBox[0].TDTR = to_send.data_len_code;
-          BYTE_ARRAY_TO_WORD(CANx->sTxMailBox[0].TDLR, &to_send.data[0]);
-          BYTE_ARRAY_TO_WORD(CANx->sTxMailBox[0].TDHR, &to_send.data[4]);
-          // Send request TXRQ
-          CANx->sTxMailBox[0].TIR |= 0x1U;
+    // fill the empty mailboxes, a frame whose ID is still pending in another mailbox waits for it
+    CANPacket_t *to_send = &can_tx_held[can_number];
+    bool popped = false;
+    bool filling = true;
+    while (filling) {
+      if (!can_tx_held_valid[can_number]) {
+        can_tx_held_valid[can_number] = can_tx_pop(bus_number, to_send);
+        popped = popped || can_tx_held_valid[can_number];
+      }
+      filling = can_tx_held_valid[can_number];
+
+      if (filling) {
+        if (can_check_checksum(to_send)) {
+          uint8_t pending = 0U;
+          uint32_t ids[CAN_TX_HW_MAILBOX_CNT] = {0U};
+          for (uint8_t i = 0U; i < CAN_TX_HW_MAILBOX_CNT; i++) {
+            if ((CANx->TSR & (CAN_TSR_TME0 << i)) == 0U) {
+              pending |= (uint8_t)(1U << i);
+              ids[i] = CANx->sTxMailBox[i].TIR & ~(CAN_TI0R_TXRQ);
+            }
+          }
+
+          int mb = can_tx_hw_mailbox_pick(pending, ids, CAN_TX_MAILBOX_TIR(to_send));
+          if (mb >= 0) {
+            can_health[can_number].total_tx_cnt += 1U;
+            CANx->sTxMailBox[mb].TIR = CAN_TX_MAILBOX_TIR(to_send);
+            CANx->sTxMailBox[mb].TDTR = to_send->data_len_code;
+            BYTE_ARRAY_TO_WORD(CANx->sTxMailBox[mb].TDLR, &to_send->data[0]);
+            BYTE_ARRAY_TO_WORD(CANx->sTxMailBox[mb].TDHR, &to_send->data[4]);
+            // Send request TXRQ
+            CANx->sTxMailBox[mb].TIR |= CAN_TI0R_TXRQ;
+            can_tx_held_valid[can_number] = false;
+          } else {
+            filling = false;
+          }
         } else {
           can_health[can_number].total_tx_checksum_error_cnt += 1U;
+          can_tx_held_valid[can_number] = false;
         }
-
-        refresh_can_tx_slots_available();
       }
     }
 
+    if (popped) {
+      refresh_can_tx_slots_available();
+    }
+
     EXIT_CRITICAL();
   }
 }
 
-// CANx_RX0 IRQ Handler
+// CANx_RX0 and CANx_RX1 IRQ Handler
+// top half: the frames go to can_rx_staging, can_rx_process does the rest from PendSV
 // blink blue when we are receiving CAN messages
-void can_rx(uint8_t can_number) {
+void can_rx(uint8_t can_number, uint8_t fifo) {
   CAN_TypeDef *CANx = CANIF_FROM_CAN_NUM(can_number);
   uint8_t bus_number = BUS_NUM_FROM_CAN_NUM(can_number);
+  // RF1R has the same layout as RF0R
+  volatile uint32_t *rfr = (fifo == 0U) ? &(CANx->RF0R) : &(CANx->RF1R);
+
+  // RX message lost due to FIFO overrun
+  if ((*rfr & CAN_RF0R_FOVR0) != 0U) {
+    can_health[can_number].total_rx_lost_cnt += 1U;
+    can_health[can_number].rx_fifo_overrun_cnt[fifo] += 1U;
+  }
+  *rfr = CAN_RF0R_FULL0 | CAN_RF0R_FOVR0;
 
-  while ((CANx->RF0R & CAN_RF0R_FMP0) != 0U) {
+  bool received = false;
+  while ((*rfr & CAN_RF0R_FMP0) != 0U) {
     can_health[can_number].total_rx_cnt += 1U;
+    uint32_t rx_time = microsecond_timer_get();
+    received = true;
 
     // can is live
     pending_can_live = 1;
 
-    // add to my fifo
-    CANPacket_t to_push;
-
-    to_push.returned = 0U;
-    to_push.rejected = 0U;
-    to_push.extended = (CANx->sFIFOMailBox[0].RIR >> 2) & 0x1U;
-    to_push.addr = (to_push.extended != 0U) ? (CANx->sFIFOMailBox[0].RIR >> 3) : (CANx->sFIFOMailBox[0].RIR >> 21);
-    to_push.data_len_code = CANx->sFIFOMailBox[0].RDTR & 0xFU;
-    to_push.bus = bus_number;
-    WORD_TO_BYTE_ARRAY(&to_push.data[0], CANx->sFIFOMailBox[0].RDLR);
-    WORD_TO_BYTE_ARRAY(&to_push.data[4], CANx->sFIFOMailBox[0].RDHR);
-    can_set_checksum(&to_push);
-
-    // forwarding (panda only)
-    int bus_fwd_num = safety_fwd_hook(bus_number, to_push.addr);
-    if (bus_fwd_num != -1) {
-      CANPacket_t to_send;
-
-      to_send.returned = 0U;
-      to_send.rejected = 0U;
-      to_send.extended = to_push.extended; // TXRQ
-      to_send.addr = to_push.addr;
-      to_send.bus = to_push.bus;
-      to_send.data_len_code = to_push.data_len_code;
-      (void)memcpy(to_send.data, to_push.data, dlc_to_len[to_push.data_len_code]);
-      can_set_checksum(&to_send);
-
-      can_send(&to_send, bus_fwd_num, true);
-      can_health[can_number].total_fwd_cnt += 1U;
+    can_rx_staged_t *staged = can_rx_stage_reserve(can_number);
+    if (staged != NULL) {
+      CANPacket_t *to_push = &staged->pkt;
+      staged->rx_time = rx_time;
+      to_push->extended = (CANx->sFIFOMailBox[fifo].RIR >> 2) & 0x1U;
+      to_push->addr = (to_push->extended != 0U) ? (CANx->sFIFOMailBox[fifo].RIR >> 3) : (CANx->sFIFOMailBox[fifo].RIR >> 21);
+      to_push->data_len_code = CANx->sFIFOMailBox[fifo].RDTR & 0xFU;
+      to_push->bus = bus_number;
+      WORD_TO_BYTE_ARRAY(&to_push->data[0], CANx->sFIFOMailBox[fifo].RDLR);
+      WORD_TO_BYTE_ARRAY(&to_push->data[4], CANx->sFIFOMailBox[fifo].RDHR);
+      can_rx_stage_commit();
     }
 
-    safety_rx_invalid += safety_rx_hook(&to_push) ? 0U : 1U;
-    ignition_can_hook(&to_push);
+    // next
+    *rfr = CAN_RF0R_RFOM0;
+  }
 
+  if (received) {
     current_board->set_led(LED_BLUE, true);
-    rx_buffer_overflow += can_push(&can_rx_q, &to_push) ? 0U : 1U;
-
-    // next
-    CANx->RF0R |= CAN_RF0R_RFOM0;
+    can_rx_pend_bottom_half();
   }
 }
 
-void CAN1_TX_IRQ_Handler(void) { process_can(0); }
-void CAN1_RX0_IRQ_Handler(void) { can_rx(0); }
+// CAN RX bottom half, at the lowest priority
+void PendSV_Handler(void) {
+  interrupt_load_enter();
+  can_rx_process();
+  interrupt_load_exit();
+}
+
+void can_rx_pend_bottom_half(void) {
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+void CAN1_TX_IRQ_Handler(void) { can_tx_irq(0); }
+void CAN1_RX0_IRQ_Handler(void) { can_rx(0, 0U); }
+void CAN1_RX1_IRQ_Handler(void) { can_rx(0, 1U); }
 void CAN1_SCE_IRQ_Handler(void) { can_sce(0); }
 
-void CAN2_TX_IRQ_Handler(void) { process_can(1); }
-void CAN2_RX0_IRQ_Handler(void) { can_rx(1); }
+void CAN2_TX_IRQ_Handler(void) { can_tx_irq(1); }
+void CAN2_RX0_IRQ_Handler(void) { can_rx(1, 0U); }
+void CAN2_RX1_IRQ_Handler(void) { can_rx(1, 1U); }
 void CAN2_SCE_IRQ_Handler(void) { can_sce(1); }
 
-void CAN3_TX_IRQ_Handler(void) { process_can(2); }
-void CAN3_RX0_IRQ_Handler(void) { can_rx(2); }
+void CAN3_TX_IRQ_Handler(void) { can_tx_irq(2); }
+void CAN3_RX0_IRQ_Handler(void) { can_rx(2, 0U); }
+void CAN3_RX1_IRQ_Handler(void) { can_rx(2, 1U); }
 void CAN3_SCE_IRQ_Handler(void) { can_sce(2); }
 
+// RX FIFO 1 for the safety mode's RX checks
+void can_set_rx_filters(uint8_t can_number) {
+  uint16_t ids[CAN_RX_FIFO1_IDS_MAX];
+  uint8_t len = can_rx_fifo1_ids(BUS_NUM_FROM_CAN_NUM(can_number), ids);
+  llcan_set_fifo1_filters(CANIF_FROM_CAN_NUM(can_number), ids, len);
+}
+
 bool can_init(uint8_t can_number) {
   bool ret = false;
 
   REGISTER_INTERRUPT(CAN1_TX_IRQn, CAN1_TX_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_1)
   REGISTER_INTERRUPT(CAN1_RX0_IRQn, CAN1_RX0_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_1)
+  REGISTER_INTERRUPT(CAN1_RX1_IRQn, CAN1_RX1_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_1)
   REGISTER_INTERRUPT(CAN1_SCE_IRQn, CAN1_SCE_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_1)
   REGISTER_INTERRUPT(CAN2_TX_IRQn, CAN2_TX_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_2)
   REGISTER_INTERRUPT(CAN2_RX0_IRQn, CAN2_RX0_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_2)
+  REGISTER_INTERRUPT(CAN2_RX1_IRQn, CAN2_RX1_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_2)
   REGISTER_INTERRUPT(CAN2_SCE_IRQn, CAN2_SCE_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_2)
   REGISTER_INTERRUPT(CAN3_TX_IRQn, CAN3_TX_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_3)
   REGISTER_INTERRUPT(CAN3_RX0_IRQn, CAN3_RX0_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_3)
+  REGISTER_INTERRUPT(CAN3_RX1_IRQn, CAN3_RX1_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_3)
   REGISTER_INTERRUPT(CAN3_SCE_IRQn, CAN3_SCE_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_3)
 
+  // the RX bottom half runs below every other interrupt
+  NVIC_SetPriority(PendSV_IRQn, (1UL << __NVIC_PRIO_BITS) - 1UL);
+
   if (can_number != 0xffU) {
     CAN_TypeDef *CANx = CANIF_FROM_CAN_NUM(can_number);
     ret &= can_set_speed(can_number);
     ret &= llcan_init(CANx);
+    can_set_rx_filters(can_number);
+    can_tx_held_valid[can_number] = false;
     // in case there are queued up messages
     process_can(can_number);
   }
@@ -3,8 +3,19 @@ typedef struct {
   volatile uint32_t r_ptr;
   uint32_t fifo_size;
   CANPacket_t *elems;
+  bool spsc; // lock-free single-producer/single-consumer mode, see ownership rules below
 } can_ring;
 
+// byte granular queue holding frames in their wire format (header + dlc_to_len bytes),
+// so classic CAN frames only take up a fraction of a CANPacket_t slot
+typedef struct {
+  volatile uint32_t w_ptr;
+  volatile uint32_t r_ptr;
+  uint32_t size; // bytes
+  uint8_t *data;
+  bool spsc;
+} can_packed_ring;
+
 typedef struct {
   uint8_t bus_lookup;
   uint8_t can_num_lookup;
@@ -42,79 +53,206 @@ int pending_can_live = 0;
 int can_silent = ALL_CAN_SILENT;
 bool can_loopback = false;
 
+// set by the host, frames in can_rx_q then carry their capture time. cleared on comms reset
+bool can_rx_timestamps = false;
+
 // ******************* functions prototypes *********************
 bool can_init(uint8_t can_number);
 void process_can(uint8_t can_number);
+void can_rx_pend_bottom_half(void);
+uint32_t can_pop_many(can_ring *q, CANPacket_t *elems, uint32_t n);
+uint32_t can_push_many(can_ring *q, const CANPacket_t *elems, uint32_t n);
 
 // ********************* instantiate queues *********************
-#define can_buffer(x, size) \
+#define can_buffer(x, size, lockfree) \
   CANPacket_t elems_##x[size]; \
-  can_ring can_##x = { .w_ptr = 0, .r_ptr = 0, .fifo_size = (size), .elems = (CANPacket_t *)&(elems_##x) };
+  can_ring can_##x = { .w_ptr = 0, .r_ptr = 0, .fifo_size = (size), .elems = (CANPacket_t *)&(elems_##x), .spsc = (lockfree) };
 
-#define CAN_RX_BUFFER_SIZE 4096U
+#define can_packed_buffer(x, len, lockfree) \
+  uint8_t data_##x[len]; \
+  can_packed_ring can_##x = { .w_ptr = 0, .r_ptr = 0, .size = (len), .data = (uint8_t *)&(data_##x), .spsc = (lockfree) };
+
+// same RAM as 4096 CANPacket_t slots, which fits 4096 CAN FD frames or up to ~5x as many classic frames
+#define CAN_RX_BUFFER_SIZE (4096U * sizeof(CANPacket_t))
 #define CAN_TX_BUFFER_SIZE 416U
+// control frames are few and get sent first, so the high priority queues can be small
+#define CAN_TX_PRIO_BUFFER_SIZE 64U
+
+// Queue ownership, which decides if a queue may run in SPSC mode:
+// * can_rx_q:  produced by can_rx_process, process_can (TX echoes) and can_send (rejected frames),
+//              consumed by comms_can_read from the USB/SPI IRQs
+// * can_txX_q: produced by comms_can_write from the USB/SPI IRQs and by can_rx_process (forwarding),
+//              consumed by process_can
+// All of these run in CAN/USB/SPI IRQs, which share the same NVIC priority and never preempt
+// each other, or in the RX bottom half, which handles each frame in a critical section. So every
+// queue has exactly one producer and one consumer context, and a producer's reserve and commit
+// are never interleaved with another one.
+// The jungle also fills the TX queues from the main loop, so it keeps the critical sections there.
+#ifdef PANDA_JUNGLE
+  #define CAN_TX_QUEUE_SPSC false
+#else
+  #define CAN_TX_QUEUE_SPSC true
+#endif
 
 #ifdef STM32H7
 // ITCM RAM and DTCM RAM are the fastest for Cortex-M7 core access
-__attribute__((section(".axisram"))) can_buffer(rx_q, CAN_RX_BUFFER_SIZE)
-__attribute__((section(".itcmram"))) can_buffer(tx1_q, CAN_TX_BUFFER_SIZE)
-__attribute__((section(".itcmram"))) can_buffer(tx2_q, CAN_TX_BUFFER_SIZE)
+__attribute__((section(".axisram"))) can_packed_buffer(rx_q, CAN_RX_BUFFER_SIZE, true)
+__attribute__((section(".itcmram"))) can_buffer(tx1_q, CAN_TX_BUFFER_SIZE, CAN_TX_QUEUE_SPSC)
+__attribute__((section(".itcmram"))) can_buffer(tx2_q, CAN_TX_BUFFER_SIZE, CAN_TX_QUEUE_SPSC)
 #else
-can_buffer(rx_q, CAN_RX_BUFFER_SIZE)
-can_buffer(tx1_q, CAN_TX_BUFFER_SIZE)
-can_buffer(tx2_q, CAN_TX_BUFFER_SIZE)
+can_packed_buffer(rx_q, CAN_RX_BUFFER_SIZE, true)
+can_buffer(tx1_q, CAN_TX_BUFFER_SIZE, CAN_TX_QUEUE_SPSC)
+can_buffer(tx2_q, CAN_TX_BUFFER_SIZE, CAN_TX_QUEUE_SPSC)
 #endif
-can_buffer(tx3_q, CAN_TX_BUFFER_SIZE)
+can_buffer(tx3_q, CAN_TX_BUFFER_SIZE, CAN_TX_QUEUE_SPSC)
+can_buffer(tx1_prio_q, CAN_TX_PRIO_BUFFER_SIZE, CAN_TX_QUEUE_SPSC)
+can_buffer(tx2_prio_q, CAN_TX_PRIO_BUFFER_SIZE, CAN_TX_QUEUE_SPSC)
+can_buffer(tx3_prio_q, CAN_TX_PRIO_BUFFER_SIZE, CAN_TX_QUEUE_SPSC)
 
 // FIXME:
 // cppcheck-suppress misra-c2012-9.3
 can_ring *can_queues[] = {&can_tx1_q, &can_tx2_q, &can_tx3_q};
 
+// all TX queues of a bus, indexed by priority level. can_queues holds the low priority (bulk) ones
+can_ring *can_tx_queues[][CAN_TX_PRIO_CNT] = {
+  {&can_tx1_prio_q, &can_tx1_q},
+  {&can_tx2_prio_q, &can_tx2_q},
+  {&can_tx3_prio_q, &can_tx3_q},
+};
+uint32_t can_tx_prio_drop_cnt[][CAN_TX_PRIO_CNT] = {{0U}, {0U}, {0U}};
+
+// addresses the host wants sent with high priority, on top of the safety mode's tx_msgs, with an
+// open addressing hash table over them, so a frame costs one probe like with the safety index
+#define CAN_TX_PRIO_ADDRS_MAX 16U
+#define CAN_TX_PRIO_HASH_SIZE 32U  // power of two, at least twice CAN_TX_PRIO_ADDRS_MAX
+typedef struct {
+  uint32_t addr;
+  uint8_t bus;
+} can_tx_prio_addr_t;
+can_tx_prio_addr_t can_tx_prio_addrs[CAN_TX_PRIO_ADDRS_MAX];
+uint8_t can_tx_prio_addrs_len = 0U;
+uint8_t can_tx_prio_hash[CAN_TX_PRIO_HASH_SIZE];  // entry of can_tx_prio_addrs + 1, 0 is empty
+
+// addresses the host put into mailbox mode, with the TX queue slot of their last queued frame
+#define CAN_TX_MAILBOX_MAX 16U
+typedef struct {
+  uint32_t addr;
+  uint8_t bus;
+  can_ring *q; // NULL until a frame was queued
+  uint32_t slot;
+} can_tx_mailbox_t;
+can_tx_mailbox_t can_tx_mailboxes[CAN_TX_MAILBOX_MAX];
+uint8_t can_tx_mailboxes_len = 0U;
+uint32_t can_tx_replaced_cnt[] = {0U, 0U, 0U};
+
+// IDs the host wants to receive, per bus. Everything else is rejected by the CAN core, see can_rx_filter_build
+#define CAN_RX_FILTERS_MAX 8U
+typedef struct {
+  uint32_t id;
+  uint32_t mask; // standard IDs only, extended IDs match exactly
+  bool extended;
+} can_rx_filter_t;
+typedef struct {
+  can_rx_filter_t filters[CAN_RX_FILTERS_MAX];
+  uint8_t len;
+} can_rx_filter_bus_t;
+can_rx_filter_bus_t can_rx_filters[3];
+
+// FDCAN filter elements of a bus, in the message RAM format. Standard ID elements are one word,
+// extended ID elements two. All of them store matching frames in RX FIFO 0.
+#define CAN_RX_FILTER_STD_EL_CNT 10U
+#define CAN_RX_FILTER_EXT_EL_CNT 4U
+#define CAN_RX_FILTER_TYPE_RANGE 0U
+#define CAN_RX_FILTER_TYPE_DUAL 1U
+#define CAN_RX_FILTER_TYPE_CLASSIC 2U
+typedef struct {
+  uint32_t std[CAN_RX_FILTER_STD_EL_CNT];
+  uint32_t ext[2U * CAN_RX_FILTER_EXT_EL_CNT];
+  uint8_t std_len;
+  uint8_t ext_len;
+  bool std_reject; // reject the standard ID frames no element matches
+  bool ext_reject;
+} can_rx_filter_elems_t;
+
+// bxCAN RX FIFO 1 takes the standard IDs of the safety mode's RX checks, see can_rx_fifo1_ids
+#define CAN_RX_FIFO1_IDS_MAX 16U
+
+// bxCAN TX mailboxes, see can_tx_hw_mailbox_pick
+#define CAN_TX_HW_MAILBOX_CNT 3U
+
 // helpers
 #define WORD_TO_BYTE_ARRAY(dst8, src32) 0[dst8] = ((src32) & 0xFFU); 1[dst8] = (((src32) >> 8U) & 0xFFU); 2[dst8] = (((src32) >> 16U) & 0xFFU); 3[dst8] = (((src32) >> 24U) & 0xFFU)
 #define BYTE_ARRAY_TO_WORD(dst32, src8) ((dst32) = 0[src8] | (1[src8] << 8U) | (2[src8] << 16U) | (3[src8] << 24U))
 
 // ********************* interrupt safe queue *********************
-bool can_pop(can_ring *q, CANPacket_t *elem) {
-  bool ret = 0;
+// Only the producer writes w_ptr and only the consumer writes r_ptr. The element is written/read
+// before the index that hands it over is published with release semantics, and the other side's
+// index is loaded with acquire semantics, so a queue in SPSC mode needs no critical section.
+// Queues with multiple producer or consumer contexts keep serializing access with ENTER_CRITICAL.
+#define CAN_RING_LOAD_ACQUIRE(ptr) __atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
+#define CAN_RING_STORE_RELEASE(ptr, val) __atomic_store_n(&(ptr), (val), __ATOMIC_RELEASE)
 
-  ENTER_CRITICAL();
-  if (q->w_ptr != q->r_ptr) {
-    *elem = q->elems[q->r_ptr];
-    if ((q->r_ptr + 1U) == q->fifo_size) {
-      q->r_ptr = 0;
-    } else {
-      q->r_ptr += 1U;
-    }
-    ret = 1;
+uint32_t can_ring_next(const can_ring *q, uint32_t ptr) {
+  return ((ptr + 1U) == q->fifo_size) ? 0U : (ptr + 1U);
+}
+
+void can_ring_lock(const can_ring *q) {
+  if (!q->spsc) {
+    ENTER_CRITICAL();
   }
-  EXIT_CRITICAL();
+}
 
-  return ret;
+void can_ring_unlock(const can_ring *q) {
+  if (!q->spsc) {
+    EXIT_CRITICAL();
+  }
 }
 
-bool can_push(can_ring *q, const CANPacket_t *elem) {
-  bool ret = false;
-  uint32_t next_w_ptr;
+// Span API: the consumer peeks at the longest contiguous run of queued frames and commits how many
+// it consumed, the producer reserves the longest contiguous run of free slots and commits how many
+// it filled. Spans stop at the end of the buffer, so call again after committing to handle wrap around.
+// Queues that are not in SPSC mode must hold can_ring_lock() from peek/reserve until commit.
+uint32_t can_pop_peek(const can_ring *q, CANPacket_t **span) {
+  uint32_t r_ptr = q->r_ptr;
+  uint32_t w_ptr = CAN_RING_LOAD_ACQUIRE(q->w_ptr);
+  *span = &q->elems[r_ptr];
+  return (w_ptr >= r_ptr) ? (w_ptr - r_ptr) : (q->fifo_size - r_ptr);
+}
 
-  ENTER_CRITICAL();
-  if ((q->w_ptr + 1U) == q->fifo_size) {
-    next_w_ptr = 0;
+void can_pop_commit(can_ring *q, uint32_t n) {
+  uint32_t r_ptr = q->r_ptr + n;
+  CAN_RING_STORE_RELEASE(q->r_ptr, (r_ptr >= q->fifo_size) ? (r_ptr - q->fifo_size) : r_ptr);
+}
+
+uint32_t can_push_reserve(const can_ring *q, CANPacket_t **span) {
+  uint32_t w_ptr = q->w_ptr;
+  uint32_t r_ptr = CAN_RING_LOAD_ACQUIRE(q->r_ptr);
+  uint32_t ret;
+  *span = &q->elems[w_ptr];
+  if (w_ptr >= r_ptr) {
+    // one slot always stays empty to tell a full queue from an empty one
+    ret = q->fifo_size - w_ptr - ((r_ptr == 0U) ? 1U : 0U);
   } else {
-    next_w_ptr = q->w_ptr + 1U;
+    ret = r_ptr - w_ptr - 1U;
   }
-  if (next_w_ptr != q->r_ptr) {
-    q->elems[q->w_ptr] = *elem;
-    q->w_ptr = next_w_ptr;
-    ret = true;
-  }
-  EXIT_CRITICAL();
+  return ret;
+}
+
+void can_push_commit(can_ring *q, uint32_t n) {
+  uint32_t w_ptr = q->w_ptr + n;
+  CAN_RING_STORE_RELEASE(q->w_ptr, (w_ptr >= q->fifo_size) ? (w_ptr - q->fifo_size) : w_ptr);
+}
+
+bool can_pop(can_ring *q, CANPacket_t *elem) {
+  return can_pop_many(q, elem, 1U) == 1U;
+}
+
+bool can_push(can_ring *q, const CANPacket_t *elem) {
+  bool ret = can_push_many(q, elem, 1U) == 1U;
   if (!ret) {
     #ifdef DEBUG
       print("can_push to ");
-      if (q == &can_rx_q) {
-        print("can_rx_q");
-      } else if (q == &can_tx1_q) {
+      if (q == &can_tx1_q) {
         print("can_tx1_q");
       } else if (q == &can_tx2_q) {
         print("can_tx2_q");
@@ -129,20 +267,201 @@ bool can_push(can_ring *q, const CANPacket_t *elem) {
   return ret;
 }
 
+// pops up to n frames under a single critical section, returns the number of frames popped
+uint32_t can_pop_many(can_ring *q, CANPacket_t *elems, uint32_t n) {
+  uint32_t ret = 0U;
+
+  can_ring_lock(q);
+  while (ret < n) {
+    CANPacket_t *span;
+    uint32_t cnt = MIN(can_pop_peek(q, &span), n - ret);
+    if (cnt == 0U) {
+      break;
+    }
+    (void)memcpy(&elems[ret], span, cnt * sizeof(CANPacket_t));
+    can_pop_commit(q, cnt);
+    ret += cnt;
+  }
+  can_ring_unlock(q);
+
+  return ret;
+}
+
+// pushes up to n frames under a single critical section, returns the number of frames pushed
+uint32_t can_push_many(can_ring *q, const CANPacket_t *elems, uint32_t n) {
+  uint32_t ret = 0U;
+
+  can_ring_lock(q);
+  while (ret < n) {
+    CANPacket_t *span;
+    uint32_t cnt = MIN(can_push_reserve(q, &span), n - ret);
+    if (cnt == 0U) {
+      break;
+    }
+    (void)memcpy(span, &elems[ret], cnt * sizeof(CANPacket_t));
+    can_push_commit(q, cnt);
+    ret += cnt;
+  }
+  can_ring_unlock(q);
+
+  return ret;
+}
+
 uint32_t can_slots_empty(const can_ring *q) {
   uint32_t ret = 0;
 
-  ENTER_CRITICAL();
-  if (q->w_ptr >= q->r_ptr) {
-    ret = q->fifo_size - 1U - q->w_ptr + q->r_ptr;
+  can_ring_lock(q);
+  // lower bound for the producer, the consumer may free up more slots in the meantime
+  uint32_t w_ptr = CAN_RING_LOAD_ACQUIRE(q->w_ptr);
+  uint32_t r_ptr = CAN_RING_LOAD_ACQUIRE(q->r_ptr);
+  if (w_ptr >= r_ptr) {
+    ret = q->fifo_size - 1U - w_ptr + r_ptr;
   } else {
-    ret = q->r_ptr - q->w_ptr - 1U;
+    ret = r_ptr - w_ptr - 1U;
   }
-  EXIT_CRITICAL();
+  can_ring_unlock(q);
 
   return ret;
 }
 
+// ********************* packed queue *********************
+// Same ownership and index hand over rules as can_ring, but the indices are byte offsets.
+// Frames wrap around the end of the buffer, one byte always stays empty.
+uint32_t can_packed_used(const can_packed_ring *q, uint32_t w_ptr, uint32_t r_ptr) {
+  return (w_ptr >= r_ptr) ? (w_ptr - r_ptr) : (q->size - r_ptr + w_ptr);
+}
+
+uint32_t can_packed_advance(const can_packed_ring *q, uint32_t ptr, uint32_t len) {
+  uint32_t ret = ptr + len;
+  return (ret >= q->size) ? (ret - q->size) : ret;
+}
+
+void can_packed_lock(const can_packed_ring *q) {
+  if (!q->spsc) {
+    ENTER_CRITICAL();
+  }
+}
+
+void can_packed_unlock(const can_packed_ring *q) {
+  if (!q->spsc) {
+    EXIT_CRITICAL();
+  }
+}
+
+void can_packed_copy_in(can_packed_ring *q, uint32_t ptr, const uint8_t *src, uint32_t len) {
+  uint32_t first = MIN(len, q->size - ptr);
+  (void)memcpy(&q->data[ptr], src, first);
+  (void)memcpy(q->data, &src[first], len - first);
+}
+
+void can_packed_copy_out(const can_packed_ring *q, uint32_t ptr, uint8_t *dst, uint32_t len) {
+  uint32_t first = MIN(len, q->size - ptr);
+  (void)memcpy(dst, &q->data[ptr], first);
+  (void)memcpy(&dst[first], q->data, len - first);
+}
+
+// can_packed_copy_out that returns the XOR of the bytes
+uint8_t can_packed_copy_out_xor(const can_packed_ring *q, uint32_t ptr, uint8_t *dst, uint32_t len) {
+  uint32_t first = MIN(len, q->size - ptr);
+  uint8_t x = memcpy_xor(dst, &q->data[ptr], first);
+  return x ^ memcpy_xor(&dst[first], q->data, len - first);
+}
+
+// length of a queued frame, given the first byte of its header
+uint32_t can_packed_frame_len(uint8_t head) {
+  return CANPACKET_HEAD_SIZE + dlc_to_len[head >> 4U] + (((head & 0x1U) != 0U) ? CANPACKET_TIMESTAMP_SIZE : 0U);
+}
+
+// pushes the frame followed by trailer_len bytes that aren't part of CANPacket_t (the RX timestamp)
+bool can_packed_push_trailer(can_packed_ring *q, const CANPacket_t *elem, const uint8_t *trailer, uint32_t trailer_len) {
+  bool ret = false;
+  uint32_t frame_len = CANPACKET_HEAD_SIZE + GET_LEN(elem);
+  uint32_t len = frame_len + trailer_len;
+
+  can_packed_lock(q);
+  uint32_t w_ptr = q->w_ptr;
+  uint32_t r_ptr = CAN_RING_LOAD_ACQUIRE(q->r_ptr);
+  if ((q->size - 1U - can_packed_used(q, w_ptr, r_ptr)) >= len) {
+    can_packed_copy_in(q, w_ptr, (const uint8_t *)elem, frame_len);
+    if (trailer_len > 0U) {
+      can_packed_copy_in(q, can_packed_advance(q, w_ptr, frame_len), trailer, trailer_len);
+    }
+    CAN_RING_STORE_RELEASE(q->w_ptr, can_packed_advance(q, w_ptr, len));
+    ret = true;
+  }
+  can_packed_unlock(q);
+
+  #ifdef DEBUG
+    if (!ret) {
+      print("can_packed_push failed!\n");
+    }
+  #endif
+  return ret;
+}
+
+bool can_packed_push(can_packed_ring *q, const CANPacket_t *elem) {
+  return can_packed_push_trailer(q, elem, NULL, 0U);
+}
+
+bool can_packed_pop(can_packed_ring *q, CANPacket_t *elem) {
+  bool ret = false;
+
+  can_packed_lock(q);
+  uint32_t r_ptr = q->r_ptr;
+  uint32_t w_ptr = CAN_RING_LOAD_ACQUIRE(q->w_ptr);
+  if (w_ptr != r_ptr) {
+    // a timestamp doesn't fit into CANPacket_t and is dropped
+    uint32_t len = can_packed_frame_len(q->data[r_ptr]);
+    can_packed_copy_out(q, r_ptr, (uint8_t *)elem, MIN(len, CANPACKET_HEAD_SIZE + dlc_to_len[q->data[r_ptr] >> 4U]));
+    CAN_RING_STORE_RELEASE(q->r_ptr, can_packed_advance(q, r_ptr, len));
+    ret = true;
+  }
+  can_packed_unlock(q);
+
+  return ret;
+}
+
+// copies up to max_len bytes of the queued byte stream, frames may be split at the end. with a
+// checksum, the bytes are XORed into it while they're copied
+uint32_t can_packed_read(can_packed_ring *q, uint8_t *out, uint32_t max_len, uint8_t *checksum) {
+  can_packed_lock(q);
+  uint32_t r_ptr = q->r_ptr;
+  uint32_t len = MIN(can_packed_used(q, CAN_RING_LOAD_ACQUIRE(q->w_ptr), r_ptr), max_len);
+  if (checksum != NULL) {
+    *checksum ^= can_packed_copy_out_xor(q, r_ptr, out, len);
+  } else {
+    can_packed_copy_out(q, r_ptr, out, len);
+  }
+  CAN_RING_STORE_RELEASE(q->r_ptr, can_packed_advance(q, r_ptr, len));
+  can_packed_unlock(q);
+
+  return len;
+}
+
+// drops up to len bytes from the front of the queue
+void can_packed_skip(can_packed_ring *q, uint32_t len) {
+  can_packed_lock(q);
+  uint32_t r_ptr = q->r_ptr;
+  uint32_t skip = MIN(can_packed_used(q, CAN_RING_LOAD_ACQUIRE(q->w_ptr), r_ptr), len);
+  CAN_RING_STORE_RELEASE(q->r_ptr, can_packed_advance(q, r_ptr, skip));
+  can_packed_unlock(q);
+}
+
+uint32_t can_packed_bytes_free(const can_packed_ring *q) {
+  can_packed_lock(q);
+  uint32_t ret = q->size - 1U - can_packed_used(q, CAN_RING_LOAD_ACQUIRE(q->w_ptr), CAN_RING_LOAD_ACQUIRE(q->r_ptr));
+  can_packed_unlock(q);
+  return ret;
+}
+
+void can_packed_clear(can_packed_ring *q) {
+  ENTER_CRITICAL();
+  q->w_ptr = 0;
+  q->r_ptr = 0;
+  EXIT_CRITICAL();
+}
+
+// resets both indices, so neither side may be active. Always runs under a critical section
 void can_clear(can_ring *q) {
   ENTER_CRITICAL();
   q->w_ptr = 0;
@@ -152,6 +471,21 @@ void can_clear(can_ring *q) {
   refresh_can_tx_slots_available();
 }
 
+void can_tx_clear(uint8_t bus_number) {
+  for (uint8_t prio = 0U; prio < CAN_TX_PRIO_CNT; prio++) {
+    can_clear(can_tx_queues[bus_number][prio]);
+  }
+}
+
+// pops from the highest priority queue of the bus that has a frame
+bool can_tx_pop(uint8_t bus_number, CANPacket_t *elem) {
+  bool ret = false;
+  for (uint8_t prio = 0U; (prio < CAN_TX_PRIO_CNT) && !ret; prio++) {
+    ret = can_pop(can_tx_queues[bus_number][prio], elem);
+  }
+  return ret;
+}
+
 // assign CAN numbering
 // bus num: CAN Bus numbers in panda, sent to/from USB
 //    Min: 0; Max: 127; Bit 7 marks message as receipt (bus 129 is receipt for but 1)
@@ -179,7 +513,7 @@ void can_init_all(void) {
     if (!current_board->has_canfd) {
       bus_config[i].can_data_speed = 0U;
     }
-    can_clear(can_queues[i]);
+    can_tx_clear(i);
     (void)can_init(i);
   }
 }
@@ -202,21 +536,21 @@ void ignition_can_hook(CANPacket_t *to_push) {
     int len = GET_LEN(to_push);
     
     // GM exception
-    if ((addr == 0x1F1) && (len == 8)) {
+    if ((addr == CAN_IGNITION_GM_ADDR) && (len == 8)) {
       // SystemPowerMode (2=Run, 3=Crank Request)
       ignition_can = (GET_BYTE(to_push, 0) & 0x2U) != 0U;
       ignition_can_cnt = 0U;
     }
 
     // Tesla exception
-    if ((addr == 0x348) && (len == 8)) {
+    if ((addr == CAN_IGNITION_TESLA_ADDR) && (len == 8)) {
       // GTW_status
       ignition_can = (GET_BYTE(to_push, 0) & 0x1U) != 0U;
       ignition_can_cnt = 0U;
     }
 
     // Mazda exception
-    if ((addr == 0x9E) && (len == 8)) {
+    if ((addr == CAN_IGNITION_MAZDA_ADDR) && (len == 8)) {
       ignition_can = (GET_BYTE(to_push, 0) >> 5) == 0x6U;
       ignition_can_cnt = 0U;
     }
@@ -224,11 +558,350 @@ void ignition_can_hook(CANPacket_t *to_push) {
   }
 }
 
+// ********************* TX priorities *********************
+// Frames the active safety mode sends (its tx_msgs, matched on address, bus and length) and
+// addresses the host asked for go to the high priority queue, everything else is bulk traffic
+// like diagnostics
+static uint32_t can_tx_prio_slot(uint8_t bus_number, uint32_t addr) {
+  return (((addr << 3) | bus_number) * 2654435761U) >> 27;  // top 5 bits, Knuth's multiplicative hash
+}
+
+static void can_tx_prio_hash_build(void) {
+  (void)memset(can_tx_prio_hash, 0, sizeof(can_tx_prio_hash));
+  for (uint8_t i = 0U; i < can_tx_prio_addrs_len; i++) {
+    uint32_t slot = can_tx_prio_slot(can_tx_prio_addrs[i].bus, can_tx_prio_addrs[i].addr);
+    while (can_tx_prio_hash[slot] != 0U) {
+      slot = (slot + 1U) & (CAN_TX_PRIO_HASH_SIZE - 1U);
+    }
+    can_tx_prio_hash[slot] = (uint8_t)(i + 1U);
+  }
+}
+
+uint8_t can_tx_priority(uint8_t bus_number, uint32_t addr, uint8_t len) {
+  bool high = safety_index_tx_msg((int)addr, (int)bus_number, (int)len);
+  uint32_t slot = can_tx_prio_slot(bus_number, addr);
+  while (!high && (can_tx_prio_hash[slot] != 0U)) {
+    const can_tx_prio_addr_t *a = &can_tx_prio_addrs[can_tx_prio_hash[slot] - 1U];
+    high = (a->addr == addr) && (a->bus == bus_number);
+    slot = (slot + 1U) & (CAN_TX_PRIO_HASH_SIZE - 1U);
+  }
+  return high ? CAN_TX_PRIO_HIGH : CAN_TX_PRIO_LOW;
+}
+
+// adds or removes a host chosen high priority address, returns false if the table is full
+bool can_tx_prio_set(uint8_t bus_number, uint32_t addr, bool high) {
+  bool ret = true;
+  uint8_t idx = can_tx_prio_addrs_len;
+  for (uint8_t i = 0U; i < can_tx_prio_addrs_len; i++) {
+    if ((can_tx_prio_addrs[i].addr == addr) && (can_tx_prio_addrs[i].bus == bus_number)) {
+      idx = i;
+    }
+  }
+
+  if (high) {
+    if (idx == can_tx_prio_addrs_len) {
+      if (can_tx_prio_addrs_len < CAN_TX_PRIO_ADDRS_MAX) {
+        can_tx_prio_addrs[idx].addr = addr;
+        can_tx_prio_addrs[idx].bus = bus_number;
+        can_tx_prio_addrs_len += 1U;
+      } else {
+        ret = false;
+      }
+    }
+  } else if (idx < can_tx_prio_addrs_len) {
+    can_tx_prio_addrs_len -= 1U;
+    can_tx_prio_addrs[idx] = can_tx_prio_addrs[can_tx_prio_addrs_len];
+  } else {
+    // not in the table
+  }
+  can_tx_prio_hash_build();
+  return ret;
+}
+
+void can_tx_prio_clear(void) {
+  can_tx_prio_addrs_len = 0U;
+  can_tx_prio_hash_build();
+}
+
+// ********************* TX mailboxes *********************
+// A newer frame for a mailbox address replaces its frame that is still waiting in the TX queue,
+// keeping its place in line, so a congested bus sends the latest command instead of stale ones
+bool can_tx_mailbox_set(uint8_t bus_number, uint32_t addr, bool enabled) {
+  bool ret = true;
+  uint8_t idx = can_tx_mailboxes_len;
+  for (uint8_t i = 0U; i < can_tx_mailboxes_len; i++) {
+    if ((can_tx_mailboxes[i].addr == addr) && (can_tx_mailboxes[i].bus == bus_number)) {
+      idx = i;
+    }
+  }
+
+  if (enabled) {
+    if (idx == can_tx_mailboxes_len) {
+      if (can_tx_mailboxes_len < CAN_TX_MAILBOX_MAX) {
+        can_tx_mailboxes[idx].addr = addr;
+        can_tx_mailboxes[idx].bus = bus_number;
+        can_tx_mailboxes[idx].q = NULL;
+        can_tx_mailboxes[idx].slot = 0U;
+        can_tx_mailboxes_len += 1U;
+      } else {
+        ret = false;
+      }
+    }
+  } else if (idx < can_tx_mailboxes_len) {
+    can_tx_mailboxes_len -= 1U;
+    can_tx_mailboxes[idx] = can_tx_mailboxes[can_tx_mailboxes_len];
+  } else {
+    // not in the table
+  }
+  return ret;
+}
+
+void can_tx_mailbox_clear(void) {
+  can_tx_mailboxes_len = 0U;
+}
+
+// true if the mailbox's last frame wasn't sent yet. must be called in a critical section
+bool can_tx_mailbox_pending(const can_tx_mailbox_t *mb) {
+  bool ret = false;
+  if (mb->q != NULL) {
+    uint32_t size = mb->q->fifo_size;
+    uint32_t r_ptr = mb->q->r_ptr;
+    uint32_t w_ptr = mb->q->w_ptr;
+    uint32_t queued = (w_ptr >= r_ptr) ? (w_ptr - r_ptr) : (size - r_ptr + w_ptr);
+    uint32_t pos = (mb->slot >= r_ptr) ? (mb->slot - r_ptr) : (size - r_ptr + mb->slot);
+    // a slot that was sent and refilled holds another address
+    ret = (pos < queued) && (mb->q->elems[mb->slot].addr == mb->addr);
+  }
+  return ret;
+}
+
+can_tx_mailbox_t *can_tx_mailbox_find(uint8_t bus_number, uint32_t addr) {
+  can_tx_mailbox_t *mb = NULL;
+  for (uint8_t i = 0U; (i < can_tx_mailboxes_len) && (mb == NULL); i++) {
+    if ((can_tx_mailboxes[i].addr == addr) && (can_tx_mailboxes[i].bus == bus_number)) {
+      mb = &can_tx_mailboxes[i];
+    }
+  }
+  return mb;
+}
+
+// queues the frame or replaces the waiting frame of its mailbox, returns false if the queue is full
+bool can_tx_push(uint8_t bus_number, uint8_t prio, const CANPacket_t *to_push) {
+  bool ret = false;
+  can_ring *q = can_tx_queues[bus_number][prio];
+  can_tx_mailbox_t *mb = can_tx_mailbox_find(bus_number, to_push->addr);
+
+  if (mb == NULL) {
+    ret = can_push(q, to_push);
+  } else {
+    // the consumer must not take the slot while it's being replaced
+    ENTER_CRITICAL();
+    if ((mb->q == q) && can_tx_mailbox_pending(mb)) {
+      (void)memcpy(&q->elems[mb->slot], to_push, sizeof(CANPacket_t));
+      can_tx_replaced_cnt[bus_number] += 1U;
+      ret = true;
+    } else {
+      CANPacket_t *span;
+      if (can_push_reserve(q, &span) > 0U) {
+        (void)memcpy(span, to_push, sizeof(CANPacket_t));
+        mb->q = q;
+        mb->slot = (uint32_t)(span - q->elems);
+        can_push_commit(q, 1U);
+        ret = true;
+      }
+    }
+    EXIT_CRITICAL();
+  }
+  return ret;
+}
+
+void update_can_tx_health(uint8_t can_number) {
+  uint8_t bus_number = BUS_NUM_FROM_CAN_NUM(can_number);
+  if (bus_number < PANDA_BUS_CNT) {
+    for (uint8_t prio = 0U; prio < CAN_TX_PRIO_CNT; prio++) {
+      const can_ring *q = can_tx_queues[bus_number][prio];
+      can_health[can_number].tx_prio_depth[prio] = (uint16_t)(q->fifo_size - 1U - can_slots_empty(q));
+      can_health[can_number].tx_prio_drop_cnt[prio] = can_tx_prio_drop_cnt[bus_number][prio];
+    }
+    can_health[can_number].tx_mailbox_replaced_cnt = can_tx_replaced_cnt[bus_number];
+  }
+}
+
+// ********************* RX filters *********************
+// adds an ID the host wants to receive on a bus, returns false if the bus has no filters left
+bool can_rx_filter_add(uint8_t bus_number, uint32_t id, uint32_t mask, bool extended) {
+  bool ret = false;
+  can_rx_filter_bus_t *f = &can_rx_filters[bus_number];
+  if (f->len < CAN_RX_FILTERS_MAX) {
+    f->filters[f->len].id = id;
+    f->filters[f->len].mask = extended ? 0x1FFFFFFFU : mask;
+    f->filters[f->len].extended = extended;
+    f->len += 1U;
+    ret = true;
+  }
+  return ret;
+}
+
+void can_rx_filter_clear(uint8_t bus_number) {
+  can_rx_filters[bus_number].len = 0U;
+}
+
+static bool can_rx_filter_std_add(can_rx_filter_elems_t *elems, uint32_t type, uint32_t id1, uint32_t id2) {
+  bool ret = false;
+  if (elems->std_len < CAN_RX_FILTER_STD_EL_CNT) {
+    // SFEC 1: store in RX FIFO 0
+    elems->std[elems->std_len] = (type << 30) | (1UL << 27) | ((id1 & 0x7FFU) << 16) | (id2 & 0x7FFU);
+    elems->std_len += 1U;
+    ret = true;
+  }
+  return ret;
+}
+
+static bool can_rx_filter_ext_add(can_rx_filter_elems_t *elems, uint32_t type, uint32_t id1, uint32_t id2) {
+  bool ret = false;
+  if (elems->ext_len < CAN_RX_FILTER_EXT_EL_CNT) {
+    // EFEC 1: store in RX FIFO 0
+    elems->ext[2U * elems->ext_len] = (1UL << 29) | (id1 & 0x1FFFFFFFU);
+    elems->ext[(2U * elems->ext_len) + 1U] = (type << 30) | (id2 & 0x1FFFFFFFU);
+    elems->ext_len += 1U;
+    ret = true;
+  }
+  return ret;
+}
+
+// The filter elements for the host's filters of a bus, plus the IDs the safety mode needs: the
+// ones safety_rx_dispatch sends through the hooks, two per element. A bus that forwards frames by
+// default keeps receiving everything, and so do standard or extended frames when their IDs don't
+// fit into the elements. Standard frames are only filtered once the host has a standard filter on
+// the bus, they carry the RX checks and ignition, which an extended only filter shouldn't cut off.
+void can_rx_filter_build(uint8_t bus_number, can_rx_filter_elems_t *elems) {
+  (void)memset(elems, 0, sizeof(*elems));
+  const can_rx_filter_bus_t *f = &can_rx_filters[bus_number];
+  bool forwarding = (safety_fwd_default(bus_number) != -1) || (bus_config[bus_number].forwarding_bus != -1);
+
+  if ((f->len > 0U) && !forwarding) {
+    bool std_filtered = false;
+    bool std_fits = true;
+    bool ext_fits = safety_dispatch_ext_len >= 0;
+    for (uint8_t i = 0U; i < f->len; i++) {
+      if (f->filters[i].extended) {
+        ext_fits = can_rx_filter_ext_add(elems, CAN_RX_FILTER_TYPE_DUAL, f->filters[i].id, f->filters[i].id) && ext_fits;
+      } else {
+        std_filtered = true;
+        std_fits = can_rx_filter_std_add(elems, CAN_RX_FILTER_TYPE_CLASSIC, f->filters[i].id, f->filters[i].mask) && std_fits;
+      }
+    }
+
+    if (std_filtered) {
+      CANPacket_t pkt = {0};
+      pkt.bus = bus_number;
+      int pending = -1;
+      for (int addr = 0; addr < 0x800; addr++) {
+        pkt.addr = (uint32_t)addr;
+        if (safety_rx_dispatch(&pkt)) {
+          if (pending == -1) {
+            pending = addr;
+          } else {
+            std_fits = can_rx_filter_std_add(elems, CAN_RX_FILTER_TYPE_DUAL, (uint32_t)pending, (uint32_t)addr) && std_fits;
+            pending = -1;
+          }
+        }
+      }
+      if (pending != -1) {
+        std_fits = can_rx_filter_std_add(elems, CAN_RX_FILTER_TYPE_DUAL, (uint32_t)pending, (uint32_t)pending) && std_fits;
+      }
+    }
+    for (int i = 0; i < safety_dispatch_ext_len; i += 2) {
+      int id2 = ((i + 1) < safety_dispatch_ext_len) ? safety_dispatch_ext[i + 1] : safety_dispatch_ext[i];
+      ext_fits = can_rx_filter_ext_add(elems, CAN_RX_FILTER_TYPE_DUAL, (uint32_t)safety_dispatch_ext[i], (uint32_t)id2) && ext_fits;
+    }
+
+    elems->std_reject = std_filtered && std_fits;
+    elems->ext_reject = ext_fits;
+  }
+}
+
+// Model of the FDCAN acceptance filtering with these elements: the first matching element stores
+// the frame, frames no element matches are rejected or accepted as elems says
+bool can_rx_filter_accepts(const can_rx_filter_elems_t *elems, bool extended, uint32_t addr) {
+  bool matched = false;
+  uint8_t len = extended ? elems->ext_len : elems->std_len;
+  for (uint8_t i = 0U; (i < len) && !matched; i++) {
+    uint32_t type;
+    uint32_t id1;
+    uint32_t id2;
+    if (extended) {
+      type = elems->ext[(2U * i) + 1U] >> 30;
+      id1 = elems->ext[2U * i] & 0x1FFFFFFFU;
+      id2 = elems->ext[(2U * i) + 1U] & 0x1FFFFFFFU;
+    } else {
+      type = elems->std[i] >> 30;
+      id1 = (elems->std[i] >> 16) & 0x7FFU;
+      id2 = elems->std[i] & 0x7FFU;
+    }
+
+    if (type == CAN_RX_FILTER_TYPE_RANGE) {
+      matched = (addr >= id1) && (addr <= id2);
+    } else if (type == CAN_RX_FILTER_TYPE_DUAL) {
+      matched = (addr == id1) || (addr == id2);
+    } else if (type == CAN_RX_FILTER_TYPE_CLASSIC) {
+      matched = (addr & id2) == (id1 & id2);
+    } else {
+      // filter element disabled
+    }
+  }
+  return matched || !(extended ? elems->ext_reject : elems->std_reject);
+}
+
+// The standard IDs of the safety mode's RX checks on a bus, up to CAN_RX_FIFO1_IDS_MAX. bxCAN
+// receives them in RX FIFO 1, so a burst of other traffic overrunning FIFO 0 can't make the checks lag.
+uint8_t can_rx_fifo1_ids(uint8_t bus_number, uint16_t ids[]) {
+  uint8_t len = 0U;
+  for (int i = 0; i < current_safety_config.rx_checks_len; i++) {
+    for (uint8_t j = 0U; j < MAX_ADDR_CHECK_MSGS; j++) {
+      const CanMsgCheck *m = &current_safety_config.rx_checks[i].msg[j];
+      bool add = (m->frequency != 0U) && (m->bus == (int)bus_number) && (m->addr < 0x800) && (len < CAN_RX_FIFO1_IDS_MAX);
+      for (uint8_t k = 0U; (k < len) && add; k++) {
+        add = (ids[k] != (uint16_t)m->addr);
+      }
+      if (add) {
+        ids[len] = (uint16_t)m->addr;
+        len++;
+      }
+    }
+  }
+  return len;
+}
+
+// bxCAN sends its pending TX mailboxes by ID priority, and the lowest mailbox first on equal IDs.
+// So a frame only gets a mailbox while no other pending mailbox holds its ID, which keeps the
+// frames of each ID in queue order. pending has a bit per mailbox with a frame waiting to be sent,
+// ids are their identifier registers. Returns the mailbox for the frame, or -1 if it has to wait.
+int can_tx_hw_mailbox_pick(uint8_t pending, const uint32_t ids[], uint32_t id) {
+  int ret = -1;
+  bool blocked = false;
+  for (uint8_t i = 0U; i < CAN_TX_HW_MAILBOX_CNT; i++) {
+    if ((pending & (1U << i)) != 0U) {
+      blocked = blocked || (ids[i] == id);
+    } else if (ret == -1) {
+      ret = (int)i;
+    } else {
+    }
+  }
+  return blocked ? -1 : ret;
+}
+
+// whether every TX queue has room for min frames. the high priority queues are smaller than some
+// transfers, those need to be empty
 bool can_tx_check_min_slots_free(uint32_t min) {
+  uint32_t prio_min = MIN(min, CAN_TX_PRIO_BUFFER_SIZE - 1U);
   return
     (can_slots_empty(&can_tx1_q) >= min) &&
     (can_slots_empty(&can_tx2_q) >= min) &&
-    (can_slots_empty(&can_tx3_q) >= min);
+    (can_slots_empty(&can_tx3_q) >= min) &&
+    (can_slots_empty(&can_tx1_prio_q) >= prio_min) &&
+    (can_slots_empty(&can_tx2_prio_q) >= prio_min) &&
+    (can_slots_empty(&can_tx3_prio_q) >= prio_min);
 }
 
 uint8_t calculate_checksum(const uint8_t *dat, uint32_t len) {
@@ -248,21 +921,217 @@ bool can_check_checksum(CANPacket_t *packet) {
   return (calculate_checksum((uint8_t *) packet, CANPACKET_HEAD_SIZE + GET_LEN(packet)) == 0U);
 }
 
-void can_send(CANPacket_t *to_push, uint8_t bus_number, bool skip_tx_hook) {
+// can_rx_push for a frame that isn't timestamped and has its checksum set already
+void can_rx_push_summed(CANPacket_t *to_push, uint32_t timestamp) {
+  uint8_t ts[CANPACKET_TIMESTAMP_SIZE];
+  uint32_t ts_len = 0U;
+
+  if (can_rx_timestamps) {
+    // the checksum is a XOR of the bytes, so it changes like the header does
+    uint8_t head = calculate_checksum((uint8_t *)to_push, CANPACKET_HEAD_SIZE);
+    to_push->timestamped = 1U;
+    to_push->checksum ^= head ^ calculate_checksum((uint8_t *)to_push, CANPACKET_HEAD_SIZE);
+    WORD_TO_BYTE_ARRAY(ts, timestamp);
+    to_push->checksum ^= calculate_checksum(ts, CANPACKET_TIMESTAMP_SIZE);
+    ts_len = CANPACKET_TIMESTAMP_SIZE;
+  }
+  rx_buffer_overflow += can_packed_push_trailer(&can_rx_q, to_push, ts, ts_len) ? 0U : 1U;
+}
+
+// queues a frame for the host. if the host asked for timestamps, the frame is flagged and
+// the capture time follows its data, covered by the frame checksum
+void can_rx_push(CANPacket_t *to_push, uint32_t timestamp) {
+  to_push->timestamped = 0U;
+  can_set_checksum(to_push);
+  can_rx_push_summed(to_push, timestamp);
+}
+
+// runs the TX safety checks and queues the frame, without kicking the CAN core.
+// returns true if the frame went to a TX queue and process_can needs to be called for the bus
+bool can_send_enqueue(CANPacket_t *to_push, uint8_t bus_number, bool skip_tx_hook) {
+  bool ret = false;
   if (skip_tx_hook || safety_tx_hook(to_push) != 0) {
     if (bus_number < PANDA_BUS_CNT) {
-      // add CAN packet to send queue
-      tx_buffer_overflow += can_push(can_queues[bus_number], to_push) ? 0U : 1U;
-      process_can(CAN_NUM_FROM_BUS_NUM(bus_number));
+      // add CAN packet to the send queue of its priority
+      uint8_t prio = can_tx_priority(bus_number, to_push->addr, GET_LEN(to_push));
+      if (!can_tx_push(bus_number, prio, to_push)) {
+        tx_buffer_overflow += 1U;
+        can_tx_prio_drop_cnt[bus_number][prio] += 1U;
+      }
+      ret = true;
     }
   } else {
     safety_tx_blocked += 1U;
     to_push->returned = 0U;
     to_push->rejected = 1U;
+    can_rx_push(to_push, microsecond_timer_get());
+  }
+  return ret;
+}
+
+// TX interrupt of a CAN core, total_tx_irq_cnt / total_tx_cnt is the TX interrupts per frame
+void can_tx_irq(uint8_t can_number) {
+  can_health[can_number].total_tx_irq_cnt += 1U;
+  process_can(can_number);
+}
+
+void can_send(CANPacket_t *to_push, uint8_t bus_number, bool skip_tx_hook) {
+  if (can_send_enqueue(to_push, bus_number, skip_tx_hook)) {
+    process_can(CAN_NUM_FROM_BUS_NUM(bus_number));
+  }
+}
+
+// bus and address of a frame in the host's format, see CANPacket_t
+uint8_t can_raw_bus(const uint8_t *raw) {
+  return (raw[0] >> 1U) & 0x7U;
+}
+
+uint32_t can_raw_addr(const uint8_t *raw) {
+  return ((uint32_t)raw[1] >> 3U) | ((uint32_t)raw[2] << 5U) | ((uint32_t)raw[3] << 13U) | ((uint32_t)raw[4] << 21U);
+}
+
+// Queues a frame from the host, raw points at its len bytes in the host's format. The frame is
+// copied straight into a free slot of its TX queue and checked by the TX hook in place, the slot
+// is only committed once it passes. Frames of a TX mailbox, queues that need a lock and full
+// queues go through can_send_enqueue. A frame whose length doesn't match its DLC, or whose
+// checksum doesn't match its bytes, is dropped before the TX hook and any queue, and counted in
+// total_tx_checksum_error_cnt. Returns true if process_can needs to be called for the bus.
+bool can_send_raw(const uint8_t *raw, uint32_t len) {
+  bool ret = false;
+  uint8_t bus_number = can_raw_bus(raw);
+  uint32_t addr = can_raw_addr(raw);
+  // CAN FD lengths don't fit a CANPacket_t on boards without CAN FD
+  bool valid = (len >= CANPACKET_HEAD_SIZE) && (len <= (CANPACKET_HEAD_SIZE + CANPACKET_DATA_SIZE_MAX)) &&
+               (len == (CANPACKET_HEAD_SIZE + dlc_to_len[raw[0] >> 4U])) && (calculate_checksum(raw, len) == 0U);
 
-    // data changed
-    can_set_checksum(to_push);
-    rx_buffer_overflow += can_push(&can_rx_q, to_push) ? 0U : 1U;
+  can_ring *q = NULL;
+  CANPacket_t *slot = NULL;
+  bool reserved = false;
+  if (valid && (bus_number < PANDA_BUS_CNT)) {
+    q = can_tx_queues[bus_number][can_tx_priority(bus_number, addr, dlc_to_len[raw[0] >> 4U])];
+    if (q->spsc && (can_tx_mailbox_find(bus_number, addr) == NULL)) {
+      reserved = can_push_reserve(q, &slot) > 0U;
+    }
+  }
+
+  if (!valid) {
+    if (bus_number < PANDA_BUS_CNT) {
+      can_health[CAN_NUM_FROM_BUS_NUM(bus_number)].total_tx_checksum_error_cnt += 1U;
+    }
+  } else if (reserved) {
+    (void)memcpy(slot, raw, len);
+    // the TX path and the hooks may read past the length, like in a zeroed CANPacket_t
+    (void)memset(&((uint8_t *)slot)[len], 0, (CANPACKET_HEAD_SIZE + CANPACKET_DATA_SIZE_MAX) - len);
+    if (safety_tx_hook(slot) != 0) {
+      can_push_commit(q, 1U);
+      ret = true;
+    } else {
+      safety_tx_blocked += 1U;
+      slot->returned = 0U;
+      slot->rejected = 1U;
+      can_rx_push(slot, microsecond_timer_get());
+    }
+  } else {
+    CANPacket_t to_push = {0};
+    (void)memcpy(&to_push, raw, len);
+    ret = can_send_enqueue(&to_push, to_push.bus, false);
+  }
+  return ret;
+}
+
+// ********************* RX bottom half *********************
+// The CAN RX interrupts only copy the frames out of the CAN core into can_rx_staging and pend
+// the bottom half. can_rx_process then does forwarding, the safety and ignition hooks and the
+// push into can_rx_q from PendSV, which has the lowest priority: USB, SPI and CAN interrupts wait
+// for at most one frame of it, instead of a whole CAN FIFO. Each frame is processed in a critical
+// section, since the safety state, the TX queues and can_rx_q are shared with those interrupts:
+// the hooks write several fields per frame, and a TX hook or a safety mode switch in the middle
+// of them would see or keep a frame only partly applied.
+//
+// A frame waits for the bottom half of the frames staged before it and for the interrupts that
+// preempt PendSV, so its forwarding latency is at most CAN_RX_STAGING_SIZE times the bottom half
+// time per frame (see bench_can_rx) plus the interrupt load over that time. can_health has the
+// longest wait seen on the device in rx_staging_max_latency_us.
+#define CAN_RX_STAGING_SIZE 64U // power of 2
+typedef struct {
+  CANPacket_t pkt;
+  uint32_t rx_time;
+} can_rx_staged_t;
+typedef struct {
+  uint32_t w_ptr; // free running, only written by the RX interrupts
+  uint32_t r_ptr; // free running, only written by the bottom half
+  can_rx_staged_t elems[CAN_RX_STAGING_SIZE];
+} can_rx_staging_t;
+can_rx_staging_t can_rx_staging;
+
+// RX interrupts: the slot for the next received frame, NULL if the bottom half is too far behind
+can_rx_staged_t *can_rx_stage_reserve(uint8_t can_number) {
+  can_rx_staged_t *ret = NULL;
+  uint32_t w_ptr = can_rx_staging.w_ptr;
+  if ((w_ptr - CAN_RING_LOAD_ACQUIRE(can_rx_staging.r_ptr)) < CAN_RX_STAGING_SIZE) {
+    ret = &can_rx_staging.elems[w_ptr & (CAN_RX_STAGING_SIZE - 1U)];
+  } else {
+    can_health[can_number].total_rx_lost_cnt += 1U;
+    can_health[can_number].rx_staging_drop_cnt += 1U;
+  }
+  return ret;
+}
+
+void can_rx_stage_commit(void) {
+  CAN_RING_STORE_RELEASE(can_rx_staging.w_ptr, can_rx_staging.w_ptr + 1U);
+}
+
+void can_rx_process_frame(CANPacket_t *to_push, uint32_t rx_time) {
+  uint8_t bus_number = to_push->bus;
+  uint8_t can_number = CAN_NUM_FROM_BUS_NUM(bus_number);
+  uint32_t latency = get_ts_elapsed(microsecond_timer_get(), rx_time);
+  can_health[can_number].rx_staging_max_latency_us = MAX(can_health[can_number].rx_staging_max_latency_us, latency);
+
+  // the forwarded frame and the one for the host share the checksum
+  to_push->returned = 0U;
+  to_push->rejected = 0U;
+  to_push->timestamped = 0U;
+  can_set_checksum(to_push);
+
+  ENTER_CRITICAL();
+  // forwarding (panda only)
+  // frames no hook acts on only need the bus default
+  bool dispatch = safety_rx_dispatch(to_push);
+  int bus_fwd_num = dispatch ? safety_fwd_hook(bus_number, to_push->addr) : safety_fwd_default(bus_number);
+  if (bus_fwd_num < 0) {
+    bus_fwd_num = bus_config[can_number].forwarding_bus;
+  }
+  if (bus_fwd_num != -1) {
+    can_send(to_push, bus_fwd_num, true);
+    can_health[can_number].total_fwd_cnt += 1U;
+  }
+
+  if (dispatch) {
+    safety_rx_invalid += safety_rx_hook(to_push) ? 0U : 1U;
+    ignition_can_hook(to_push);
+  }
+
+  can_rx_push_summed(to_push, rx_time);
+  EXIT_CRITICAL();
+}
+
+// PendSV: everything the RX interrupts staged, a frame at a time
+void can_rx_process(void) {
+  can_rx_staged_t staged = {0};
+  bool pending = true;
+  while (pending) {
+    ENTER_CRITICAL();
+    uint32_t r_ptr = can_rx_staging.r_ptr;
+    pending = r_ptr != CAN_RING_LOAD_ACQUIRE(can_rx_staging.w_ptr);
+    if (pending) {
+      staged = can_rx_staging.elems[r_ptr & (CAN_RX_STAGING_SIZE - 1U)];
+      CAN_RING_STORE_RELEASE(can_rx_staging.r_ptr, r_ptr + 1U);
+    }
+    EXIT_CRITICAL();
+
+    if (pending) {
+      can_rx_process_frame(&staged.pkt, staged.rx_time);
+    }
   }
 }
 
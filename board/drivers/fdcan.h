@@ -19,6 +19,59 @@ uint8_t can_irq_number[3][2] = {
 
 #define CAN_ACK_ERROR 3U
 
+// Frames handed to the TX FIFO, echoed to the host from their TX event once they are on the bus.
+// TX FIFO elements are reused before their event is read, so the frames are kept here under their message marker.
+// The upper bits of the 8 bit message marker carry a generation, which can_tx_pending_clear bumps, so the
+// events of frames from before a core reset or bus off can't echo the frames queued after it
+#define CAN_TX_MARKER_GEN_SHIFT 4U // FDCAN_TX_EVENT_FIFO_EL_CNT frames below it
+typedef struct {
+  CANPacket_t frames[FDCAN_TX_EVENT_FIFO_EL_CNT];
+  uint8_t marker; // index of the next frame
+  uint8_t gen;
+  uint8_t in_flight;
+} can_tx_pending_t;
+can_tx_pending_t can_tx_pending[3];
+
+// TX event FIFO: echo the frames that completed, with the time they did
+void can_tx_events(uint8_t can_number) {
+  FDCAN_GlobalTypeDef *FDCANx = CANIF_FROM_CAN_NUM(can_number);
+  uint8_t bus_number = BUS_NUM_FROM_CAN_NUM(can_number);
+  can_tx_pending_t *pending = &can_tx_pending[can_number];
+  uint32_t TxEventSA = FDCAN_START_ADDRESS + (can_number * FDCAN_OFFSET) + (FDCAN_TX_EVENT_FIFO_OFFSET * 4UL);
+
+  FDCANx->IR |= FDCAN_IR_TEFN; // Clear Tx event FIFO new entry flag
+  while ((FDCANx->TXEFS & FDCAN_TXEFS_EFFL) != 0U) {
+    // get the index of the next TX event (0 to FDCAN_TX_EVENT_FIFO_EL_CNT - 1)
+    uint32_t event_index = (FDCANx->TXEFS & FDCAN_TXEFS_EFGI) >> FDCAN_TXEFS_EFGI_Pos;
+    const volatile uint32_t *event = (uint32_t *)(TxEventSA + (event_index * FDCAN_TX_EVENT_FIFO_EL_SIZE));
+    uint32_t marker = (event[1] >> 24) & ((1UL << CAN_TX_MARKER_GEN_SHIFT) - 1UL);
+    uint32_t gen = event[1] >> (24U + CAN_TX_MARKER_GEN_SHIFT);
+
+    if ((pending->in_flight > 0U) && (gen == pending->gen) && (marker < FDCAN_TX_EVENT_FIFO_EL_CNT)) {
+      // the event timestamp is in nominal bit times, can_speed in kbps * 10
+      uint32_t age = (FDCANx->TSCV - event[1]) & 0xFFFFU;
+      uint32_t age_us = (age * 10000U) / MAX((uint32_t)bus_config[bus_number].can_speed, 1U);
+      can_rx_push(&pending->frames[marker], microsecond_timer_get() - age_us);
+      pending->in_flight -= 1U;
+    }
+
+    // update read index
+    FDCANx->TXEFA = event_index;
+  }
+}
+
+// echoes what completed before a core reset, the frames still in flight never will. events of
+// theirs that still show up are dropped by their generation
+void can_tx_pending_clear(uint8_t can_number) {
+  ENTER_CRITICAL();
+  can_tx_pending_t *pending = &can_tx_pending[can_number];
+  can_tx_events(can_number);
+  can_health[can_number].total_tx_lost_cnt += pending->in_flight;
+  pending->in_flight = 0U;
+  pending->gen = (uint8_t)((pending->gen + 1U) % (1U << (8U - CAN_TX_MARKER_GEN_SHIFT)));
+  EXIT_CRITICAL();
+}
+
 bool can_set_speed(uint8_t can_number) {
   bool ret = true;
   FDCAN_GlobalTypeDef *FDCANx = CANIF_FROM_CAN_NUM(can_number);
@@ -69,6 +122,7 @@ void update_can_health_pkt(uint8_t can_number, uint32_t ir_reg) {
     // Check for RX FIFO overflow
     if ((ir_reg & (FDCAN_IR_RF0L)) != 0U) {
       can_health[can_number].total_rx_lost_cnt += 1U;
+      can_health[can_number].rx_fifo_overrun_cnt[0] += 1U;
     }
     // Cases:
     // 1. while multiplexing between buses 1 and 3 we are getting ACK errors that overwhelm CAN core, by resetting it recovers faster
@@ -76,7 +130,7 @@ void update_can_health_pkt(uint8_t can_number, uint32_t ir_reg) {
     if ((((can_health[can_number].last_error == CAN_ACK_ERROR) || (can_health[can_number].last_data_error == CAN_ACK_ERROR)) && (can_health[can_number].transmit_error_cnt > 127U)) ||
      ((ir_reg & FDCAN_IR_BO) != 0U)) {
       can_health[can_number].can_core_reset_cnt += 1U;
-      can_health[can_number].total_tx_lost_cnt += (FDCAN_TX_FIFO_EL_CNT - (FDCANx->TXFQS & FDCAN_TXFQS_TFFL)); // TX FIFO msgs will be lost after reset
+      can_tx_pending_clear(can_number); // TX FIFO msgs will be lost after reset
       llcan_clear_send(FDCANx);
     }
   }
@@ -91,59 +145,72 @@ void process_can(uint8_t can_number) {
     FDCAN_GlobalTypeDef *FDCANx = CANIF_FROM_CAN_NUM(can_number);
     uint8_t bus_number = BUS_NUM_FROM_CAN_NUM(can_number);
 
-    FDCANx->IR |= FDCAN_IR_TFE; // Clear Tx FIFO Empty flag
+    can_tx_pending_t *pending = &can_tx_pending[can_number];
 
-    if ((FDCANx->TXFQS & FDCAN_TXFQS_TFQF) == 0U) {
-      CANPacket_t to_send;
-      if (can_pop(can_queues[bus_number], &to_send)) {
-        if (can_check_checksum(&to_send)) {
+    FDCANx->IR |= FDCAN_IR_TFE; // Clear Tx FIFO Empty flag
+    can_tx_events(can_number);
+
+    // fill every free TX FIFO element, the TX FIFO empty interrupt then comes once per batch
+    uint32_t TxFIFOSA = FDCAN_START_ADDRESS + (can_number * FDCAN_OFFSET) + (FDCAN_RX_FIFO_0_EL_CNT * FDCAN_RX_FIFO_0_EL_SIZE);
+    bool popped = false;
+    bool tx_pending = true;
+    while (((FDCANx->TXFQS & FDCAN_TXFQS_TFQF) == 0U) && (pending->in_flight < FDCAN_TX_EVENT_FIFO_EL_CNT) && tx_pending) {
+      CANPacket_t *to_send = &pending->frames[pending->marker];
+      tx_pending = can_tx_pop(bus_number, to_send);
+      if (tx_pending) {
+        popped = true;
+        if (can_check_checksum(to_send)) {
           can_health[can_number].total_tx_cnt += 1U;
 
-          uint32_t TxFIFOSA = FDCAN_START_ADDRESS + (can_number * FDCAN_OFFSET) + (FDCAN_RX_FIFO_0_EL_CNT * FDCAN_RX_FIFO_0_EL_SIZE);
           // get the index of the next TX FIFO element (0 to FDCAN_TX_FIFO_EL_CNT - 1)
           uint32_t tx_index = (FDCANx->TXFQS >> FDCAN_TXFQS_TFQPI_Pos) & 0x1FU;
-          // only send if we have received a packet
           canfd_fifo *fifo;
           fifo = (canfd_fifo *)(TxFIFOSA + (tx_index * FDCAN_TX_FIFO_EL_SIZE));
 
-          fifo->header[0] = (to_send.extended << 30) | ((to_send.extended != 0U) ? (to_send.addr) : (to_send.addr << 18));
+          fifo->header[0] = (to_send->extended << 30) | ((to_send->extended != 0U) ? (to_send->addr) : (to_send->addr << 18));
           uint32_t canfd_enabled_header = bus_config[can_number].canfd_enabled ? (1UL << 21) : 0UL;
           uint32_t brs_enabled_header = bus_config[can_number].brs_enabled ? (1UL << 20) : 0UL;
-          fifo->header[1] = (to_send.data_len_code << 16) | canfd_enabled_header | brs_enabled_header;
+          // store a TX event with the message marker, which is where the frame waits for its echo
+          uint32_t event_header = (1UL << 23) | ((uint32_t)pending->marker << 24) | ((uint32_t)pending->gen << (24U + CAN_TX_MARKER_GEN_SHIFT));
+          fifo->header[1] = (to_send->data_len_code << 16) | canfd_enabled_header | brs_enabled_header | event_header;
 
-          uint8_t data_len_w = (dlc_to_len[to_send.data_len_code] / 4U);
-          data_len_w += ((dlc_to_len[to_send.data_len_code] % 4U) > 0U) ? 1U : 0U;
+          uint8_t data_len_w = (dlc_to_len[to_send->data_len_code] / 4U);
+          data_len_w += ((dlc_to_len[to_send->data_len_code] % 4U) > 0U) ? 1U : 0U;
           for (unsigned int i = 0; i < data_len_w; i++) {
-            BYTE_ARRAY_TO_WORD(fifo->data_word[i], &to_send.data[i*4U]);
+            BYTE_ARRAY_TO_WORD(fifo->data_word[i], &to_send->data[i*4U]);
           }
 
+          // one add request per element, this advances the put index and keeps the queue order on the bus
           FDCANx->TXBAR = (1UL << tx_index);
 
-          // Send back to USB
-          CANPacket_t to_push;
-
-          to_push.returned = 1U;
-          to_push.rejected = 0U;
-          to_push.extended = to_send.extended;
-          to_push.addr = to_send.addr;
-          to_push.bus = bus_number;
-          to_push.data_len_code = to_send.data_len_code;
-          (void)memcpy(to_push.data, to_send.data, dlc_to_len[to_push.data_len_code]);
-          can_set_checksum(&to_push);
-
-          rx_buffer_overflow += can_push(&can_rx_q, &to_push) ? 0U : 1U;
+          // Send back to USB once it's on the bus, see can_tx_events
+          to_send->returned = 1U;
+          to_send->rejected = 0U;
+          to_send->bus = bus_number;
+          pending->marker = (uint8_t)((pending->marker + 1U) % FDCAN_TX_EVENT_FIFO_EL_CNT);
+          pending->in_flight += 1U;
         } else {
           can_health[can_number].total_tx_checksum_error_cnt += 1U;
         }
-
-        refresh_can_tx_slots_available();
       }
     }
+
+    if (popped) {
+      refresh_can_tx_slots_available();
+    }
+
+    // the TX FIFO emptied before the last events were stored, get an interrupt for them
+    if ((pending->in_flight > 0U) && ((FDCANx->TXFQS & FDCAN_TXFQS_TFFL) == FDCAN_TX_FIFO_EL_CNT)) {
+      FDCANx->IE |= FDCAN_IE_TEFNE;
+    } else {
+      FDCANx->IE &= ~(FDCAN_IE_TEFNE);
+    }
     EXIT_CRITICAL();
   }
 }
 
 // FDFDCANx_IT0 IRQ Handler (RX and errors)
+// top half: the frames go to can_rx_staging, can_rx_process does the rest from PendSV
 // blink blue when we are receiving CAN messages
 void can_rx(uint8_t can_number) {
   FDCAN_GlobalTypeDef *FDCANx = CANIF_FROM_CAN_NUM(can_number);
@@ -153,8 +220,11 @@ void can_rx(uint8_t can_number) {
 
   // Clear all new messages from Rx FIFO 0
   FDCANx->IR |= FDCAN_IR_RF0N;
+  bool received = false;
   while((FDCANx->RXF0S & FDCAN_RXF0S_F0FL) != 0U) {
     can_health[can_number].total_rx_cnt += 1U;
+    uint32_t rx_time = microsecond_timer_get();
+    received = true;
 
     // can is live
     pending_can_live = 1;
@@ -169,57 +239,31 @@ void can_rx(uint8_t can_number) {
     }
 
     uint32_t RxFIFO0SA = FDCAN_START_ADDRESS + (can_number * FDCAN_OFFSET);
-    CANPacket_t to_push;
     canfd_fifo *fifo;
 
     // getting address
     fifo = (canfd_fifo *)(RxFIFO0SA + (rx_fifo_idx * FDCAN_RX_FIFO_0_EL_SIZE));
 
-    to_push.returned = 0U;
-    to_push.rejected = 0U;
-    to_push.extended = (fifo->header[0] >> 30) & 0x1U;
-    to_push.addr = ((to_push.extended != 0U) ? (fifo->header[0] & 0x1FFFFFFFU) : ((fifo->header[0] >> 18) & 0x7FFU));
-    to_push.bus = bus_number;
-    to_push.data_len_code = ((fifo->header[1] >> 16) & 0xFU);
-
-    bool canfd_frame = ((fifo->header[1] >> 21) & 0x1U);
-    bool brs_frame = ((fifo->header[1] >> 20) & 0x1U);
-
-    uint8_t data_len_w = (dlc_to_len[to_push.data_len_code] / 4U);
-    data_len_w += ((dlc_to_len[to_push.data_len_code] % 4U) > 0U) ? 1U : 0U;
-    for (unsigned int i = 0; i < data_len_w; i++) {
-      WORD_TO_BYTE_ARRAY(&to_push.data[i*4U], fifo->data_word[i]);
-    }
-    can_set_checksum(&to_push);
-
-    // forwarding (panda only)
-    int bus_fwd_num = safety_fwd_hook(bus_number, to_push.addr);
-    if (bus_fwd_num < 0) {
-      bus_fwd_num = bus_config[can_number].forwarding_bus;
-    }
-    if (bus_fwd_num != -1) {
-      CANPacket_t to_send;
-
-      to_send.returned = 0U;
-      to_send.rejected = 0U;
-      to_send.extended = to_push.extended;
-      to_send.addr = to_push.addr;
-      to_send.bus = to_push.bus;
-      to_send.data_len_code = to_push.data_len_code;
-      (void)memcpy(to_send.data, to_push.data, dlc_to_len[to_push.data_len_code]);
-      can_set_checksum(&to_send);
-
-      can_send(&to_send, bus_fwd_num, true);
-      can_health[can_number].total_fwd_cnt += 1U;
+    can_rx_staged_t *staged = can_rx_stage_reserve(can_number);
+    if (staged != NULL) {
+      CANPacket_t *to_push = &staged->pkt;
+      staged->rx_time = rx_time;
+      to_push->extended = (fifo->header[0] >> 30) & 0x1U;
+      to_push->addr = ((to_push->extended != 0U) ? (fifo->header[0] & 0x1FFFFFFFU) : ((fifo->header[0] >> 18) & 0x7FFU));
+      to_push->bus = bus_number;
+      to_push->data_len_code = ((fifo->header[1] >> 16) & 0xFU);
+
+      uint8_t data_len_w = (dlc_to_len[to_push->data_len_code] / 4U);
+      data_len_w += ((dlc_to_len[to_push->data_len_code] % 4U) > 0U) ? 1U : 0U;
+      for (unsigned int i = 0; i < data_len_w; i++) {
+        WORD_TO_BYTE_ARRAY(&to_push->data[i*4U], fifo->data_word[i]);
+      }
+      can_rx_stage_commit();
     }
 
-    safety_rx_invalid += safety_rx_hook(&to_push) ? 0U : 1U;
-    ignition_can_hook(&to_push);
-
-    current_board->set_led(LED_BLUE, true);
-    rx_buffer_overflow += can_push(&can_rx_q, &to_push) ? 0U : 1U;
-
     // Enable CAN FD and BRS if CAN FD message was received
+    bool canfd_frame = ((fifo->header[1] >> 21) & 0x1U);
+    bool brs_frame = ((fifo->header[1] >> 20) & 0x1U);
     if (!(bus_config[can_number].canfd_enabled) && (canfd_frame)) {
       bus_config[can_number].canfd_enabled = true;
     }
@@ -231,20 +275,43 @@ void can_rx(uint8_t can_number) {
     FDCANx->RXF0A = rx_fifo_idx;
   }
 
+  if (received) {
+    current_board->set_led(LED_BLUE, true);
+    can_rx_pend_bottom_half();
+  }
+
   // Error handling
   if ((ir_reg & (FDCAN_IR_PED | FDCAN_IR_PEA | FDCAN_IR_EP | FDCAN_IR_BO | FDCAN_IR_RF0L)) != 0U) {
     update_can_health_pkt(can_number, ir_reg);
   }
 }
 
+// CAN RX bottom half, at the lowest priority
+void PendSV_Handler(void) {
+  interrupt_load_enter();
+  can_rx_process();
+  interrupt_load_exit();
+}
+
+void can_rx_pend_bottom_half(void) {
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
 void FDCAN1_IT0_IRQ_Handler(void) { can_rx(0); }
-void FDCAN1_IT1_IRQ_Handler(void) { process_can(0); }
+void FDCAN1_IT1_IRQ_Handler(void) { can_tx_irq(0); }
 
 void FDCAN2_IT0_IRQ_Handler(void) { can_rx(1); }
-void FDCAN2_IT1_IRQ_Handler(void) { process_can(1); }
+void FDCAN2_IT1_IRQ_Handler(void) { can_tx_irq(1); }
 
 void FDCAN3_IT0_IRQ_Handler(void) { can_rx(2);  }
-void FDCAN3_IT1_IRQ_Handler(void) { process_can(2); }
+void FDCAN3_IT1_IRQ_Handler(void) { can_tx_irq(2); }
+
+bool can_set_rx_filters(uint8_t can_number) {
+  COMPILE_TIME_ASSERT((CAN_RX_FILTER_STD_EL_CNT == FDCAN_STD_FILTER_EL_CNT) && (CAN_RX_FILTER_EXT_EL_CNT == FDCAN_EXT_FILTER_EL_CNT));
+  can_rx_filter_elems_t elems;
+  can_rx_filter_build(BUS_NUM_FROM_CAN_NUM(can_number), &elems);
+  return llcan_set_filters(CANIF_FROM_CAN_NUM(can_number), elems.std, elems.std_len, elems.ext, elems.ext_len, elems.std_reject, elems.ext_reject);
+}
 
 bool can_init(uint8_t can_number) {
   bool ret = false;
@@ -256,10 +323,15 @@ bool can_init(uint8_t can_number) {
   REGISTER_INTERRUPT(FDCAN3_IT0_IRQn, FDCAN3_IT0_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_3)
   REGISTER_INTERRUPT(FDCAN3_IT1_IRQn, FDCAN3_IT1_IRQ_Handler, CAN_INTERRUPT_RATE, FAULT_INTERRUPT_RATE_CAN_3)
 
+  // the RX bottom half runs below every other interrupt
+  NVIC_SetPriority(PendSV_IRQn, (1UL << __NVIC_PRIO_BITS) - 1UL);
+
   if (can_number != 0xffU) {
     FDCAN_GlobalTypeDef *FDCANx = CANIF_FROM_CAN_NUM(can_number);
+    can_tx_pending_clear(can_number);
     ret &= can_set_speed(can_number);
     ret &= llcan_init(FDCANx);
+    ret &= can_set_rx_filters(can_number);
     // in case there are queued up messages
     process_can(can_number);
   }
@@ -34,7 +34,8 @@ uint32_t idle_time = 0U;
 uint32_t busy_time = 0U;
 float interrupt_load = 0.0f;
 
-void handle_interrupt(IRQn_Type irq_type){
+// interrupt load accounting, around every handler
+void interrupt_load_enter(void) {
   ENTER_CRITICAL();
   if (interrupt_depth == 0U) {
     uint32_t time = microsecond_timer_get();
@@ -43,15 +44,9 @@ void handle_interrupt(IRQn_Type irq_type){
   }
   interrupt_depth += 1U;
   EXIT_CRITICAL();
+}
 
-  interrupts[irq_type].call_counter++;
-  interrupts[irq_type].handler();
-
-  // Check that the interrupts don't fire too often
-  if (check_interrupt_rate && (interrupts[irq_type].call_counter > interrupts[irq_type].max_call_rate)) {
-    fault_occurred(interrupts[irq_type].call_rate_fault);
-  }
-
+void interrupt_load_exit(void) {
   ENTER_CRITICAL();
   interrupt_depth -= 1U;
   if (interrupt_depth == 0U) {
@@ -62,6 +57,20 @@ void handle_interrupt(IRQn_Type irq_type){
   EXIT_CRITICAL();
 }
 
+void handle_interrupt(IRQn_Type irq_type){
+  interrupt_load_enter();
+
+  interrupts[irq_type].call_counter++;
+  interrupts[irq_type].handler();
+
+  // Check that the interrupts don't fire too often
+  if (check_interrupt_rate && (interrupts[irq_type].call_counter > interrupts[irq_type].max_call_rate)) {
+    fault_occurred(interrupts[irq_type].call_rate_fault);
+  }
+
+  interrupt_load_exit();
+}
+
 // Every second
 void interrupt_timer_handler(void) {
   if (INTERRUPT_TIMER->SR != 0U) {
@@ -0,0 +1,61 @@
+// Cooperative main loop scheduler. Interrupts post work with sched_post, periodic tasks run every
+// period_us, and sched_run runs whatever is due from the main loop, where the other interrupts can
+// preempt it. The time spent in tasks is measured, so together with the interrupt load it shows
+// how much of the MCU is left.
+
+typedef struct sched_task_t {
+  void (*func)(void);
+  uint32_t period_us;        // 0 for tasks that only run when posted
+  uint32_t last_run;
+  volatile uint32_t post_cnt; // free running, only written by sched_post
+  uint32_t run_cnt;          // free running, only written by sched_run
+  uint32_t max_run_time_us;  // in the current second
+} sched_task_t;
+
+uint32_t sched_window_start = 0U;
+uint32_t sched_busy_time = 0U;
+uint32_t sched_max_run_time_us = 0U; // the longest task run in the last second
+float sched_load = 0.0f;             // fraction of the last second spent in tasks, with the interrupts preempting them
+
+// interrupts and tasks: run the task once more from the main loop
+void sched_post(sched_task_t *task) {
+  task->post_cnt += 1U;
+}
+
+static void sched_run_task(sched_task_t *task, uint32_t start) {
+  task->func();
+  uint32_t run_time = get_ts_elapsed(microsecond_timer_get(), start);
+  task->max_run_time_us = MAX(task->max_run_time_us, run_time);
+  sched_busy_time += run_time;
+}
+
+// main loop: every posted run and every periodic task that is due
+void sched_run(sched_task_t *tasks[], uint8_t tasks_len) {
+  for (uint8_t i = 0U; i < tasks_len; i++) {
+    sched_task_t *task = tasks[i];
+    // posts that come in while it runs get their own run
+    while (task->run_cnt != task->post_cnt) {
+      task->run_cnt += 1U;
+      sched_run_task(task, microsecond_timer_get());
+    }
+
+    uint32_t now = microsecond_timer_get();
+    if ((task->period_us != 0U) && (get_ts_elapsed(now, task->last_run) >= task->period_us)) {
+      task->last_run = now;
+      sched_run_task(task, now);
+    }
+  }
+
+  uint32_t now = microsecond_timer_get();
+  uint32_t window = get_ts_elapsed(now, sched_window_start);
+  if (window >= 1000000U) {
+    sched_load = (float)sched_busy_time / (float)window;
+    sched_max_run_time_us = 0U;
+    for (uint8_t i = 0U; i < tasks_len; i++) {
+      sched_max_run_time_us = MAX(sched_max_run_time_us, tasks[i]->max_run_time_us);
+      tasks[i]->max_run_time_us = 0U;
+    }
+    sched_busy_time = 0U;
+    sched_window_start = now;
+  }
+}
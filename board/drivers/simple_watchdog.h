@@ -7,16 +7,20 @@ typedef struct simple_watchdog_state_t {
 simple_watchdog_state_t wd_state;
 
 
-void simple_watchdog_kick(void) {
-  uint32_t ts = microsecond_timer_get();
-
-  uint32_t et = get_ts_elapsed(ts, wd_state.last_ts);
-  if (et > wd_state.threshold) {
+// true if the last kick is more than the threshold ago, from a different context than the kicks
+bool simple_watchdog_check(void) {
+  uint32_t et = get_ts_elapsed(microsecond_timer_get(), wd_state.last_ts);
+  bool timeout = et > wd_state.threshold;
+  if (timeout) {
     print("WD timeout 0x"); puth(et); print("\n");
     fault_occurred(wd_state.fault);
   }
+  return timeout;
+}
 
-  wd_state.last_ts = ts;
+void simple_watchdog_kick(void) {
+  (void)simple_watchdog_check();
+  wd_state.last_ts = microsecond_timer_get();
 }
 
 void simple_watchdog_init(uint32_t fault, uint32_t threshold) {
@@ -8,23 +8,41 @@
 // in a tight loop, plus some buffer
 #define SPI_IRQ_RATE  16000U
 
+// responses are cut down to fit the TX buffer, the H7 takes a whole 16kB CAN batch at once
 #ifdef STM32H7
 #define SPI_BUF_SIZE 2048U
+#define SPI_TX_BUF_SIZE (0x4000U + 0x40U)
 // H7 DMA2 located in D2 domain, so we need to use SRAM1/SRAM2
 __attribute__((section(".sram12"))) uint8_t spi_buf_rx[SPI_BUF_SIZE];
-__attribute__((section(".sram12"))) uint8_t spi_buf_tx[SPI_BUF_SIZE];
+__attribute__((section(".sram12"), aligned(4))) uint8_t spi_buf_tx[SPI_TX_BUF_SIZE];
 #else
 #define SPI_BUF_SIZE 1024U
+#define SPI_TX_BUF_SIZE SPI_BUF_SIZE
 uint8_t spi_buf_rx[SPI_BUF_SIZE];
-uint8_t spi_buf_tx[SPI_BUF_SIZE];
+__attribute__((aligned(4))) uint8_t spi_buf_tx[SPI_TX_BUF_SIZE];
+#endif
+
+// v3 frames every request by the end of its transfer, which takes an interrupt on CS
+#ifdef STM32H7
+#define SPI_PROTOCOL_VERSION 3U
+#else
+#define SPI_PROTOCOL_VERSION 2U
 #endif
 
 #define SPI_CHECKSUM_START 0xABU
 #define SPI_SYNC_BYTE 0x5AU
+#define SPI_SYNC_BYTE_V3 0x5BU
 #define SPI_HACK 0x79U
 #define SPI_DACK 0x85U
 #define SPI_NACK 0x1FU
 
+// CAN write and read in one request: the data is sent like on endpoint 3, the response is a byte
+// telling whether it was taken, then the received frames like on endpoint 1
+#define SPI_ENDPOINT_CAN_EXCHANGE 4U
+
+// v2 request to switch to another protocol version once its response is sent, data is the version
+#define SPI_ENDPOINT_PROTOCOL 0xA3U
+
 // SPI states
 enum {
   SPI_STATE_HEADER,
@@ -32,7 +50,8 @@ enum {
   SPI_STATE_HEADER_NACK,
   SPI_STATE_DATA_RX,
   SPI_STATE_DATA_RX_ACK,
-  SPI_STATE_DATA_TX
+  SPI_STATE_DATA_TX,
+  SPI_STATE_V3
 };
 
 bool spi_tx_dma_done = false;
@@ -42,15 +61,29 @@ uint16_t spi_data_len_mosi;
 uint16_t spi_data_len_miso;
 uint16_t spi_checksum_error_count = 0;
 bool spi_can_tx_ready = false;
+uint8_t spi_protocol_next = 2U;
+
+// v3: the response to the last request, sent again on every transfer until the next request
+uint16_t spi_v3_response_len = 0U;
+bool spi_v3_armed = false;
+bool spi_v3_nack = false;
 
 const unsigned char version_text[] = "VERSION";
 
 #define SPI_HEADER_SIZE 7U
 
+// v3 request: sync, endpoint, 2 byte data length, 2 byte max response length, sequence number,
+// header checksum, then the data and its checksum.
+// v3 response: ACK, sequence number of the request, 2 byte data length, data, checksum
+#define SPI_HEADER_SIZE_V3 8U
+#define SPI_RESPONSE_HEADER_SIZE_V3 4U
+
 // low level SPI prototypes
 void llspi_init(void);
 void llspi_mosi_dma(uint8_t *addr, int len);
 void llspi_miso_dma(uint8_t *addr, int len);
+uint16_t llspi_mosi_dma_stop(void);
+bool llspi_cs_active(void);
 
 void can_tx_comms_resume_spi(void) {
   spi_can_tx_ready = true;
@@ -85,7 +118,7 @@ uint16_t spi_version_packet(uint8_t *out) {
   data_len += 1U;
 
   // SPI protocol version
-  out[data_pos + data_len] = 0x2;
+  out[data_pos + data_len] = SPI_PROTOCOL_VERSION;
   data_len += 1U;
 
   // data length
@@ -94,7 +127,7 @@ uint16_t spi_version_packet(uint8_t *out) {
 
   // CRC8
   uint16_t resp_len = data_pos + data_len;
-  out[resp_len] = crc_checksum(out, resp_len, 0xD5U);
+  out[resp_len] = crc_checksum(out, resp_len);
   resp_len += 1U;
 
   return resp_len;
@@ -109,16 +142,148 @@ void spi_init(void) {
   llspi_mosi_dma(spi_buf_rx, SPI_HEADER_SIZE);
 }
 
+// XOR of the bytes, a word at a time once data is aligned
+uint8_t spi_xor(const uint8_t *data, uint32_t len) {
+  const uint8_t *d8 = data;
+  uint32_t n = len;
+  uint8_t x = 0U;
+  while ((n > 0U) && (UNALIGNED(d8, 0U) != 0U)) {
+    x ^= *d8;
+    d8++;
+    n--;
+  }
+
+  const uint32_t *d32 = (const uint32_t *)d8; // cppcheck-suppress misra-c2012-11.3 ; aligned above
+  uint32_t x32 = 0U;
+  while (n >= 4U) {
+    x32 ^= *d32;
+    d32++;
+    n -= 4U;
+  }
+  x32 ^= x32 >> 16U;
+  x32 ^= x32 >> 8U;
+  x ^= (uint8_t)(x32 & 0xFFU);
+
+  d8 = (const uint8_t *)d32;
+  while (n > 0U) {
+    x ^= *d8;
+    d8++;
+    n--;
+  }
+  return x;
+}
+
 bool validate_checksum(const uint8_t *data, uint16_t len) {
-  // TODO: can speed this up by casting the bulk to uint32_t and xor-ing the bytes afterwards
-  uint8_t checksum = SPI_CHECKSUM_START;
-  for(uint16_t i = 0U; i < len; i++){
-    checksum ^= data[i];
+  return (SPI_CHECKSUM_START ^ spi_xor(data, len)) == 0U;
+}
+
+// runs a request on its endpoint, for both protocol versions. the response data goes to resp and
+// its XOR to resp_xor, CAN reads checksum the frames while copying them out of the RX queue.
+// returns false to NACK the request
+bool spi_handle_request(uint8_t endpoint, const uint8_t *data, uint16_t len_mosi, uint16_t len_miso, uint8_t *resp, uint16_t *resp_len, uint8_t *resp_xor) {
+  bool ack = false;
+  bool xor_done = false;
+  *resp_len = 0U;
+  *resp_xor = 0U;
+
+  if (endpoint == 0U) {
+    if (len_mosi >= sizeof(ControlPacket_t)) {
+      ControlPacket_t ctrl = {0};
+      (void)memcpy(&ctrl, data, sizeof(ControlPacket_t));
+      *resp_len = comms_control_handler(&ctrl, resp);
+      ack = true;
+    } else {
+      print("SPI: insufficient data for control handler\n");
+    }
+  } else if ((endpoint == 1U) || (endpoint == 0x81U)) {
+    if (len_mosi == 0U) {
+      *resp_len = comms_can_read_checksum(resp, len_miso, resp_xor);
+      xor_done = true;
+      ack = true;
+    } else {
+      print("SPI: did not expect data for can_read\n");
+    }
+  } else if (endpoint == 2U) {
+    comms_endpoint2_write(data, len_mosi);
+    ack = true;
+  } else if (endpoint == 3U) {
+    if (len_mosi > 0U) {
+      if (spi_can_tx_ready) {
+        spi_can_tx_ready = false;
+        comms_can_write(data, len_mosi);
+        ack = true;
+      } else {
+        ack = false;
+        print("SPI: CAN NACK\n");
+      }
+    } else {
+      print("SPI: did expect data for can_write\n");
+    }
+  } else if (endpoint == SPI_ENDPOINT_CAN_EXCHANGE) {
+    if (len_miso > 0U) {
+      // the frames wait on the master when the TX queues are full, receiving goes on
+      bool tx_taken = (len_mosi == 0U) || spi_can_tx_ready;
+      if ((len_mosi > 0U) && tx_taken) {
+        spi_can_tx_ready = false;
+        comms_can_write(data, len_mosi);
+      }
+      resp[0] = tx_taken ? 1U : 0U;
+      *resp_xor = resp[0];
+      *resp_len = 1U + comms_can_read_checksum(&resp[1], len_miso - 1U, resp_xor);
+      xor_done = true;
+      ack = true;
+    } else {
+      print("SPI: did expect room for can_exchange response\n");
+    }
+  } else if (endpoint == SPI_ENDPOINT_PROTOCOL) {
+    if ((len_mosi == 1U) && (data[0] >= 2U) && (data[0] <= SPI_PROTOCOL_VERSION)) {
+      spi_protocol_next = data[0];
+      ack = true;
+    }
+  } else if (endpoint == 0xABU) {
+    // test endpoint, send max response length
+    *resp_len = len_miso;
+    ack = true;
+  } else {
+    print("SPI: unexpected endpoint"); puth(endpoint); print("\n");
+  }
+
+  if (!xor_done) {
+    *resp_xor = spi_xor(resp, *resp_len);
   }
-  return checksum == 0U;
+  return ack;
 }
 
-void spi_rx_done(void) {
+// v3: receive the next transfer and send the current response, unless a transfer already started.
+// that one is discarded when CS goes up, so the master never sees a response from the middle
+void spi_v3_arm(void) {
+  spi_v3_armed = !llspi_cs_active();
+  if (spi_v3_armed) {
+    llspi_mosi_dma(spi_buf_rx, SPI_BUF_SIZE);
+    llspi_miso_dma(spi_buf_tx, spi_v3_response_len);
+  }
+}
+
+// data_xor is the XOR of the data already in place after the header
+void spi_v3_response(bool ack, uint8_t seq, uint16_t data_len, uint8_t data_xor) {
+  spi_buf_tx[0] = ack ? SPI_DACK : SPI_NACK;
+  spi_buf_tx[1] = seq;
+  spi_buf_tx[2] = data_len & 0xFFU;
+  spi_buf_tx[3] = (data_len >> 8) & 0xFFU;
+
+  uint16_t len = SPI_RESPONSE_HEADER_SIZE_V3 + data_len;
+  spi_buf_tx[len] = SPI_CHECKSUM_START ^ spi_xor(spi_buf_tx, SPI_RESPONSE_HEADER_SIZE_V3) ^ data_xor;
+  spi_v3_response_len = len + 1U;
+}
+
+void spi_v3_start(void) {
+  spi_state = SPI_STATE_V3;
+  spi_v3_nack = false;
+  spi_v3_response(false, 0U, 0U, 0U);
+  spi_v3_arm();
+}
+
+void spi_rx_done_v2(void) {
   uint16_t response_len = 0U;
   uint8_t next_rx_state = SPI_STATE_HEADER_NACK;
   bool checksum_valid = false;
@@ -148,47 +313,12 @@ void spi_rx_done(void) {
   } else if (spi_state == SPI_STATE_DATA_RX) {
     // We got everything! Based on the endpoint specified, call the appropriate handler
     bool response_ack = false;
+    uint8_t response_xor = 0U;
     checksum_valid = validate_checksum(&(spi_buf_rx[SPI_HEADER_SIZE]), spi_data_len_mosi + 1U);
     if (checksum_valid) {
-      if (spi_endpoint == 0U) {
-        if (spi_data_len_mosi >= sizeof(ControlPacket_t)) {
-          ControlPacket_t ctrl = {0};
-          (void)memcpy(&ctrl, &spi_buf_rx[SPI_HEADER_SIZE], sizeof(ControlPacket_t));
-          response_len = comms_control_handler(&ctrl, &spi_buf_tx[3]);
-          response_ack = true;
-        } else {
-          print("SPI: insufficient data for control handler\n");
-        }
-      } else if ((spi_endpoint == 1U) || (spi_endpoint == 0x81U)) {
-        if (spi_data_len_mosi == 0U) {
-          response_len = comms_can_read(&(spi_buf_tx[3]), spi_data_len_miso);
-          response_ack = true;
-        } else {
-          print("SPI: did not expect data for can_read\n");
-        }
-      } else if (spi_endpoint == 2U) {
-        comms_endpoint2_write(&spi_buf_rx[SPI_HEADER_SIZE], spi_data_len_mosi);
-        response_ack = true;
-      } else if (spi_endpoint == 3U) {
-        if (spi_data_len_mosi > 0U) {
-          if (spi_can_tx_ready) {
-            spi_can_tx_ready = false;
-            comms_can_write(&spi_buf_rx[SPI_HEADER_SIZE], spi_data_len_mosi);
-            response_ack = true;
-          } else {
-            response_ack = false;
-            print("SPI: CAN NACK\n");
-          }
-        } else {
-          print("SPI: did expect data for can_write\n");
-        }
-      } else if (spi_endpoint == 0xABU) {
-        // test endpoint, send max response length
-        response_len = spi_data_len_miso;
-        response_ack = true;
-      } else {
-        print("SPI: unexpected endpoint"); puth(spi_endpoint); print("\n");
-      }
+      response_ack = spi_handle_request(spi_endpoint, &spi_buf_rx[SPI_HEADER_SIZE], spi_data_len_mosi,
+                                        MIN(spi_data_len_miso, SPI_TX_BUF_SIZE - 4U), &spi_buf_tx[3], &response_len,
+                                        &response_xor);
     } else {
       // Checksum was incorrect
       response_ack = false;
@@ -210,12 +340,8 @@ void spi_rx_done(void) {
       spi_buf_tx[1] = response_len & 0xFFU;
       spi_buf_tx[2] = (response_len >> 8) & 0xFFU;
 
-      // Add checksum
-      uint8_t checksum = SPI_CHECKSUM_START;
-      for(uint16_t i = 0U; i < (response_len + 3U); i++) {
-        checksum ^= spi_buf_tx[i];
-      }
-      spi_buf_tx[response_len + 3U] = checksum;
+      // Add checksum, the handler already has the data's
+      spi_buf_tx[response_len + 3U] = SPI_CHECKSUM_START ^ spi_buf_tx[0] ^ spi_buf_tx[1] ^ spi_buf_tx[2] ^ response_xor;
       response_len += 4U;
 
       next_rx_state = SPI_STATE_DATA_TX;
@@ -239,8 +365,21 @@ void spi_rx_done(void) {
   }
 }
 
+void spi_rx_done(void) {
+  // in v3 the transfer filled the whole buffer, CS going up ends it
+  if (spi_state != SPI_STATE_V3) {
+    spi_rx_done_v2();
+  }
+}
+
 void spi_tx_done(bool reset) {
-  if ((spi_state == SPI_STATE_HEADER_NACK) || reset) {
+  if (spi_state == SPI_STATE_V3) {
+    // v3 responses end with the transfer
+  } else if ((spi_state == SPI_STATE_DATA_TX) && (spi_protocol_next != 2U)) {
+    // the switch was acknowledged, the next transfer is the first in the new version
+    spi_protocol_next = 2U;
+    spi_v3_start();
+  } else if ((spi_state == SPI_STATE_HEADER_NACK) || reset) {
     // Reset state
     spi_state = SPI_STATE_HEADER;
     llspi_mosi_dma(spi_buf_rx, SPI_HEADER_SIZE);
@@ -258,3 +397,57 @@ void spi_tx_done(bool reset) {
     print("SPI: TX unexpected state: "); puth(spi_state); print("\n");
   }
 }
+
+// v3: a whole transfer came in. read-only transfers start with a zero and clock out the response
+// again, v2 masters and VERSION switch back to v2, anything else is a request. after a NACK the
+// following requests are NACKed too until a read-only transfer, so pipelined requests never run out
+// of order
+void spi_v3_rx_done(uint16_t len) {
+  bool version = (len >= SPI_HEADER_SIZE) && (memcmp(spi_buf_rx, version_text, 7) == 0);
+  if (version || ((len == SPI_HEADER_SIZE) && (spi_buf_rx[0] == SPI_SYNC_BYTE))) {
+    spi_state = SPI_STATE_HEADER;
+    spi_rx_done_v2();
+  } else if ((len == 0U) || (spi_buf_rx[0] == 0U)) {
+    spi_v3_nack = false;
+  } else {
+    uint8_t endpoint = spi_buf_rx[1];
+    uint16_t len_mosi = (spi_buf_rx[3] << 8) | spi_buf_rx[2];
+    uint16_t len_miso = (spi_buf_rx[5] << 8) | spi_buf_rx[4];
+    uint8_t seq = (len > 6U) ? spi_buf_rx[6] : 0U;
+
+    bool ack = false;
+    uint16_t data_len = 0U;
+    uint8_t data_xor = 0U;
+    bool checksum_valid = (len >= SPI_HEADER_SIZE_V3) && (spi_buf_rx[0] == SPI_SYNC_BYTE_V3) &&
+                          validate_checksum(spi_buf_rx, SPI_HEADER_SIZE_V3) &&
+                          (len >= (SPI_HEADER_SIZE_V3 + len_mosi + 1U)) &&
+                          validate_checksum(&spi_buf_rx[SPI_HEADER_SIZE_V3], len_mosi + 1U);
+    if (!checksum_valid) {
+      print("- incorrect v3 sync or checksum "); hexdump(spi_buf_rx, MIN(len, SPI_HEADER_SIZE_V3));
+      if (spi_checksum_error_count < UINT16_MAX) {
+        spi_checksum_error_count += 1U;
+      }
+    } else if (spi_v3_nack) {
+      // an earlier request was NACKed and the master didn't see it yet
+    } else {
+      ack = spi_handle_request(endpoint, &spi_buf_rx[SPI_HEADER_SIZE_V3], len_mosi,
+                               MIN(len_miso, SPI_TX_BUF_SIZE - SPI_RESPONSE_HEADER_SIZE_V3 - 1U),
+                               &spi_buf_tx[SPI_RESPONSE_HEADER_SIZE_V3], &data_len, &data_xor);
+    }
+    spi_v3_nack = !ack;
+    spi_v3_response(ack, seq, ack ? data_len : 0U, ack ? data_xor : 0U);
+  }
+}
+
+// CS went up, a transfer ended
+void spi_cs_done(void) {
+  if (spi_state == SPI_STATE_V3) {
+    uint16_t len = llspi_mosi_dma_stop();
+    if (spi_v3_armed) {
+      spi_v3_rx_done(len);
+    }
+    if (spi_state == SPI_STATE_V3) {
+      spi_v3_arm();
+    }
+  }
+}
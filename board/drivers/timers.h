@@ -15,6 +15,20 @@ uint32_t microsecond_timer_get(void) {
   return MICROSECOND_TIMER->CNT;
 }
 
+// DWT cycle counter, counts at CORE_FREQ
+void cycle_counter_init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#ifdef STM32H7
+  DWT->LAR = 0xC5ACCE55U;  // unlock the DWT registers
+#endif
+  DWT->CYCCNT = 0U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t cycle_counter_get(void) {
+  return DWT->CYCCNT;
+}
+
 void interrupt_timer_init(void) {
   enable_interrupt_timer();
   REGISTER_INTERRUPT(INTERRUPT_TIMER_IRQ, interrupt_timer_handler, 1, FAULT_INTERRUPT_RATE_INTERRUPTS)
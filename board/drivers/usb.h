@@ -79,7 +79,7 @@ void refresh_can_tx_slots_available(void);
 #define STS_SETUP_COMP                         4
 #define STS_SETUP_UPDT                         6
 
-uint8_t response[USBPACKET_MAX_SIZE];
+uint8_t response[USB_CONTROL_RESP_MAX_SIZE];
 
 // for the repeating interfaces
 #define DSCR_INTERFACE_LEN 9
@@ -627,8 +627,7 @@ void usb_setup(void) {
       resp_len = comms_control_handler(&control_req, response);
       // response pending if -1 was returned
       if (resp_len != -1) {
-        USB_WritePacket(response, MIN(resp_len, setup.b.wLength.w), 0);
-        USBx_OUTEP(0U)->DOEPCTL |= USB_OTG_DOEPCTL_CNAK;
+        USB_WritePacket_EP0(response, MIN(resp_len, setup.b.wLength.w));
       }
   }
 }
@@ -9,8 +9,11 @@
 #define ALLOW_DEBUG
 #define PANDA
 
+// host benchmarks provide their own critical section
+#ifndef ENTER_CRITICAL
 #define ENTER_CRITICAL() 0
 #define EXIT_CRITICAL() 0
+#endif
 
 void print(const char *a) {
   printf("%s", a);
@@ -24,10 +27,28 @@ typedef struct {
   uint32_t CNT;
 } TIM_TypeDef;
 
-TIM_TypeDef timer;
-TIM_TypeDef *MICROSECOND_TIMER = &timer;
+SAFETY_STATE TIM_TypeDef timer;
+#define MICROSECOND_TIMER (&timer)
 uint32_t microsecond_timer_get(void);
 
 uint32_t microsecond_timer_get(void) {
   return MICROSECOND_TIMER->CNT;
 }
+
+#ifdef HOST_CYCLE_COUNTER
+// profiling builds count nanoseconds of the host's monotonic clock, like a 1 GHz core
+#include <time.h>
+#define CORE_FREQ 1000U
+uint32_t cycle_counter_get(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec);
+}
+#else
+// the host cycle counter is the fake microsecond timer, like a 1 MHz core. A real clock read would
+// cost more than most safety hooks, and the host benchmarks time the hooks themselves
+#define CORE_FREQ 1U
+uint32_t cycle_counter_get(void) {
+  return MICROSECOND_TIMER->CNT;
+}
+#endif
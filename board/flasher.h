@@ -102,6 +102,13 @@ int comms_can_read(uint8_t *data, uint32_t max_len) {
   return 0;
 }
 
+int comms_can_read_checksum(uint8_t *data, uint32_t max_len, uint8_t *checksum) {
+  UNUSED(data);
+  UNUSED(max_len);
+  UNUSED(checksum);
+  return 0;
+}
+
 void refresh_can_tx_slots_available(void) {}
 
 void comms_endpoint2_write(const uint8_t *data, uint32_t len) {
@@ -1,6 +1,6 @@
 // When changing these structs, python/__init__.py needs to be kept up to date!
 
-#define HEALTH_PACKET_VERSION 16
+#define HEALTH_PACKET_VERSION 17
 struct __attribute__((packed)) health_t {
   uint32_t uptime_pkt;
   uint32_t voltage_pkt;
@@ -28,9 +28,11 @@ struct __attribute__((packed)) health_t {
   uint16_t sbu1_voltage_mV;
   uint16_t sbu2_voltage_mV;
   uint8_t som_reset_triggered;
+  float main_loop_load_pkt;
+  uint16_t main_loop_max_task_us_pkt;
 };
 
-#define CAN_HEALTH_PACKET_VERSION 5
+#define CAN_HEALTH_PACKET_VERSION 10
 typedef struct __attribute__((packed)) {
   uint8_t bus_off;
   uint32_t bus_off_cnt;
@@ -58,4 +60,11 @@ typedef struct __attribute__((packed)) {
   uint32_t irq1_call_rate;
   uint32_t irq2_call_rate;
   uint32_t can_core_reset_cnt;
+  uint16_t tx_prio_depth[CAN_TX_PRIO_CNT]; // frames waiting in each TX priority queue, highest priority first
+  uint32_t tx_prio_drop_cnt[CAN_TX_PRIO_CNT]; // frames dropped because their TX priority queue was full
+  uint32_t tx_mailbox_replaced_cnt; // queued frames of mailbox addresses replaced by a newer frame
+  uint32_t total_tx_irq_cnt; // TX interrupts, one per refill of the hardware TX FIFO or mailbox
+  uint32_t rx_fifo_overrun_cnt[2]; // frames lost because RX FIFO 0 / 1 was full, FDCAN only uses FIFO 0
+  uint32_t rx_staging_drop_cnt; // frames lost because the RX bottom half was too far behind
+  uint32_t rx_staging_max_latency_us; // longest wait of a frame between the RX interrupt and the bottom half
 } can_health_t;
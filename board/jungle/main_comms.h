@@ -88,7 +88,7 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
       break;
     // **** 0xc2: CAN health stats
     case 0xc2:
-      COMPILE_TIME_ASSERT(sizeof(can_health_t) <= USBPACKET_MAX_SIZE);
+      COMPILE_TIME_ASSERT(sizeof(can_health_t) <= USB_CONTROL_RESP_MAX_SIZE);
       if (req->param1 < 3U) {
         update_can_health_pkt(req->param1, 0U);
         can_health[req->param1].can_speed = (bus_config[req->param1].can_speed / 10U);
@@ -96,6 +96,7 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
         can_health[req->param1].canfd_enabled = bus_config[req->param1].canfd_enabled;
         can_health[req->param1].brs_enabled = bus_config[req->param1].brs_enabled;
         can_health[req->param1].canfd_non_iso = bus_config[req->param1].canfd_non_iso;
+        update_can_tx_health(req->param1);
         resp_len = sizeof(can_health[req->param1]);
         (void)memcpy(resp, &can_health[req->param1], resp_len);
       }
@@ -207,14 +208,54 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
       can_loopback = (req->param1 > 0U);
       can_init_all();
       break;
+    // **** 0xe8: enable/disable CAN RX timestamps
+    case 0xe8:
+      can_rx_timestamps = (req->param1 > 0U);
+      break;
+    // **** 0xe9: set CAN TX priority of an address
+    // param1: bit 15 high priority, bits 13-14 bus, bits 0-12 addr >> 16. param2: addr & 0xFFFF
+    // all ones clears the host's high priority addresses
+    case 0xe9:
+      if ((req->param1 == 0xFFFFU) && (req->param2 == 0xFFFFU)) {
+        can_tx_prio_clear();
+      } else {
+        uint8_t bus = (uint8_t)((req->param1 >> 13) & 0x3U);
+        uint32_t addr = ((uint32_t)(req->param1 & 0x1FFFU) << 16) | req->param2;
+        if (bus >= PANDA_BUS_CNT) {
+          print("Invalid CAN bus number\n");
+        } else if (!can_tx_prio_set(bus, addr, (req->param1 >> 15) != 0U)) {
+          print("CAN TX priority table full\n");
+        } else {
+          // address updated
+        }
+      }
+      break;
+    // **** 0xea: set CAN TX mailbox mode of an address
+    // same encoding as 0xe9, bit 15 enables the mailbox
+    case 0xea:
+      if ((req->param1 == 0xFFFFU) && (req->param2 == 0xFFFFU)) {
+        can_tx_mailbox_clear();
+      } else {
+        uint8_t bus = (uint8_t)((req->param1 >> 13) & 0x3U);
+        uint32_t addr = ((uint32_t)(req->param1 & 0x1FFFU) << 16) | req->param2;
+        if (bus >= PANDA_BUS_CNT) {
+          print("Invalid CAN bus number\n");
+        } else if (!can_tx_mailbox_set(bus, addr, (req->param1 >> 15) != 0U)) {
+          print("CAN TX mailbox table full\n");
+        } else {
+          // address updated
+        }
+      }
+      break;
     // **** 0xf1: Clear CAN ring buffer.
     case 0xf1:
       if (req->param1 == 0xFFFFU) {
         print("Clearing CAN Rx queue\n");
-        can_clear(&can_rx_q);
+        can_packed_clear(&can_rx_q);
+        can_read_tail = 0U;
       } else if (req->param1 < PANDA_BUS_CNT) {
         print("Clearing CAN Tx queue\n");
-        can_clear(can_queues[req->param1]);
+        can_tx_clear(req->param1);
       } else {
         print("Clearing CAN CAN ring buffer failed: wrong bus number\n");
       }
@@ -60,6 +60,45 @@ void *memcpy(void *dest, const void *src, unsigned int len) {
   return dest;
 }
 
+// memcpy that also returns the XOR of the bytes, so data can be checksummed on its way into a
+// transfer buffer instead of in a second pass
+uint8_t memcpy_xor(void *dest, const void *src, unsigned int len) {
+  unsigned int n = len;
+  uint8_t *d8 = dest;
+  const uint8_t *s8 = src;
+  uint8_t x = 0U;
+
+  // words work once both pointers are aligned, which takes them being equally misaligned
+  if ((n >= 8U) && (UNALIGNED(s8, 0U) == UNALIGNED(d8, 0U))) {
+    while (UNALIGNED(s8, 0U) != 0U) {
+      x ^= *s8;
+      *d8 = *s8; d8++; s8++;
+      n--;
+    }
+
+    uint32_t *d32 = (uint32_t *)d8; // cppcheck-suppress misra-c2012-11.3 ; aligned above
+    const uint32_t *s32 = (const uint32_t *)s8; // cppcheck-suppress misra-c2012-11.3 ; aligned above
+    uint32_t x32 = 0U;
+    while (n >= 4U) {
+      x32 ^= *s32;
+      *d32 = *s32; d32++; s32++;
+      n -= 4U;
+    }
+    x32 ^= x32 >> 16U;
+    x32 ^= x32 >> 8U;
+    x ^= (uint8_t)(x32 & 0xFFU);
+
+    d8 = (uint8_t *)d32;
+    s8 = (const uint8_t *)s32;
+  }
+  while (n > 0U) {
+    x ^= *s8;
+    *d8 = *s8; d8++; s8++;
+    n--;
+  }
+  return x;
+}
+
 // cppcheck-suppress misra-c2012-21.2
 int memcmp(const void * ptr1, const void * ptr2, unsigned int num) {
   int ret = 0;
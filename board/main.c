@@ -4,6 +4,7 @@
 #include "drivers/pwm.h"
 #include "drivers/usb.h"
 #include "drivers/simple_watchdog.h"
+#include "drivers/scheduler.h"
 #include "drivers/bootkick.h"
 
 #include "early_init.h"
@@ -143,6 +144,112 @@ void __attribute__ ((noinline)) enable_fpu(void) {
 // called at 8Hz
 uint8_t loop_counter = 0U;
 uint8_t prev_harness_status = HARNESS_STATUS_NC;
+bool recent_heartbeat = false;  // a heartbeat came in the second before the last 1Hz tick
+
+// main loop, at 8Hz
+void tick_task(void) {
+  // watched by tick_handler
+  simple_watchdog_kick();
+
+  // re-init everything that uses harness status, shared with the USB and SPI interrupts
+  uint8_t harness_status = harness.status;
+  if (harness_status != prev_harness_status) {
+    ENTER_CRITICAL();
+    prev_harness_status = harness_status;
+    can_set_orientation(harness_status == HARNESS_STATUS_FLIPPED);
+
+    // re-init everything that uses harness status
+    can_init_all();
+    set_safety_mode(current_safety_mode, current_safety_param);
+    set_power_save_state(power_save_status);
+    EXIT_CRITICAL();
+  }
+}
+
+// main loop, at 1Hz, after tick_handler counted the heartbeat and ran the safety tick
+void second_task(void) {
+  can_live = pending_can_live;
+
+  //puth(usart1_dma); print(" "); puth(DMA2_Stream5->M0AR); print(" "); puth(DMA2_Stream5->NDTR); print("\n");
+
+  // reset this every 16th pass
+  if ((uptime_cnt & 0xFU) == 0U) {
+    pending_can_live = 0;
+  }
+  #ifdef DEBUG
+    print("** blink ");
+    print("rx:"); puth4(can_rx_q.r_ptr); print("-"); puth4(can_rx_q.w_ptr); print("  ");
+    print("tx1:"); puth4(can_tx1_q.r_ptr); print("-"); puth4(can_tx1_q.w_ptr); print("  ");
+    print("tx2:"); puth4(can_tx2_q.r_ptr); print("-"); puth4(can_tx2_q.w_ptr); print("  ");
+    print("tx3:"); puth4(can_tx3_q.r_ptr); print("-"); puth4(can_tx3_q.w_ptr); print("\n");
+  #endif
+
+  // set green LED to be controls allowed
+  current_board->set_led(LED_GREEN, controls_allowed | green_led_enabled);
+
+  // turn off the blue LED, turned on by CAN
+  // unless we are in power saving mode
+  current_board->set_led(LED_BLUE, (uptime_cnt & 1U) && (power_save_status == POWER_SAVE_STATUS_ENABLED));
+
+  // tick drivers at 1Hz
+  bootkick_tick(check_started(), recent_heartbeat);
+
+  // the heartbeat and safety state is shared with the USB and SPI interrupts
+  ENTER_CRITICAL();
+  // disabling heartbeat not allowed while in safety mode
+  if (is_car_safety_mode(current_safety_mode)) {
+    heartbeat_disabled = false;
+  }
+
+  // if the heartbeat has been gone for a while, go to SILENT safety mode and enter power save
+  uint32_t heartbeat_cnt = heartbeat_counter;
+  bool heartbeat_timeout = !heartbeat_disabled &&
+                           (heartbeat_cnt >= (check_started() ? HEARTBEAT_IGNITION_CNT_ON : HEARTBEAT_IGNITION_CNT_OFF));
+  if (heartbeat_timeout) {
+    if (controls_allowed_countdown > 0U && heartbeat_engaged) {
+      siren_countdown = 5U;
+      controls_allowed_countdown = 0U;
+    }
+
+    // set flag to indicate the heartbeat was lost
+    if (is_car_safety_mode(current_safety_mode)) {
+      heartbeat_lost = true;
+    }
+
+    // clear heartbeat engaged state
+    heartbeat_engaged = false;
+
+    if (current_safety_mode != SAFETY_SILENT) {
+      set_safety_mode(SAFETY_SILENT, 0U);
+    }
+
+    if (power_save_status != POWER_SAVE_STATUS_ENABLED) {
+      set_power_save_state(POWER_SAVE_STATUS_ENABLED);
+    }
+  }
+  EXIT_CRITICAL();
+
+  if (heartbeat_timeout) {
+    print("device hasn't sent a heartbeat for 0x");
+    puth(heartbeat_cnt);
+    print(" seconds. Safety is set to SILENT mode.\n");
+
+    // Also disable IR when the heartbeat goes missing
+    current_board->set_ir_power(0U);
+
+    // Run fan when device is up, but not talking to us
+    // * bootloader enables the SOM GPIO on boot
+    // * fallback to USB enumerated where supported
+    bool enabled = usb_enumerated || current_board->read_som_gpio();
+    fan_set_power(enabled ? 50U : 0U);
+  }
+}
+
+sched_task_t tick_sched_task = {.func = tick_task};
+sched_task_t second_sched_task = {.func = second_task};
+sched_task_t registers_sched_task = {.func = check_registers, .period_us = 1000000U};
+sched_task_t *main_tasks[] = {&tick_sched_task, &second_sched_task, &registers_sched_task};
+
 void tick_handler(void) {
   if (TICK_TIMER->SR != 0U) {
 
@@ -153,59 +260,24 @@ void tick_handler(void) {
     fan_tick();
     usb_tick();
     harness_tick();
-    simple_watchdog_kick();
 
-    // re-init everything that uses harness status
-    if (harness.status != prev_harness_status) {
-      prev_harness_status = harness.status;
-      can_set_orientation(harness.status == HARNESS_STATUS_FLIPPED);
-
-      // re-init everything that uses harness status
-      can_init_all();
-      set_safety_mode(current_safety_mode, current_safety_param);
-      set_power_save_state(power_save_status);
+    // the heartbeat timeout runs from the main loop, disengage if it's stuck
+    if (simple_watchdog_check()) {
+      disengageFromBrakes = false;
+      controls_allowed = false;
+      controls_allowed_long = false;
     }
 
+    sched_post(&tick_sched_task);
     // decimated to 1Hz
     if (loop_counter == 0U) {
-      can_live = pending_can_live;
-
-      //puth(usart1_dma); print(" "); puth(DMA2_Stream5->M0AR); print(" "); puth(DMA2_Stream5->NDTR); print("\n");
-
-      // reset this every 16th pass
-      if ((uptime_cnt & 0xFU) == 0U) {
-        pending_can_live = 0;
-      }
-      #ifdef DEBUG
-        print("** blink ");
-        print("rx:"); puth4(can_rx_q.r_ptr); print("-"); puth4(can_rx_q.w_ptr); print("  ");
-        print("tx1:"); puth4(can_tx1_q.r_ptr); print("-"); puth4(can_tx1_q.w_ptr); print("  ");
-        print("tx2:"); puth4(can_tx2_q.r_ptr); print("-"); puth4(can_tx2_q.w_ptr); print("  ");
-        print("tx3:"); puth4(can_tx3_q.r_ptr); print("-"); puth4(can_tx3_q.w_ptr); print("\n");
-      #endif
-
-      // set green LED to be controls allowed
-      current_board->set_led(LED_GREEN, controls_allowed | green_led_enabled);
-
-      // turn off the blue LED, turned on by CAN
-      // unless we are in power saving mode
-      current_board->set_led(LED_BLUE, (uptime_cnt & 1U) && (power_save_status == POWER_SAVE_STATUS_ENABLED));
-
-      const bool recent_heartbeat = heartbeat_counter == 0U;
-
-      // tick drivers at 1Hz
-      bootkick_tick(check_started(), recent_heartbeat);
+      recent_heartbeat = heartbeat_counter == 0U;
 
       // increase heartbeat counter and cap it at the uint32 limit
       if (heartbeat_counter < UINT32_MAX) {
         heartbeat_counter += 1U;
       }
 
-      // disabling heartbeat not allowed while in safety mode
-      if (is_car_safety_mode(current_safety_mode)) {
-        heartbeat_disabled = false;
-      }
-
       if (siren_countdown > 0U) {
         siren_countdown -= 1U;
       }
@@ -230,48 +302,6 @@ void tick_handler(void) {
         heartbeat_engaged_mismatches = 0U;
       }
 
-      if (!heartbeat_disabled) {
-        // if the heartbeat has been gone for a while, go to SILENT safety mode and enter power save
-        if (heartbeat_counter >= (check_started() ? HEARTBEAT_IGNITION_CNT_ON : HEARTBEAT_IGNITION_CNT_OFF)) {
-          print("device hasn't sent a heartbeat for 0x");
-          puth(heartbeat_counter);
-          print(" seconds. Safety is set to SILENT mode.\n");
-
-          if (controls_allowed_countdown > 0U && heartbeat_engaged) {
-            siren_countdown = 5U;
-            controls_allowed_countdown = 0U;
-          }
-
-          // set flag to indicate the heartbeat was lost
-          if (is_car_safety_mode(current_safety_mode)) {
-            heartbeat_lost = true;
-          }
-
-          // clear heartbeat engaged state
-          heartbeat_engaged = false;
-
-          if (current_safety_mode != SAFETY_SILENT) {
-            set_safety_mode(SAFETY_SILENT, 0U);
-          }
-
-          if (power_save_status != POWER_SAVE_STATUS_ENABLED) {
-            set_power_save_state(POWER_SAVE_STATUS_ENABLED);
-          }
-
-          // Also disable IR when the heartbeat goes missing
-          current_board->set_ir_power(0U);
-
-          // Run fan when device is up, but not talking to us
-          // * bootloader enables the SOM GPIO on boot
-          // * fallback to USB enumerated where supported
-          bool enabled = usb_enumerated || current_board->read_som_gpio();
-          fan_set_power(enabled ? 50U : 0U);
-        }
-      }
-
-      // check registers
-      check_registers();
-
       // set ignition_can to false after 2s of no CAN seen
       if (ignition_can_cnt > 2U) {
         ignition_can = false;
@@ -284,6 +314,9 @@ void tick_handler(void) {
 
       // synchronous safety check
       safety_tick(&current_safety_config);
+
+      // the rest of the heartbeat timeout
+      sched_post(&second_sched_task);
     }
 
     loop_counter++;
@@ -292,6 +325,25 @@ void tick_handler(void) {
   TICK_TIMER->SR = 0;
 }
 
+// software PWM fade of the red LED from the main loop, breaks in the fade = panda is overloaded
+bool led_fade_on = false;
+void led_fade_update(bool enabled) {
+  uint32_t ts = microsecond_timer_get();
+  uint32_t step = (ts >> 10) & 0x7FFU;  // ~1ms steps, ~2s to fade in and out
+  uint32_t duty = (step < 0x400U) ? step : (0x7FFU - step);
+  bool on = enabled && ((ts & 0x3FFU) < duty);
+  #ifdef DEBUG_FAULTS
+  if (fault_status != FAULT_STATUS_NONE) {
+    on = enabled && (((ts >> 19) & 1U) != 0U);
+  }
+  #endif
+
+  if (on != led_fade_on) {
+    current_board->set_led(LED_RED, on);
+    led_fade_on = on;
+  }
+}
+
 int main(void) {
   // Init interrupt table
   init_interrupts(true);
@@ -328,6 +380,7 @@ int main(void) {
   }
 
   microsecond_timer_init();
+  cycle_counter_init();
 
   // init to SILENT and can silent
   set_safety_mode(SAFETY_SILENT, 0U);
@@ -362,34 +415,13 @@ int main(void) {
 
   // LED should keep on blinking all the time
   while (true) {
-    if (power_save_status == POWER_SAVE_STATUS_DISABLED) {
-      #ifdef DEBUG_FAULTS
-      if (fault_status == FAULT_STATUS_NONE) {
-      #endif
-        // useful for debugging, fade breaks = panda is overloaded
-        for (uint32_t fade = 0U; fade < MAX_LED_FADE; fade += 1U) {
-          current_board->set_led(LED_RED, true);
-          delay(fade >> 4);
-          current_board->set_led(LED_RED, false);
-          delay((MAX_LED_FADE - fade) >> 4);
-        }
-
-        for (uint32_t fade = MAX_LED_FADE; fade > 0U; fade -= 1U) {
-          current_board->set_led(LED_RED, true);
-          delay(fade >> 4);
-          current_board->set_led(LED_RED, false);
-          delay((MAX_LED_FADE - fade) >> 4);
-        }
+    sched_run(main_tasks, sizeof(main_tasks) / sizeof(main_tasks[0]));
 
-      #ifdef DEBUG_FAULTS
-      } else {
-          current_board->set_led(LED_RED, 1);
-          delay(512000U);
-          current_board->set_led(LED_RED, 0);
-          delay(512000U);
-        }
-      #endif
+    if (power_save_status == POWER_SAVE_STATUS_DISABLED) {
+      led_fade_update(true);
     } else {
+      led_fade_update(false);
+      // the tick timer wakes us up for the next tasks
       __WFI();
       SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
     }
@@ -35,6 +35,8 @@ int get_health_pkt(void *dat) {
   health->faults_pkt = faults;
 
   health->interrupt_load_pkt = interrupt_load;
+  health->main_loop_load_pkt = sched_load;
+  health->main_loop_max_task_us_pkt = MIN(sched_max_run_time_us, 0xFFFFU);
 
   health->fan_power = fan_state.power;
   health->fan_stall_count = fan_state.total_stall_count;
@@ -108,7 +110,7 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
       break;
     // **** 0xc2: CAN health stats
     case 0xc2:
-      COMPILE_TIME_ASSERT(sizeof(can_health_t) <= USBPACKET_MAX_SIZE);
+      COMPILE_TIME_ASSERT(sizeof(can_health_t) <= USB_CONTROL_RESP_MAX_SIZE);
       if (req->param1 < 3U) {
         update_can_health_pkt(req->param1, 0U);
         can_health[req->param1].can_speed = (bus_config[req->param1].can_speed / 10U);
@@ -116,6 +118,7 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
         can_health[req->param1].canfd_enabled = bus_config[req->param1].canfd_enabled;
         can_health[req->param1].brs_enabled = bus_config[req->param1].brs_enabled;
         can_health[req->param1].canfd_non_iso = bus_config[req->param1].canfd_non_iso;
+        update_can_tx_health(req->param1);
         resp_len = sizeof(can_health[req->param1]);
         (void)memcpy(resp, &can_health[req->param1], resp_len);
       }
@@ -317,14 +320,122 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
     case 0xe7:
       set_power_save_state(req->param1);
       break;
+    // **** 0xe8: enable/disable CAN RX timestamps
+    case 0xe8:
+      can_rx_timestamps = (req->param1 > 0U);
+      break;
+    // **** 0xe9: set CAN TX priority of an address
+    // param1: bit 15 high priority, bits 13-14 bus, bits 0-12 addr >> 16. param2: addr & 0xFFFF
+    // all ones clears the host's high priority addresses
+    case 0xe9:
+      if ((req->param1 == 0xFFFFU) && (req->param2 == 0xFFFFU)) {
+        can_tx_prio_clear();
+      } else {
+        uint8_t bus = (uint8_t)((req->param1 >> 13) & 0x3U);
+        uint32_t addr = ((uint32_t)(req->param1 & 0x1FFFU) << 16) | req->param2;
+        if (bus >= PANDA_BUS_CNT) {
+          print("Invalid CAN bus number\n");
+        } else if (!can_tx_prio_set(bus, addr, (req->param1 >> 15) != 0U)) {
+          print("CAN TX priority table full\n");
+        } else {
+          // address updated
+        }
+      }
+      break;
+    // **** 0xea: set CAN TX mailbox mode of an address
+    // same encoding as 0xe9, bit 15 enables the mailbox
+    case 0xea:
+      if ((req->param1 == 0xFFFFU) && (req->param2 == 0xFFFFU)) {
+        can_tx_mailbox_clear();
+      } else {
+        uint8_t bus = (uint8_t)((req->param1 >> 13) & 0x3U);
+        uint32_t addr = ((uint32_t)(req->param1 & 0x1FFFU) << 16) | req->param2;
+        if (bus >= PANDA_BUS_CNT) {
+          print("Invalid CAN bus number\n");
+        } else if (!can_tx_mailbox_set(bus, addr, (req->param1 >> 15) != 0U)) {
+          print("CAN TX mailbox table full\n");
+        } else {
+          // address updated
+        }
+      }
+      break;
+    // **** 0xeb: get safety hook timings of a safety mode
+    // param1: safety mode, 0xFFFF for the current one. param2: 1 resets all timings after reading
+    // response: clock in MHz, then count, min, max and sum (low, high word) of the cycles in the RX, TX and FWD hooks
+    case 0xeb:
+      {
+        uint16_t mode = (req->param1 == 0xFFFFU) ? current_safety_mode : req->param1;
+        uint32_t timings[1U + (5U * SAFETY_HOOK_CNT)] = {0};
+        COMPILE_TIME_ASSERT(sizeof(timings) <= USBPACKET_MAX_SIZE);
+        timings[0] = CORE_FREQ;
+        for (uint8_t hook = 0U; hook < SAFETY_HOOK_CNT; hook++) {
+          safety_hook_profile profile;
+          if (safety_profile_get(mode, hook, &profile)) {
+            timings[1U + (5U * hook)] = profile.cnt;
+            timings[2U + (5U * hook)] = profile.min;
+            timings[3U + (5U * hook)] = profile.max;
+            timings[4U + (5U * hook)] = (uint32_t)profile.sum;
+            timings[5U + (5U * hook)] = (uint32_t)(profile.sum >> 32);
+          }
+        }
+        (void)memcpy(resp, timings, sizeof(timings));
+        resp_len = sizeof(timings);
+        if (req->param2 == 1U) {
+          safety_profile_reset();
+        }
+      }
+      break;
+    // **** 0xec: receive an ID on a bus, everything the filters of a bus don't match is dropped by the CAN core
+    // param1: bit 15 extended, bits 13-14 bus, bits 0-12 addr >> 16 for extended IDs or the mask for standard IDs
+    // param2: addr & 0xFFFF. the safety mode's IDs are always received, and standard IDs are only filtered
+    // once the bus has a standard filter, see can_rx_filter_build
+    case 0xec:
+      {
+        uint8_t bus = (uint8_t)((req->param1 >> 13) & 0x3U);
+        bool extended = (req->param1 >> 15) != 0U;
+        uint32_t addr = extended ? (((uint32_t)(req->param1 & 0x1FFFU) << 16) | req->param2) : (req->param2 & 0x7FFU);
+        if (bus >= PANDA_BUS_CNT) {
+          print("Invalid CAN bus number\n");
+        } else if (!can_rx_filter_add(bus, addr, req->param1 & 0x7FFU, extended)) {
+          print("CAN RX filters full\n");
+        } else {
+          bool ret = can_init(CAN_NUM_FROM_BUS_NUM(bus));
+          UNUSED(ret);
+        }
+      }
+      break;
+    // **** 0xed: clear the RX filters of a bus, 0xFFFF for all buses
+    case 0xed:
+      for (uint8_t bus = 0U; bus < PANDA_BUS_CNT; bus++) {
+        if ((req->param1 == 0xFFFFU) || (req->param1 == bus)) {
+          can_rx_filter_clear(bus);
+          bool ret = can_init(CAN_NUM_FROM_BUS_NUM(bus));
+          UNUSED(ret);
+        }
+      }
+      break;
+    // **** 0xee: get the RX filter state of each bus
+    // response: per bus, bit 0 standard and bit 1 extended ID frames the filters don't match are dropped
+    case 0xee:
+      for (uint8_t bus = 0U; bus < PANDA_BUS_CNT; bus++) {
+        can_rx_filter_elems_t elems = {0};
+        // only FDCAN filters in hardware
+#ifdef STM32H7
+        can_rx_filter_build(bus, &elems);
+#endif
+        resp[bus] = (elems.std_reject ? 1U : 0U) | (elems.ext_reject ? 2U : 0U);
+      }
+      resp_len = PANDA_BUS_CNT;
+      break;
     // **** 0xf1: Clear CAN ring buffer.
     case 0xf1:
       if (req->param1 == 0xFFFFU) {
         print("Clearing CAN Rx queue\n");
-        can_clear(&can_rx_q);
+        can_packed_clear(&can_rx_q);
+        can_read_tail = 0U;
       } else if (req->param1 < PANDA_BUS_CNT) {
         print("Clearing CAN Tx queue\n");
-        can_clear(can_queues[req->param1]);
+        can_tx_clear(req->param1);
       } else {
         print("Clearing CAN CAN ring buffer failed: wrong bus number\n");
       }
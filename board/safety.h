@@ -1,5 +1,6 @@
 #include "safety_declarations.h"
 #include "can_definitions.h"
+#include "obj/crc_tables.h"
 
 #include "safety_sunnypilot_common.h"
 
@@ -54,73 +55,138 @@
 #define SAFETY_BODY 27U
 #define SAFETY_HYUNDAI_CANFD 28U
 
-uint16_t current_safety_mode = SAFETY_SILENT;
-uint16_t current_safety_param = 0;
-const safety_hooks *current_hooks = &nooutput_hooks;
-safety_config current_safety_config;
+SAFETY_STATE uint16_t current_safety_mode = SAFETY_SILENT;
+SAFETY_STATE uint16_t current_safety_param = 0;
+SAFETY_STATE const safety_hooks *current_hooks = &nooutput_hooks;
+SAFETY_STATE safety_config current_safety_config;
+
+// Cost of the safety hooks per safety mode, in cycles of cycle_counter_get. They run in the CAN
+// and USB/SPI ISRs, so a slow mode takes time from everything else running there.
+#define SAFETY_PROFILE_MODES 32U
+SAFETY_STATE safety_hook_profile safety_profile[SAFETY_PROFILE_MODES][SAFETY_HOOK_CNT];
+
+static void safety_profile_record(uint8_t hook, uint32_t start) {
+  uint32_t cycles = cycle_counter_get() - start;
+  if (current_safety_mode < SAFETY_PROFILE_MODES) {
+    safety_hook_profile *p = &safety_profile[current_safety_mode][hook];
+    p->cnt++;
+    p->sum += cycles;
+    p->min = (p->cnt == 1U) ? cycles : MIN(p->min, cycles);
+    p->max = MAX(p->max, cycles);
+  }
+}
+
+bool safety_profile_get(uint16_t mode, uint8_t hook, safety_hook_profile *profile) {
+  bool ret = (mode < SAFETY_PROFILE_MODES) && (hook < SAFETY_HOOK_CNT);
+  if (ret) {
+    *profile = safety_profile[mode][hook];
+  }
+  return ret;
+}
+
+void safety_profile_reset(void) {
+  (void)memset(safety_profile, 0, sizeof(safety_profile));
+}
 
 bool safety_rx_hook(const CANPacket_t *to_push) {
-  bool controls_allowed_prev = controls_allowed;
+  uint32_t start = cycle_counter_get();
+  bool valid = true;
 
-  bool valid = rx_msg_safety_check(to_push, &current_safety_config, current_hooks);
-  if (valid) {
-    current_hooks->rx(to_push);
-  }
+  // no hook acts on most frames of a bus
+  if (safety_rx_dispatch(to_push)) {
+    bool controls_allowed_prev = controls_allowed;
+
+    valid = rx_msg_safety_check(to_push, &current_safety_config, current_hooks);
+    if (valid) {
+      current_hooks->rx(to_push);
+    }
 
-  // reset mismatches on rising edge of controls_allowed to avoid rare race condition
-  if (controls_allowed && !controls_allowed_prev) {
-    heartbeat_engaged_mismatches = 0;
+    // reset mismatches on rising edge of controls_allowed to avoid rare race condition
+    if (controls_allowed && !controls_allowed_prev) {
+      heartbeat_engaged_mismatches = 0;
+    }
   }
 
+  safety_profile_record(SAFETY_HOOK_RX, start);
   return valid;
 }
 
 bool safety_tx_hook(CANPacket_t *to_send) {
-  bool whitelisted = msg_allowed(to_send, current_safety_config.tx_msgs, current_safety_config.tx_msgs_len);
+  uint32_t start = cycle_counter_get();
+  bool whitelisted = safety_index_tx_allowed(to_send);
   if ((current_safety_mode == SAFETY_ALLOUTPUT) || (current_safety_mode == SAFETY_ELM327)) {
     whitelisted = true;
   }
 
   const bool safety_allowed = current_hooks->tx(to_send);
+  safety_profile_record(SAFETY_HOOK_TX, start);
   return !relay_malfunction && whitelisted && safety_allowed;
 }
 
 int safety_fwd_hook(int bus_num, int addr) {
-  return (relay_malfunction ? -1 : current_hooks->fwd(bus_num, addr));
+  uint32_t start = cycle_counter_get();
+  int bus_fwd = relay_malfunction ? -1 : current_hooks->fwd(bus_num, addr);
+  safety_profile_record(SAFETY_HOOK_FWD, start);
+  return bus_fwd;
 }
 
 bool get_longitudinal_allowed(void) {
   return controls_allowed && controls_allowed_long && (!gas_pressed_prev || cruise_override);
 }
 
-// Given a CRC-8 poly, generate a static lookup table to use with a fast CRC-8
-// algorithm. Called at init time for safety modes using CRC-8.
-void gen_crc_lookup_table_8(uint8_t poly, uint8_t crc_lut[]) {
-  for (uint16_t i = 0U; i <= 0xFFU; i++) {
-    uint8_t crc = (uint8_t)i;
-    for (int j = 0; j < 8; j++) {
-      if ((crc & 0x80U) != 0U) {
-        crc = (uint8_t)((crc << 1) ^ poly);
-      } else {
-        crc <<= 1;
-      }
-    }
-    crc_lut[i] = crc;
+// CRC-8 over data bytes [start, end) with one of the tables in obj/crc_tables.h
+uint8_t crc8_lut(const CANPacket_t *msg, int start, int end, uint8_t init, const uint8_t crc_lut[]) {
+  uint8_t crc = init;
+  for (int i = start; i < end; i++) {
+    crc = crc_lut[crc ^ msg->data[i]];
   }
+  return crc;
 }
 
-void gen_crc_lookup_table_16(uint16_t poly, uint16_t crc_lut[]) {
-  for (uint16_t i = 0; i < 256U; i++) {
-    uint16_t crc = i << 8U;
-    for (uint16_t j = 0; j < 8U; j++) {
-      if ((crc & 0x8000U) != 0U) {
-        crc = (uint16_t)((crc << 1) ^ poly);
-      } else {
-        crc <<= 1;
-      }
-    }
-    crc_lut[i] = crc;
+// The XOR and nibble checksums go through the data a word at a time, with every byte in its
+// own lane of the word, and fold the lanes together at the end. The short additive checksums
+// (Toyota, Subaru) and the VW MQB CRC stay inline byte loops, which measured faster.
+
+// XOR of the data bytes [start, end)
+uint8_t xor_bytes(const CANPacket_t *msg, int start, int end) {
+  uint32_t x = 0U;
+  int i = start;
+  for (; (i + 4) <= end; i += 4) {
+    x ^= get_word(msg, i);
+  }
+  x ^= x >> 16;
+  x ^= x >> 8;
+  for (; i < end; i++) {
+    x ^= msg->data[i];
+  }
+  return (uint8_t)x;
+}
+
+// sum of the nibbles of a word
+uint32_t sum_nibbles(uint32_t w) {
+  uint32_t n = (w & 0x0F0F0F0FU) + ((w >> 4) & 0x0F0F0F0FU);
+  n = (n & 0x00FF00FFU) + ((n >> 8) & 0x00FF00FFU);
+  return (n & 0xFFFFU) + (n >> 16);
+}
+
+// sum of the nibbles of the data bytes [start, end)
+uint32_t sum_nibbles_bytes(const CANPacket_t *msg, int start, int end) {
+  uint32_t sum = 0U;
+  int i = start;
+  for (; (i + 4) <= end; i += 4) {
+    sum += sum_nibbles(get_word(msg, i));
+  }
+  for (; i < end; i++) {
+    sum += sum_nibbles(msg->data[i]);
   }
+  return sum;
+}
+
+uint32_t count_bits(uint32_t w) {
+  uint32_t n = w - ((w >> 1) & 0x55555555U);
+  n = (n & 0x33333333U) + ((n >> 2) & 0x33333333U);
+  n = (n + (n >> 4)) & 0x0F0F0F0FU;
+  return (n * 0x01010101U) >> 24;
 }
 
 bool msg_allowed(const CANPacket_t *to_send, const CanMsg msg_list[], int len) {
@@ -169,6 +235,149 @@ int get_addr_check_index(const CANPacket_t *to_push, RxCheck addr_list[], const
   return index;
 }
 
+// ********************* lookup index *********************
+// The TX whitelist and the RX check variants of the active config, grouped by (addr, bus) in config
+// order, with an open addressing hash table pointing at the first entry of each group. Built by
+// set_safety_hooks, so a frame the config doesn't know costs one probe instead of a scan.
+// msg_allowed and get_addr_check_index stay the reference, and are used when the index is off.
+#define SAFETY_INDEX_MAX 64
+#define SAFETY_INDEX_HASH_SIZE 128U  // power of two, at least twice SAFETY_INDEX_MAX
+
+typedef struct {
+  SafetyIndexEntry entries[SAFETY_INDEX_MAX];
+  int len;                                      // -1: not built, lookups scan the config
+  uint8_t hash[SAFETY_INDEX_HASH_SIZE];         // first entry of each (addr, bus) group + 1, 0 is empty
+} safety_index_t;
+
+SAFETY_STATE safety_index_t safety_tx_index = {.len = -1};
+SAFETY_STATE safety_index_t safety_rx_index = {.len = -1};
+SAFETY_STATE const RxCheck *safety_rx_index_checks = NULL;  // the rx_checks the RX index was built from
+
+static uint32_t safety_index_key(int addr, int bus) {
+  return ((uint32_t)addr << 3) | ((uint32_t)bus & 0x7U);
+}
+
+static uint32_t safety_index_slot(uint32_t key) {
+  return (key * 2654435761U) >> 25;  // top 7 bits, Knuth's multiplicative hash
+}
+
+// inserts after all entries with the same key, so a group stays in config order. -1 once it's full
+static void safety_index_insert(safety_index_t *index, SafetyIndexEntry entry) {
+  if ((index->len >= 0) && (index->len < SAFETY_INDEX_MAX)) {
+    int i = index->len;
+    while ((i > 0) && (entry.key < index->entries[i - 1].key)) {
+      index->entries[i] = index->entries[i - 1];
+      i--;
+    }
+    index->entries[i] = entry;
+    index->len++;
+  } else {
+    index->len = -1;
+  }
+}
+
+static void safety_index_hash(safety_index_t *index) {
+  (void)memset(index->hash, 0, sizeof(index->hash));
+  for (int i = 0; i < index->len; i++) {
+    if ((i == 0) || (index->entries[i].key != index->entries[i - 1].key)) {
+      uint32_t slot = safety_index_slot(index->entries[i].key);
+      while (index->hash[slot] != 0U) {
+        slot = (slot + 1U) & (SAFETY_INDEX_HASH_SIZE - 1U);
+      }
+      index->hash[slot] = (uint8_t)(i + 1);
+    }
+  }
+}
+
+// first entry with the key, -1 if there is none
+static int safety_index_find(const safety_index_t *index, uint32_t key) {
+  int ret = -1;
+  uint32_t slot = safety_index_slot(key);
+  while (index->hash[slot] != 0U) {
+    int i = (int)index->hash[slot] - 1;
+    if (index->entries[i].key == key) {
+      ret = i;
+      break;
+    }
+    slot = (slot + 1U) & (SAFETY_INDEX_HASH_SIZE - 1U);
+  }
+  return ret;
+}
+
+void safety_index_build(void) {
+  safety_tx_index.len = 0;
+  for (int i = 0; i < current_safety_config.tx_msgs_len; i++) {
+    const CanMsg *m = &current_safety_config.tx_msgs[i];
+    safety_index_insert(&safety_tx_index, (SafetyIndexEntry){safety_index_key(m->addr, m->bus), m->len, -1, -1});
+  }
+  safety_index_hash(&safety_tx_index);
+
+  // same variants, in the same order, as get_addr_check_index walks them
+  safety_rx_index.len = 0;
+  safety_rx_index_checks = current_safety_config.rx_checks;
+  for (int i = 0; i < current_safety_config.rx_checks_len; i++) {
+    const RxCheck *c = &current_safety_config.rx_checks[i];
+    for (int j = 0; (j < (int)MAX_ADDR_CHECK_MSGS) && (c->msg[j].addr != 0); j++) {
+      safety_index_insert(&safety_rx_index, (SafetyIndexEntry){safety_index_key(c->msg[j].addr, c->msg[j].bus), c->msg[j].len, i, j});
+    }
+  }
+  safety_index_hash(&safety_rx_index);
+}
+
+// whether the TX whitelist of the active config has addr on bus with the length
+bool safety_index_tx_msg(int addr, int bus, int length) {
+  bool allowed = false;
+  if (safety_tx_index.len < 0) {
+    for (int i = 0; i < current_safety_config.tx_msgs_len; i++) {
+      const CanMsg *m = &current_safety_config.tx_msgs[i];
+      if ((addr == m->addr) && (bus == m->bus) && (length == m->len)) {
+        allowed = true;
+        break;
+      }
+    }
+  } else {
+    uint32_t key = safety_index_key(addr, bus);
+    for (int i = safety_index_find(&safety_tx_index, key); (i >= 0) && (i < safety_tx_index.len) && (safety_tx_index.entries[i].key == key); i++) {
+      if (safety_tx_index.entries[i].len == length) {
+        allowed = true;
+        break;
+      }
+    }
+  }
+  return allowed;
+}
+
+bool safety_index_tx_allowed(const CANPacket_t *to_send) {
+  return safety_index_tx_msg(GET_ADDR(to_send), GET_BUS(to_send), GET_LEN(to_send));
+}
+
+// same result and msg_seen/index side effects as get_addr_check_index on cfg
+int safety_index_rx_check(const CANPacket_t *to_push, const safety_config *cfg) {
+  int index = -1;
+  if ((safety_rx_index.len < 0) || (cfg->rx_checks != safety_rx_index_checks)) {
+    index = get_addr_check_index(to_push, cfg->rx_checks, cfg->rx_checks_len);
+  } else {
+    uint32_t key = safety_index_key(GET_ADDR(to_push), GET_BUS(to_push));
+    int length = GET_LEN(to_push);
+    // the group is ordered by check, then msg
+    for (int i = safety_index_find(&safety_rx_index, key); (i >= 0) && (i < safety_rx_index.len) && (safety_rx_index.entries[i].key == key); i++) {
+      const SafetyIndexEntry *e = &safety_rx_index.entries[i];
+      if (e->len == length) {
+        RxStatus *status = &cfg->rx_checks[e->check].status;
+        if (!status->msg_seen) {
+          status->index = e->msg;
+          status->msg_seen = true;
+        }
+        if (status->index == e->msg) {
+          index = e->check;
+          break;
+        }
+      }
+    }
+  }
+  return index;
+}
+
 // 1Hz safety function called by main. Now just a check for lagging safety messages
 void safety_tick(const safety_config *cfg) {
   bool rx_checks_invalid = false;
@@ -226,11 +435,108 @@ void update_addr_timestamp(RxCheck addr_list[], int index) {
   }
 }
 
+// ********************* RX dispatch *********************
+// Per bus bitmap over the 11-bit IDs, plus a short list of 29-bit IDs, of the frames a hook acts on:
+// the mode's RX checks, TX messages (stock ECU detection) and hook_addrs, the ignition_can_hook IDs,
+// and the IDs the fwd hook doesn't handle like the rest of their bus. Rebuilt by set_safety_hooks.
+// Every other frame skips the hooks and is forwarded to fwd_default of its bus.
+#define SAFETY_DISPATCH_BUS_CNT 3
+#define SAFETY_DISPATCH_EXT_MAX 16
+
+typedef struct {
+  uint32_t std_addrs[0x800U / 32U];
+  int fwd_default;
+} safety_dispatch_bus_t;
+
+SAFETY_STATE safety_dispatch_bus_t safety_dispatch[SAFETY_DISPATCH_BUS_CNT];
+SAFETY_STATE int safety_dispatch_ext[SAFETY_DISPATCH_EXT_MAX];
+SAFETY_STATE int safety_dispatch_ext_len = -1;  // -1: not built or full, every 29-bit ID goes through the hooks
+
+// bus -1 marks the address on all buses
+static void safety_dispatch_mark(int bus, int addr) {
+  if (addr < 0x800) {
+    for (int b = 0; b < SAFETY_DISPATCH_BUS_CNT; b++) {
+      if ((bus == -1) || (bus == b)) {
+        safety_dispatch[b].std_addrs[(uint32_t)addr >> 5] |= (1UL << ((uint32_t)addr & 0x1FU));
+      }
+    }
+  } else if ((safety_dispatch_ext_len >= 0) && (safety_dispatch_ext_len < SAFETY_DISPATCH_EXT_MAX)) {
+    safety_dispatch_ext[safety_dispatch_ext_len] = addr;
+    safety_dispatch_ext_len++;
+  } else {
+    safety_dispatch_ext_len = -1;
+  }
+}
+
+void safety_dispatch_build(void) {
+  (void)memset(safety_dispatch, 0, sizeof(safety_dispatch));
+  safety_dispatch_ext_len = 0;
+
+  for (int i = 0; i < current_safety_config.rx_checks_len; i++) {
+    for (int j = 0; (j < (int)MAX_ADDR_CHECK_MSGS) && (current_safety_config.rx_checks[i].msg[j].addr != 0); j++) {
+      safety_dispatch_mark(-1, current_safety_config.rx_checks[i].msg[j].addr);
+    }
+  }
+  for (int i = 0; i < current_safety_config.tx_msgs_len; i++) {
+    safety_dispatch_mark(-1, current_safety_config.tx_msgs[i].addr);
+  }
+  for (int i = 0; i < current_hooks->hook_addrs_len; i++) {
+    safety_dispatch_mark(-1, current_hooks->hook_addrs[i]);
+  }
+  safety_dispatch_mark(0, CAN_IGNITION_GM_ADDR);
+  safety_dispatch_mark(0, CAN_IGNITION_TESLA_ADDR);
+  safety_dispatch_mark(0, CAN_IGNITION_MAZDA_ADDR);
+
+  // the most common fwd hook result of each bus is its default, the other IDs need the hook
+  for (int bus = 0; bus < SAFETY_DISPATCH_BUS_CNT; bus++) {
+    int fwd_cnt[SAFETY_DISPATCH_BUS_CNT + 1] = {0};  // -1 (no forwarding) and each bus
+    for (int addr = 0; addr < 0x800; addr++) {
+      fwd_cnt[current_hooks->fwd(bus, addr) + 1]++;
+    }
+    int fwd_default = -1;
+    for (int fwd = 0; fwd < SAFETY_DISPATCH_BUS_CNT; fwd++) {
+      fwd_default = (fwd_cnt[fwd + 1] > fwd_cnt[fwd_default + 1]) ? fwd : fwd_default;
+    }
+    safety_dispatch[bus].fwd_default = fwd_default;
+    for (int addr = 0; addr < 0x800; addr++) {
+      if (current_hooks->fwd(bus, addr) != fwd_default) {
+        safety_dispatch_mark(bus, addr);
+      }
+    }
+  }
+}
+
+// true if a hook acts on the frame
+bool safety_rx_dispatch(const CANPacket_t *to_push) {
+  int bus = GET_BUS(to_push);
+  int addr = GET_ADDR(to_push);
+
+  bool dispatch = true;
+  if (bus < SAFETY_DISPATCH_BUS_CNT) {
+    if (addr < 0x800) {
+      dispatch = (safety_dispatch[bus].std_addrs[(uint32_t)addr >> 5] & (1UL << ((uint32_t)addr & 0x1FU))) != 0U;
+    } else if (safety_dispatch_ext_len >= 0) {
+      dispatch = false;
+      for (int i = 0; (i < safety_dispatch_ext_len) && !dispatch; i++) {
+        dispatch = (safety_dispatch_ext[i] == addr);
+      }
+    } else {
+      // not built, or too many 29-bit IDs
+    }
+  }
+  return dispatch;
+}
+
+// where a frame safety_rx_dispatch doesn't dispatch is forwarded, same as safety_fwd_hook
+int safety_fwd_default(int bus_num) {
+  return relay_malfunction ? -1 : safety_dispatch[bus_num].fwd_default;
+}
+
 bool rx_msg_safety_check(const CANPacket_t *to_push,
                          const safety_config *cfg,
                          const safety_hooks *safety_hooks) {
 
-  int index = get_addr_check_index(to_push, cfg->rx_checks, cfg->rx_checks_len);
+  int index = safety_index_rx_check(to_push, cfg);
   update_addr_timestamp(cfg->rx_checks, index);
 
   if (index != -1) {
@@ -401,6 +707,8 @@ int set_safety_hooks(uint16_t mode, uint16_t param) {
       current_safety_config.rx_checks[j].status = (RxStatus){0};
     }
   }
+  safety_index_build();
+  safety_dispatch_build();
   return set_status;
 }
 
@@ -414,24 +722,37 @@ int to_signed(int d, int bits) {
   return d_signed;
 }
 
-// given a new sample, update the sample_t struct
-void update_sample(struct sample_t *sample, int sample_new) {
-  for (int i = MAX_SAMPLE_VALS - 1; i > 0; i--) {
-    sample->values[i] = sample->values[i-1];
-  }
-  sample->values[0] = sample_new;
-
-  // get the minimum and maximum measured samples
-  sample->min = sample->values[0];
-  sample->max = sample->values[0];
-  for (int i = 1; i < MAX_SAMPLE_VALS; i++) {
-    if (sample->values[i] < sample->min) {
-      sample->min = sample->values[i];
-    }
-    if (sample->values[i] > sample->max) {
-      sample->max = sample->values[i];
+// given a new sample, update the sample_t struct. min and max are the extremes of the stored samples
+// widened by margin, which must be the same for every update of the sample
+void update_sample_margin(struct sample_t *sample, int sample_new, int margin) {
+  // the new sample replaces the oldest one
+  int idx = (sample->idx + 1) % MAX_SAMPLE_VALS;
+  int sample_old = sample->values[idx];
+  sample->values[idx] = sample_new;
+
+  // get the minimum and maximum measured samples, only rescan if the old sample may have been one of
+  // them. this includes the first update after reset_sample, whose zeroed min and max have no margin
+  bool rescan_min = (sample_old - margin) <= sample->min;
+  bool rescan_max = (sample_old + margin) >= sample->max;
+  int min = MIN(sample->min, sample_new - margin);
+  int max = MAX(sample->max, sample_new + margin);
+  if (rescan_min || rescan_max) {
+    min = sample_new;
+    max = sample_new;
+    for (int i = 0; i < MAX_SAMPLE_VALS; i++) {
+      min = MIN(min, sample->values[i]);
+      max = MAX(max, sample->values[i]);
     }
+    min -= margin;
+    max += margin;
   }
+  sample->min = min;
+  sample->max = max;
+  sample->idx = idx;
+}
+
+void update_sample(struct sample_t *sample, int sample_new) {
+  update_sample_margin(sample, sample_new, 0);
 }
 
 // resets values and min/max for sample_t struct
@@ -439,7 +760,14 @@ void reset_sample(struct sample_t *sample) {
   for (int i = 0; i < MAX_SAMPLE_VALS; i++) {
     sample->values[i] = 0;
   }
-  update_sample(sample, 0);
+  sample->idx = 0;
+  sample->min = 0;
+  sample->max = 0;
+}
+
+// newest sample
+int sample_last(const struct sample_t *sample) {
+  return sample->values[sample->idx];
 }
 
 bool max_limit_check(int val, const int MAX_VAL, const int MIN_VAL) {
@@ -498,27 +826,53 @@ bool rt_rate_limit_check(int val, int val_last, const int MAX_RT_DELTA) {
 }
 
 
-// interp function that holds extreme values
-float interpolate(struct lookup_t xy, float x) {
+// converts a lookup_t to speed and CAN units once, so the checks don't need floats. The ends
+// are truncated exactly like the float checks truncate them, in between the float checks carry
+// rounding error, at most 2^-20 of their largest term, that interpolate_fixed rounds away from
+struct lookup_fixed_t lookup_to_fixed(const struct lookup_t *xy, float y_factor) {
+  struct lookup_fixed_t ret;
+  int size = sizeof(xy->x) / sizeof(xy->x[0]);
+  float y_max = 0.;
+  float slope_max = 0.;
+  for (int i = 0; i < size; i++) {
+    ret.x[i] = ROUND(xy->x[i] * (float)VEHICLE_SPEED_FACTOR);
+    ret.y[i] = (int)((xy->y[i] * y_factor) * (float)ANGLE_RATE_SCALE);
+    y_max = MAX(y_max, ABS(xy->y[i]));
+    if ((i > 0) && (xy->x[i] > xy->x[i - 1])) {
+      slope_max = MAX(slope_max, ABS(xy->y[i] - xy->y[i - 1]) / (xy->x[i] - xy->x[i - 1]));
+    }
+  }
+  ret.y_first = (int)(xy->y[0] * y_factor);
+  ret.y_last = (int)(xy->y[size - 1] * y_factor);
+  // plus one unit each for truncating y, the interpolation and the float math above
+  float error = ABS(y_factor) * (y_max + (slope_max * ABS(xy->x[size - 1]))) * ((float)ANGLE_RATE_SCALE / 1048576.);
+  ret.error = (int)error + 3;
+  return ret;
+}
+
+// interp function that holds extreme values, in CAN units. Between the ends it rounds past the
+// float math's error, up if round_up or down otherwise, so it's never looser than the float
+// checks. y * x ranges must fit in an int
+int interpolate_fixed(const struct lookup_fixed_t *xy, int x, bool round_up) {
 
-  int size = sizeof(xy.x) / sizeof(xy.x[0]);
-  float ret = xy.y[size - 1];  // default output is last point
+  int size = sizeof(xy->x) / sizeof(xy->x[0]);
+  int ret = xy->y_last;  // default output is last point
 
   // x is lower than the first point in the x array. Return the first point
-  if (x <= xy.x[0]) {
-    ret = xy.y[0];
+  if (x <= xy->x[0]) {
+    ret = xy->y_first;
 
   } else {
     // find the index such that (xy.x[i] <= x < xy.x[i+1]) and linearly interp
-    for (int i=0; i < (size - 1); i++) {
-      if (x < xy.x[i+1]) {
-        float x0 = xy.x[i];
-        float y0 = xy.y[i];
-        float dx = xy.x[i+1] - x0;
-        float dy = xy.y[i+1] - y0;
-        // dx should not be zero as xy.x is supposed to be monotonic
-        dx = MAX(dx, 0.0001);
-        ret = (dy * (x - x0) / dx) + y0;
+    for (int i = 0; i < (size - 1); i++) {
+      if (x < xy->x[i+1]) {
+        int x0 = xy->x[i];
+        int y0 = xy->y[i];
+        // dx is positive, since x0 <= x < xy.x[i+1]
+        int dx = xy->x[i+1] - x0;
+        int dy = xy->y[i+1] - y0;
+        int y = floor_div(dy * (x - x0), dx) + y0;
+        ret = floor_div(round_up ? (y + xy->error) : (y - xy->error), ANGLE_RATE_SCALE);
         break;
       }
     }
@@ -526,10 +880,41 @@ float interpolate(struct lookup_t xy, float x) {
   return ret;
 }
 
+static bool lookup_equal(const struct lookup_t *a, const struct lookup_t *b) {
+  bool equal = true;
+  int size = sizeof(a->x) / sizeof(a->x[0]);
+  for (int i = 0; i < size; i++) {
+    equal = equal && (a->x[i] == b->x[i]) && (a->y[i] == b->y[i]);
+  }
+  return equal;
+}
+
+// converts the angle rate limits of a safety mode, called from the init of the angle modes
+void angle_rate_limits_init(const SteeringLimits *limits) {
+  angle_rate_up_lookup = limits->angle_rate_up_lookup;
+  angle_rate_down_lookup = limits->angle_rate_down_lookup;
+  angle_rate_deg_to_can = limits->angle_deg_to_can;
+  angle_rate_error_min_speed = limits->angle_error_min_speed;
+
+  angle_rate_up_limits = lookup_to_fixed(&limits->angle_rate_up_lookup, limits->angle_deg_to_can);
+  angle_rate_down_limits = lookup_to_fixed(&limits->angle_rate_down_lookup, limits->angle_deg_to_can);
+  angle_error_min_speed = (int)(limits->angle_error_min_speed * (float)VEHICLE_SPEED_FACTOR);
+}
+
 int ROUND(float val) {
   return val + ((val > 0.0) ? 0.5 : -0.5);
 }
 
+// integer division rounded like ROUND, den must be positive
+int round_div(int num, int den) {
+  return (num >= 0) ? ((num + (den / 2)) / den) : -((-num + (den / 2)) / den);
+}
+
+// integer division rounded down, den must be positive
+int floor_div(int num, int den) {
+  return (num >= 0) ? (num / den) : (((num + 1) / den) - 1);
+}
+
 // Safety checks for longitudinal actuation
 bool longitudinal_accel_checks(int desired_accel, const LongitudinalLimits limits) {
   bool accel_valid = get_longitudinal_allowed() && !max_limit_check(desired_accel, limits.max_accel, limits.min_accel);
@@ -655,12 +1040,20 @@ bool steer_angle_cmd_checks(int desired_angle, bool steer_control_enabled, const
   bool violation = false;
 
   if (controls_allowed && steer_control_enabled) {
-    // convert floating point angle rate limits to integers in the scale of the desired angle on CAN,
+    // the mode's init converted its limits, convert again if it checks against others
+    bool limits_converted = lookup_equal(&angle_rate_up_lookup, &limits.angle_rate_up_lookup) &&
+                            lookup_equal(&angle_rate_down_lookup, &limits.angle_rate_down_lookup) &&
+                            (angle_rate_deg_to_can == limits.angle_deg_to_can) &&
+                            (angle_rate_error_min_speed == limits.angle_error_min_speed);
+    if (!limits_converted) {
+      angle_rate_limits_init(&limits);
+    }
+
     // add 1 to not false trigger the violation. also fudge the speed by 1 m/s so rate limits are
     // always slightly above openpilot's in case we read an updated speed in between angle commands
     // TODO: this speed fudge can be much lower, look at data to determine the lowest reasonable offset
-    int delta_angle_up = (interpolate(limits.angle_rate_up_lookup, (vehicle_speed.min / VEHICLE_SPEED_FACTOR) - 1.) * limits.angle_deg_to_can) + 1.;
-    int delta_angle_down = (interpolate(limits.angle_rate_down_lookup, (vehicle_speed.min / VEHICLE_SPEED_FACTOR) - 1.) * limits.angle_deg_to_can) + 1.;
+    int delta_angle_up = interpolate_fixed(&angle_rate_up_limits, vehicle_speed.min - VEHICLE_SPEED_FACTOR, false) + 1;
+    int delta_angle_down = interpolate_fixed(&angle_rate_down_limits, vehicle_speed.min - VEHICLE_SPEED_FACTOR, false) + 1;
 
     // allow down limits at zero since small floats will be rounded to 0
     int highest_desired_angle = desired_angle_last + ((desired_angle_last > 0) ? delta_angle_up : delta_angle_down);
@@ -668,11 +1061,12 @@ bool steer_angle_cmd_checks(int desired_angle, bool steer_control_enabled, const
 
     // check that commanded angle value isn't too far from measured, used to limit torque for some safety modes
     // ensure we start moving in direction of meas while respecting rate limits if error is exceeded
-    if (limits.enforce_angle_error && ((vehicle_speed.values[0] / VEHICLE_SPEED_FACTOR) > limits.angle_error_min_speed)) {
+    if (limits.enforce_angle_error && (sample_last(&vehicle_speed) > angle_error_min_speed)) {
       // the rate limits above are liberally above openpilot's to avoid false positives.
       // likewise, allow a lower rate for moving towards meas when error is exceeded
-      int delta_angle_up_lower = interpolate(limits.angle_rate_up_lookup, (vehicle_speed.max / VEHICLE_SPEED_FACTOR) + 1.) * limits.angle_deg_to_can;
-      int delta_angle_down_lower = interpolate(limits.angle_rate_down_lookup, (vehicle_speed.max / VEHICLE_SPEED_FACTOR) + 1.) * limits.angle_deg_to_can;
+      // rounded up, a higher rate towards meas is the stricter one
+      int delta_angle_up_lower = interpolate_fixed(&angle_rate_up_limits, vehicle_speed.max + VEHICLE_SPEED_FACTOR, true);
+      int delta_angle_down_lower = interpolate_fixed(&angle_rate_down_limits, vehicle_speed.max + VEHICLE_SPEED_FACTOR, true);
 
       int highest_desired_angle_lower = desired_angle_last + ((desired_angle_last > 0) ? delta_angle_up_lower : delta_angle_down_lower);
       int lowest_desired_angle_lower = desired_angle_last - ((desired_angle_last >= 0) ? delta_angle_down_lower : delta_angle_up_lower);
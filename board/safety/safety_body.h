@@ -2,7 +2,7 @@ const CanMsg BODY_TX_MSGS[] = {{0x250, 0, 8}, {0x250, 0, 6}, {0x251, 0, 5},  //
                                {0x350, 0, 8}, {0x350, 0, 6}, {0x351, 0, 5},  // knee
                                {0x1, 0, 8}}; // CAN flasher
 
-RxCheck body_rx_checks[] = {
+SAFETY_STATE RxCheck body_rx_checks[] = {
   {.msg = {{0x201, 0, 8, .check_checksum = false, .max_counter = 0U, .frequency = 100U}, { 0 }, { 0 }}},
 };
 
@@ -35,12 +35,18 @@ static bool body_tx_hook(const CANPacket_t *to_send) {
 
 static safety_config body_init(uint16_t param) {
   UNUSED(param);
+  vehicle_moving = true;  // also before the first frame body_rx_hook sees
   return BUILD_SAFETY_CFG(body_rx_checks, BODY_TX_MSGS);
 }
 
+// body_rx_hook reads
+const int BODY_HOOK_ADDRS[] = {0x201};
+
 const safety_hooks body_hooks = {
   .init = body_init,
   .rx = body_rx_hook,
   .tx = body_tx_hook,
   .fwd = default_fwd_hook,
+  .hook_addrs = BODY_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(BODY_HOOK_ADDRS) / sizeof(BODY_HOOK_ADDRS[0]),
 };
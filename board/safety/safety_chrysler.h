@@ -104,7 +104,7 @@ const CanMsg CHRYSLER_RAM_HD_TX_MSGS[] = {
   {CHRYSLER_RAM_HD_ADDRS.DAS_6, 0, 8},
 };
 
-RxCheck chrysler_rx_checks[] = {
+SAFETY_STATE RxCheck chrysler_rx_checks[] = {
   {.msg = {{CHRYSLER_ADDRS.EPS_2, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 100U}, { 0 }, { 0 }}},
   {.msg = {{CHRYSLER_ADDRS.ESP_1, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
   //{.msg = {{ESP_8, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}}},
@@ -113,7 +113,7 @@ RxCheck chrysler_rx_checks[] = {
   {.msg = {{CHRYSLER_ADDRS.DAS_3, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
 };
 
-RxCheck chrysler_ram_dt_rx_checks[] = {
+SAFETY_STATE RxCheck chrysler_ram_dt_rx_checks[] = {
   {.msg = {{CHRYSLER_RAM_DT_ADDRS.EPS_2, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 100U}, { 0 }, { 0 }}},
   {.msg = {{CHRYSLER_RAM_DT_ADDRS.ESP_1, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
   {.msg = {{CHRYSLER_RAM_DT_ADDRS.ESP_8, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
@@ -121,7 +121,7 @@ RxCheck chrysler_ram_dt_rx_checks[] = {
   {.msg = {{CHRYSLER_RAM_DT_ADDRS.DAS_3, 2, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
 };
 
-RxCheck chrysler_ram_hd_rx_checks[] = {
+SAFETY_STATE RxCheck chrysler_ram_hd_rx_checks[] = {
   {.msg = {{CHRYSLER_RAM_HD_ADDRS.EPS_2, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 100U}, { 0 }, { 0 }}},
   {.msg = {{CHRYSLER_RAM_HD_ADDRS.ESP_1, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
   {.msg = {{CHRYSLER_RAM_HD_ADDRS.ESP_8, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
@@ -139,8 +139,8 @@ typedef enum {
   CHRYSLER_RAM_HD,
   CHRYSLER_PACIFICA,  // plus Jeep
 } ChryslerPlatform;
-ChryslerPlatform chrysler_platform = CHRYSLER_PACIFICA;
-const ChryslerAddrs *chrysler_addrs = &CHRYSLER_ADDRS;
+SAFETY_STATE ChryslerPlatform chrysler_platform = CHRYSLER_PACIFICA;
+SAFETY_STATE const ChryslerAddrs *chrysler_addrs = &CHRYSLER_ADDRS;
 
 static uint32_t chrysler_get_checksum(const CANPacket_t *to_push) {
   int checksum_byte = GET_LEN(to_push) - 1U;
@@ -148,36 +148,9 @@ static uint32_t chrysler_get_checksum(const CANPacket_t *to_push) {
 }
 
 static uint32_t chrysler_compute_checksum(const CANPacket_t *to_push) {
-  // TODO: clean this up
-  // http://illmatics.com/Remote%20Car%20Hacking.pdf
-  uint8_t checksum = 0xFFU;
-  int len = GET_LEN(to_push);
-  for (int j = 0; j < (len - 1); j++) {
-    uint8_t shift = 0x80U;
-    uint8_t curr = (uint8_t)GET_BYTE(to_push, j);
-    for (int i=0; i<8; i++) {
-      uint8_t bit_sum = curr & shift;
-      uint8_t temp_chk = checksum & 0x80U;
-      if (bit_sum != 0U) {
-        bit_sum = 0x1C;
-        if (temp_chk != 0U) {
-          bit_sum = 1;
-        }
-        checksum = checksum << 1;
-        temp_chk = checksum | 1U;
-        bit_sum ^= temp_chk;
-      } else {
-        if (temp_chk != 0U) {
-          bit_sum = 0x1D;
-        }
-        checksum = checksum << 1;
-        bit_sum ^= checksum;
-      }
-      checksum = bit_sum;
-      shift = shift >> 1;
-    }
-  }
-  return (uint8_t)(~checksum);
+  // CRC-8 SAE J1850 over all but the checksum byte, see http://illmatics.com/Remote%20Car%20Hacking.pdf
+  uint8_t crc = crc8_lut(to_push, 0, GET_LEN(to_push) - 1, 0xFFU, crc8_lut_j1850);
+  return (uint8_t)(~crc);
 }
 
 static uint8_t chrysler_get_counter(const CANPacket_t *to_push) {
@@ -303,6 +276,17 @@ static safety_config chrysler_init(uint16_t param) {
   return ret;
 }
 
+// chrysler_rx_hook reads, on all platforms
+const int CHRYSLER_HOOK_ADDRS[] = {
+  514,
+  CHRYSLER_ADDRS.EPS_2, CHRYSLER_ADDRS.ESP_1, CHRYSLER_ADDRS.ESP_8,
+  CHRYSLER_ADDRS.ECM_5, CHRYSLER_ADDRS.DAS_3, CHRYSLER_ADDRS.LKAS_COMMAND,
+  CHRYSLER_RAM_DT_ADDRS.EPS_2, CHRYSLER_RAM_DT_ADDRS.ESP_1, CHRYSLER_RAM_DT_ADDRS.ESP_8,
+  CHRYSLER_RAM_DT_ADDRS.ECM_5, CHRYSLER_RAM_DT_ADDRS.DAS_3, CHRYSLER_RAM_DT_ADDRS.LKAS_COMMAND,
+  CHRYSLER_RAM_HD_ADDRS.EPS_2, CHRYSLER_RAM_HD_ADDRS.ESP_1, CHRYSLER_RAM_HD_ADDRS.ESP_8,
+  CHRYSLER_RAM_HD_ADDRS.ECM_5, CHRYSLER_RAM_HD_ADDRS.DAS_3, CHRYSLER_RAM_HD_ADDRS.LKAS_COMMAND,
+};
+
 const safety_hooks chrysler_hooks = {
   .init = chrysler_init,
   .rx = chrysler_rx_hook,
@@ -311,4 +295,6 @@ const safety_hooks chrysler_hooks = {
   .get_counter = chrysler_get_counter,
   .get_checksum = chrysler_get_checksum,
   .compute_checksum = chrysler_compute_checksum,
+  .hook_addrs = CHRYSLER_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(CHRYSLER_HOOK_ADDRS) / sizeof(CHRYSLER_HOOK_ADDRS[0]),
 };
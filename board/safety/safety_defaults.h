@@ -31,7 +31,7 @@ const safety_hooks nooutput_hooks = {
 
 // Enables passthrough mode where relay is open and bus 0 gets forwarded to bus 2 and vice versa
 const uint16_t ALLOUTPUT_PARAM_PASSTHROUGH = 1;
-bool alloutput_passthrough = false;
+SAFETY_STATE bool alloutput_passthrough = false;
 
 static safety_config alloutput_init(uint16_t param) {
   controls_allowed = true;
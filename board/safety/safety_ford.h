@@ -57,7 +57,7 @@ const CanMsg FORD_CANFD_LONG_TX_MSGS[] = {
 
 // warning: quality flags are not yet checked in openpilot's CAN parser,
 // this may be the cause of blocked messages
-RxCheck ford_rx_checks[] = {
+SAFETY_STATE RxCheck ford_rx_checks[] = {
   {.msg = {{FORD_BrakeSysFeatures, 0, 8, .check_checksum = true, .max_counter = 15U, .quality_flag=true, .frequency = 50U}, { 0 }, { 0 }}},
   // FORD_EngVehicleSpThrottle2 has a counter that either randomly skips or by 2, likely ECU bug
   // Some hybrid models also experience a bug where this checksum mismatches for one or two frames under heavy acceleration with ACC
@@ -140,8 +140,8 @@ static bool ford_get_quality_flag_valid(const CANPacket_t *to_push) {
 const uint16_t FORD_PARAM_LONGITUDINAL = 1;
 const uint16_t FORD_PARAM_CANFD = 2;
 
-bool ford_longitudinal = false;
-bool ford_canfd = false;
+SAFETY_STATE bool ford_longitudinal = false;
+SAFETY_STATE bool ford_canfd = false;
 
 const LongitudinalLimits FORD_LONG_LIMITS = {
   // acceleration cmd limits (used for brakes)
@@ -208,7 +208,7 @@ static void ford_rx_hook(const CANPacket_t *to_push) {
     // Update vehicle speed
     if (addr == FORD_BrakeSysFeatures) {
       // Signal: Veh_V_ActlBrk
-      UPDATE_VEHICLE_SPEED(((GET_BYTE(to_push, 0) << 8) | GET_BYTE(to_push, 1)) * 0.01 / 3.6);
+      UPDATE_VEHICLE_SPEED((GET_BYTE(to_push, 0) << 8) | GET_BYTE(to_push, 1), 5, 18);  // 0.01 / 3.6 m/s
     }
 
     // Check vehicle speed against a second source
@@ -216,7 +216,7 @@ static void ford_rx_hook(const CANPacket_t *to_push) {
       // Disable controls if speeds from ABS and PCM ECUs are too far apart.
       // Signal: Veh_V_ActlEng
       float filtered_pcm_speed = ((GET_BYTE(to_push, 6) << 8) | GET_BYTE(to_push, 7)) * 0.01 / 3.6;
-      bool is_invalid_speed = ABS(filtered_pcm_speed - ((float)vehicle_speed.values[0] / VEHICLE_SPEED_FACTOR)) > FORD_MAX_SPEED_DELTA;
+      bool is_invalid_speed = ABS(filtered_pcm_speed - ((float)sample_last(&vehicle_speed) / (double)VEHICLE_SPEED_FACTOR)) > FORD_MAX_SPEED_DELTA;
       if (is_invalid_speed) {
         controls_allowed_long = false;
       }
@@ -226,7 +226,7 @@ static void ford_rx_hook(const CANPacket_t *to_push) {
     if (addr == FORD_Yaw_Data_FD1) {
       // Signal: VehYaw_W_Actl
       float ford_yaw_rate = (((GET_BYTE(to_push, 2) << 8U) | GET_BYTE(to_push, 3)) * 0.0002) - 6.5;
-      float current_curvature = ford_yaw_rate / MAX(vehicle_speed.values[0] / VEHICLE_SPEED_FACTOR, 0.1);
+      float current_curvature = ford_yaw_rate / MAX(sample_last(&vehicle_speed) / (double)VEHICLE_SPEED_FACTOR, 0.1);
       // convert current curvature into units on CAN for comparison with desired curvature
       update_sample(&angle_meas, ROUND(current_curvature * FORD_STEERING_LIMITS.angle_deg_to_can));
     }
@@ -402,6 +402,7 @@ static safety_config ford_init(uint16_t param) {
   ford_longitudinal = GET_FLAG(param, FORD_PARAM_LONGITUDINAL);
   ford_canfd = GET_FLAG(param, FORD_PARAM_CANFD);
 #endif
+  angle_rate_limits_init(&FORD_STEERING_LIMITS);
 
   safety_config ret;
   if (ford_canfd) {
@@ -414,6 +415,13 @@ static safety_config ford_init(uint16_t param) {
   return ret;
 }
 
+// ford_rx_hook reads
+const int FORD_HOOK_ADDRS[] = {
+  FORD_EngBrakeData, FORD_EngVehicleSpThrottle, FORD_DesiredTorqBrk, FORD_BrakeSysFeatures,
+  FORD_EngVehicleSpThrottle2, FORD_Yaw_Data_FD1, FORD_ACCDATA, FORD_ACCDATA_3,
+  FORD_Lane_Assist_Data1, FORD_LateralMotionControl, FORD_LateralMotionControl2, FORD_IPMA_Data
+};
+
 const safety_hooks ford_hooks = {
   .init = ford_init,
   .rx = ford_rx_hook,
@@ -423,4 +431,6 @@ const safety_hooks ford_hooks = {
   .get_checksum = ford_get_checksum,
   .compute_checksum = ford_compute_checksum,
   .get_quality_flag_valid = ford_get_quality_flag_valid,
+  .hook_addrs = FORD_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(FORD_HOOK_ADDRS) / sizeof(FORD_HOOK_ADDRS[0]),
 };
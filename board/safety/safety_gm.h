@@ -23,7 +23,7 @@ const LongitudinalLimits GM_CAM_LONG_LIMITS = {
   .max_brake = 400,
 };
 
-const LongitudinalLimits *gm_long_limits;
+SAFETY_STATE const LongitudinalLimits *gm_long_limits;
 
 const int GM_STANDSTILL_THRSLD = 10;  // 0.311kph
 
@@ -38,7 +38,7 @@ const CanMsg GM_CAM_LONG_TX_MSGS[] = {{0x180, 0, 4}, {0x315, 0, 5}, {0x2CB, 0, 8
                                       {0x184, 2, 8}};  // camera bus
 
 // TODO: do checksum and counter checks. Add correct timestep, 0.1s for now.
-RxCheck gm_rx_checks[] = {
+SAFETY_STATE RxCheck gm_rx_checks[] = {
   {.msg = {{0x184, 0, 8, .frequency = 10U}, { 0 }, { 0 }}},
   {.msg = {{0x34A, 0, 5, .frequency = 10U}, { 0 }, { 0 }}},
   {.msg = {{0x1E1, 0, 7, .frequency = 10U}, { 0 }, { 0 }}},
@@ -63,9 +63,9 @@ typedef enum {
   GM_ASCM,
   GM_CAM
 } GmHardware;
-GmHardware gm_hw = GM_ASCM;
-bool gm_cam_long = false;
-bool gm_pcm_cruise = false;
+SAFETY_STATE GmHardware gm_hw = GM_ASCM;
+SAFETY_STATE bool gm_cam_long = false;
+SAFETY_STATE bool gm_pcm_cruise = false;
 
 static void gm_rx_hook(const CANPacket_t *to_push) {
   if (GET_BUS(to_push) == 0U) {
@@ -245,9 +245,14 @@ static safety_config gm_init(uint16_t param) {
   return ret;
 }
 
+// gm_rx_hook reads
+const int GM_HOOK_ADDRS[] = {0xBD, 0xBE, 0xC9, 0x180, 0x184, 0x1C4, 0x1E1, 0x2CB, 0x34A};
+
 const safety_hooks gm_hooks = {
   .init = gm_init,
   .rx = gm_rx_hook,
   .tx = gm_tx_hook,
   .fwd = gm_fwd_hook,
+  .hook_addrs = GM_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(GM_HOOK_ADDRS) / sizeof(GM_HOOK_ADDRS[0]),
 };
@@ -43,36 +43,36 @@ const LongitudinalLimits HONDA_NIDEC_LONG_LIMITS = {
 
 
 // Nidec and bosch radarless has the powertrain bus on bus 0
-RxCheck honda_common_rx_checks[] = {
+SAFETY_STATE RxCheck honda_common_rx_checks[] = {
   HONDA_COMMON_RX_CHECKS(0)
 };
 
-RxCheck honda_common_interceptor_rx_checks[] = {
+SAFETY_STATE RxCheck honda_common_interceptor_rx_checks[] = {
   HONDA_COMMON_RX_CHECKS(0)
   {.msg = {{0x201, 0, 6, .check_checksum = false, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
 };
 
-RxCheck honda_common_alt_brake_rx_checks[] = {
+SAFETY_STATE RxCheck honda_common_alt_brake_rx_checks[] = {
   HONDA_COMMON_RX_CHECKS(0)
   HONDA_ALT_BRAKE_ADDR_CHECK(0)
 };
 
 // For Nidecs with main on signal on an alternate msg (missing 0x326)
-RxCheck honda_nidec_alt_rx_checks[] = {
+SAFETY_STATE RxCheck honda_nidec_alt_rx_checks[] = {
   HONDA_COMMON_NO_SCM_FEEDBACK_RX_CHECKS(0)
 };
 
-RxCheck honda_nidec_alt_interceptor_rx_checks[] = {
+SAFETY_STATE RxCheck honda_nidec_alt_interceptor_rx_checks[] = {
   HONDA_COMMON_NO_SCM_FEEDBACK_RX_CHECKS(0)
   {.msg = {{0x201, 0, 6, .check_checksum = false, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
 };
 
 // Bosch has pt on bus 1, verified 0x1A6 does not exist
-RxCheck honda_bosch_rx_checks[] = {
+SAFETY_STATE RxCheck honda_bosch_rx_checks[] = {
   HONDA_COMMON_RX_CHECKS(1)
 };
 
-RxCheck honda_bosch_alt_brake_rx_checks[] = {
+SAFETY_STATE RxCheck honda_bosch_alt_brake_rx_checks[] = {
   HONDA_COMMON_RX_CHECKS(1)
   HONDA_ALT_BRAKE_ADDR_CHECK(1)
 };
@@ -92,15 +92,15 @@ enum {
   HONDA_BTN_RESUME = 4,
 };
 
-int honda_brake = 0;
-bool honda_brake_switch_prev = false;
-bool honda_alt_brake_msg = false;
-bool honda_fwd_brake = false;
-bool honda_bosch_long = false;
-bool honda_bosch_radarless = false;
-bool honda_clarity_brake_msg = false;
+SAFETY_STATE int honda_brake = 0;
+SAFETY_STATE bool honda_brake_switch_prev = false;
+SAFETY_STATE bool honda_alt_brake_msg = false;
+SAFETY_STATE bool honda_fwd_brake = false;
+SAFETY_STATE bool honda_bosch_long = false;
+SAFETY_STATE bool honda_bosch_radarless = false;
+SAFETY_STATE bool honda_clarity_brake_msg = false;
 typedef enum {HONDA_NIDEC, HONDA_BOSCH} HondaHw;
-HondaHw honda_hw = HONDA_NIDEC;
+SAFETY_STATE HondaHw honda_hw = HONDA_NIDEC;
 
 
 int honda_get_pt_bus(void) {
@@ -114,19 +114,9 @@ static uint32_t honda_get_checksum(const CANPacket_t *to_push) {
 
 static uint32_t honda_compute_checksum(const CANPacket_t *to_push) {
   int len = GET_LEN(to_push);
-  uint8_t checksum = 0U;
-  unsigned int addr = GET_ADDR(to_push);
-  while (addr > 0U) {
-    checksum += (uint8_t)(addr & 0xFU); addr >>= 4;
-  }
-  for (int j = 0; j < len; j++) {
-    uint8_t byte = GET_BYTE(to_push, j);
-    checksum += (uint8_t)(byte & 0xFU) + (byte >> 4U);
-    if (j == (len - 1)) {
-      checksum -= (byte & 0xFU);  // remove checksum in message
-    }
-  }
-  return (uint8_t)((8U - checksum) & 0xFU);
+  uint32_t checksum = sum_nibbles((uint32_t)GET_ADDR(to_push)) + sum_nibbles_bytes(to_push, 0, len);
+  checksum -= GET_BYTE(to_push, len - 1) & 0xFU;  // remove checksum in message
+  return (8U - checksum) & 0xFU;
 }
 
 static uint8_t honda_get_counter(const CANPacket_t *to_push) {
@@ -477,6 +467,9 @@ static int honda_bosch_fwd_hook(int bus_num, int addr) {
   return bus_fwd;
 }
 
+// honda_rx_hook reads
+const int HONDA_NIDEC_HOOK_ADDRS[] = {0xE4, 0x158, 0x17C, 0x194, 0x1A6, 0x1BE, 0x1DF, 0x1FA, 0x201, 0x296, 0x326};
+
 const safety_hooks honda_nidec_hooks = {
   .init = honda_nidec_init,
   .rx = honda_rx_hook,
@@ -485,8 +478,13 @@ const safety_hooks honda_nidec_hooks = {
   .get_counter = honda_get_counter,
   .get_checksum = honda_get_checksum,
   .compute_checksum = honda_compute_checksum,
+  .hook_addrs = HONDA_NIDEC_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(HONDA_NIDEC_HOOK_ADDRS) / sizeof(HONDA_NIDEC_HOOK_ADDRS[0]),
 };
 
+// honda_rx_hook reads, and the 29-bit LKAS HUD messages honda_bosch_fwd_hook blocks
+const int HONDA_BOSCH_HOOK_ADDRS[] = {0xE4, 0x158, 0x17C, 0x194, 0x1A6, 0x1BE, 0x1DF, 0x1FA, 0x201, 0x296, 0x326, 0x33DA, 0x33DB};
+
 const safety_hooks honda_bosch_hooks = {
   .init = honda_bosch_init,
   .rx = honda_rx_hook,
@@ -495,4 +493,6 @@ const safety_hooks honda_bosch_hooks = {
   .get_counter = honda_get_counter,
   .get_checksum = honda_get_checksum,
   .compute_checksum = honda_compute_checksum,
+  .hook_addrs = HONDA_BOSCH_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(HONDA_BOSCH_HOOK_ADDRS) / sizeof(HONDA_BOSCH_HOOK_ADDRS[0]),
 };
@@ -72,29 +72,29 @@ const CanMsg HYUNDAI_CAMERA_SCC_LONG_TX_MSGS[] = {
 #define HYUNDAI_SCC12_ADDR_CHECK(scc_bus)                                                                                  \
   {.msg = {{0x421, (scc_bus), 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}}, \
 
-RxCheck hyundai_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_rx_checks[] = {
    HYUNDAI_COMMON_RX_CHECKS(false)
    HYUNDAI_SCC12_ADDR_CHECK(0)
 };
 
-RxCheck hyundai_cam_scc_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_cam_scc_rx_checks[] = {
   HYUNDAI_COMMON_RX_CHECKS(false)
   HYUNDAI_SCC12_ADDR_CHECK(2)
 };
 
-RxCheck hyundai_long_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_long_rx_checks[] = {
   HYUNDAI_COMMON_RX_CHECKS(false)
   // Use CLU11 (buttons) to manage controls allowed instead of SCC cruise state
   {.msg = {{0x4F1, 0, 4, .check_checksum = false, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
 };
 
 // older hyundai models have less checks due to missing counters and checksums
-RxCheck hyundai_legacy_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_legacy_rx_checks[] = {
   HYUNDAI_COMMON_RX_CHECKS(true)
   HYUNDAI_SCC12_ADDR_CHECK(0)
 };
 
-RxCheck hyundai_non_scc_addr_checks[] = {
+SAFETY_STATE RxCheck hyundai_non_scc_addr_checks[] = {
   {.msg = {{0x260, 0, 8, .check_checksum = true, .max_counter = 3U, .frequency = 100U},
            {0x371, 0, 8, .frequency = 100U}, { 0 }}},
   {.msg = {{0x367, 0, 8, .frequency = 100U},
@@ -106,10 +106,10 @@ const int HYUNDAI_PARAM_LFA_BTN = 256;
 const int HYUNDAI_PARAM_ESCC = 512;
 const int HYUNDAI_PARAM_NON_SCC = 1024;
 
-bool hyundai_legacy = false;
-bool hyundai_lfa_button = false;
-bool hyundai_escc = false;
-bool hyundai_non_scc = false;
+SAFETY_STATE bool hyundai_legacy = false;
+SAFETY_STATE bool hyundai_lfa_button = false;
+SAFETY_STATE bool hyundai_escc = false;
+SAFETY_STATE bool hyundai_non_scc = false;
 
 
 static uint8_t hyundai_get_counter(const CANPacket_t *to_push) {
@@ -151,34 +151,26 @@ static uint32_t hyundai_get_checksum(const CANPacket_t *to_push) {
 static uint32_t hyundai_compute_checksum(const CANPacket_t *to_push) {
   int addr = GET_ADDR(to_push);
 
-  uint8_t chksum = 0;
+  uint32_t lo = get_word(to_push, 0);
+  uint32_t hi = get_word(to_push, 4);
+
+  uint32_t chksum;
   if (addr == 0x386) {
-    // count the bits
-    for (int i = 0; i < 8; i++) {
-      uint8_t b = GET_BYTE(to_push, i);
-      for (int j = 0; j < 8; j++) {
-        uint8_t bit = 0;
-        // exclude checksum and counter
-        if (((i != 1) || (j < 6)) && ((i != 3) || (j < 6)) && ((i != 5) || (j < 6)) && ((i != 7) || (j < 6))) {
-          bit = (b >> (uint8_t)j) & 1U;
-        }
-        chksum += bit;
-      }
-    }
+    // count the bits, excluding checksum and counter in the top two bits of bytes 1, 3, 5 and 7
+    chksum = count_bits(lo & 0x3FFF3FFFU) + count_bits(hi & 0x3FFF3FFFU);
     chksum = (chksum ^ 9U) & 15U;
   } else {
-    // sum of nibbles
-    for (int i = 0; i < 8; i++) {
-      if ((addr == 0x394) && (i == 7)) {
-        continue; // exclude
-      }
-      uint8_t b = GET_BYTE(to_push, i);
-      if (((addr == 0x260) && (i == 7)) || ((addr == 0x394) && (i == 6)) || ((addr == 0x421) && (i == 7))) {
-        b &= (addr == 0x421) ? 0x0FU : 0xF0U; // remove checksum
-      }
-      chksum += (b % 16U) + (b / 16U);
+    // sum of nibbles, without the checksum
+    if (addr == 0x394) {
+      hi &= 0x00F0FFFFU;
+    } else if (addr == 0x260) {
+      hi &= 0xF0FFFFFFU;
+    } else if (addr == 0x421) {
+      hi &= 0x0FFFFFFFU;
+    } else {
     }
-    chksum = (16U - (chksum %  16U)) % 16U;
+    chksum = sum_nibbles(lo) + sum_nibbles(hi);
+    chksum = (16U - (chksum % 16U)) % 16U;
   }
 
   return chksum;
@@ -197,7 +189,7 @@ static void hyundai_rx_hook(const CANPacket_t *to_push) {
     }
     if (addr == 0x421) {
       // 2 bits: 13-14
-      int cruise_engaged = (GET_BYTES(to_push, 0, 4) >> 13) & 0x3U;
+      int cruise_engaged = (get_word(to_push, 0) >> 13) & 0x3U;
       hyundai_common_cruise_state_check(cruise_engaged);
     }
   }
@@ -250,9 +242,9 @@ static void hyundai_rx_hook(const CANPacket_t *to_push) {
       } else {
       }
 
-      acc_main_on = (hyundai_ev_gas_signal || hyundai_hybrid_gas_signal) ? GET_BIT(to_push, 50U) : GET_BIT(to_push, 25U);
       if (((addr == 0x595) && (hyundai_ev_gas_signal || hyundai_hybrid_gas_signal)) ||
           ((addr == 0x260) && !hyundai_ev_gas_signal && !hyundai_hybrid_gas_signal)) {
+        acc_main_on = (hyundai_ev_gas_signal || hyundai_hybrid_gas_signal) ? GET_BIT(to_push, 50U) : GET_BIT(to_push, 25U);
         mads_acc_main_check(acc_main_on);
       } else {
       }
@@ -416,6 +408,9 @@ static safety_config hyundai_legacy_init(uint16_t param) {
   return BUILD_SAFETY_CFG(hyundai_legacy_rx_checks, HYUNDAI_TX_MSGS);
 }
 
+// hyundai_rx_hook reads, for all variants
+const int HYUNDAI_HOOK_ADDRS[] = {0x251, 0x260, 0x340, 0x367, 0x371, 0x386, 0x391, 0x394, 0x420, 0x421, 0x4F1, 0x595};
+
 const safety_hooks hyundai_hooks = {
   .init = hyundai_init,
   .rx = hyundai_rx_hook,
@@ -424,6 +419,8 @@ const safety_hooks hyundai_hooks = {
   .get_counter = hyundai_get_counter,
   .get_checksum = hyundai_get_checksum,
   .compute_checksum = hyundai_compute_checksum,
+  .hook_addrs = HYUNDAI_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(HYUNDAI_HOOK_ADDRS) / sizeof(HYUNDAI_HOOK_ADDRS[0]),
 };
 
 const safety_hooks hyundai_legacy_hooks = {
@@ -434,4 +431,6 @@ const safety_hooks hyundai_legacy_hooks = {
   .get_counter = hyundai_get_counter,
   .get_checksum = hyundai_get_checksum,
   .compute_checksum = hyundai_compute_checksum,
+  .hook_addrs = HYUNDAI_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(HYUNDAI_HOOK_ADDRS) / sizeof(HYUNDAI_HOOK_ADDRS[0]),
 };
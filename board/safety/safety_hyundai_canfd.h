@@ -78,34 +78,34 @@ const CanMsg HYUNDAI_CANFD_HDA1_TX_MSGS[] = {
 // *** Non-HDA2 checks ***
 // Camera sends SCC messages on HDA1.
 // Both button messages exist on some platforms, so we ensure we track the correct one using flag
-RxCheck hyundai_canfd_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_canfd_rx_checks[] = {
   HYUNDAI_CANFD_COMMON_RX_CHECKS(0)
   HYUNDAI_CANFD_BUTTONS_ADDR_CHECK(0)
   HYUNDAI_CANFD_SCC_ADDR_CHECK(2)
 };
-RxCheck hyundai_canfd_alt_buttons_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_canfd_alt_buttons_rx_checks[] = {
   HYUNDAI_CANFD_COMMON_RX_CHECKS(0)
   HYUNDAI_CANFD_ALT_BUTTONS_ADDR_CHECK(0)
   HYUNDAI_CANFD_SCC_ADDR_CHECK(2)
 };
 
 // Longitudinal checks for HDA1
-RxCheck hyundai_canfd_long_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_canfd_long_rx_checks[] = {
   HYUNDAI_CANFD_COMMON_RX_CHECKS(0)
   HYUNDAI_CANFD_BUTTONS_ADDR_CHECK(0)
 };
-RxCheck hyundai_canfd_long_alt_buttons_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_canfd_long_alt_buttons_rx_checks[] = {
   HYUNDAI_CANFD_COMMON_RX_CHECKS(0)
   HYUNDAI_CANFD_ALT_BUTTONS_ADDR_CHECK(0)
 };
 
 // Radar sends SCC messages on these cars instead of camera
-RxCheck hyundai_canfd_radar_scc_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_canfd_radar_scc_rx_checks[] = {
   HYUNDAI_CANFD_COMMON_RX_CHECKS(0)
   HYUNDAI_CANFD_BUTTONS_ADDR_CHECK(0)
   HYUNDAI_CANFD_SCC_ADDR_CHECK(0)
 };
-RxCheck hyundai_canfd_radar_scc_alt_buttons_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_canfd_radar_scc_alt_buttons_rx_checks[] = {
   HYUNDAI_CANFD_COMMON_RX_CHECKS(0)
   HYUNDAI_CANFD_ALT_BUTTONS_ADDR_CHECK(0)
   HYUNDAI_CANFD_SCC_ADDR_CHECK(0)
@@ -115,12 +115,12 @@ RxCheck hyundai_canfd_radar_scc_alt_buttons_rx_checks[] = {
 // *** HDA2 checks ***
 // E-CAN is on bus 1, ADAS unit sends SCC messages on HDA2.
 // Does not use the alt buttons message
-RxCheck hyundai_canfd_hda2_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_canfd_hda2_rx_checks[] = {
   HYUNDAI_CANFD_COMMON_RX_CHECKS(1)
   HYUNDAI_CANFD_BUTTONS_ADDR_CHECK(1)
   HYUNDAI_CANFD_SCC_ADDR_CHECK(1)
 };
-RxCheck hyundai_canfd_hda2_long_rx_checks[] = {
+SAFETY_STATE RxCheck hyundai_canfd_hda2_long_rx_checks[] = {
   HYUNDAI_CANFD_COMMON_RX_CHECKS(1)
   HYUNDAI_CANFD_BUTTONS_ADDR_CHECK(1)
 };
@@ -129,8 +129,8 @@ RxCheck hyundai_canfd_hda2_long_rx_checks[] = {
 
 const int HYUNDAI_PARAM_CANFD_ALT_BUTTONS = 32;
 const int HYUNDAI_PARAM_CANFD_HDA2_ALT_STEERING = 128;
-bool hyundai_canfd_alt_buttons = false;
-bool hyundai_canfd_hda2_alt_steering = false;
+SAFETY_STATE bool hyundai_canfd_alt_buttons = false;
+SAFETY_STATE bool hyundai_canfd_hda2_alt_steering = false;
 
 
 int hyundai_canfd_hda2_get_lkas_addr(void) {
@@ -324,7 +324,6 @@ static int hyundai_canfd_fwd_hook(int bus_num, int addr) {
 static safety_config hyundai_canfd_init(uint16_t param) {
   hyundai_common_init(param);
 
-  gen_crc_lookup_table_16(0x1021, hyundai_canfd_crc_lut);
   hyundai_canfd_alt_buttons = GET_FLAG(param, HYUNDAI_PARAM_CANFD_ALT_BUTTONS);
   hyundai_canfd_hda2_alt_steering = GET_FLAG(param, HYUNDAI_PARAM_CANFD_HDA2_ALT_STEERING);
 
@@ -357,6 +356,9 @@ static safety_config hyundai_canfd_init(uint16_t param) {
   return ret;
 }
 
+// hyundai_canfd_rx_hook reads, for all variants
+const int HYUNDAI_CANFD_HOOK_ADDRS[] = {0x35, 0x50, 0xa0, 0xea, 0x100, 0x105, 0x110, 0x12a, 0x175, 0x1a0, 0x1aa, 0x1cf};
+
 const safety_hooks hyundai_canfd_hooks = {
   .init = hyundai_canfd_init,
   .rx = hyundai_canfd_rx_hook,
@@ -365,4 +367,6 @@ const safety_hooks hyundai_canfd_hooks = {
   .get_counter = hyundai_canfd_get_counter,
   .get_checksum = hyundai_canfd_get_checksum,
   .compute_checksum = hyundai_common_canfd_compute_checksum,
+  .hook_addrs = HYUNDAI_CANFD_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(HYUNDAI_CANFD_HOOK_ADDRS) / sizeof(HYUNDAI_CANFD_HOOK_ADDRS[0]),
 };
@@ -20,15 +20,13 @@ enum {
 };
 
 // common state
-bool hyundai_ev_gas_signal = false;
-bool hyundai_hybrid_gas_signal = false;
-bool hyundai_longitudinal = false;
-bool hyundai_camera_scc = false;
-bool hyundai_canfd_hda2 = false;
-bool hyundai_alt_limits = false;
-uint8_t hyundai_last_button_interaction;  // button messages since the user pressed an enable button
-
-uint16_t hyundai_canfd_crc_lut[256];
+SAFETY_STATE bool hyundai_ev_gas_signal = false;
+SAFETY_STATE bool hyundai_hybrid_gas_signal = false;
+SAFETY_STATE bool hyundai_longitudinal = false;
+SAFETY_STATE bool hyundai_camera_scc = false;
+SAFETY_STATE bool hyundai_canfd_hda2 = false;
+SAFETY_STATE bool hyundai_alt_limits = false;
+SAFETY_STATE uint8_t hyundai_last_button_interaction;  // button messages since the user pressed an enable button
 
 void hyundai_common_init(uint16_t param) {
   hyundai_ev_gas_signal = GET_FLAG(param, HYUNDAI_PARAM_EV_GAS);
@@ -97,12 +95,12 @@ uint32_t hyundai_common_canfd_compute_checksum(const CANPacket_t *to_push) {
   uint16_t crc = 0;
 
   for (int i = 2; i < len; i++) {
-    crc = (crc << 8U) ^ hyundai_canfd_crc_lut[(crc >> 8U) ^ GET_BYTE(to_push, i)];
+    crc = (crc << 8U) ^ crc16_lut_xmodem[(crc >> 8U) ^ GET_BYTE(to_push, i)];
   }
 
   // Add address to crc
-  crc = (crc << 8U) ^ hyundai_canfd_crc_lut[(crc >> 8U) ^ ((address >> 0U) & 0xFFU)];
-  crc = (crc << 8U) ^ hyundai_canfd_crc_lut[(crc >> 8U) ^ ((address >> 8U) & 0xFFU)];
+  crc = (crc << 8U) ^ crc16_lut_xmodem[(crc >> 8U) ^ ((address >> 0U) & 0xFFU)];
+  crc = (crc << 8U) ^ crc16_lut_xmodem[(crc >> 8U) ^ ((address >> 8U) & 0xFFU)];
 
   if (len == 24) {
     crc ^= 0x819dU;
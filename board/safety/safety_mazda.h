@@ -25,7 +25,7 @@ const SteeringLimits MAZDA_STEERING_LIMITS = {
 
 const CanMsg MAZDA_TX_MSGS[] = {{MAZDA_LKAS, 0, 8}, {MAZDA_CRZ_BTNS, 0, 8}, {MAZDA_LKAS_HUD, 0, 8}};
 
-RxCheck mazda_rx_checks[] = {
+SAFETY_STATE RxCheck mazda_rx_checks[] = {
   {.msg = {{MAZDA_CRZ_CTRL,     0, 8, .frequency = 50U}, { 0 }, { 0 }}},
   {.msg = {{MAZDA_CRZ_BTNS,     0, 8, .frequency = 10U}, { 0 }, { 0 }}},
   {.msg = {{MAZDA_STEER_TORQUE, 0, 8, .frequency = 83U}, { 0 }, { 0 }}},
@@ -128,9 +128,14 @@ static safety_config mazda_init(uint16_t param) {
   return BUILD_SAFETY_CFG(mazda_rx_checks, MAZDA_TX_MSGS);
 }
 
+// mazda_rx_hook reads
+const int MAZDA_HOOK_ADDRS[] = {MAZDA_PEDALS, MAZDA_ENGINE_DATA, MAZDA_CRZ_CTRL, MAZDA_STEER_TORQUE, MAZDA_LKAS};
+
 const safety_hooks mazda_hooks = {
   .init = mazda_init,
   .rx = mazda_rx_hook,
   .tx = mazda_tx_hook,
   .fwd = mazda_fwd_hook,
+  .hook_addrs = MAZDA_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(MAZDA_HOOK_ADDRS) / sizeof(MAZDA_HOOK_ADDRS[0]),
 };
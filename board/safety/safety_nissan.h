@@ -20,7 +20,7 @@ const CanMsg NISSAN_TX_MSGS[] = {
 };
 
 // Signals duplicated below due to the fact that these messages can come in on either CAN bus, depending on car model.
-RxCheck nissan_rx_checks[] = {
+SAFETY_STATE RxCheck nissan_rx_checks[] = {
   {.msg = {{0x2, 0, 5, .frequency = 100U},
            {0x2, 1, 5, .frequency = 100U}, { 0 }}},  // STEER_ANGLE_SENSOR
   {.msg = {{0x285, 0, 8, .frequency = 50U},
@@ -38,7 +38,7 @@ RxCheck nissan_rx_checks[] = {
 // EPS Location. false = V-CAN, true = C-CAN
 const int NISSAN_PARAM_ALT_EPS_BUS = 1;
 
-bool nissan_alt_eps = false;
+SAFETY_STATE bool nissan_alt_eps = false;
 
 static void nissan_rx_hook(const CANPacket_t *to_push) {
   int bus = GET_BUS(to_push);
@@ -61,7 +61,7 @@ static void nissan_rx_hook(const CANPacket_t *to_push) {
       uint16_t right_rear = (GET_BYTE(to_push, 0) << 8) | (GET_BYTE(to_push, 1));
       uint16_t left_rear = (GET_BYTE(to_push, 2) << 8) | (GET_BYTE(to_push, 3));
       vehicle_moving = (right_rear | left_rear) != 0U;
-      UPDATE_VEHICLE_SPEED((right_rear + left_rear) / 2.0 * 0.005 / 3.6);
+      UPDATE_VEHICLE_SPEED(right_rear + left_rear, 5, 72);  // (right_rear + left_rear) / 2 * 0.005 / 3.6 m/s
     }
 
     // X-Trail 0x15c, Leaf 0x239
@@ -158,12 +158,18 @@ static int nissan_fwd_hook(int bus_num, int addr) {
 
 static safety_config nissan_init(uint16_t param) {
   nissan_alt_eps = GET_FLAG(param, NISSAN_PARAM_ALT_EPS_BUS);
+  angle_rate_limits_init(&NISSAN_STEERING_LIMITS);
   return BUILD_SAFETY_CFG(nissan_rx_checks, NISSAN_TX_MSGS);
 }
 
+// nissan_rx_hook reads
+const int NISSAN_HOOK_ADDRS[] = {0x2, 0x15c, 0x169, 0x1B6, 0x239, 0x285, 0x30f, 0x454};
+
 const safety_hooks nissan_hooks = {
   .init = nissan_init,
   .rx = nissan_rx_hook,
   .tx = nissan_tx_hook,
   .fwd = nissan_fwd_hook,
+  .hook_addrs = NISSAN_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(NISSAN_HOOK_ADDRS) / sizeof(NISSAN_HOOK_ADDRS[0]),
 };
@@ -104,11 +104,11 @@ const CanMsg SUBARU_GEN2_LONG_TX_MSGS[] = {
   SUBARU_GEN2_LONG_ADDITIONAL_TX_MSGS()
 };
 
-RxCheck subaru_rx_checks[] = {
+SAFETY_STATE RxCheck subaru_rx_checks[] = {
   SUBARU_COMMON_RX_CHECKS(SUBARU_MAIN_BUS)
 };
 
-RxCheck subaru_gen2_rx_checks[] = {
+SAFETY_STATE RxCheck subaru_gen2_rx_checks[] = {
   SUBARU_COMMON_RX_CHECKS(SUBARU_ALT_BUS)
 };
 
@@ -118,10 +118,10 @@ const uint16_t SUBARU_PARAM_LONGITUDINAL = 2;
 const uint16_t SUBARU_PARAM_MAX_STEER_2018 = 4;
 const uint16_t SUBARU_PARAM_SNG = 1024;
 
-bool subaru_gen2 = false;
-bool subaru_longitudinal = false;
-bool subaru_max_steer_2018_crosstrek = false;
-bool subaru_sng = false;
+SAFETY_STATE bool subaru_gen2 = false;
+SAFETY_STATE bool subaru_longitudinal = false;
+SAFETY_STATE bool subaru_max_steer_2018_crosstrek = false;
+SAFETY_STATE bool subaru_sng = false;
 
 
 static uint32_t subaru_get_checksum(const CANPacket_t *to_push) {
@@ -182,7 +182,7 @@ static void subaru_rx_hook(const CANPacket_t *to_push) {
 
     vehicle_moving = (fr > 0U) || (rr > 0U) || (rl > 0U) || (fl > 0U);
 
-    UPDATE_VEHICLE_SPEED((fr + rr + rl + fl) / 4U * 0.057);
+    UPDATE_VEHICLE_SPEED((int)((fr + rr + rl + fl) / 4U), 57, 10);  // 0.057 m/s
   }
 
   if ((addr == MSG_SUBARU_Brake_Status) && (bus == alt_main_bus)) {
@@ -310,6 +310,12 @@ static safety_config subaru_init(uint16_t param) {
   return ret;
 }
 
+// subaru_rx_hook reads
+const int SUBARU_HOOK_ADDRS[] = {
+  MSG_SUBARU_Throttle, MSG_SUBARU_Steering_Torque, MSG_SUBARU_ES_LKAS, MSG_SUBARU_Wheel_Speeds,
+  MSG_SUBARU_Brake_Status, MSG_SUBARU_CruiseControl, MSG_SUBARU_ES_LKAS_State
+};
+
 const safety_hooks subaru_hooks = {
   .init = subaru_init,
   .rx = subaru_rx_hook,
@@ -318,4 +324,6 @@ const safety_hooks subaru_hooks = {
   .get_counter = subaru_get_counter,
   .get_checksum = subaru_get_checksum,
   .compute_checksum = subaru_compute_checksum,
+  .hook_addrs = SUBARU_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(SUBARU_HOOK_ADDRS) / sizeof(SUBARU_HOOK_ADDRS[0]),
 };
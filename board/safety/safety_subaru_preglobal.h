@@ -31,7 +31,7 @@ const CanMsg SUBARU_PG_TX_MSGS[] = {
 };
 
 // TODO: do checksum and counter checks after adding the signals to the outback dbc file
-RxCheck subaru_preglobal_rx_checks[] = {
+SAFETY_STATE RxCheck subaru_preglobal_rx_checks[] = {
   {.msg = {{MSG_SUBARU_PG_Throttle,        SUBARU_PG_MAIN_BUS, 8, .frequency = 100U}, { 0 }, { 0 }}},
   {.msg = {{MSG_SUBARU_PG_Steering_Torque, SUBARU_PG_MAIN_BUS, 8, .frequency = 50U}, { 0 }, { 0 }}},
   {.msg = {{MSG_SUBARU_PG_CruiseControl,   SUBARU_PG_MAIN_BUS, 8, .frequency = 20U}, { 0 }, { 0 }}},
@@ -40,8 +40,8 @@ RxCheck subaru_preglobal_rx_checks[] = {
 
 const int SUBARU_PG_PARAM_REVERSED_DRIVER_TORQUE = 1;
 const uint16_t SUBARU_PG_PARAM_SNG = 1024;
-bool subaru_pg_reversed_driver_torque = false;
-bool subaru_pg_sng = false;
+SAFETY_STATE bool subaru_pg_reversed_driver_torque = false;
+SAFETY_STATE bool subaru_pg_sng = false;
 
 
 static void subaru_preglobal_rx_hook(const CANPacket_t *to_push) {
@@ -135,9 +135,17 @@ static safety_config subaru_preglobal_init(uint16_t param) {
   return BUILD_SAFETY_CFG(subaru_preglobal_rx_checks, SUBARU_PG_TX_MSGS);
 }
 
+// subaru_preglobal_rx_hook reads
+const int SUBARU_PG_HOOK_ADDRS[] = {
+  MSG_SUBARU_PG_Brake_Pedal, MSG_SUBARU_PG_Wheel_Speeds, MSG_SUBARU_PG_Throttle,
+  MSG_SUBARU_PG_CruiseControl, MSG_SUBARU_PG_ES_LKAS, MSG_SUBARU_PG_Steering_Torque
+};
+
 const safety_hooks subaru_preglobal_hooks = {
   .init = subaru_preglobal_init,
   .rx = subaru_preglobal_rx_hook,
   .tx = subaru_preglobal_tx_hook,
   .fwd = subaru_preglobal_fwd_hook,
+  .hook_addrs = SUBARU_PG_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(SUBARU_PG_HOOK_ADDRS) / sizeof(SUBARU_PG_HOOK_ADDRS[0]),
 };
@@ -32,7 +32,7 @@ const CanMsg TESLA_PT_TX_MSGS[] = {
   {0x2bf, 0, 8},  // DAS_control
 };
 
-RxCheck tesla_rx_checks[] = {
+SAFETY_STATE RxCheck tesla_rx_checks[] = {
   {.msg = {{0x2b9, 2, 8, .frequency = 25U}, { 0 }, { 0 }}},   // DAS_control
   {.msg = {{0x370, 0, 8, .frequency = 25U}, { 0 }, { 0 }}},   // EPAS_sysStatus
   {.msg = {{0x108, 0, 8, .frequency = 100U}, { 0 }, { 0 }}},  // DI_torque1
@@ -42,7 +42,7 @@ RxCheck tesla_rx_checks[] = {
   {.msg = {{0x318, 0, 8, .frequency = 10U}, { 0 }, { 0 }}},   // GTW_carState
 };
 
-RxCheck tesla_raven_rx_checks[] = {
+SAFETY_STATE RxCheck tesla_raven_rx_checks[] = {
   {.msg = {{0x2b9, 2, 8, .frequency = 25U}, { 0 }, { 0 }}},   // DAS_control
   {.msg = {{0x131, 2, 8, .frequency = 100U}, { 0 }, { 0 }}},  // EPAS3P_sysStatus
   {.msg = {{0x108, 0, 8, .frequency = 100U}, { 0 }, { 0 }}},  // DI_torque1
@@ -52,7 +52,7 @@ RxCheck tesla_raven_rx_checks[] = {
   {.msg = {{0x318, 0, 8, .frequency = 10U}, { 0 }, { 0 }}},   // GTW_carState
 };
 
-RxCheck tesla_pt_rx_checks[] = {
+SAFETY_STATE RxCheck tesla_pt_rx_checks[] = {
   {.msg = {{0x106, 0, 8, .frequency = 100U}, { 0 }, { 0 }}},  // DI_torque1
   {.msg = {{0x116, 0, 6, .frequency = 100U}, { 0 }, { 0 }}},  // DI_torque2
   {.msg = {{0x1f8, 0, 8, .frequency = 50U}, { 0 }, { 0 }}},   // BrakeMessage
@@ -60,11 +60,11 @@ RxCheck tesla_pt_rx_checks[] = {
   {.msg = {{0x256, 0, 8, .frequency = 10U}, { 0 }, { 0 }}},   // DI_state
 };
 
-bool tesla_longitudinal = false;
-bool tesla_powertrain = false;  // Are we the second panda intercepting the powertrain bus?
-bool tesla_raven = false;
+SAFETY_STATE bool tesla_longitudinal = false;
+SAFETY_STATE bool tesla_powertrain = false;  // Are we the second panda intercepting the powertrain bus?
+SAFETY_STATE bool tesla_raven = false;
 
-bool tesla_stock_aeb = false;
+SAFETY_STATE bool tesla_stock_aeb = false;
 
 static void tesla_rx_hook(const CANPacket_t *to_push) {
   int bus = GET_BUS(to_push);
@@ -82,9 +82,9 @@ static void tesla_rx_hook(const CANPacket_t *to_push) {
   if(bus == 0) {
     if(addr == (tesla_powertrain ? 0x116 : 0x118)) {
       // Vehicle speed: ((0.05 * val) - 25) * MPH_TO_MPS
-      float speed = (((((GET_BYTE(to_push, 3) & 0x0FU) << 8) | (GET_BYTE(to_push, 2))) * 0.05) - 25) * 0.447;
-      vehicle_moving = ABS(speed) > 0.1;
-      UPDATE_VEHICLE_SPEED(speed);
+      int speed = (int)((((GET_BYTE(to_push, 3) & 0x0FU) << 8) | (GET_BYTE(to_push, 2)))) - 500;
+      UPDATE_VEHICLE_SPEED(speed, 447, 200);  // 0.05 * 0.447 m/s
+      vehicle_moving = ABS(sample_last(&vehicle_speed)) > 10;  // 0.1 m/s
     }
 
     if(addr == (tesla_powertrain ? 0x106 : 0x108)) {
@@ -221,6 +221,7 @@ static safety_config tesla_init(uint16_t param) {
   tesla_raven = GET_FLAG(param, TESLA_FLAG_RAVEN);
 
   tesla_stock_aeb = false;
+  angle_rate_limits_init(&TESLA_STEERING_LIMITS);
 
   safety_config ret;
   if (tesla_powertrain) {
@@ -233,9 +234,14 @@ static safety_config tesla_init(uint16_t param) {
   return ret;
 }
 
+// tesla_rx_hook reads, on all platforms
+const int TESLA_HOOK_ADDRS[] = {0x106, 0x108, 0x116, 0x118, 0x131, 0x1f8, 0x20a, 0x256, 0x2b9, 0x2bf, 0x368, 0x370, 0x488};
+
 const safety_hooks tesla_hooks = {
   .init = tesla_init,
   .rx = tesla_rx_hook,
   .tx = tesla_tx_hook,
   .fwd = tesla_fwd_hook,
+  .hook_addrs = TESLA_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(TESLA_HOOK_ADDRS) / sizeof(TESLA_HOOK_ADDRS[0]),
 };
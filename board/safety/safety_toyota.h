@@ -74,21 +74,21 @@ const CanMsg TOYOTA_INTERCEPTOR_TX_MSGS[] = {
   {.msg = {{0x224, 0, 8, .check_checksum = false, .frequency = 40U},                                        \
            {0x226, 0, 8, .check_checksum = false, .frequency = 40U}, { 0 }}},                               \
 
-RxCheck toyota_lka_rx_checks[] = {
+SAFETY_STATE RxCheck toyota_lka_rx_checks[] = {
   TOYOTA_COMMON_RX_CHECKS(false)
 };
 
-RxCheck toyota_lka_interceptor_rx_checks[] = {
+SAFETY_STATE RxCheck toyota_lka_interceptor_rx_checks[] = {
   TOYOTA_COMMON_RX_CHECKS(false)
   {.msg = {{0x201, 0, 6, .check_checksum = false, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
 };
 
 // Check the quality flag for angle measurement when using LTA, since it's not set on TSS-P cars
-RxCheck toyota_lta_rx_checks[] = {
+SAFETY_STATE RxCheck toyota_lta_rx_checks[] = {
   TOYOTA_COMMON_RX_CHECKS(true)
 };
 
-RxCheck toyota_lta_interceptor_rx_checks[] = {
+SAFETY_STATE RxCheck toyota_lta_interceptor_rx_checks[] = {
   TOYOTA_COMMON_RX_CHECKS(true)
   {.msg = {{0x201, 0, 6, .check_checksum = false, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
 };
@@ -105,14 +105,14 @@ const uint32_t TOYOTA_PARAM_GAS_INTERCEPTOR = 8UL << TOYOTA_PARAM_OFFSET;
 const uint32_t TOYOTA_PARAM_SDSU = 64U << TOYOTA_PARAM_OFFSET;
 const uint32_t TOYOTA_PARAM_UNSUPPORTED_DSU_CAR = 128U << TOYOTA_PARAM_OFFSET;
 
-bool toyota_alt_brake = false;
-bool toyota_stock_longitudinal = false;
-bool toyota_lta = false;
-int toyota_dbc_eps_torque_factor = 100;   // conversion factor for STEER_TORQUE_EPS in %: see dbc file
+SAFETY_STATE bool toyota_alt_brake = false;
+SAFETY_STATE bool toyota_stock_longitudinal = false;
+SAFETY_STATE bool toyota_lta = false;
+SAFETY_STATE int toyota_dbc_eps_torque_factor = 100;   // conversion factor for STEER_TORQUE_EPS in %: see dbc file
 
-bool toyota_mads_lta_msg = false;
-bool toyota_unsupported_dsu_car = false;
-bool toyota_sdsu = false;
+SAFETY_STATE bool toyota_mads_lta_msg = false;
+SAFETY_STATE bool toyota_unsupported_dsu_car = false;
+SAFETY_STATE bool toyota_sdsu = false;
 
 static uint32_t toyota_compute_checksum(const CANPacket_t *to_push) {
   int addr = GET_ADDR(to_push);
@@ -173,12 +173,8 @@ static void toyota_rx_hook(const CANPacket_t *to_push) {
       // scale by dbc_factor
       torque_meas_new = (torque_meas_new * toyota_dbc_eps_torque_factor) / 100;
 
-      // update array of sample
-      update_sample(&torque_meas, torque_meas_new);
-
-      // increase torque_meas by 1 to be conservative on rounding
-      torque_meas.min--;
-      torque_meas.max++;
+      // update array of sample, widened by 1 to be conservative on rounding
+      update_sample_margin(&torque_meas, torque_meas_new, 1);
 
       // driver torque for angle limiting
       int torque_driver_new = (GET_BYTE(to_push, 1) << 8) | GET_BYTE(to_push, 2);
@@ -229,7 +225,7 @@ static void toyota_rx_hook(const CANPacket_t *to_push) {
       // check that all wheel speeds are at zero value
       vehicle_moving = speed != 0;
 
-      UPDATE_VEHICLE_SPEED(speed / 4.0 * 0.01 / 3.6);
+      UPDATE_VEHICLE_SPEED(speed, 5, 72);  // speed / 4 * 0.01 / 3.6 m/s
     }
 
     // most cars have brake_pressed on 0x226, corolla and rav4 on 0x224
@@ -405,6 +401,7 @@ static safety_config toyota_init(uint16_t param) {
   toyota_mads_lta_msg = false;
   toyota_unsupported_dsu_car = GET_FLAG(param, TOYOTA_PARAM_UNSUPPORTED_DSU_CAR);
   toyota_sdsu = GET_FLAG(param, TOYOTA_PARAM_SDSU);
+  angle_rate_limits_init(&TOYOTA_STEERING_LIMITS);
 
   // Gas interceptor should not be used if openpilot is not controlling longitudinal
   if (toyota_stock_longitudinal) {
@@ -452,6 +449,9 @@ static int toyota_fwd_hook(int bus_num, int addr) {
   return bus_fwd;
 }
 
+// toyota_rx_hook reads
+const int TOYOTA_HOOK_ADDRS[] = {0xaa, 0x1D2, 0x1D3, 0x201, 0x224, 0x226, 0x260, 0x2E4, 0x343, 0x365, 0x412};
+
 const safety_hooks toyota_hooks = {
   .init = toyota_init,
   .rx = toyota_rx_hook,
@@ -461,4 +461,6 @@ const safety_hooks toyota_hooks = {
   .compute_checksum = toyota_compute_checksum,
   .get_counter = toyota_get_counter,
   .get_quality_flag_valid = toyota_get_quality_flag_valid,
+  .hook_addrs = TOYOTA_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(TOYOTA_HOOK_ADDRS) / sizeof(TOYOTA_HOOK_ADDRS[0]),
 };
@@ -3,8 +3,8 @@
 
 const uint16_t FLAG_VOLKSWAGEN_LONG_CONTROL = 1;
 
-bool volkswagen_longitudinal = false;
-bool volkswagen_set_button_prev = false;
-bool volkswagen_resume_button_prev = false;
+SAFETY_STATE bool volkswagen_longitudinal = false;
+SAFETY_STATE bool volkswagen_set_button_prev = false;
+SAFETY_STATE bool volkswagen_resume_button_prev = false;
 
 #endif
@@ -40,7 +40,7 @@ const CanMsg VOLKSWAGEN_MQB_STOCK_TX_MSGS[] = {{MSG_HCA_01, 0, 8}, {MSG_PLA_01,
 const CanMsg VOLKSWAGEN_MQB_LONG_TX_MSGS[] = {{MSG_HCA_01, 0, 8}, {MSG_LDW_02, 0, 8}, {MSG_LH_EPS_03, 2, 8},
                                               {MSG_ACC_02, 0, 8}, {MSG_ACC_06, 0, 8}, {MSG_ACC_07, 0, 8}};
 
-RxCheck volkswagen_mqb_rx_checks[] = {
+SAFETY_STATE RxCheck volkswagen_mqb_rx_checks[] = {
   {.msg = {{MSG_ESP_19, 0, 8, .check_checksum = false, .max_counter = 0U, .frequency = 100U}, { 0 }, { 0 }}},
   {.msg = {{MSG_LH_EPS_03, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 100U}, { 0 }, { 0 }}},
   {.msg = {{MSG_ESP_05, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 50U}, { 0 }, { 0 }}},
@@ -50,9 +50,8 @@ RxCheck volkswagen_mqb_rx_checks[] = {
   {.msg = {{MSG_GRA_ACC_01, 0, 8, .check_checksum = true, .max_counter = 15U, .frequency = 33U}, { 0 }, { 0 }}},
 };
 
-uint8_t volkswagen_crc8_lut_8h2f[256]; // Static lookup table for CRC8 poly 0x2F, aka 8H2F/AUTOSAR
-bool volkswagen_mqb_brake_pedal_switch = false;
-bool volkswagen_mqb_brake_pressure_detected = false;
+SAFETY_STATE bool volkswagen_mqb_brake_pedal_switch = false;
+SAFETY_STATE bool volkswagen_mqb_brake_pressure_detected = false;
 
 static uint32_t volkswagen_mqb_get_checksum(const CANPacket_t *to_push) {
   return (uint8_t)GET_BYTE(to_push, 0);
@@ -73,7 +72,7 @@ static uint32_t volkswagen_mqb_compute_crc(const CANPacket_t *to_push) {
   uint8_t crc = 0xFFU;
   for (int i = 1; i < len; i++) {
     crc ^= (uint8_t)GET_BYTE(to_push, i);
-    crc = volkswagen_crc8_lut_8h2f[crc];
+    crc = crc8_lut_8h2f[crc];
   }
 
   uint8_t counter = volkswagen_mqb_get_counter(to_push);
@@ -90,7 +89,7 @@ static uint32_t volkswagen_mqb_compute_crc(const CANPacket_t *to_push) {
   } else {
     // Undefined CAN message, CRC check expected to fail
   }
-  crc = volkswagen_crc8_lut_8h2f[crc];
+  crc = crc8_lut_8h2f[crc];
 
   return (uint8_t)(crc ^ 0xFFU);
 }
@@ -106,7 +105,6 @@ static safety_config volkswagen_mqb_init(uint16_t param) {
 #ifdef ALLOW_DEBUG
   volkswagen_longitudinal = GET_FLAG(param, FLAG_VOLKSWAGEN_LONG_CONTROL);
 #endif
-  gen_crc_lookup_table_8(0x2F, volkswagen_crc8_lut_8h2f);
   return volkswagen_longitudinal ? BUILD_SAFETY_CFG(volkswagen_mqb_rx_checks, VOLKSWAGEN_MQB_LONG_TX_MSGS) : \
                                    BUILD_SAFETY_CFG(volkswagen_mqb_rx_checks, VOLKSWAGEN_MQB_STOCK_TX_MSGS);
 }
@@ -297,6 +295,12 @@ static int volkswagen_mqb_fwd_hook(int bus_num, int addr) {
   return bus_fwd;
 }
 
+// volkswagen_mqb_rx_hook reads
+const int VOLKSWAGEN_MQB_HOOK_ADDRS[] = {
+  MSG_LH_EPS_03, MSG_ESP_19, MSG_ESP_05, MSG_TSK_06, MSG_MOTOR_20, MSG_HCA_01, MSG_GRA_ACC_01,
+  MSG_MOTOR_14
+};
+
 const safety_hooks volkswagen_mqb_hooks = {
   .init = volkswagen_mqb_init,
   .rx = volkswagen_mqb_rx_hook,
@@ -305,4 +309,6 @@ const safety_hooks volkswagen_mqb_hooks = {
   .get_counter = volkswagen_mqb_get_counter,
   .get_checksum = volkswagen_mqb_get_checksum,
   .compute_checksum = volkswagen_mqb_compute_crc,
+  .hook_addrs = VOLKSWAGEN_MQB_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(VOLKSWAGEN_MQB_HOOK_ADDRS) / sizeof(VOLKSWAGEN_MQB_HOOK_ADDRS[0]),
 };
@@ -46,7 +46,7 @@ const CanMsg VOLKSWAGEN_PQ_LONG_TX_MSGS[] =  {{MSG_HCA_1, 0, 5}, {MSG_LDW_1, 0,
                                               {MSG_MOTOR_2, 2, 8}, {MSG_EPB_1, 1, 8}, {MSG_EPB_1, 2, 8},
                                               {MSG_BREMSE_8, 2, 8}, {MSG_BREMSE_11, 2, 8}, {MSG_AWV, 0, 8}};
 
-RxCheck volkswagen_pq_rx_checks[] = {
+SAFETY_STATE RxCheck volkswagen_pq_rx_checks[] = {
   {.msg = {{MSG_LENKHILFE_3, 0, 6, .check_checksum = true, .max_counter = 15U, .frequency = 100U}, { 0 }, { 0 }}},
   {.msg = {{MSG_BREMSE_1, 0, 8, .check_checksum = false, .max_counter = 0U, .frequency = 100U}, { 0 }, { 0 }}},
   {.msg = {{MSG_MOTOR_2, 0, 8, .check_checksum = false, .max_counter = 0U, .frequency = 50U}, { 0 }, { 0 }}},
@@ -78,14 +78,12 @@ static uint8_t volkswagen_pq_get_counter(const CANPacket_t *to_push) {
 static uint32_t volkswagen_pq_compute_checksum(const CANPacket_t *to_push) {
   int addr = GET_ADDR(to_push);
   int len = GET_LEN(to_push);
-  uint8_t checksum = 0U;
   int checksum_byte = (addr == MSG_MOTOR_5) ? 7 : 0;
 
   // Simple XOR over the payload, except for the byte where the checksum lives.
-  for (int i = 0; i < len; i++) {
-    if (i != checksum_byte) {
-      checksum ^= (uint8_t)GET_BYTE(to_push, i);
-    }
+  uint8_t checksum = xor_bytes(to_push, 0, len);
+  if (checksum_byte < len) {
+    checksum ^= (uint8_t)GET_BYTE(to_push, checksum_byte);
   }
 
   return checksum;
@@ -100,6 +98,7 @@ static safety_config volkswagen_pq_init(uint16_t param) {
 #ifdef ALLOW_DEBUG
   volkswagen_longitudinal = GET_FLAG(param, FLAG_VOLKSWAGEN_LONG_CONTROL);
 #endif
+  cruise_override = volkswagen_longitudinal;  // also before the first frame volkswagen_pq_rx_hook sees
   return volkswagen_longitudinal ? BUILD_SAFETY_CFG(volkswagen_pq_rx_checks, VOLKSWAGEN_PQ_LONG_TX_MSGS) : \
                                    BUILD_SAFETY_CFG(volkswagen_pq_rx_checks, VOLKSWAGEN_PQ_STOCK_TX_MSGS);
 }
@@ -268,6 +267,9 @@ static int volkswagen_pq_fwd_hook(int bus_num, int addr) {
   return bus_fwd;
 }
 
+// volkswagen_pq_rx_hook reads
+const int VOLKSWAGEN_PQ_HOOK_ADDRS[] = {MSG_LENKHILFE_3, MSG_HCA_1, MSG_BREMSE_1, MSG_MOTOR_2, MSG_MOTOR_3, MSG_GRA_NEU, MSG_MOTOR_5};
+
 const safety_hooks volkswagen_pq_hooks = {
   .init = volkswagen_pq_init,
   .rx = volkswagen_pq_rx_hook,
@@ -276,4 +278,6 @@ const safety_hooks volkswagen_pq_hooks = {
   .get_counter = volkswagen_pq_get_counter,
   .get_checksum = volkswagen_pq_get_checksum,
   .compute_checksum = volkswagen_pq_compute_checksum,
+  .hook_addrs = VOLKSWAGEN_PQ_HOOK_ADDRS,
+  .hook_addrs_len = sizeof(VOLKSWAGEN_PQ_HOOK_ADDRS) / sizeof(VOLKSWAGEN_PQ_HOOK_ADDRS[0]),
 };
@@ -1,5 +1,11 @@
 #pragma once
 
+// Storage class of all mutable safety state. The firmware runs a single safety instance, so this
+// is empty there. libpanda defines it as __thread, which gives every thread its own safety context.
+#ifndef SAFETY_STATE
+#define SAFETY_STATE
+#endif
+
 #define GET_BIT(msg, b) ((bool)!!(((msg)->data[((b) / 8U)] >> ((b) % 8U)) & 0x1U))
 #define GET_BYTE(msg, b) ((msg)->data[(b)])
 #define GET_FLAG(value, mask) (((__typeof__(mask))(value) & (mask)) == (mask)) // cppcheck-suppress misra-c2012-1.2; allow __typeof__
@@ -10,7 +16,8 @@
                                    (config).rx_checks_len = sizeof((rx)) / sizeof((rx)[0]))
 #define SET_TX_MSGS(tx, config) ((config).tx_msgs = (tx), \
                                  (config).tx_msgs_len = sizeof((tx)) / sizeof((tx)[0]))
-#define UPDATE_VEHICLE_SPEED(val_ms) (update_sample(&vehicle_speed, ROUND((val_ms) * VEHICLE_SPEED_FACTOR)))
+// vehicle speed from an integer speed signal, raw * num / den in VEHICLE_SPEED_FACTOR units
+#define UPDATE_VEHICLE_SPEED(raw, num, den) (update_sample(&vehicle_speed, round_div((raw) * (num), (den))))
 
 uint32_t GET_BYTES(const CANPacket_t *msg, int start, int len) {
   uint32_t ret = 0U;
@@ -21,20 +28,30 @@ uint32_t GET_BYTES(const CANPacket_t *msg, int start, int len) {
   return ret;
 }
 
+// little endian word of data bytes b to b + 3, a single load on the little endian targets
+static inline uint32_t get_word(const CANPacket_t *msg, int b) {
+  uint32_t w;
+  __builtin_memcpy(&w, &msg->data[b], sizeof(w));
+  return w;
+}
+
 const int MAX_WRONG_COUNTERS = 5;
 const uint8_t MAX_MISSED_MSGS = 10U;
 #define MAX_ADDR_CHECK_MSGS 3U
 #define MAX_SAMPLE_VALS 6
-// used to represent floating point vehicle speed in a sample_t
-#define VEHICLE_SPEED_FACTOR 100.0
+// vehicle speed is kept in a sample_t in cm/s
+#define VEHICLE_SPEED_FACTOR 100
+// fixed point scale of the angle rate limits in CAN units
+#define ANGLE_RATE_SCALE 4096
 
 
-// sample struct that keeps 6 samples in memory
+// sample struct that keeps 6 samples in memory, values is a ring with the newest sample at idx
 struct sample_t {
   int values[MAX_SAMPLE_VALS];
+  int idx;
   int min;
   int max;
-} sample_t_default = {.values = {0}, .min = 0, .max = 0};
+} sample_t_default = {.values = {0}, .idx = 0, .min = 0, .max = 0};
 
 // safety code requires floats
 struct lookup_t {
@@ -42,6 +59,17 @@ struct lookup_t {
   float y[3];
 };
 
+// a lookup_t converted at safety init: x in VEHICLE_SPEED_FACTOR units, y in CAN units
+// times ANGLE_RATE_SCALE. The ends are kept in CAN units as the float math truncates them,
+// error bounds how far the float math can land from y between the ends
+struct lookup_fixed_t {
+  int x[3];
+  int y[3];
+  int y_first;
+  int y_last;
+  int error;
+};
+
 typedef struct {
   int addr;
   int bus;
@@ -144,6 +172,27 @@ typedef struct {
   int tx_msgs_len;
 } safety_config;
 
+// sorted lookup entry for the TX whitelist and the RX checks of the active safety config
+typedef struct {
+  uint32_t key;   // addr << 3 | bus
+  int len;
+  int check;      // RX only: rx_checks index
+  int msg;        // RX only: msg index within the check
+} SafetyIndexEntry;
+
+// cycles spent in a safety hook, see safety_profile_get
+#define SAFETY_HOOK_RX 0U
+#define SAFETY_HOOK_TX 1U
+#define SAFETY_HOOK_FWD 2U
+#define SAFETY_HOOK_CNT 3U
+
+typedef struct {
+  uint32_t cnt;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+} safety_hook_profile;
+
 typedef uint32_t (*get_checksum_t)(const CANPacket_t *to_push);
 typedef uint32_t (*compute_checksum_t)(const CANPacket_t *to_push);
 typedef uint8_t (*get_counter_t)(const CANPacket_t *to_push);
@@ -163,6 +212,8 @@ typedef struct {
   compute_checksum_t compute_checksum;
   get_counter_t get_counter;
   get_quality_flag_valid_t get_quality_flag_valid;
+  const int *hook_addrs;  // addresses the rx or fwd hook acts on besides the RX checks and TX messages
+  int hook_addrs_len;
 } safety_hooks;
 
 bool safety_rx_hook(const CANPacket_t *to_push);
@@ -170,7 +221,9 @@ bool safety_tx_hook(CANPacket_t *to_send);
 uint32_t get_ts_elapsed(uint32_t ts, uint32_t ts_last);
 int to_signed(int d, int bits);
 void update_sample(struct sample_t *sample, int sample_new);
+void update_sample_margin(struct sample_t *sample, int sample_new, int margin);
 void reset_sample(struct sample_t *sample);
+int sample_last(const struct sample_t *sample);
 bool max_limit_check(int val, const int MAX, const int MIN);
 bool angle_dist_to_meas_check(int val, struct sample_t *val_meas,
   const int MAX_ERROR, const int MAX_VAL);
@@ -181,12 +234,28 @@ bool driver_limit_check(int val, int val_last, const struct sample_t *val_driver
   const int MAX_ALLOWANCE, const int DRIVER_FACTOR);
 bool get_longitudinal_allowed(void);
 bool rt_rate_limit_check(int val, int val_last, const int MAX_RT_DELTA);
-float interpolate(struct lookup_t xy, float x);
+struct lookup_fixed_t lookup_to_fixed(const struct lookup_t *xy, float y_factor);
+int interpolate_fixed(const struct lookup_fixed_t *xy, int x, bool round_up);
+void angle_rate_limits_init(const SteeringLimits *limits);
 int ROUND(float val);
-void gen_crc_lookup_table_8(uint8_t poly, uint8_t crc_lut[]);
-void gen_crc_lookup_table_16(uint16_t poly, uint16_t crc_lut[]);
+int round_div(int num, int den);
+int floor_div(int num, int den);
+uint8_t crc8_lut(const CANPacket_t *msg, int start, int end, uint8_t init, const uint8_t crc_lut[]);
+uint8_t xor_bytes(const CANPacket_t *msg, int start, int end);
+uint32_t sum_nibbles(uint32_t w);
+uint32_t sum_nibbles_bytes(const CANPacket_t *msg, int start, int end);
+uint32_t count_bits(uint32_t w);
 bool msg_allowed(const CANPacket_t *to_send, const CanMsg msg_list[], int len);
 int get_addr_check_index(const CANPacket_t *to_push, RxCheck addr_list[], const int len);
+void safety_index_build(void);
+bool safety_index_tx_msg(int addr, int bus, int length);
+bool safety_index_tx_allowed(const CANPacket_t *to_send);
+int safety_index_rx_check(const CANPacket_t *to_push, const safety_config *cfg);
+void safety_dispatch_build(void);
+bool safety_rx_dispatch(const CANPacket_t *to_push);
+int safety_fwd_default(int bus_num);
+bool safety_profile_get(uint16_t mode, uint8_t hook, safety_hook_profile *profile);
+void safety_profile_reset(void);
 void update_counter(RxCheck addr_list[], int index, uint8_t counter);
 void update_addr_timestamp(RxCheck addr_list[], int index);
 bool is_msg_valid(RxCheck addr_list[], int index);
@@ -209,46 +278,54 @@ void pcm_cruise_check(bool cruise_engaged);
 void safety_tick(const safety_config *safety_config);
 
 // This can be set by the safety hooks
-bool disengageFromBrakes = false;
-bool controls_allowed = false;
-bool controls_allowed_long = false;
-bool relay_malfunction = false;
-bool enable_gas_interceptor = false;
-int gas_interceptor_prev = 0;
-bool gas_pressed = false;
-bool gas_pressed_prev = false;
-bool brake_pressed = false;
-bool brake_pressed_prev = false;
-bool regen_braking = false;
-bool regen_braking_prev = false;
-bool cruise_engaged_prev = false;
-bool acc_main_on_prev = false;
-bool lkas_pressed_prev = false;
-struct sample_t vehicle_speed;
-bool vehicle_moving = false;
-bool acc_main_on = false;  // referred to as "ACC off" in ISO 15622:2018
-int cruise_button_prev = 0;
-bool safety_rx_checks_invalid = false;
-bool cruise_override = false;
+SAFETY_STATE bool disengageFromBrakes = false;
+SAFETY_STATE bool controls_allowed = false;
+SAFETY_STATE bool controls_allowed_long = false;
+SAFETY_STATE bool relay_malfunction = false;
+SAFETY_STATE bool enable_gas_interceptor = false;
+SAFETY_STATE int gas_interceptor_prev = 0;
+SAFETY_STATE bool gas_pressed = false;
+SAFETY_STATE bool gas_pressed_prev = false;
+SAFETY_STATE bool brake_pressed = false;
+SAFETY_STATE bool brake_pressed_prev = false;
+SAFETY_STATE bool regen_braking = false;
+SAFETY_STATE bool regen_braking_prev = false;
+SAFETY_STATE bool cruise_engaged_prev = false;
+SAFETY_STATE bool acc_main_on_prev = false;
+SAFETY_STATE bool lkas_pressed_prev = false;
+SAFETY_STATE struct sample_t vehicle_speed;
+SAFETY_STATE bool vehicle_moving = false;
+SAFETY_STATE bool acc_main_on = false;  // referred to as "ACC off" in ISO 15622:2018
+SAFETY_STATE int cruise_button_prev = 0;
+SAFETY_STATE bool safety_rx_checks_invalid = false;
+SAFETY_STATE bool cruise_override = false;
 
 // for safety modes with torque steering control
-int desired_torque_last = 0;       // last desired steer torque
-int rt_torque_last = 0;            // last desired torque for real time check
-int valid_steer_req_count = 0;     // counter for steer request bit matching non-zero torque
-int invalid_steer_req_count = 0;   // counter to allow multiple frames of mismatching torque request bit
-struct sample_t torque_meas;       // last 6 motor torques produced by the eps
-struct sample_t torque_driver;     // last 6 driver torques measured
-uint32_t ts_torque_check_last = 0;
-uint32_t ts_steer_req_mismatch_last = 0;  // last timestamp steer req was mismatched with torque
+SAFETY_STATE int desired_torque_last = 0;       // last desired steer torque
+SAFETY_STATE int rt_torque_last = 0;            // last desired torque for real time check
+SAFETY_STATE int valid_steer_req_count = 0;     // counter for steer request bit matching non-zero torque
+SAFETY_STATE int invalid_steer_req_count = 0;   // counter to allow multiple frames of mismatching torque request bit
+SAFETY_STATE struct sample_t torque_meas;       // last 6 motor torques produced by the eps
+SAFETY_STATE struct sample_t torque_driver;     // last 6 driver torques measured
+SAFETY_STATE uint32_t ts_torque_check_last = 0;
+SAFETY_STATE uint32_t ts_steer_req_mismatch_last = 0;  // last timestamp steer req was mismatched with torque
 
 // state for controls_allowed timeout logic
-bool heartbeat_engaged = false;             // openpilot enabled, passed in heartbeat USB command
-uint32_t heartbeat_engaged_mismatches = 0;  // count of mismatches between heartbeat_engaged and controls_allowed
+SAFETY_STATE bool heartbeat_engaged = false;             // openpilot enabled, passed in heartbeat USB command
+SAFETY_STATE uint32_t heartbeat_engaged_mismatches = 0;  // count of mismatches between heartbeat_engaged and controls_allowed
 
 // for safety modes with angle steering control
-uint32_t ts_angle_last = 0;
-int desired_angle_last = 0;
-struct sample_t angle_meas;         // last 6 steer angles/curvatures
+SAFETY_STATE uint32_t ts_angle_last = 0;
+SAFETY_STATE int desired_angle_last = 0;
+// angle rate limits of the current safety mode, converted by its init from the limits below
+SAFETY_STATE struct lookup_t angle_rate_up_lookup;
+SAFETY_STATE struct lookup_t angle_rate_down_lookup;
+SAFETY_STATE float angle_rate_deg_to_can = 0.;
+SAFETY_STATE float angle_rate_error_min_speed = 0.;
+SAFETY_STATE struct lookup_fixed_t angle_rate_up_limits;
+SAFETY_STATE struct lookup_fixed_t angle_rate_down_limits;
+SAFETY_STATE int angle_error_min_speed;  // VEHICLE_SPEED_FACTOR units
+SAFETY_STATE struct sample_t angle_meas;         // last 6 steer angles/curvatures
 
 // This can be set with a USB command
 // It enables features that allow alternative experiences, like not disengaging on gas press
@@ -278,11 +355,11 @@ struct sample_t angle_meas;         // last 6 steer angles/curvatures
 // The feature must be gated behind this flag per geohot's comment on the comma community Discord server.
 #define ALT_EXP_MADS_DISABLE_DISENGAGE_LATERAL_ON_BRAKE 64
 
-int alternative_experience = 0;
+SAFETY_STATE int alternative_experience = 0;
 
-bool mads_enabled = false;
+SAFETY_STATE bool mads_enabled = false;
 
 // time since safety mode has been changed
-uint32_t safety_mode_cnt = 0U;
+SAFETY_STATE uint32_t safety_mode_cnt = 0U;
 // allow 1s of transition timeout after relay changes state before assessing malfunctioning
 const uint32_t RELAY_TRNS_TIMEOUT = 1U;
@@ -79,14 +79,17 @@ void llcan_irq_disable(const CAN_TypeDef *CANx) {
   if (CANx == CAN1) {
     NVIC_DisableIRQ(CAN1_TX_IRQn);
     NVIC_DisableIRQ(CAN1_RX0_IRQn);
+    NVIC_DisableIRQ(CAN1_RX1_IRQn);
     NVIC_DisableIRQ(CAN1_SCE_IRQn);
   } else if (CANx == CAN2) {
     NVIC_DisableIRQ(CAN2_TX_IRQn);
     NVIC_DisableIRQ(CAN2_RX0_IRQn);
+    NVIC_DisableIRQ(CAN2_RX1_IRQn);
     NVIC_DisableIRQ(CAN2_SCE_IRQn);
   } else if (CANx == CAN3) {
     NVIC_DisableIRQ(CAN3_TX_IRQn);
     NVIC_DisableIRQ(CAN3_RX0_IRQn);
+    NVIC_DisableIRQ(CAN3_RX1_IRQn);
     NVIC_DisableIRQ(CAN3_SCE_IRQn);
   } else {
   }
@@ -96,14 +99,17 @@ void llcan_irq_enable(const CAN_TypeDef *CANx) {
   if (CANx == CAN1) {
     NVIC_EnableIRQ(CAN1_TX_IRQn);
     NVIC_EnableIRQ(CAN1_RX0_IRQn);
+    NVIC_EnableIRQ(CAN1_RX1_IRQn);
     NVIC_EnableIRQ(CAN1_SCE_IRQn);
   } else if (CANx == CAN2) {
     NVIC_EnableIRQ(CAN2_TX_IRQn);
     NVIC_EnableIRQ(CAN2_RX0_IRQn);
+    NVIC_EnableIRQ(CAN2_RX1_IRQn);
     NVIC_EnableIRQ(CAN2_SCE_IRQn);
   } else if (CANx == CAN3) {
     NVIC_EnableIRQ(CAN3_TX_IRQn);
     NVIC_EnableIRQ(CAN3_RX0_IRQn);
+    NVIC_EnableIRQ(CAN3_RX1_IRQn);
     NVIC_EnableIRQ(CAN3_SCE_IRQn);
   } else {
   }
@@ -143,16 +149,47 @@ bool llcan_init(CAN_TypeDef *CANx) {
 
     // enable certain CAN interrupts
     register_set_bits(&(CANx->IER), CAN_IER_TMEIE | CAN_IER_FMPIE0 | CAN_IER_ERRIE | CAN_IER_LECIE | CAN_IER_BOFIE | CAN_IER_EPVIE | CAN_IER_EWGIE | CAN_IER_FOVIE0 | CAN_IER_FFIE0);
+    register_set_bits(&(CANx->IER), CAN_IER_FMPIE1 | CAN_IER_FOVIE1);
 
-    // clear overrun flag on init
-    CANx->RF0R &= ~(CAN_RF0R_FOVR0);
+    // clear full and overrun flags on init, they're cleared by writing 1
+    CANx->RF0R = CAN_RF0R_FULL0 | CAN_RF0R_FOVR0;
+    CANx->RF1R = CAN_RF1R_FULL1 | CAN_RF1R_FOVR1;
 
     llcan_irq_enable(CANx);
   }
   return ret;
 }
 
+// Standard IDs received in RX FIFO 1, four per filter bank in 16-bit identifier list mode. List mode
+// banks take precedence over the accept all mask mode bank, so only the other frames go to FIFO 0.
+#define CAN_RX_FIFO1_BANK_CNT 4U
+void llcan_set_fifo1_filters(CAN_TypeDef *CANx, const uint16_t ids[], uint8_t len) {
+  // CAN2 uses the filter banks of CAN1 from bank 14 on
+  CAN_TypeDef *CANf = (CANx == CAN2) ? CAN1 : CANx;
+  uint32_t first_bank = (CANx == CAN2) ? 15U : 1U;
+
+  register_set_bits(&(CANf->FMR), CAN_FMR_FINIT);
+  for (uint32_t b = 0U; b < CAN_RX_FIFO1_BANK_CNT; b++) {
+    uint32_t bank = first_bank + b;
+    register_clear_bits(&(CANf->FA1R), 1UL << bank);
+    if ((b * 4U) < len) {
+      // STID in bits 5-15 of each half word, the last ID fills the unused entries
+      uint32_t fid[4];
+      for (uint32_t i = 0U; i < 4U; i++) {
+        fid[i] = (uint32_t)ids[MIN((b * 4U) + i, (uint32_t)len - 1U)] << 5;
+      }
+      CANf->sFilterRegister[bank].FR1 = fid[0] | (fid[1] << 16);
+      CANf->sFilterRegister[bank].FR2 = fid[2] | (fid[3] << 16);
+      register_set_bits(&(CANf->FM1R), 1UL << bank);
+      register_clear_bits(&(CANf->FS1R), 1UL << bank);
+      register_set_bits(&(CANf->FFA1R), 1UL << bank);
+      register_set_bits(&(CANf->FA1R), 1UL << bank);
+    }
+  }
+  register_clear_bits(&(CANf->FMR), CAN_FMR_FINIT);
+}
+
 void llcan_clear_send(CAN_TypeDef *CANx) {
-  CANx->TSR |= CAN_TSR_ABRQ0; // Abort message transmission on error interrupt
+  CANx->TSR = CAN_TSR_ABRQ0 | CAN_TSR_ABRQ1 | CAN_TSR_ABRQ2; // Abort message transmission on error interrupt
   CANx->MSR |= CAN_MSR_ERRI; // Clear error interrupt
 }
@@ -12,6 +12,8 @@ void llspi_miso_dma(uint8_t *addr, int len) {
   DMA2_Stream3->CR |= DMA_SxCR_EN;
 }
 
+uint16_t llspi_mosi_len = 0U;
+
 void llspi_mosi_dma(uint8_t *addr, int len) {
   // disable DMA
   register_clear_bits(&(SPI1->CR2), SPI_CR2_RXDMAEN);
@@ -24,12 +26,25 @@ void llspi_mosi_dma(uint8_t *addr, int len) {
   // setup destination and length
   register_set(&(DMA2_Stream2->M0AR), (uint32_t)addr, 0xFFFFFFFFU);
   DMA2_Stream2->NDTR = len;
+  llspi_mosi_len = len;
 
   // enable DMA
   DMA2_Stream2->CR |= DMA_SxCR_EN;
   register_set_bits(&(SPI1->CR2), SPI_CR2_RXDMAEN);
 }
 
+// the F4 has no CS interrupt, so it stays on protocol v2 and never stops a transfer early
+uint16_t llspi_mosi_dma_stop(void) {
+  register_clear_bits(&(SPI1->CR2), SPI_CR2_RXDMAEN);
+  DMA2_Stream2->CR &= ~DMA_SxCR_EN;
+  while ((DMA2_Stream2->CR & DMA_SxCR_EN) != 0U) {}
+  return llspi_mosi_len - DMA2_Stream2->NDTR;
+}
+
+bool llspi_cs_active(void) {
+  return !get_gpio_input(GPIOA, 4);
+}
+
 // SPI MOSI DMA FINISHED
 void DMA2_Stream2_IRQ_Handler(void) {
   // Clear interrupt flag
@@ -17,10 +17,12 @@
 #define FDCAN_OFFSET_W 846UL // words for each FDCAN module, equally
 #define FDCAN_END_ADDRESS 0x4000D3FCUL // Message RAM has a width of 4 bytes
 
-// FDCAN_RX_FIFO_0_EL_CNT + FDCAN_TX_FIFO_EL_CNT can't exceed 47 elements (47 * 72 bytes = 3,384 bytes) per FDCAN module
+// FDCAN_RX_FIFO_0_EL_CNT + FDCAN_TX_FIFO_EL_CNT can't exceed 44 elements (44 * 72 bytes = 3,168 bytes) per FDCAN module,
+// the TX event FIFO and RX filter elements take the remaining 216 bytes.
+// The TX FIFO holds several frames, so process_can refills it once per TX FIFO empty interrupt instead of once per frame
 
 // RX FIFO 0
-#define FDCAN_RX_FIFO_0_EL_CNT 46UL
+#define FDCAN_RX_FIFO_0_EL_CNT 36UL
 #define FDCAN_RX_FIFO_0_HEAD_SIZE 8UL // bytes
 #define FDCAN_RX_FIFO_0_DATA_SIZE 64UL // bytes
 #define FDCAN_RX_FIFO_0_EL_SIZE (FDCAN_RX_FIFO_0_HEAD_SIZE + FDCAN_RX_FIFO_0_DATA_SIZE)
@@ -28,13 +30,25 @@
 #define FDCAN_RX_FIFO_0_OFFSET 0UL
 
 // TX FIFO
-#define FDCAN_TX_FIFO_EL_CNT 1UL
+#define FDCAN_TX_FIFO_EL_CNT 8UL
 #define FDCAN_TX_FIFO_HEAD_SIZE 8UL // bytes
 #define FDCAN_TX_FIFO_DATA_SIZE 64UL // bytes
 #define FDCAN_TX_FIFO_EL_SIZE (FDCAN_TX_FIFO_HEAD_SIZE + FDCAN_TX_FIFO_DATA_SIZE)
 #define FDCAN_TX_FIFO_EL_W_SIZE (FDCAN_TX_FIFO_EL_SIZE / 4UL)
 #define FDCAN_TX_FIFO_OFFSET (FDCAN_RX_FIFO_0_OFFSET + (FDCAN_RX_FIFO_0_EL_CNT * FDCAN_RX_FIFO_0_EL_W_SIZE))
 
+// TX event FIFO, one element per frame in flight: twice the TX FIFO, as TX FIFO elements are reused before their event is read
+#define FDCAN_TX_EVENT_FIFO_EL_CNT (2UL * FDCAN_TX_FIFO_EL_CNT)
+#define FDCAN_TX_EVENT_FIFO_EL_SIZE 8UL // bytes
+#define FDCAN_TX_EVENT_FIFO_EL_W_SIZE (FDCAN_TX_EVENT_FIFO_EL_SIZE / 4UL)
+#define FDCAN_TX_EVENT_FIFO_OFFSET (FDCAN_TX_FIFO_OFFSET + (FDCAN_TX_FIFO_EL_CNT * FDCAN_TX_FIFO_EL_W_SIZE))
+
+// RX filters, standard ID elements are 1 word, extended ID elements 2
+#define FDCAN_STD_FILTER_EL_CNT 10UL
+#define FDCAN_STD_FILTER_OFFSET (FDCAN_TX_EVENT_FIFO_OFFSET + (FDCAN_TX_EVENT_FIFO_EL_CNT * FDCAN_TX_EVENT_FIFO_EL_W_SIZE))
+#define FDCAN_EXT_FILTER_EL_CNT 4UL
+#define FDCAN_EXT_FILTER_OFFSET (FDCAN_STD_FILTER_OFFSET + FDCAN_STD_FILTER_EL_CNT)
+
 #define CAN_NAME_FROM_CANIF(CAN_DEV) (((CAN_DEV)==FDCAN1) ? "FDCAN1" : (((CAN_DEV) == FDCAN2) ? "FDCAN2" : "FDCAN3"))
 #define CAN_NUM_FROM_CANIF(CAN_DEV) (((CAN_DEV)==FDCAN1) ? 0UL : (((CAN_DEV) == FDCAN2) ? 1UL : 2UL))
 
@@ -208,13 +222,7 @@ bool llcan_init(FDCAN_GlobalTypeDef *FDCANx) {
     FDCANx->TXESC |= 0x7U << FDCAN_TXESC_TBDS_Pos; // 64 bytes
     //Configure RX FIFO0 element data size
     FDCANx->RXESC |= 0x7U << FDCAN_RXESC_F0DS_Pos;
-    // Disable filtering, accept all valid frames received
-    FDCANx->XIDFC &= ~(FDCAN_XIDFC_LSE); // No extended filters
-    FDCANx->SIDFC &= ~(FDCAN_SIDFC_LSS); // No standard filters
-    FDCANx->GFC &= ~(FDCAN_GFC_RRFE); // Accept extended remote frames
-    FDCANx->GFC &= ~(FDCAN_GFC_RRFS); // Accept standard remote frames
-    FDCANx->GFC &= ~(FDCAN_GFC_ANFE); // Accept extended frames to FIFO 0
-    FDCANx->GFC &= ~(FDCAN_GFC_ANFS); // Accept standard frames to FIFO 0
+    // Filters are set by llcan_set_filters, and survive the resets of llcan_clear_send
 
     uint32_t RxFIFO0SA = FDCAN_START_ADDRESS + (can_number * FDCAN_OFFSET);
     uint32_t TxFIFOSA = RxFIFO0SA + (FDCAN_RX_FIFO_0_EL_CNT * FDCAN_RX_FIFO_0_EL_SIZE);
@@ -229,8 +237,13 @@ bool llcan_init(FDCAN_GlobalTypeDef *FDCANx) {
     FDCANx->TXBC |= (FDCAN_TX_FIFO_OFFSET + (can_number * FDCAN_OFFSET_W)) << FDCAN_TXBC_TBSA_Pos;
     FDCANx->TXBC |= FDCAN_TX_FIFO_EL_CNT << FDCAN_TXBC_TFQS_Pos;
 
+    // TX event FIFO, filled for the TX FIFO elements that request it
+    FDCANx->TXEFC = ((FDCAN_TX_EVENT_FIFO_OFFSET + (can_number * FDCAN_OFFSET_W)) << FDCAN_TXEFC_EFSA_Pos) | (FDCAN_TX_EVENT_FIFO_EL_CNT << FDCAN_TXEFC_EFS_Pos);
+    // Timestamp counter counts nominal bit times, the TX events carry it
+    FDCANx->TSCC = (0UL << FDCAN_TSCC_TCP_Pos) | (1UL << FDCAN_TSCC_TSS_Pos);
+
     // Flush allocated RAM
-    uint32_t EndAddress = TxFIFOSA + (FDCAN_TX_FIFO_EL_CNT * FDCAN_TX_FIFO_EL_SIZE);
+    uint32_t EndAddress = TxFIFOSA + (FDCAN_TX_FIFO_EL_CNT * FDCAN_TX_FIFO_EL_SIZE) + (FDCAN_TX_EVENT_FIFO_EL_CNT * FDCAN_TX_EVENT_FIFO_EL_SIZE);
     for (uint32_t RAMcounter = RxFIFO0SA; RAMcounter < EndAddress; RAMcounter += 4U) {
         *(uint32_t *)(RAMcounter) = 0x00000000;
     }
@@ -246,6 +259,7 @@ bool llcan_init(FDCAN_GlobalTypeDef *FDCANx) {
     // Messages for INT1 (Only TFE works??)
     FDCANx->ILS |= FDCAN_ILS_TFEL;
     FDCANx->IE |= FDCAN_IE_TFEE; // Tx FIFO empty
+    FDCANx->ILS |= FDCAN_ILS_TEFNL; // Tx event FIFO new entry, enabled by process_can while it waits for events
 
     ret = fdcan_exit_init(FDCANx);
     if(!ret) {
@@ -260,6 +274,42 @@ bool llcan_init(FDCAN_GlobalTypeDef *FDCANx) {
   return ret;
 }
 
+// Writes the standard and extended ID filter elements (see can_rx_filter_elems_t) to message RAM.
+// Frames no element matches go to RX FIFO 0 unless std_reject / ext_reject, remote frames are accepted.
+bool llcan_set_filters(FDCAN_GlobalTypeDef *FDCANx, const uint32_t std_elems[], uint8_t std_len, const uint32_t ext_elems[], uint8_t ext_len, bool std_reject, bool ext_reject) {
+  uint32_t can_number = CAN_NUM_FROM_CANIF(FDCANx);
+  bool ret = fdcan_request_init(FDCANx);
+
+  if (ret) {
+    // Enable config change
+    FDCANx->CCCR |= FDCAN_CCCR_CCE;
+
+    uint32_t std_len_el = MIN((uint32_t)std_len, FDCAN_STD_FILTER_EL_CNT);
+    uint32_t ext_len_el = MIN((uint32_t)ext_len, FDCAN_EXT_FILTER_EL_CNT);
+    uint32_t StdFilterSA = FDCAN_START_ADDRESS + (can_number * FDCAN_OFFSET) + (FDCAN_STD_FILTER_OFFSET * 4UL);
+    uint32_t ExtFilterSA = FDCAN_START_ADDRESS + (can_number * FDCAN_OFFSET) + (FDCAN_EXT_FILTER_OFFSET * 4UL);
+    for (uint32_t i = 0U; i < std_len_el; i++) {
+      *(uint32_t *)(StdFilterSA + (i * 4U)) = std_elems[i];
+    }
+    for (uint32_t i = 0U; i < (2U * ext_len_el); i++) {
+      *(uint32_t *)(ExtFilterSA + (i * 4U)) = ext_elems[i];
+    }
+
+    FDCANx->SIDFC = ((FDCAN_STD_FILTER_OFFSET + (can_number * FDCAN_OFFSET_W)) << FDCAN_SIDFC_FLSSA_Pos) | (std_len_el << FDCAN_SIDFC_LSS_Pos);
+    FDCANx->XIDFC = ((FDCAN_EXT_FILTER_OFFSET + (can_number * FDCAN_OFFSET_W)) << FDCAN_XIDFC_FLESA_Pos) | (ext_len_el << FDCAN_XIDFC_LSE_Pos);
+    // ANFS / ANFE 2: reject non-matching frames, 0: accept them to FIFO 0
+    FDCANx->GFC = (std_reject ? (2UL << FDCAN_GFC_ANFS_Pos) : 0UL) | (ext_reject ? (2UL << FDCAN_GFC_ANFE_Pos) : 0UL);
+
+    ret = fdcan_exit_init(FDCANx);
+    if (!ret) {
+      print(CAN_NAME_FROM_CANIF(FDCANx)); print(" set_filters timed out! (2)\n");
+    }
+  } else {
+    print(CAN_NAME_FROM_CANIF(FDCANx)); print(" set_filters timed out! (1)\n");
+  }
+  return ret;
+}
+
 void llcan_clear_send(FDCAN_GlobalTypeDef *FDCANx) {
   // from datasheet: "Transmit cancellation is not intended for Tx FIFO operation."
   // so we need to clear pending transmission manually by resetting FDCAN core
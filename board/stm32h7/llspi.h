@@ -1,3 +1,5 @@
+uint16_t llspi_mosi_len = 0U;
+
 // master -> panda DMA start
 void llspi_mosi_dma(uint8_t *addr, int len) {
   // disable DMA + SPI
@@ -18,6 +20,7 @@ void llspi_mosi_dma(uint8_t *addr, int len) {
   // setup destination and length
   register_set(&(DMA2_Stream2->M0AR), (uint32_t)addr, 0xFFFFFFFFU);
   DMA2_Stream2->NDTR = len;
+  llspi_mosi_len = len;
 
   // enable DMA + SPI
   DMA2_Stream2->CR |= DMA_SxCR_EN;
@@ -25,6 +28,18 @@ void llspi_mosi_dma(uint8_t *addr, int len) {
   register_set_bits(&(SPI4->CR1), SPI_CR1_SPE);
 }
 
+// master -> panda DMA stop, returns how much was received
+uint16_t llspi_mosi_dma_stop(void) {
+  register_clear_bits(&(SPI4->CFG1), SPI_CFG1_RXDMAEN);
+  DMA2_Stream2->CR &= ~DMA_SxCR_EN;
+  while ((DMA2_Stream2->CR & DMA_SxCR_EN) != 0U) {}
+  return llspi_mosi_len - DMA2_Stream2->NDTR;
+}
+
+bool llspi_cs_active(void) {
+  return !get_gpio_input(GPIOE, 11);
+}
+
 // panda -> master DMA start
 void llspi_miso_dma(uint8_t *addr, int len) {
   // disable DMA + SPI
@@ -77,11 +92,20 @@ void SPI4_IRQ_Handler(void) {
   }
 }
 
+// CS went up
+void EXTI15_10_IRQ_Handler(void) {
+  volatile unsigned int pr = EXTI->PR1 & (1U << 11);
+  EXTI->PR1 = (1U << 11);
+  if ((pr & (1U << 11)) != 0U) {
+    spi_cs_done();
+  }
+}
 
 void llspi_init(void) {
   REGISTER_INTERRUPT(SPI4_IRQn, SPI4_IRQ_Handler, (SPI_IRQ_RATE * 2U), FAULT_INTERRUPT_RATE_SPI)
   REGISTER_INTERRUPT(DMA2_Stream2_IRQn, DMA2_Stream2_IRQ_Handler, SPI_IRQ_RATE, FAULT_INTERRUPT_RATE_SPI_DMA)
   REGISTER_INTERRUPT(DMA2_Stream3_IRQn, DMA2_Stream3_IRQ_Handler, SPI_IRQ_RATE, FAULT_INTERRUPT_RATE_SPI_DMA)
+  REGISTER_INTERRUPT(EXTI15_10_IRQn, EXTI15_10_IRQ_Handler, SPI_IRQ_RATE, FAULT_INTERRUPT_RATE_SPI_CS)
 
   // Setup MOSI DMA
   register_set(&(DMAMUX1_Channel10->CCR), 83U, 0xFFFFFFFFU);
@@ -100,7 +124,13 @@ void llspi_init(void) {
   register_set(&(SPI4->CR1), SPI_CR1_SPE, 0xFFFFU);
   register_set(&(SPI4->CR2), 0, 0xFFFFU);
 
+  // CS rising edge ends the v3 transfers
+  register_set(&(SYSCFG->EXTICR[2]), SYSCFG_EXTICR3_EXTI11_PE, 0xF000U);
+  register_set_bits(&(EXTI->IMR1), (1U << 11));
+  register_set_bits(&(EXTI->RTSR1), (1U << 11));
+
   NVIC_EnableIRQ(DMA2_Stream2_IRQn);
   NVIC_EnableIRQ(DMA2_Stream3_IRQn);
   NVIC_EnableIRQ(SPI4_IRQn);
+  NVIC_EnableIRQ(EXTI15_10_IRQn);
 }
@@ -14,7 +14,7 @@ from .base import BaseHandle
 from .constants import FW_PATH, McuType
 from .dfu import PandaDFU
 from .isotp import isotp_send, isotp_recv
-from .spi import PandaSpiHandle, PandaSpiException, PandaProtocolMismatch
+from .spi import PandaSpiHandle, PandaSpiException, PandaSpiNackResponse, PandaProtocolMismatch, XFER_SIZE
 from .usb import PandaUsbHandle
 
 __version__ = '0.0.10'
@@ -24,6 +24,7 @@ LOGLEVEL = os.environ.get('LOGLEVEL', 'INFO').upper()
 logging.basicConfig(level=LOGLEVEL, format='%(message)s')
 
 CANPACKET_HEAD_SIZE = 0x6
+CANPACKET_TIMESTAMP_SIZE = 0x4
 DLC_TO_LEN = [0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64]
 LEN_TO_DLC = {length: dlc for (dlc, length) in enumerate(DLC_TO_LEN)}
 PANDA_BUS_CNT = 4
@@ -58,11 +59,13 @@ def pack_can_buffer(arr):
 
   return snds
 
-def unpack_can_buffer(dat):
+def unpack_can_buffer(dat, timestamps=False):
   ret = []
 
   while len(dat) >= CANPACKET_HEAD_SIZE:
     data_len = DLC_TO_LEN[(dat[0]>>4)]
+    # frames may carry a microsecond RX timestamp after the data
+    ts_len = CANPACKET_TIMESTAMP_SIZE if (dat[0] & 0x1) else 0
 
     header = dat[:CANPACKET_HEAD_SIZE]
 
@@ -77,15 +80,19 @@ def unpack_can_buffer(dat):
       bus += 192
 
     # we need more from the next transfer
-    if data_len > len(dat) - CANPACKET_HEAD_SIZE:
+    if data_len + ts_len > len(dat) - CANPACKET_HEAD_SIZE:
       break
 
-    assert calculate_checksum(dat[:(CANPACKET_HEAD_SIZE+data_len)]) == 0, "CAN packet checksum incorrect"
+    assert calculate_checksum(dat[:(CANPACKET_HEAD_SIZE+data_len+ts_len)]) == 0, "CAN packet checksum incorrect"
 
     data = dat[CANPACKET_HEAD_SIZE:(CANPACKET_HEAD_SIZE+data_len)]
-    dat = dat[(CANPACKET_HEAD_SIZE+data_len):]
+    ts_dat = dat[(CANPACKET_HEAD_SIZE+data_len):(CANPACKET_HEAD_SIZE+data_len+ts_len)]
+    dat = dat[(CANPACKET_HEAD_SIZE+data_len+ts_len):]
 
-    ret.append((address, data, bus))
+    if timestamps:
+      ret.append((address, data, bus, struct.unpack("<I", ts_dat)[0] if ts_len else None))
+    else:
+      ret.append((address, data, bus))
 
   return (ret, dat)
 
@@ -166,11 +173,11 @@ class Panda:
   HW_TYPE_TRES = b'\x09'
   HW_TYPE_CUATRO = b'\x0a'
 
-  CAN_PACKET_VERSION = 4
-  HEALTH_PACKET_VERSION = 16
-  CAN_HEALTH_PACKET_VERSION = 5
-  HEALTH_STRUCT = struct.Struct("<IIIIIIIIBBBBBHBBBHfBBHBHHB")
-  CAN_HEALTH_STRUCT = struct.Struct("<BIBBBBBBBBIIIIIIIHHBBBIIII")
+  CAN_PACKET_VERSION = 5
+  HEALTH_PACKET_VERSION = 17
+  CAN_HEALTH_PACKET_VERSION = 10
+  HEALTH_STRUCT = struct.Struct("<IIIIIIIIBBBBBHBBBHfBBHBHHBfH")
+  CAN_HEALTH_STRUCT = struct.Struct("<BIBBBBBBBBIIIIIIIHHBBBIIIIHHIIIIIIII")
 
   F4_DEVICES = [HW_TYPE_WHITE_PANDA, HW_TYPE_GREY_PANDA, HW_TYPE_BLACK_PANDA, HW_TYPE_UNO, HW_TYPE_DOS]
   H7_DEVICES = [HW_TYPE_RED_PANDA, HW_TYPE_RED_PANDA_V2, HW_TYPE_TRES, HW_TYPE_CUATRO]
@@ -250,6 +257,7 @@ class Panda:
     self._handle_open = False
     self.can_rx_overflow_buffer = b''
     self._can_speed_kbps = can_speed_kbps
+    self._can_rx_timestamps = False
 
     # connect and set mcu type
     self.connect(claim)
@@ -313,6 +321,8 @@ class Panda:
 
     # reset comms
     self.can_reset_communications()
+    if self._can_rx_timestamps:
+      self.set_can_rx_timestamps(True)
 
     # set CAN speed
     for bus in range(PANDA_BUS_CNT):
@@ -358,10 +368,15 @@ class Panda:
 
     # ensure our protocol version matches the panda
     if handle is not None and not ignore_version:
-      if spi_version != handle.PROTOCOL_VERSION:
-        err = f"panda protocol mismatch: expected {handle.PROTOCOL_VERSION}, got {spi_version}. reflash panda"
+      if spi_version not in handle.PROTOCOL_VERSIONS:
+        err = f"panda protocol mismatch: expected one of {handle.PROTOCOL_VERSIONS}, got {spi_version}. reflash panda"
         raise PandaProtocolMismatch(err)
 
+      try:
+        handle.set_protocol_version(spi_version)
+      except PandaSpiException:
+        logging.debug("failed to switch SPI protocol version, staying on v2", exc_info=True)
+
     return None, handle, spi_serial, bootstub, None
 
   @classmethod
@@ -630,6 +645,8 @@ class Panda:
       "sbu1_voltage_mV": a[23],
       "sbu2_voltage_mV": a[24],
       "som_reset_triggered": a[25],
+      "main_loop_load": a[26],
+      "main_loop_max_task_us": a[27],
     }
 
   @ensure_can_health_packet_version
@@ -673,6 +690,17 @@ class Panda:
       "irq1_call_rate": a[23],
       "irq2_call_rate": a[24],
       "can_core_reset_count": a[25],
+      "tx_high_prio_depth": a[26],
+      "tx_low_prio_depth": a[27],
+      "tx_high_prio_drop_cnt": a[28],
+      "tx_low_prio_drop_cnt": a[29],
+      "tx_mailbox_replaced_cnt": a[30],
+      "total_tx_irq_cnt": a[31],
+      "tx_irq_per_frame": a[31] / max(a[13], 1),
+      "rx_fifo0_overrun_cnt": a[32],
+      "rx_fifo1_overrun_cnt": a[33],
+      "rx_staging_drop_cnt": a[34],
+      "rx_staging_max_latency_us": a[35],
     }
 
   # ******************* control *******************
@@ -761,6 +789,25 @@ class Panda:
     dat = self._handle.controlRead(Panda.REQUEST_IN, 0xc4, int(irqnum), 0, 4)
     return struct.unpack("I", dat)[0]
 
+  def get_safety_hook_timings(self, mode=None, reset=False):
+    """
+      Returns the count and min/avg/max time in microseconds spent in the rx, tx and fwd safety hooks of a safety mode,
+      the current one by default, since the last reset
+    """
+    dat = self._handle.controlRead(Panda.REQUEST_IN, 0xeb, 0xFFFF if mode is None else mode, int(reset), 64)
+    a = struct.unpack("<16I", dat)
+    core_mhz = a[0]
+    ret = {}
+    for i, hook in enumerate(("rx", "tx", "fwd")):
+      cnt, min_cycles, max_cycles, sum_lo, sum_hi = a[1 + 5 * i:6 + 5 * i]
+      ret[hook] = {
+        "count": cnt,
+        "min_us": min_cycles / core_mhz,
+        "avg_us": ((sum_hi << 32) | sum_lo) / cnt / core_mhz if cnt > 0 else 0.,
+        "max_us": max_cycles / core_mhz,
+      }
+    return ret
+
   # ******************* configuration *******************
 
   def set_power_save(self, power_save_enabled=0):
@@ -780,6 +827,36 @@ class Panda:
     # sets the can transceiver enable pin
     self._handle.controlWrite(Panda.REQUEST_OUT, 0xf4, int(bus_num), int(enable), b'')
 
+  def set_can_tx_priority(self, bus, addr, high=True):
+    # frames to addr on bus are sent before bulk traffic, on top of the safety mode's TX messages
+    self._handle.controlWrite(Panda.REQUEST_OUT, 0xe9, (int(high) << 15) | (bus << 13) | (addr >> 16), addr & 0xFFFF, b'')
+
+  def clear_can_tx_priorities(self):
+    self._handle.controlWrite(Panda.REQUEST_OUT, 0xe9, 0xFFFF, 0xFFFF, b'')
+
+  def set_can_tx_mailboxes(self, addrs):
+    # a newer frame to one of these (bus, addr) replaces the queued one instead of queueing behind it
+    self._handle.controlWrite(Panda.REQUEST_OUT, 0xea, 0xFFFF, 0xFFFF, b'')
+    for bus, addr in addrs:
+      self._handle.controlWrite(Panda.REQUEST_OUT, 0xea, (1 << 15) | (bus << 13) | (addr >> 16), addr & 0xFFFF, b'')
+
+  def set_can_filter(self, bus, addrs):
+    # receive only these IDs on bus, the CAN core drops the other frames. the safety mode's IDs are always received,
+    # and 11-bit IDs are only filtered if addrs has one. addrs are IDs or (ID, mask) for 11-bit IDs, None or empty
+    # receives everything
+    self._handle.controlWrite(Panda.REQUEST_OUT, 0xed, bus, 0, b'')
+    for a in (addrs or []):
+      addr, mask = a if isinstance(a, tuple) else (a, 0x7FF)
+      if addr >= 0x800:
+        self._handle.controlWrite(Panda.REQUEST_OUT, 0xec, (1 << 15) | (bus << 13) | (addr >> 16), addr & 0xFFFF, b'')
+      else:
+        self._handle.controlWrite(Panda.REQUEST_OUT, 0xec, (bus << 13) | mask, addr, b'')
+
+  def get_can_filter_state(self):
+    # per bus, if (11-bit, 29-bit) frames the filters don't match are dropped
+    dat = self._handle.controlRead(Panda.REQUEST_IN, 0xee, 0, 0, 3)
+    return [(bool(b & 1), bool(b & 2)) for b in dat]
+
   def set_can_speed_kbps(self, bus, speed):
     self._handle.controlWrite(Panda.REQUEST_OUT, 0xde, bus, int(speed * 10), b'')
 
@@ -809,6 +886,13 @@ class Panda:
   def can_reset_communications(self):
     self._handle.controlWrite(Panda.REQUEST_OUT, 0xc0, 0, 0, b'')
 
+  @ensure_can_packet_version
+  def set_can_rx_timestamps(self, enabled):
+    """With timestamps enabled, can_recv returns (address, data, bus, timestamp) with the
+    panda's microsecond timer value at reception. Costs 4 bytes per frame."""
+    self._handle.controlWrite(Panda.REQUEST_OUT, 0xe8, int(enabled), 0, b'')
+    self._can_rx_timestamps = enabled
+
   @ensure_can_packet_version
   def can_send_many(self, arr, timeout=CAN_SEND_TIMEOUT_MS):
     snds = pack_can_buffer(arr)
@@ -838,7 +922,38 @@ class Panda:
       except (usb1.USBErrorIO, usb1.USBErrorOverflow):
         logging.error("CAN: BAD RECV, RETRYING")
         time.sleep(0.1)
-    msgs, self.can_rx_overflow_buffer = unpack_can_buffer(self.can_rx_overflow_buffer + dat)
+    msgs, self.can_rx_overflow_buffer = unpack_can_buffer(self.can_rx_overflow_buffer + dat, self._can_rx_timestamps)
+    return msgs
+
+  @ensure_can_packet_version
+  def can_exchange(self, arr, timeout=CAN_SEND_TIMEOUT_MS):
+    """Sends the messages in arr and returns the received ones, like can_send_many followed by
+    can_recv. Over SPI both directions share the requests, which saves a round trip per cycle."""
+    if not self.spi:
+      self.can_send_many(arr, timeout=timeout)
+      return self.can_recv()
+
+    snds = b"".join(pack_can_buffer(arr))
+    sent = 0
+    received = 0
+    start_time = time.monotonic()
+    while True:
+      tx = snds[sent:sent+XFER_SIZE]
+      length = min(self._handle.max_rx_len, 16384 - received)
+      taken, dat = self._handle.bulkExchange(4, tx, length, timeout=timeout)
+      # keep what came in, even if the send times out
+      self.can_rx_overflow_buffer += dat
+      received += len(dat)
+      if taken:
+        sent += len(tx)
+        start_time = time.monotonic()
+      elif (timeout != 0) and ((time.monotonic() - start_time) * 1e3) > timeout:
+        raise PandaSpiNackResponse("CAN: TX queues full")
+
+      # everything sent and the RX queue read like can_recv does
+      if (sent == len(snds)) and ((len(dat) < length) or (received >= 16384)):
+        break
+    msgs, self.can_rx_overflow_buffer = unpack_can_buffer(self.can_rx_overflow_buffer, self._can_rx_timestamps)
     return msgs
 
   def can_clear(self, bus):
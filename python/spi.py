@@ -21,30 +21,49 @@ except ImportError:
 
 # Constants
 SYNC = 0x5A
+SYNC_V3 = 0x5B
 HACK = 0x79
 DACK = 0x85
 NACK = 0x1F
 CHECKSUM_START = 0xAB
 
+# v2 request that switches the panda to another protocol version
+ENDPOINT_PROTOCOL = 0xA3
+
+# v3 response: ACK, sequence number, 2 byte length, data, checksum
+V3_RESPONSE_HEADER_SIZE = 4
+
 MIN_ACK_TIMEOUT_MS = 100
+# v3: answers to another request before the master gives up on the panda still speaking v3
+V3_MAX_FOREIGN_RESPONSES = 3
 MAX_XFER_RETRY_COUNT = 5
 
 XFER_SIZE = 0x40*31
+# v3 pandas cut responses down to their TX buffer, which takes a whole 16kB CAN batch
+V3_MAX_RX_LEN = 0x4000
 
 DEV_PATH = "/dev/spidev0.0"
+# spidev copies every transfer through a buffer of this size and fails longer ones
+BUFSIZ_PATH = "/sys/module/spidev/parameters/bufsiz"
+DEFAULT_BUFSIZ = 4096
+
+
+def gen_crc8_table(poly):
+  table = []
+  for i in range(256):
+    crc = i
+    for _ in range(8):
+      crc = ((crc << 1) ^ poly) & 0xFF if (crc & 0x80) else (crc << 1)
+    table.append(crc)
+  return bytes(table)
+
+CRC8_LUT = gen_crc8_table(0xD5)  # standard crc8: x8+x7+x6+x4+x2+1, same as board/obj/crc_tables.h
 
 
 def crc8(data):
   crc = 0xFF    # standard init value
-  poly = 0xD5   # standard crc8: x8+x7+x6+x4+x2+1
-  size = len(data)
-  for i in range(size - 1, -1, -1):
-    crc ^= data[i]
-    for _ in range(8):
-      if ((crc & 0x80) != 0):
-        crc = ((crc << 1) ^ poly) & 0xFF
-      else:
-        crc <<= 1
+  for b in reversed(data):
+    crc = CRC8_LUT[crc ^ b]
   return crc
 
 
@@ -104,6 +123,13 @@ class SpiDevice:
     self._spidev.open(0, 0)
     self._spidev.max_speed_hz = speed
 
+    # longest single transfer
+    try:
+      with open(BUFSIZ_PATH) as f:
+        self.max_xfer_len = int(f.read())
+    except (OSError, ValueError):
+      self.max_xfer_len = DEFAULT_BUFSIZ
+
   @contextmanager
   def acquire(self):
     try:
@@ -122,12 +148,25 @@ class SpiDevice:
 class PandaSpiHandle(BaseHandle):
   """
   A class that mimics a libusb1 handle for panda SPI communications.
+
+  Protocol v2 takes a round trip for the header ACK and polls for the data ACK, v3 sends a request
+  in one transfer and clocks its response out with the next one, which can carry the next request.
   """
 
-  PROTOCOL_VERSION = 2
+  # the newest protocol version, and the ones we can talk
+  PROTOCOL_VERSION = 3
+  PROTOCOL_VERSIONS = (2, 3)
+
+  def __init__(self, dev=None) -> None:
+    self.dev = SpiDevice() if dev is None else dev
+    self.protocol_version = 2
 
-  def __init__(self) -> None:
-    self.dev = SpiDevice()
+    # v3: sequence number of the last request the panda took and the length of its response, whether
+    # the panda may have gone back to v2, and whether it NACKs every request until a read-only transfer
+    self._seq = 0
+    self._v3_response_len = V3_RESPONSE_HEADER_SIZE + 1
+    self._v3_resync = False
+    self._v3_nacked = False
 
     self._transfer_raw: Callable[[SpiDevice, int, bytes, int, int, bool], bytes] = self._transfer_spidev
 
@@ -221,10 +260,105 @@ class PandaSpiHandle(BaseHandle):
       raise PandaSpiException(f"ioctl returned {ret}")
     return bytes(self.rx_buf[:ret])
 
-  def _transfer(self, endpoint: int, data, timeout: int, max_rx_len: int = 1000, expect_disconnect: bool = False) -> bytes:
-    logging.debug("starting transfer: endpoint=%d, max_rx_len=%d", endpoint, max_rx_len)
+  def _transfer_v3(self, spi, requests, responses: list[bytes], timeout: int, expect_disconnect: bool = False) -> None:
+    if self._v3_resync:
+      logging.debug("- switching to v3")
+      self._transfer_spidev(spi, ENDPOINT_PROTOCOL, bytes([3, ]), MIN_ACK_TIMEOUT_MS)
+      self._seq = 0
+      self._v3_response_len = V3_RESPONSE_HEADER_SIZE + 1
+      self._v3_resync = False
+      self._v3_nacked = False
+
+    # every transfer sends the next request and clocks out the response to the one before. the
+    # panda repeats its last response until it takes another request, so a transfer it missed
+    # doesn't start with that response and read-only transfers wait for it to listen again. they
+    # also clear a NACK, so a pending response is read before the request goes out again. a
+    # transfer that starts before the panda handled the end of the last one gets the rest of the
+    # old response or the under-run value, which don't pass the sequence number and checksum.
+    # a panda busy with a request sends the under-run value, it's waited for like a v2 data ACK
+    timeout_s = max(MIN_ACK_TIMEOUT_MS, timeout) * 1e-3
+    i = 0
+    packet = None
+    seq = self._seq
+    max_rx_len = 0
+    pending = None  # max response length of the request the panda took last
+    sized = False   # pending is the exact length
+    ready = True
+    foreign = 0
+    start = time.monotonic()
+    while (i < len(requests)) or (pending is not None) or self._v3_nacked:
+      if (packet is None) and (i < len(requests)) and not self._v3_nacked:
+        endpoint, data, max_rx_len = requests[i]
+        max_rx_len = max(USBPACKET_MAX_SIZE, max_rx_len)
+        seq = (self._seq % 0xFF) + 1
+        header = struct.pack("<BBHHB", SYNC_V3, endpoint, len(data), max_rx_len, seq)
+        packet = bytes([*header, self._calc_checksum(header), *data, self._calc_checksum(data)])
+
+      tx = packet if (packet is not None) and ready else b""
+      if pending is None:
+        rx_len = len(tx) if len(tx) > 0 else self._v3_response_len
+      elif (len(tx) == 0) and not sized:
+        # a read-only transfer gets the length first, like a v2 data ACK
+        rx_len = V3_RESPONSE_HEADER_SIZE + 1 + min(pending, USBPACKET_MAX_SIZE)
+      else:
+        rx_len = V3_RESPONSE_HEADER_SIZE + 1 + pending
+      dat = bytes(spi.xfer2(tx + bytes(max(rx_len - len(tx), 0))))
+      ready = (dat[0] in (DACK, NACK)) and (dat[1] == self._seq)
+      if not ready:
+        # answers to another sequence number are a v2 panda NACKing the request, another master
+        # or a VERSION request switched it back. a transfer that started too early gets one at most
+        foreign += dat[0] in (DACK, NACK)
+        if (foreign >= V3_MAX_FOREIGN_RESPONSES) or ((timeout != 0) and ((time.monotonic() - start) > timeout_s)):
+          self._v3_resync = True
+          raise PandaSpiMissingAck
+        continue
+      start = time.monotonic()
+      foreign = 0
+
+      response = None
+      if pending is not None:
+        response_len = struct.unpack("<H", dat[2:4])[0]
+        if response_len > pending:
+          self._v3_resync = True
+          raise PandaSpiException(f"response length greater than max ({pending} {response_len})")
+        if len(dat) < (V3_RESPONSE_HEADER_SIZE + response_len + 1):
+          # the panda sends the whole response again with the next transfer
+          pending = response_len
+          sized = True
+          continue
+        response = dat[:V3_RESPONSE_HEADER_SIZE + response_len + 1]
+
+      if len(tx) > 0:
+        self._seq = seq
+        pending = max_rx_len
+        sized = False
+        packet = None
+        i += 1
+      else:
+        pending = None
+        self._v3_nacked = False
+
+      if response is not None:
+        if self._calc_checksum(response) != 0:
+          self._v3_resync = True
+          raise PandaSpiBadChecksum
+        self._v3_response_len = len(response)
+        if response[0] == NACK:
+          # the panda also NACKed whatever this transfer sent
+          self._v3_nacked = True
+          raise PandaSpiNackResponse
+        responses.append(response[V3_RESPONSE_HEADER_SIZE:-1])
+
+      if expect_disconnect and (pending is not None):
+        logging.debug("- expecting disconnect, returning")
+        responses.append(b"")
+        return
+
+  def _transfer_many(self, requests, timeout: int, expect_disconnect: bool = False) -> list[bytes]:
+    logging.debug("starting transfer: %d requests, endpoint=%d, max_rx_len=%d", len(requests), requests[0][0], requests[0][2])
     logging.debug("==============================================")
 
+    responses: list[bytes] = []
     n = 0
     start_time = time.monotonic()
     exc = PandaSpiException()
@@ -232,14 +366,39 @@ class PandaSpiHandle(BaseHandle):
       n += 1
       logging.debug("\ntry #%d", n)
       with self.dev.acquire() as spi:
+        done = len(responses)
         try:
-          return self._transfer_raw(spi, endpoint, data, timeout, max_rx_len, expect_disconnect)
+          if self.protocol_version >= 3:
+            self._transfer_v3(spi, requests[done:], responses, timeout, expect_disconnect)
+          else:
+            for endpoint, data, max_rx_len in requests[done:]:
+              responses.append(self._transfer_raw(spi, endpoint, data, timeout, max_rx_len, expect_disconnect))
+          return responses
         except PandaSpiException as e:
           exc = e
           logging.debug("SPI transfer failed, retrying", exc_info=True)
+        # the timeout is per request
+        if len(responses) > done:
+          start_time = time.monotonic()
 
     raise exc
 
+  def _transfer(self, endpoint: int, data, timeout: int, max_rx_len: int = 1000, expect_disconnect: bool = False) -> bytes:
+    return self._transfer_many([(endpoint, data, max_rx_len), ], timeout, expect_disconnect)[0]
+
+  def set_protocol_version(self, version: int) -> None:
+    """Switches to a protocol version the panda speaks, the kernel driver only does v2."""
+    if (version >= 3) and (self._transfer_raw == self._transfer_spidev):
+      self._transfer(ENDPOINT_PROTOCOL, bytes([3, ]), TIMEOUT)
+      self.protocol_version = 3
+      self._seq = 0
+      self._v3_response_len = V3_RESPONSE_HEADER_SIZE + 1
+      self._v3_nacked = False
+    elif (version < 3) and (self.protocol_version >= 3):
+      # VERSION switches the panda back to v2
+      self.protocol_version = 2
+      self.get_protocol_version()
+
   def get_protocol_version(self) -> bytes:
     vers_str = b"VERSION"
     def _get_version(spi) -> bytes:
@@ -266,6 +425,9 @@ class PandaSpiHandle(BaseHandle):
         raise PandaSpiBadChecksum
       return bytes(resp)
 
+    # it switches the panda back to v2
+    self._v3_resync = self.protocol_version >= 3
+
     exc = PandaSpiException()
     with self.dev.acquire() as spi:
       for _ in range(10):
@@ -281,25 +443,41 @@ class PandaSpiHandle(BaseHandle):
     self.dev.close()
 
   def controlWrite(self, request_type: int, request: int, value: int, index: int, data, timeout: int = TIMEOUT, expect_disconnect: bool = False):
-    return self._transfer(0, struct.pack("<BHHH", request, value, index, 0), timeout, expect_disconnect=expect_disconnect)
+    return self._transfer(0, struct.pack("<BHHH", request, value, index, 0), timeout, max_rx_len=0, expect_disconnect=expect_disconnect)
 
   def controlRead(self, request_type: int, request: int, value: int, index: int, length: int, timeout: int = TIMEOUT):
     return self._transfer(0, struct.pack("<BHHH", request, value, index, length), timeout, max_rx_len=length)
 
   def bulkWrite(self, endpoint: int, data: bytes, timeout: int = TIMEOUT) -> int:
-    for x in range(math.ceil(len(data) / XFER_SIZE)):
-      self._transfer(endpoint, data[XFER_SIZE*x:XFER_SIZE*(x+1)], timeout)
+    # v3 pipelines the chunks
+    requests = [(endpoint, data[XFER_SIZE*x:XFER_SIZE*(x+1)], 0) for x in range(math.ceil(len(data) / XFER_SIZE))]
+    if len(requests):
+      self._transfer_many(requests, timeout)
     return len(data)
 
+  @property
+  def max_rx_len(self) -> int:
+    if self.protocol_version < 3:
+      return XFER_SIZE
+    # v3 clocks out the whole response in one transfer, with its header, checksum and the flag of bulkExchange
+    return min(V3_MAX_RX_LEN, self.dev.max_xfer_len - V3_RESPONSE_HEADER_SIZE - 2)
+
   def bulkRead(self, endpoint: int, length: int, timeout: int = TIMEOUT) -> bytes:
     ret = b""
-    for _ in range(math.ceil(length / XFER_SIZE)):
-      d = self._transfer(endpoint, [], timeout, max_rx_len=XFER_SIZE)
+    while len(ret) < length:
+      chunk = min(self.max_rx_len, length - len(ret))
+      d = self._transfer(endpoint, [], timeout, max_rx_len=chunk)
       ret += d
-      if len(d) < XFER_SIZE:
+      if len(d) < chunk:
         break
     return ret
 
+  def bulkExchange(self, endpoint: int, data: bytes, length: int, timeout: int = TIMEOUT) -> tuple[bool, bytes]:
+    """Writes up to one chunk and reads up to length bytes in the same request, returns whether the
+    panda took the data and what it read."""
+    d = self._transfer(endpoint, data, timeout, max_rx_len=min(length, self.max_rx_len) + 1)
+    return d[0] != 0, d[1:]
+
 
 class STBootloaderSPIHandle(BaseSTBootloaderHandle):
   """
@@ -174,6 +174,11 @@ def test_bulk_write(p, panda_jungle):
   if len(rx) != 4 * NUM_MESSAGES_PER_BUS:
     raise Exception("Did not receive all messages!")
 
+  # the H7 refills its TX FIFO with a batch of frames per interrupt
+  if p.get_type() in Panda.H7_DEVICES:
+    for bus in range(3):
+      assert p.can_health(bus)['tx_irq_per_frame'] < 0.5
+
 def test_message_integrity(p):
   p.set_safety_mode(Panda.SAFETY_ALLOUTPUT)
   p.set_can_loopback(True)
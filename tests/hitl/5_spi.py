@@ -30,17 +30,23 @@ def test_dfu_with_spam(p):
     assert dfu_serial in PandaDFU.list()
 
 class TestSpi:
+  def _spy(self, mocker, panda):
+    # v2 waits for the header and the data ACK, v3 does the whole operation in one pipelined call
+    if panda._handle.protocol_version == 3:
+      return mocker.spy(panda._handle, '_transfer_v3'), 1
+    return mocker.spy(panda._handle, '_wait_for_ack'), 2
+
   def _ping(self, mocker, panda):
     # should work with no retries
-    spy = mocker.spy(panda._handle, '_wait_for_ack')
+    spy, calls = self._spy(mocker, panda)
     panda.health()
-    assert spy.call_count == 2
+    assert spy.call_count == calls
     mocker.stop(spy)
 
   def test_protocol_version_check(self, p):
     for bootstub in (False, True):
       p.reset(enter_bootstub=bootstub)
-      with patch('panda.python.spi.PandaSpiHandle.PROTOCOL_VERSION', return_value="abc"):
+      with patch('panda.python.spi.PandaSpiHandle.PROTOCOL_VERSIONS', ()):
         # list should still work with wrong version
         assert p._serial in Panda.list()
 
@@ -63,20 +69,20 @@ class TestSpi:
       assert bstub == (0xEE if bootstub else 0xCC)
 
   def test_all_comm_types(self, mocker, p):
-    spy = mocker.spy(p._handle, '_wait_for_ack')
+    spy, calls = self._spy(mocker, p)
 
     # controlRead + controlWrite
     p.health()
     p.can_clear(0)
-    assert spy.call_count == 2*2
+    assert spy.call_count == calls*2
 
     # bulkRead + bulkWrite
     p.can_recv()
     p.can_send(0x123, b"somedata", 0)
-    assert spy.call_count == 2*4
+    assert spy.call_count == calls*4
 
   def test_bad_header(self, mocker, p):
-    with patch('panda.python.spi.SYNC', return_value=0):
+    with patch('panda.python.spi.SYNC', 0x42), patch('panda.python.spi.SYNC_V3', 0x42):
       with pytest.raises(PandaSpiNackResponse):
         p._handle.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, p.HEALTH_STRUCT.size, timeout=50)
     self._ping(mocker, p)
@@ -91,7 +97,7 @@ class TestSpi:
 
   def test_non_existent_endpoint(self, mocker, p):
     for _ in range(10):
-      ep = random.randint(4, 20)
+      ep = random.randint(5, 20)
       with pytest.raises(PandaSpiNackResponse):
         p._handle.bulkRead(ep, random.randint(1, 1000), timeout=50)
 
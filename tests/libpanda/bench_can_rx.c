@@ -0,0 +1,90 @@
+// CAN RX benchmark: ns/frame of the RX interrupt top half (staging) and of the PendSV bottom half
+// (forwarding, safety and ignition hooks, push into can_rx_q), for a few safety modes. The traffic
+// is the mode's RX check messages plus 80 other 11-bit IDs on buses 0 and 2, staged a full
+// staging buffer at a time. A staged frame waits for at most CAN_RX_STAGING_SIZE bottom halves,
+// which is the forwarding latency bound printed, not counting the interrupts preempting PendSV.
+//
+// usage: ./bench_can_rx [rounds]
+
+#include <stdbool.h>
+
+#include "panda.c"
+#include "benchmark.h"
+
+#define BENCH_OTHER_IDS 80
+#define BENCH_FRAMES 4096U
+
+static CANPacket_t frames[BENCH_FRAMES];
+static uint32_t frames_len;
+
+static uint32_t bench_rand(uint32_t *state) {
+  *state = (*state * 1103515245U) + 12345U;
+  return *state >> 8;
+}
+
+static void make_traffic(void) {
+  uint32_t state = 1U;
+  frames_len = 0U;
+  while (frames_len < BENCH_FRAMES) {
+    CANPacket_t *pkt = &frames[frames_len];
+    (void)memset(pkt, 0, sizeof(*pkt));
+    uint32_t pick = bench_rand(&state) % (BENCH_OTHER_IDS + 32U);
+    if ((pick < 32U) && (pick < (uint32_t)current_safety_config.rx_checks_len)) {
+      const CanMsgCheck *m = &current_safety_config.rx_checks[pick].msg[0];
+      pkt->addr = m->addr;
+      pkt->bus = m->bus;
+    } else {
+      pkt->addr = bench_rand(&state) & 0x7FFU;
+      pkt->bus = ((bench_rand(&state) & 1U) != 0U) ? 2U : 0U;
+    }
+    pkt->data_len_code = 8U;
+    for (int b = 0; b < 8; b++) {
+      pkt->data[b] = (uint8_t)bench_rand(&state);
+    }
+    frames_len++;
+  }
+}
+
+static void drain_queues(void) {
+  CANPacket_t pkt;
+  while (can_packed_pop(&can_rx_q, &pkt)) {}
+  for (uint8_t bus = 0U; bus < 3U; bus++) {
+    can_tx_clear(bus);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint32_t rounds = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 100U;
+  const uint16_t modes[] = {SAFETY_SILENT, SAFETY_ALLOUTPUT, SAFETY_TOYOTA, SAFETY_HONDA_NIDEC, SAFETY_HYUNDAI_CANFD};
+
+  printf("mode  top half  bottom half  latency bound  (ns/frame, us)\n");
+  for (uint32_t i = 0U; i < (sizeof(modes) / sizeof(modes[0])); i++) {
+    (void)set_safety_hooks(modes[i], 0U);
+    make_traffic();
+    drain_queues();
+
+    uint64_t top_ns = 0U;
+    uint64_t bottom_ns = 0U;
+    for (uint32_t r = 0U; r < rounds; r++) {
+      for (uint32_t n = 0U; n < frames_len; n += CAN_RX_STAGING_SIZE) {
+        uint64_t start = bench_nanos();
+        for (uint32_t k = n; (k < (n + CAN_RX_STAGING_SIZE)) && (k < frames_len); k++) {
+          can_rx_staged_t *staged = can_rx_stage_reserve(CAN_NUM_FROM_BUS_NUM(frames[k].bus));
+          staged->pkt = frames[k];
+          staged->rx_time = r;
+          can_rx_stage_commit();
+        }
+        uint64_t mid = bench_nanos();
+        can_rx_process();
+        top_ns += mid - start;
+        bottom_ns += bench_nanos() - mid;
+        drain_queues();
+      }
+    }
+
+    double top = (double)top_ns / ((double)rounds * (double)frames_len);
+    double bottom = (double)bottom_ns / ((double)rounds * (double)frames_len);
+    printf("%4u  %8.1f  %11.1f  %13.1f\n", modes[i], top, bottom, (bottom * CAN_RX_STAGING_SIZE) / 1000.0);
+  }
+  return 0;
+}
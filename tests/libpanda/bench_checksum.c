@@ -0,0 +1,75 @@
+// Checksum kernel benchmark: ns/frame of every safety mode's checksum kernel against the byte
+// and bit at a time version it replaced (checksum_reference.h), on random data with the
+// addresses and lengths of the mode's RX check messages. Also checks that both agree.
+//
+// usage: ./bench_checksum [rounds]
+
+#include <stdbool.h>
+
+#include "panda.c"
+#include "benchmark.h"
+
+#define BENCH_FRAMES 4096U
+
+static CANPacket_t frames[BENCH_FRAMES];
+
+static uint32_t bench_rand(uint32_t *state) {
+  *state = (*state * 1103515245U) + 12345U;
+  return *state >> 8;
+}
+
+static void make_frames(void) {
+  uint32_t state = 1U;
+  for (uint32_t n = 0U; n < BENCH_FRAMES; n++) {
+    const CanMsgCheck *m = &current_safety_config.rx_checks[n % (uint32_t)current_safety_config.rx_checks_len].msg[0];
+    CANPacket_t *pkt = &frames[n];
+    (void)memset(pkt, 0, sizeof(*pkt));
+    pkt->addr = m->addr;
+    pkt->extended = (m->addr >= 0x800) ? 1U : 0U;
+    pkt->bus = m->bus;
+    for (uint8_t dlc = 0U; dlc < sizeof(dlc_to_len); dlc++) {
+      if (dlc_to_len[dlc] == m->len) {
+        pkt->data_len_code = dlc;
+      }
+    }
+    for (int b = 0; b < m->len; b++) {
+      pkt->data[b] = (uint8_t)bench_rand(&state);
+    }
+  }
+}
+
+static double bench_ns(uint32_t (*compute)(const CANPacket_t *to_push), uint32_t rounds) {
+  uint64_t start = bench_nanos();
+  for (uint32_t r = 0U; r < rounds; r++) {
+    for (uint32_t n = 0U; n < BENCH_FRAMES; n++) {
+      uint32_t res = compute(&frames[n]);
+      BENCH_KEEP(res);
+    }
+  }
+  return (double)(bench_nanos() - start) / ((double)rounds * (double)BENCH_FRAMES);
+}
+
+int main(int argc, char **argv) {
+  uint32_t rounds = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 200U;
+  int ret = 0;
+
+  printf("mode  reference     kernel  speedup  (ns/frame)\n");
+  for (unsigned int i = 0U; i < CHECKSUM_REFERENCES_LEN; i++) {
+    const checksum_reference *c = &CHECKSUM_REFERENCES[i];
+    (void)set_safety_hooks(c->mode, 0U);
+    make_frames();
+
+    for (uint32_t n = 0U; n < BENCH_FRAMES; n++) {
+      if (current_hooks->compute_checksum(&frames[n]) != c->reference(&frames[n])) {
+        printf("mode %u: kernel and reference disagree on 0x%x\n", c->mode, frames[n].addr);
+        ret = 1;
+        break;
+      }
+    }
+
+    double reference_ns = bench_ns(c->reference, rounds);
+    double kernel_ns = bench_ns(current_hooks->compute_checksum, rounds);
+    printf("%4u  %9.1f  %9.1f  %6.1fx\n", c->mode, reference_ns, kernel_ns, reference_ns / kernel_ns);
+  }
+  return ret;
+}
@@ -0,0 +1,145 @@
+// comms_can_read/comms_can_write throughput for full USB and SPI bulk transfers, comms_can_write
+// for transfers cut at random points, and SPI reads with their response checksum, either as a
+// second pass or while copying out of the RX queue.
+// Frames are 8 byte classic CAN frames, as seen on most buses.
+//
+// usage: ./bench_comms [transfers]
+
+#include <stdbool.h>
+
+#include "panda.c"
+#include "benchmark.h"
+
+#define BENCH_FRAME_LEN (CANPACKET_HEAD_SIZE + 8U)
+
+static uint32_t pack_frames(uint8_t *buf, uint32_t frames, uint32_t seq) {
+  uint32_t pos = 0U;
+  for (uint32_t i = 0U; i < frames; i++) {
+    CANPacket_t pkt = {0};
+    pkt.bus = (seq + i) % PANDA_BUS_CNT;
+    pkt.addr = 0x100U + ((seq + i) & 0x3FFU);
+    pkt.data_len_code = 8U;
+    (void)memcpy(pkt.data, &i, sizeof(i));
+    can_set_checksum(&pkt);
+    (void)memcpy(&buf[pos], &pkt, BENCH_FRAME_LEN);
+    pos += BENCH_FRAME_LEN;
+  }
+  return pos;
+}
+
+// chunk_size is the size of each comms call, a full USB packet or the whole SPI transfer. 0 cuts
+// the transfer into random chunks of up to two USB packets, so frames straddle the comms calls.
+static void bench_write(const char *name, uint32_t frames, uint32_t chunk_size, uint32_t transfers) {
+  uint8_t buf[MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER * BENCH_FRAME_LEN];
+  uint32_t len = pack_frames(buf, frames, 0U);
+  CANPacket_t drain[MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER];
+  uint32_t sent = 0U;
+  uint32_t state = 1U;
+
+  comms_can_reset();
+  uint64_t start = bench_nanos();
+  for (uint32_t t = 0U; t < transfers; t++) {
+    uint32_t pos = 0U;
+    while (pos < len) {
+      uint32_t chunk = chunk_size;
+      if (chunk == 0U) {
+        state = (state * 1103515245U) + 12345U;
+        chunk = 1U + ((state >> 16) % (2U * USBPACKET_MAX_SIZE));
+      }
+      chunk = MIN(chunk, len - pos);
+      comms_can_write(&buf[pos], chunk);
+      pos += chunk;
+    }
+    // CAN cores empty the TX queues
+    for (uint8_t bus = 0U; bus < PANDA_BUS_CNT; bus++) {
+      sent += can_pop_many(can_queues[bus], drain, MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER);
+    }
+  }
+  uint64_t elapsed = bench_nanos() - start;
+
+  printf("write %-4s %3u frames/transfer: %12.0f frames/s %s\n", name, frames,
+         (double)sent * 1e9 / (double)elapsed, (sent == (frames * transfers)) ? "" : "FRAMES LOST");
+}
+
+static void bench_read(const char *name, uint32_t frames, uint32_t chunk_size, uint32_t transfers) {
+  uint8_t buf[MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER * BENCH_FRAME_LEN];
+  CANPacket_t pkts[MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER] = {0};
+  for (uint32_t i = 0U; i < frames; i++) {
+    pkts[i].bus = i % PANDA_BUS_CNT;
+    pkts[i].addr = 0x100U + i;
+    pkts[i].data_len_code = 8U;
+    (void)memcpy(pkts[i].data, &i, sizeof(i));
+    can_set_checksum(&pkts[i]);
+  }
+  uint32_t len = frames * BENCH_FRAME_LEN;
+  uint64_t received = 0U;
+
+  comms_can_reset();
+  can_packed_clear(&can_rx_q);
+  uint64_t start = bench_nanos();
+  for (uint32_t t = 0U; t < transfers; t++) {
+    // CAN cores fill the RX queue
+    for (uint32_t i = 0U; i < frames; i++) {
+      (void)can_packed_push(&can_rx_q, &pkts[i]);
+    }
+    for (uint32_t pos = 0U; pos < len; pos += chunk_size) {
+      received += (uint32_t)comms_can_read(buf, MIN(chunk_size, len - pos));
+    }
+  }
+  uint64_t elapsed = bench_nanos() - start;
+
+  printf("read  %-4s %3u frames/transfer: %12.0f frames/s %s\n", name, frames,
+         (double)(received / BENCH_FRAME_LEN) * 1e9 / (double)elapsed,
+         (received == ((uint64_t)len * transfers)) ? "" : "FRAMES LOST");
+}
+
+// a full 16kB SPI response, where the checksum pass used to come after the copy
+static void bench_read_checksum(bool fused, uint32_t transfers) {
+  const uint32_t frames = 0x4000U / BENCH_FRAME_LEN;
+  static uint8_t buf[0x4000U + 4U];
+  CANPacket_t pkt = {0};
+  pkt.addr = 0x100U;
+  pkt.data_len_code = 8U;
+  uint64_t received = 0U;
+  uint8_t checksum = 0U;
+
+  comms_can_reset();
+  can_packed_clear(&can_rx_q);
+  uint64_t elapsed = 0U;
+  for (uint32_t t = 0U; t < transfers; t++) {
+    for (uint32_t i = 0U; i < frames; i++) {
+      pkt.bus = i % PANDA_BUS_CNT;
+      pkt.data[0] = (uint8_t)(i + t);
+      (void)can_packed_push(&can_rx_q, &pkt);
+    }
+    // the response data starts after the v3 header
+    uint64_t start = bench_nanos();
+    if (fused) {
+      received += (uint32_t)comms_can_read_checksum(&buf[4], 0x4000U, &checksum);
+    } else {
+      uint32_t len = (uint32_t)comms_can_read(&buf[4], 0x4000U);
+      for (uint32_t i = 0U; i < len; i++) {
+        checksum ^= buf[4U + i];
+      }
+      received += len;
+    }
+    elapsed += bench_nanos() - start;
+  }
+
+  printf("read  SPI 16kB, checksum %-11s %10.0f MB/s (%02x)\n", fused ? "in the copy" : "after",
+         (double)received * 1e3 / (double)elapsed, checksum);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t transfers = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 20000U;
+  set_safety_hooks(SAFETY_ALLOUTPUT, 0U);
+
+  bench_write("USB", MAX_CAN_MSGS_PER_USB_BULK_TRANSFER, USBPACKET_MAX_SIZE, transfers);
+  bench_write("SPI", MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER, MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER * BENCH_FRAME_LEN, transfers);
+  bench_write("rand", MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER, 0U, transfers);
+  bench_read("USB", MAX_CAN_MSGS_PER_USB_BULK_TRANSFER, USBPACKET_MAX_SIZE, transfers);
+  bench_read("SPI", MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER, MAX_CAN_MSGS_PER_SPI_BULK_TRANSFER * BENCH_FRAME_LEN, transfers);
+  bench_read_checksum(false, transfers / 10U);
+  bench_read_checksum(true, transfers / 10U);
+  return 0;
+}
@@ -0,0 +1,110 @@
+// RX dispatch benchmark: the per frame hook work of can_rx for every safety mode in the registry,
+// once calling the fwd, rx and ignition hooks for every frame like before, and once through
+// safety_rx_dispatch. The traffic is recorded-style: the mode's RX check messages plus 80 other
+// 11-bit IDs at 10-100 Hz on bus 0, and the same IDs echoed by a camera on bus 2.
+//
+// usage: ./bench_rx_dispatch [rounds]
+
+#include <stdbool.h>
+
+#include "panda.c"
+#include "benchmark.h"
+
+#define BENCH_OTHER_IDS 80
+#define BENCH_FRAMES 8192U
+
+static CANPacket_t frames[BENCH_FRAMES];
+static uint32_t frames_len;
+
+static uint32_t bench_rand(uint32_t *state) {
+  *state = (*state * 1103515245U) + 12345U;
+  return *state >> 8;
+}
+
+// one second of traffic, frames of each ID spread evenly
+static void make_traffic(void) {
+  int addrs[BENCH_OTHER_IDS + 32];
+  int periods[BENCH_OTHER_IDS + 32];
+  int addrs_len = 0;
+  uint32_t state = 1U;
+
+  for (int i = 0; (i < current_safety_config.rx_checks_len) && (addrs_len < 32); i++) {
+    addrs[addrs_len] = current_safety_config.rx_checks[i].msg[0].addr;
+    periods[addrs_len] = 10;
+    addrs_len++;
+  }
+  for (int i = 0; i < BENCH_OTHER_IDS; i++) {
+    const int period_ms[] = {10, 20, 50, 100};
+    addrs[addrs_len] = (int)(bench_rand(&state) & 0x7FFU);
+    periods[addrs_len] = period_ms[bench_rand(&state) % 4U];
+    addrs_len++;
+  }
+
+  frames_len = 0U;
+  for (int t = 0; (t < 1000) && (frames_len < (BENCH_FRAMES - 2U)); t++) {
+    for (int i = 0; (i < addrs_len) && (frames_len < (BENCH_FRAMES - 2U)); i++) {
+      if ((t % periods[i]) == 0) {
+        for (int bus = 0; bus <= 2; bus += 2) {
+          CANPacket_t *pkt = &frames[frames_len];
+          (void)memset(pkt, 0, sizeof(*pkt));
+          pkt->addr = addrs[i];
+          pkt->extended = (addrs[i] >= 0x800) ? 1U : 0U;
+          pkt->bus = bus;
+          pkt->data_len_code = 8U;
+          for (int b = 0; b < 8; b++) {
+            pkt->data[b] = (uint8_t)bench_rand(&state);
+          }
+          frames_len++;
+        }
+      }
+    }
+  }
+}
+
+static double bench_ns(bool dispatched, uint32_t rounds) {
+  uint64_t start = bench_nanos();
+  for (uint32_t r = 0U; r < rounds; r++) {
+    for (uint32_t n = 0U; n < frames_len; n++) {
+      CANPacket_t *to_push = &frames[n];
+      int bus_fwd_num;
+      if (dispatched) {
+        bool dispatch = safety_rx_dispatch(to_push);
+        bus_fwd_num = dispatch ? safety_fwd_hook(to_push->bus, to_push->addr) : safety_fwd_default(to_push->bus);
+        if (dispatch) {
+          safety_rx_invalid += safety_rx_hook(to_push) ? 0U : 1U;
+          ignition_can_hook(to_push);
+        }
+      } else {
+        bus_fwd_num = safety_fwd_hook(to_push->bus, to_push->addr);
+        bool valid = rx_msg_safety_check(to_push, &current_safety_config, current_hooks);
+        if (valid) {
+          current_hooks->rx(to_push);
+        }
+        safety_rx_invalid += valid ? 0U : 1U;
+        ignition_can_hook(to_push);
+      }
+      BENCH_KEEP(bus_fwd_num);
+    }
+  }
+  return (double)(bench_nanos() - start) / ((double)rounds * (double)frames_len);
+}
+
+int main(int argc, char **argv) {
+  uint32_t rounds = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 100U;
+
+  printf("mode  frames  dispatched   all hooks  dispatch  (ns/frame)\n");
+  int mode_cnt = sizeof(safety_hook_registry) / sizeof(safety_hook_config);
+  for (int i = 0; i < mode_cnt; i++) {
+    uint16_t mode = safety_hook_registry[i].id;
+    (void)set_safety_hooks(mode, 0U);
+    make_traffic();
+
+    uint32_t dispatched = 0U;
+    for (uint32_t n = 0U; n < frames_len; n++) {
+      dispatched += safety_rx_dispatch(&frames[n]) ? 1U : 0U;
+    }
+    printf("%4u  %6u  %9.1f%%  %10.1f  %8.1f\n", mode, frames_len, (100.0 * dispatched) / frames_len,
+           bench_ns(false, rounds), bench_ns(true, rounds));
+  }
+  return 0;
+}
@@ -0,0 +1,288 @@
+// Safety mode throughput benchmark: ns/frame of the RX, TX and FWD safety hooks for every safety
+// mode in the registry, on one second of generated traffic per mode:
+//  - the mode's RX check messages at their expected frequency, with valid checksums and counters
+//  - 80 other 11-bit IDs at 10-100 Hz on buses 0-2, which no RX check covers
+//  - the mode's TX messages at 100 Hz
+// The results also go to a JSON file, for tests/libpanda/bench_safety_compare.py to flag regressions.
+// tests/safety/test.sh does that when BENCH_SAFETY_BASELINE points at an earlier results file.
+//
+// usage: ./bench_safety [-o results.json] [rounds]
+
+#include <stdbool.h>
+
+#include "panda.c"
+#include "benchmark.h"
+
+#define BENCH_OTHER_IDS 80
+#define BENCH_RX_FRAMES 16384U
+#define BENCH_TX_FRAMES 4096U
+#define BENCH_FIELD_BITS (64U * 8U)
+#define BENCH_TRIES 32
+
+typedef struct {
+  CANPacket_t pkt;
+  uint32_t ts;  // us
+  bool checked;  // one of the mode's RX check messages
+} bench_frame;
+
+static bench_frame rx_frames[BENCH_RX_FRAMES];
+static uint32_t rx_frames_len;
+static bench_frame tx_frames[BENCH_TX_FRAMES];
+static uint32_t tx_frames_len;
+
+typedef struct {
+  uint16_t mode;
+  uint32_t rx_frames;
+  uint32_t rx_checked;
+  uint32_t rx_valid;
+  uint32_t tx_frames;
+  double rx_ns;
+  double tx_ns;
+  double fwd_ns;
+} bench_result;
+
+static uint32_t bench_rand(uint32_t *state) {
+  *state = (*state * 1103515245U) + 12345U;
+  return *state >> 8;
+}
+
+static void fill_frame(CANPacket_t *pkt, int addr, int bus, int len) {
+  (void)memset(pkt, 0, sizeof(*pkt));
+  pkt->addr = addr;
+  pkt->extended = (addr >= 0x800) ? 1U : 0U;
+  pkt->bus = bus;
+  for (uint8_t dlc = 0U; dlc < sizeof(dlc_to_len); dlc++) {
+    if (dlc_to_len[dlc] == len) {
+      pkt->data_len_code = dlc;
+    }
+  }
+}
+
+// The counter and checksum getters extract a field from the data, so flipping a single data bit
+// changes their result by that bit's weight in the field. This finds the weights, which
+// set_field uses to write a value into the field.
+typedef struct {
+  uint32_t weights[BENCH_FIELD_BITS];
+} bench_field;
+
+static uint32_t get_field(const CANPacket_t *pkt, bool counter) {
+  return counter ? current_hooks->get_counter(pkt) : current_hooks->get_checksum(pkt);
+}
+
+static void probe_field(const CANPacket_t *pkt, bool counter, bench_field *field) {
+  CANPacket_t probe = *pkt;
+  (void)memset(probe.data, 0, sizeof(probe.data));
+  uint32_t zero = get_field(&probe, counter);
+  for (uint32_t bit = 0U; bit < (GET_LEN(pkt) * 8U); bit++) {
+    probe.data[bit / 8U] = (uint8_t)(1U << (bit % 8U));
+    field->weights[bit] = get_field(&probe, counter) ^ zero;
+    probe.data[bit / 8U] = 0U;
+  }
+}
+
+static void set_field(CANPacket_t *pkt, const bench_field *field, uint32_t value) {
+  for (uint32_t bit = 0U; bit < (GET_LEN(pkt) * 8U); bit++) {
+    if (field->weights[bit] != 0U) {
+      uint8_t mask = (uint8_t)(1U << (bit % 8U));
+      pkt->data[bit / 8U] = ((value & field->weights[bit]) != 0U) ? (pkt->data[bit / 8U] | mask) : (pkt->data[bit / 8U] & ~mask);
+    }
+  }
+}
+
+// random data with the given counter and a valid checksum and quality flag, if the mode checks them
+static void fill_checked(CANPacket_t *pkt, const CanMsgCheck *m, uint8_t counter, uint32_t *state) {
+  static bench_field counter_field;
+  static bench_field checksum_field;
+  bool use_counter = (m->max_counter > 0U) && (current_hooks->get_counter != NULL);
+  bool use_checksum = m->check_checksum && (current_hooks->get_checksum != NULL) && (current_hooks->compute_checksum != NULL);
+
+  fill_frame(pkt, m->addr, m->bus, m->len);
+  if (use_counter) {
+    probe_field(pkt, true, &counter_field);
+  }
+  if (use_checksum) {
+    probe_field(pkt, false, &checksum_field);
+  }
+
+  for (int tries = 0; tries < BENCH_TRIES; tries++) {
+    for (int b = 0; b < m->len; b++) {
+      pkt->data[b] = (uint8_t)bench_rand(state);
+    }
+    if (use_counter) {
+      set_field(pkt, &counter_field, counter);
+    }
+    if (use_checksum) {
+      set_field(pkt, &checksum_field, current_hooks->compute_checksum(pkt));
+    }
+
+    bool valid = !use_counter || (current_hooks->get_counter(pkt) == counter);
+    valid = valid && (!use_checksum || (current_hooks->get_checksum(pkt) == current_hooks->compute_checksum(pkt)));
+    valid = valid && ((current_hooks->get_quality_flag_valid == NULL) || current_hooks->get_quality_flag_valid(pkt));
+    if (valid) {
+      break;
+    }
+  }
+}
+
+static void make_traffic(void) {
+  const int period_ms[] = {10, 20, 50, 100};
+  int other_addrs[BENCH_OTHER_IDS];
+  int other_buses[BENCH_OTHER_IDS];
+  int other_periods[BENCH_OTHER_IDS];
+  uint8_t counters[32] = {0};
+  uint32_t state = 1U;
+
+  for (int i = 0; i < BENCH_OTHER_IDS; i++) {
+    other_addrs[i] = (int)(bench_rand(&state) & 0x7FFU);
+    other_buses[i] = (int)(bench_rand(&state) % 3U);
+    other_periods[i] = period_ms[bench_rand(&state) % 4U];
+  }
+
+  rx_frames_len = 0U;
+  tx_frames_len = 0U;
+  for (uint32_t t = 0U; t < 1000U; t++) {
+    for (int i = 0; (i < current_safety_config.rx_checks_len) && (i < 32); i++) {
+      const CanMsgCheck *m = &current_safety_config.rx_checks[i].msg[0];
+      uint32_t period = MAX(1000U / MAX(m->frequency, 1U), 1U);
+      if (((t % period) == 0U) && (rx_frames_len < BENCH_RX_FRAMES)) {
+        bench_frame *f = &rx_frames[rx_frames_len];
+        fill_checked(&f->pkt, m, counters[i], &state);
+        f->ts = t * 1000U;
+        f->checked = true;
+        counters[i] = (counters[i] >= m->max_counter) ? 0U : (counters[i] + 1U);
+        rx_frames_len++;
+      }
+    }
+    for (int i = 0; i < BENCH_OTHER_IDS; i++) {
+      if (((t % (uint32_t)other_periods[i]) == 0U) && (rx_frames_len < BENCH_RX_FRAMES)) {
+        bench_frame *f = &rx_frames[rx_frames_len];
+        fill_frame(&f->pkt, other_addrs[i], other_buses[i], 8);
+        for (int b = 0; b < 8; b++) {
+          f->pkt.data[b] = (uint8_t)bench_rand(&state);
+        }
+        f->ts = t * 1000U;
+        f->checked = false;
+        rx_frames_len++;
+      }
+    }
+    for (int i = 0; i < current_safety_config.tx_msgs_len; i++) {
+      if (((t % 10U) == 0U) && (tx_frames_len < BENCH_TX_FRAMES)) {
+        const CanMsg *m = &current_safety_config.tx_msgs[i];
+        bench_frame *f = &tx_frames[tx_frames_len];
+        fill_frame(&f->pkt, m->addr, m->bus, m->len);
+        f->ts = t * 1000U;
+        f->checked = false;
+        tx_frames_len++;
+      }
+    }
+  }
+}
+
+static double bench_ns(uint8_t hook, uint32_t rounds) {
+  bench_frame *frames = (hook == SAFETY_HOOK_TX) ? tx_frames : rx_frames;
+  uint32_t frames_len = (hook == SAFETY_HOOK_TX) ? tx_frames_len : rx_frames_len;
+  if (frames_len == 0U) {
+    return 0.0;
+  }
+
+  uint64_t start = bench_nanos();
+  for (uint32_t r = 0U; r < rounds; r++) {
+    for (uint32_t n = 0U; n < frames_len; n++) {
+      timer.CNT = frames[n].ts + (r * 1000000U);
+      int res;
+      if (hook == SAFETY_HOOK_RX) {
+        res = safety_rx_hook(&frames[n].pkt);
+      } else if (hook == SAFETY_HOOK_TX) {
+        res = safety_tx_hook(&frames[n].pkt);
+      } else {
+        res = safety_fwd_hook(frames[n].pkt.bus, frames[n].pkt.addr);
+      }
+      BENCH_KEEP(res);
+    }
+  }
+  return (double)(bench_nanos() - start) / ((double)rounds * (double)frames_len);
+}
+
+static bench_result bench_mode(uint16_t mode, uint32_t rounds) {
+  bench_result res = {.mode = mode};
+  (void)set_safety_hooks(mode, 0U);
+  make_traffic();
+  res.rx_frames = rx_frames_len;
+  res.tx_frames = tx_frames_len;
+
+  // how much of the RX check traffic the mode accepts, from a fresh state
+  for (uint32_t n = 0U; n < rx_frames_len; n++) {
+    timer.CNT = rx_frames[n].ts;
+    bool valid = safety_rx_hook(&rx_frames[n].pkt);
+    if (rx_frames[n].checked) {
+      res.rx_checked++;
+      res.rx_valid += valid ? 1U : 0U;
+    }
+  }
+
+  // engaged, so the TX hooks check their limits
+  (void)set_safety_hooks(mode, 0U);
+  controls_allowed = true;
+  res.rx_ns = bench_ns(SAFETY_HOOK_RX, rounds);
+  controls_allowed = true;
+  res.tx_ns = bench_ns(SAFETY_HOOK_TX, rounds);
+  res.fwd_ns = bench_ns(SAFETY_HOOK_FWD, rounds);
+  return res;
+}
+
+static void write_json(FILE *f, const bench_result *results, int results_len, uint32_t rounds) {
+  fprintf(f, "{\n  \"benchmark\": \"bench_safety\",\n  \"rounds\": %u,\n  \"modes\": [\n", rounds);
+  for (int i = 0; i < results_len; i++) {
+    const bench_result *r = &results[i];
+    fprintf(f, "    {\"mode\": %u, \"rx_frames\": %u, \"rx_checked\": %u, \"rx_valid\": %u, \"tx_frames\": %u, "
+               "\"rx_ns\": %.2f, \"tx_ns\": %.2f, \"fwd_ns\": %.2f}%s\n",
+            r->mode, r->rx_frames, r->rx_checked, r->rx_valid, r->tx_frames, r->rx_ns, r->tx_ns, r->fwd_ns,
+            (i < (results_len - 1)) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+  const char *out_fn = NULL;
+  long rounds_arg = 50;
+  for (int i = 1; i < argc; i++) {
+    if ((argv[i][0] == '-') && (argv[i][1] == 'o') && ((i + 1) < argc)) {
+      out_fn = argv[++i];
+    } else {
+      char *end;
+      rounds_arg = strtol(argv[i], &end, 10);
+      rounds_arg = (*end == '\0') ? rounds_arg : 0;
+    }
+  }
+  if ((rounds_arg < 1) || (rounds_arg > 100000)) {
+    printf("usage: ./bench_safety [-o results.json] [rounds], rounds from 1 to 100000\n");
+    return 1;
+  }
+  uint32_t rounds = (uint32_t)rounds_arg;
+
+  static bench_result results[sizeof(safety_hook_registry) / sizeof(safety_hook_config)];
+  int mode_cnt = sizeof(safety_hook_registry) / sizeof(safety_hook_config);
+
+  printf("mode  rx frames  rx valid  tx frames     rx     tx    fwd  (ns/frame)\n");
+  for (int i = 0; i < mode_cnt; i++) {
+    results[i] = bench_mode(safety_hook_registry[i].id, rounds);
+    const bench_result *r = &results[i];
+    char rx_valid[16] = "n/a";
+    if (r->rx_checked > 0U) {
+      (void)snprintf(rx_valid, sizeof(rx_valid), "%.1f%%", (100.0 * r->rx_valid) / r->rx_checked);
+    }
+    printf("%4u  %9u  %8s  %9u  %5.1f  %5.1f  %5.1f\n", r->mode, r->rx_frames, rx_valid,
+           r->tx_frames, r->rx_ns, r->tx_ns, r->fwd_ns);
+  }
+
+  if (out_fn != NULL) {
+    FILE *f = fopen(out_fn, "w");
+    if (f == NULL) {
+      perror(out_fn);
+      return 1;
+    }
+    write_json(f, results, mode_cnt, rounds);
+    (void)fclose(f);
+  }
+  return 0;
+}
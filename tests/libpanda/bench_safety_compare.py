@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+import argparse
+import json
+import sys
+
+HOOKS = ("rx_ns", "tx_ns", "fwd_ns")
+
+
+def load(fn):
+  with open(fn) as f:
+    return {m["mode"]: m for m in json.load(f)["modes"]}
+
+
+def compare(baseline, current, threshold, min_ns):
+  """Returns the (mode, hook, baseline ns, current ns) that got more than threshold slower."""
+  regressions = []
+  for mode, cur in sorted(current.items()):
+    if mode not in baseline:
+      continue
+    for hook in HOOKS:
+      base_ns, cur_ns = baseline[mode][hook], cur[hook]
+      # a few ns difference on the fastest hooks is noise
+      if cur_ns > max(base_ns * (1 + threshold), base_ns + min_ns):
+        regressions.append((mode, hook, base_ns, cur_ns))
+    if cur["rx_valid"] < baseline[mode]["rx_valid"]:
+      regressions.append((mode, "rx_valid", baseline[mode]["rx_valid"], cur["rx_valid"]))
+  return regressions
+
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser(description="Compare two bench_safety results, fail on regressions")
+  parser.add_argument("baseline")
+  parser.add_argument("current")
+  parser.add_argument("--threshold", type=float, default=0.2, help="allowed relative slowdown per hook")
+  parser.add_argument("--min-ns", type=float, default=2.0, help="allowed absolute slowdown per hook")
+  args = parser.parse_args()
+
+  regressions = compare(load(args.baseline), load(args.current), args.threshold, args.min_ns)
+  for mode, hook, base, cur in regressions:
+    print(f"mode {mode} {hook}: {base} -> {cur}")
+  sys.exit(1 if len(regressions) else 0)
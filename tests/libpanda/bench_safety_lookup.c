@@ -0,0 +1,101 @@
+// TX whitelist and RX check lookup benchmark: for every safety mode in the registry,
+// the linear scans (msg_allowed, get_addr_check_index) against the sorted index
+// set_safety_hooks builds. The traffic is half the mode's own TX and RX check
+// messages and half random 11-bit IDs, on buses 0-2.
+//
+// usage: ./bench_safety_lookup [rounds]
+
+#include <stdbool.h>
+
+#include "panda.c"
+#include "benchmark.h"
+
+#define BENCH_FRAMES 4096U
+
+static CANPacket_t frames[BENCH_FRAMES];
+
+static uint32_t bench_rand(uint32_t *state) {
+  *state = (*state * 1103515245U) + 12345U;
+  return *state >> 8;
+}
+
+static void fill_frame(CANPacket_t *pkt, int addr, int bus, int len) {
+  (void)memset(pkt, 0, sizeof(*pkt));
+  pkt->addr = addr;
+  pkt->extended = (addr >= 0x800) ? 1U : 0U;
+  pkt->bus = bus;
+  for (uint8_t dlc = 0U; dlc < sizeof(dlc_to_len); dlc++) {
+    if (dlc_to_len[dlc] == len) {
+      pkt->data_len_code = dlc;
+    }
+  }
+}
+
+static void make_traffic(void) {
+  uint32_t state = 1U;
+  int own_cnt = current_safety_config.tx_msgs_len;
+  for (int i = 0; i < current_safety_config.rx_checks_len; i++) {
+    for (int j = 0; (j < (int)MAX_ADDR_CHECK_MSGS) && (current_safety_config.rx_checks[i].msg[j].addr != 0); j++) {
+      own_cnt++;
+    }
+  }
+
+  for (uint32_t n = 0U; n < BENCH_FRAMES; n++) {
+    uint32_t r = bench_rand(&state);
+    if (((n & 1U) == 0U) || (own_cnt == 0)) {
+      fill_frame(&frames[n], (int)(r & 0x7FFU), (int)((r >> 11) % 3U), 8);
+    } else {
+      int k = (int)(r % (uint32_t)own_cnt);
+      if (k < current_safety_config.tx_msgs_len) {
+        const CanMsg *m = &current_safety_config.tx_msgs[k];
+        fill_frame(&frames[n], m->addr, m->bus, m->len);
+      } else {
+        k -= current_safety_config.tx_msgs_len;
+        for (int i = 0; i < current_safety_config.rx_checks_len; i++) {
+          for (int j = 0; (j < (int)MAX_ADDR_CHECK_MSGS) && (current_safety_config.rx_checks[i].msg[j].addr != 0); j++) {
+            if (k == 0) {
+              const CanMsgCheck *m = &current_safety_config.rx_checks[i].msg[j];
+              fill_frame(&frames[n], m->addr, m->bus, m->len);
+            }
+            k--;
+          }
+        }
+      }
+    }
+  }
+}
+
+static double bench_ns(bool tx, bool indexed, uint32_t rounds) {
+  uint64_t start = bench_nanos();
+  for (uint32_t r = 0U; r < rounds; r++) {
+    for (uint32_t n = 0U; n < BENCH_FRAMES; n++) {
+      int res;
+      if (tx) {
+        res = indexed ? safety_index_tx_allowed(&frames[n]) :
+                        msg_allowed(&frames[n], current_safety_config.tx_msgs, current_safety_config.tx_msgs_len);
+      } else {
+        res = indexed ? safety_index_rx_check(&frames[n], &current_safety_config) :
+                        get_addr_check_index(&frames[n], current_safety_config.rx_checks, current_safety_config.rx_checks_len);
+      }
+      BENCH_KEEP(res);
+    }
+  }
+  return (double)(bench_nanos() - start) / ((double)rounds * (double)BENCH_FRAMES);
+}
+
+int main(int argc, char **argv) {
+  uint32_t rounds = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 200U;
+
+  printf("mode  tx  rx   tx scan  tx index   rx scan  rx index  (ns/frame)\n");
+  int mode_cnt = sizeof(safety_hook_registry) / sizeof(safety_hook_config);
+  for (int i = 0; i < mode_cnt; i++) {
+    uint16_t mode = safety_hook_registry[i].id;
+    (void)set_safety_hooks(mode, 0U);
+    make_traffic();
+    printf("%4u %3d %3d  %8.1f  %8.1f  %8.1f  %8.1f\n", mode,
+           current_safety_config.tx_msgs_len, current_safety_config.rx_checks_len,
+           bench_ns(true, false, rounds), bench_ns(true, true, rounds),
+           bench_ns(false, false, rounds), bench_ns(false, true, rounds));
+  }
+  return 0;
+}
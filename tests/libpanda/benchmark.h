@@ -0,0 +1,15 @@
+// shared helpers for the libpanda host benchmarks
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static inline uint64_t bench_nanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+// prevents the compiler from optimizing away benchmarked results
+#define BENCH_KEEP(x) __asm__ volatile("" : : "r"(x) : "memory")
@@ -12,7 +12,7 @@ ffi = FFI()
 
 ffi.cdef("""
 typedef struct {
-  unsigned char reserved : 1;
+  unsigned char timestamped : 1;
   unsigned char bus : 3;
   unsigned char data_len_code : 4;
   unsigned char rejected : 1;
@@ -28,7 +28,32 @@ ffi.cdef("""
 bool safety_rx_hook(CANPacket_t *to_send);
 bool safety_tx_hook(CANPacket_t *to_push);
 int safety_fwd_hook(int bus_num, int addr);
+bool safety_rx_dispatch(const CANPacket_t *to_push);
+int safety_fwd_default(int bus_num);
 int set_safety_hooks(uint16_t mode, uint16_t param);
+int safety_contexts_run(uint32_t n, uint32_t workers, void (*fn)(uint32_t idx, void *arg), void *arg);
+
+typedef struct {
+  uint32_t cnt;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+} safety_hook_profile;
+bool safety_profile_get(uint16_t mode, uint8_t hook, safety_hook_profile *profile);
+void safety_profile_reset(void);
+
+struct sample_t {
+  int values[6];
+  int idx;
+  int min;
+  int max;
+};
+void update_sample(struct sample_t *sample, int sample_new);
+void update_sample_margin(struct sample_t *sample, int sample_new, int margin);
+void reset_sample(struct sample_t *sample);
+int sample_last(const struct sample_t *sample);
+int ROUND(float val);
+int round_div(int num, int den);
 """)
 
 ffi.cdef("""
@@ -37,26 +62,83 @@ typedef struct {
   volatile uint32_t r_ptr;
   uint32_t fifo_size;
   CANPacket_t *elems;
+  bool spsc;
 } can_ring;
 
-extern can_ring *rx_q;
+typedef struct {
+  volatile uint32_t w_ptr;
+  volatile uint32_t r_ptr;
+  uint32_t size;
+  uint8_t *data;
+  bool spsc;
+} can_packed_ring;
+
+extern can_packed_ring *rx_q;
 extern can_ring *tx1_q;
 extern can_ring *tx2_q;
 extern can_ring *tx3_q;
+extern bool can_rx_timestamps;
 
 bool can_pop(can_ring *q, CANPacket_t *elem);
 bool can_push(can_ring *q, CANPacket_t *elem);
+uint32_t can_pop_many(can_ring *q, CANPacket_t *elems, uint32_t n);
+uint32_t can_push_many(can_ring *q, CANPacket_t *elems, uint32_t n);
+bool can_packed_pop(can_packed_ring *q, CANPacket_t *elem);
+bool can_packed_push(can_packed_ring *q, CANPacket_t *elem);
+uint32_t can_packed_bytes_free(can_packed_ring *q);
 void can_set_checksum(CANPacket_t *packet);
+void can_rx_push(CANPacket_t *to_push, uint32_t timestamp);
 int comms_can_read(uint8_t *data, uint32_t max_len);
+int comms_can_read_checksum(uint8_t *data, uint32_t max_len, uint8_t *checksum);
 void comms_can_write(uint8_t *data, uint32_t len);
 void comms_can_reset(void);
+bool can_send_raw(const uint8_t *raw, uint32_t len);
+uint32_t can_tx_checksum_error_cnt(uint8_t can_number);
+void refresh_can_tx_slots_available(void);
 uint32_t can_slots_empty(can_ring *q);
+bool can_tx_pop(uint8_t bus_number, CANPacket_t *elem);
+void can_tx_clear(uint8_t bus_number);
+uint8_t can_tx_priority(uint8_t bus_number, uint32_t addr, uint8_t len);
+bool can_tx_prio_set(uint8_t bus_number, uint32_t addr, bool high);
+void can_tx_prio_clear(void);
+extern uint32_t can_tx_prio_drop_cnt[3][2];
+bool can_tx_mailbox_set(uint8_t bus_number, uint32_t addr, bool enabled);
+void can_tx_mailbox_clear(void);
+extern uint32_t can_tx_replaced_cnt[3];
+
+typedef struct {
+  uint32_t std[10];
+  uint32_t ext[8];
+  uint8_t std_len;
+  uint8_t ext_len;
+  bool std_reject;
+  bool ext_reject;
+} can_rx_filter_elems_t;
+bool can_rx_filter_add(uint8_t bus_number, uint32_t id, uint32_t mask, bool extended);
+void can_rx_filter_clear(uint8_t bus_number);
+void can_rx_filter_build(uint8_t bus_number, can_rx_filter_elems_t *elems);
+bool can_rx_filter_accepts(const can_rx_filter_elems_t *elems, bool extended, uint32_t addr);
+uint8_t can_rx_fifo1_ids(uint8_t bus_number, uint16_t ids[]);
+int can_tx_hw_mailbox_pick(uint8_t pending, const uint32_t ids[], uint32_t id);
+bool can_rx_stage(const CANPacket_t *to_stage, uint32_t rx_time);
+void can_rx_process(void);
+uint32_t can_rx_staging_drop_cnt(uint8_t can_number);
+
+extern uint16_t spi_checksum_error_count;
+extern uint8_t spi_state;
+extern bool spi_can_tx_ready;
+void spi_emu_init(uint32_t byte_ns, uint32_t irq_latency_ns);
+void spi_emu_idle(uint64_t ns);
+void spi_emu_xfer(const uint8_t *mosi, uint8_t *miso, uint32_t len);
+uint64_t spi_emu_time(void);
+void spi_emu_control_delay(uint64_t ns);
+uint32_t spi_emu_control_cnt(void);
 """)
 
 setup_safety_helpers(ffi)
 
 class CANPacket:
-  reserved: int
+  timestamped: int
   bus: int
   data_len_code: int
   rejected: int
@@ -67,21 +149,40 @@ class CANPacket:
 
 class Panda(PandaSafety, Protocol):
   # CAN
+  rx_q: Any
+  can_rx_timestamps: bool
   tx1_q: Any
   tx2_q: Any
   tx3_q: Any
   def can_set_checksum(self, p: CANPacket) -> None: ...
+  def can_rx_push(self, p: CANPacket, timestamp: int) -> None: ...
 
   # safety
   def safety_rx_hook(self, to_send: CANPacket) -> int: ...
   def safety_tx_hook(self, to_push: CANPacket) -> int: ...
   def safety_fwd_hook(self, bus_num: int, addr: int) -> int: ...
+  def safety_rx_dispatch(self, to_push: CANPacket) -> bool: ...
+  def safety_fwd_default(self, bus_num: int) -> int: ...
   def set_safety_hooks(self, mode: int, param: int) -> int: ...
+  def safety_contexts_run(self, n: int, workers: int, fn: Any, arg: Any) -> int: ...
+  def safety_profile_get(self, mode: int, hook: int, profile: Any) -> bool: ...
+  def safety_profile_reset(self) -> None: ...
+  def update_sample(self, sample: Any, sample_new: int) -> None: ...
+  def update_sample_margin(self, sample: Any, sample_new: int, margin: int) -> None: ...
+  def reset_sample(self, sample: Any) -> None: ...
+  def sample_last(self, sample: Any) -> int: ...
+  def ROUND(self, val: float) -> int: ...
+  def round_div(self, num: int, den: int) -> int: ...
 
 
 libpanda: Panda = ffi.dlopen(libpanda_fn)
 
 
+# libpanda with the safety hook profile in nanoseconds, the clock reads slow down the hooks
+def dlopen_profile() -> Panda:
+  return ffi.dlopen(os.path.join(libpanda_dir, "libpanda_profile.so"))
+
+
 # helpers
 
 def make_CANPacket(addr: int, bus: int, dat):
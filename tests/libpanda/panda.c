@@ -1,15 +1,19 @@
+// every thread gets its own safety context, see safety_contexts.h
+#define SAFETY_STATE __thread
+
 #include "fake_stm.h"
 #include "config.h"
 #include "can_definitions.h"
 
 bool can_init(uint8_t can_number) { return true; }
 void process_can(uint8_t can_number) { }
+void can_rx_pend_bottom_half(void) { }
 //int safety_tx_hook(CANPacket_t *to_send) { return 1; }
 
 typedef struct harness_configuration harness_configuration;
 void refresh_can_tx_slots_available(void);
 void can_tx_comms_resume_usb(void) { };
-void can_tx_comms_resume_spi(void) { };
+void can_tx_comms_resume_spi(void);
 
 #include "health.h"
 #include "faults.h"
@@ -19,7 +23,7 @@ void can_tx_comms_resume_spi(void) { };
 #include "main_declarations.h"
 #include "drivers/can_common.h"
 
-can_ring *rx_q = &can_rx_q;
+can_packed_ring *rx_q = &can_rx_q;
 can_ring *tx1_q = &can_tx1_q;
 can_ring *tx2_q = &can_tx2_q;
 can_ring *tx3_q = &can_tx3_q;
@@ -27,5 +31,27 @@ can_ring *tx3_q = &can_tx3_q;
 #include "comms_definitions.h"
 #include "can_comms.h"
 
+// the RX interrupts' top half, for the RX bottom half tests
+bool can_rx_stage(const CANPacket_t *to_stage, uint32_t rx_time) {
+  can_rx_staged_t *staged = can_rx_stage_reserve(CAN_NUM_FROM_BUS_NUM(to_stage->bus));
+  if (staged != NULL) {
+    staged->pkt = *to_stage;
+    staged->rx_time = rx_time;
+    can_rx_stage_commit();
+  }
+  return staged != NULL;
+}
+
+uint32_t can_rx_staging_drop_cnt(uint8_t can_number) {
+  return can_health[can_number].rx_staging_drop_cnt;
+}
+
+uint32_t can_tx_checksum_error_cnt(uint8_t can_number) {
+  return can_health[can_number].total_tx_checksum_error_cnt;
+}
+
 // libpanda stuff
+#include "checksum_reference.h"
 #include "safety_helpers.h"
+#include "safety_contexts.h"
+#include "spi_emulation.h"
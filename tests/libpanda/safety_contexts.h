@@ -0,0 +1,76 @@
+// All safety state is SAFETY_STATE, which is thread local in libpanda, so every thread has its own
+// safety context and a new thread starts from the power-on state. This runs many independent safety
+// instances across cores, e.g. one replay or test case per context.
+#include <pthread.h>
+#include <unistd.h>
+
+typedef void (*safety_context_fn)(uint32_t idx, void *arg);
+
+typedef struct {
+  safety_context_fn fn;
+  void *arg;
+  uint32_t n;
+  uint32_t next;
+  bool failed;
+} safety_contexts_job;
+
+typedef struct {
+  safety_contexts_job *job;
+  uint32_t idx;
+} safety_context_task;
+
+static void *safety_context_thread(void *arg) {
+  const safety_context_task *task = arg;
+  task->job->fn(task->idx, task->job->arg);
+  return NULL;
+}
+
+static void *safety_contexts_worker(void *arg) {
+  safety_contexts_job *job = arg;
+  while (true) {
+    uint32_t idx = __atomic_fetch_add(&job->next, 1U, __ATOMIC_RELAXED);
+    if (idx >= job->n) {
+      break;
+    }
+    // a thread per context, so each one starts from a clean state
+    safety_context_task task = {.job = job, .idx = idx};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, safety_context_thread, &task) != 0) {
+      __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+      break;
+    }
+    (void)pthread_join(thread, NULL);
+  }
+  return NULL;
+}
+
+// runs fn(idx, arg) for idx 0..n-1, each in a new safety context, with up to workers contexts
+// at the same time (0: one per core). Returns 0 once all of them finished, -1 if a thread failed to start.
+int safety_contexts_run(uint32_t n, uint32_t workers, safety_context_fn fn, void *arg) {
+  safety_contexts_job job = {.fn = fn, .arg = arg, .n = n, .next = 0U, .failed = false};
+  if (n == 0U) {
+    return 0;
+  }
+  if (workers == 0U) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = (cores > 0) ? (uint32_t)cores : 1U;
+  }
+  workers = MIN(workers, n);
+
+  pthread_t *threads = malloc(workers * sizeof(pthread_t));
+  job.failed = (threads == NULL);
+  uint32_t started = 0U;
+  while (!__atomic_load_n(&job.failed, __ATOMIC_RELAXED) && (started < workers)) {
+    if (pthread_create(&threads[started], NULL, safety_contexts_worker, &job) != 0) {
+      __atomic_store_n(&job.failed, true, __ATOMIC_RELAXED);
+      break;
+    }
+    started++;
+  }
+  for (uint32_t i = 0U; i < started; i++) {
+    (void)pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  return job.failed ? -1 : 0;
+}
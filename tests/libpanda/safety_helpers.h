@@ -19,6 +19,173 @@ bool safety_config_valid() {
   return true;
 }
 
+void set_safety_index_enabled(bool enabled) {
+  if (enabled) {
+    safety_index_build();
+  } else {
+    safety_tx_index.len = -1;
+    safety_rx_index.len = -1;
+  }
+}
+
+// runs the frame through the lookup index and through the reference scans, starting from the same RX check state
+static bool safety_index_matches_scan(int addr, int bus, int dlc) {
+  CANPacket_t to_push = {0};
+  to_push.addr = addr;
+  to_push.extended = (addr >= 0x800) ? 1U : 0U;
+  to_push.bus = bus;
+  to_push.data_len_code = dlc;
+
+  RxCheck *checks = current_safety_config.rx_checks;
+  int checks_len = current_safety_config.rx_checks_len;
+  RxStatus saved[SAFETY_INDEX_MAX];
+  RxStatus scanned[SAFETY_INDEX_MAX];
+  for (int i = 0; i < checks_len; i++) {
+    saved[i] = checks[i].status;
+  }
+  bool tx_scan = msg_allowed(&to_push, current_safety_config.tx_msgs, current_safety_config.tx_msgs_len);
+  int rx_scan = get_addr_check_index(&to_push, checks, checks_len);
+  for (int i = 0; i < checks_len; i++) {
+    scanned[i] = checks[i].status;
+    checks[i].status = saved[i];
+  }
+
+  bool ret = (safety_index_tx_allowed(&to_push) == tx_scan) && (safety_index_rx_check(&to_push, &current_safety_config) == rx_scan);
+  for (int i = 0; i < checks_len; i++) {
+    ret = ret && (checks[i].status.msg_seen == scanned[i].msg_seen) && (checks[i].status.index == scanned[i].index);
+  }
+  if (!ret) {
+    printf("lookup mismatch addr 0x%x bus %d dlc %d\n", addr, bus, dlc);
+  }
+  return ret;
+}
+
+// every TX and RX check address of the active config on all buses and lengths, then the whole 11-bit range
+bool safety_index_self_check(void) {
+  bool ret = current_safety_config.rx_checks_len <= SAFETY_INDEX_MAX;
+  for (int bus = 0; bus < 4; bus++) {
+    for (int dlc = 0; dlc < 16; dlc++) {
+      for (int i = 0; i < current_safety_config.tx_msgs_len; i++) {
+        ret = ret && safety_index_matches_scan(current_safety_config.tx_msgs[i].addr, bus, dlc);
+      }
+      for (int i = 0; i < current_safety_config.rx_checks_len; i++) {
+        for (int j = 0; (j < (int)MAX_ADDR_CHECK_MSGS) && (current_safety_config.rx_checks[i].msg[j].addr != 0); j++) {
+          ret = ret && safety_index_matches_scan(current_safety_config.rx_checks[i].msg[j].addr, bus, dlc);
+        }
+      }
+    }
+  }
+  for (int addr = 0; addr < 0x800; addr++) {
+    for (int bus = 0; bus < 3; bus++) {
+      ret = ret && safety_index_matches_scan(addr, bus, 8);
+    }
+  }
+  return ret;
+}
+
+// a TX whitelist too long for the index has to fall back to the scan
+bool safety_index_overflow_check(void) {
+  static SAFETY_STATE CanMsg msgs[SAFETY_INDEX_MAX + 1];
+  for (int i = 0; i < (SAFETY_INDEX_MAX + 1); i++) {
+    msgs[i] = (CanMsg){.addr = 0x100 + i, .bus = 0, .len = 8};
+  }
+  const CanMsg *tx_msgs = current_safety_config.tx_msgs;
+  int tx_msgs_len = current_safety_config.tx_msgs_len;
+  current_safety_config.tx_msgs = msgs;
+  current_safety_config.tx_msgs_len = SAFETY_INDEX_MAX + 1;
+  safety_index_build();
+
+  CANPacket_t to_send = {0};
+  to_send.addr = 0x100 + SAFETY_INDEX_MAX;
+  to_send.data_len_code = 8U;
+  bool ret = (safety_tx_index.len == -1) && safety_index_tx_allowed(&to_send);
+
+  current_safety_config.tx_msgs = tx_msgs;
+  current_safety_config.tx_msgs_len = tx_msgs_len;
+  safety_index_build();
+  return ret;
+}
+
+// more 29-bit IDs than the dispatch list holds send every 29-bit frame through the hooks
+bool safety_dispatch_overflow_check(void) {
+  for (int i = 0; i < (SAFETY_DISPATCH_EXT_MAX + 1); i++) {
+    safety_dispatch_mark(-1, 0x18DA00F1 + (i << 8));
+  }
+  CANPacket_t to_push = {0};
+  to_push.extended = 1U;
+  to_push.addr = 0x1FFFFFFFU;
+  bool ret = (safety_dispatch_ext_len == -1) && safety_rx_dispatch(&to_push);
+  safety_dispatch_build();
+  return ret;
+}
+
+#define HOOK_STATE_LEN 24
+
+static void hook_state_get(int state[]) {
+  state[0] = controls_allowed;
+  state[1] = controls_allowed_long;
+  state[2] = disengageFromBrakes;
+  state[3] = relay_malfunction;
+  state[4] = gas_interceptor_prev;
+  state[5] = gas_pressed;
+  state[6] = brake_pressed;
+  state[7] = regen_braking;
+  state[8] = cruise_engaged_prev;
+  state[9] = acc_main_on;
+  state[10] = acc_main_on_prev;
+  state[11] = lkas_pressed_prev;
+  state[12] = cruise_button_prev;
+  state[13] = cruise_override;
+  state[14] = vehicle_moving;
+  state[15] = vehicle_speed.min;
+  state[16] = vehicle_speed.max;
+  state[17] = sample_last(&vehicle_speed);
+  state[18] = torque_meas.min;
+  state[19] = torque_meas.max;
+  state[20] = torque_driver.min;
+  state[21] = torque_driver.max;
+  state[22] = angle_meas.min;
+  state[23] = angle_meas.max;
+}
+
+// every 11-bit frame the RX dispatch table skips, with a few payloads and lengths and with MADS off
+// and on, straight through the mode's rx hook. Returns (bus << 11) | addr of the first one that
+// changes the common safety state, so is missing from the mode's hook_addrs, or -1 if none does.
+int safety_hook_addrs_check(void) {
+  static const uint8_t payloads[] = {0x00U, 0xFFU, 0x55U, 0xAAU};
+  bool mads_enabled_prev = mads_enabled;
+  int ret = -1;
+
+  for (int mads = 0; (mads < 2) && (ret == -1); mads++) {
+    mads_enabled = (mads == 1);
+    for (int bus = 0; (bus < SAFETY_DISPATCH_BUS_CNT) && (ret == -1); bus++) {
+      for (int addr = 0; (addr < 0x800) && (ret == -1); addr++) {
+        CANPacket_t to_push = {0};
+        to_push.addr = addr;
+        to_push.bus = bus;
+        for (uint8_t dlc = 8U; (dlc <= 15U) && (ret == -1); dlc += 7U) {
+          to_push.data_len_code = dlc;
+          for (unsigned int p = 0U; (p < sizeof(payloads)) && (ret == -1); p++) {
+            (void)memset(to_push.data, payloads[p], sizeof(to_push.data));
+            if (!safety_rx_dispatch(&to_push)) {
+              int before[HOOK_STATE_LEN];
+              int after[HOOK_STATE_LEN];
+              hook_state_get(before);
+              current_hooks->rx(&to_push);
+              hook_state_get(after);
+              if (memcmp(before, after, sizeof(before)) != 0) {
+                ret = (bus << 11) | addr;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  mads_enabled = mads_enabled_prev;
+  return ret;
+}
+
 void set_controls_allowed(bool c){
   controls_allowed = c;
 }
@@ -79,6 +246,10 @@ bool get_acc_main_on(void){
   return acc_main_on;
 }
 
+bool get_cruise_override(void){
+  return cruise_override;
+}
+
 int get_vehicle_speed_min(void){
   return vehicle_speed.min;
 }
@@ -88,7 +259,7 @@ int get_vehicle_speed_max(void){
 }
 
 int get_vehicle_speed_last(void){
-  return vehicle_speed.values[0];
+  return sample_last(&vehicle_speed);
 }
 
 int get_current_safety_mode(void){
@@ -107,9 +278,18 @@ void set_timer(uint32_t t){
   timer.CNT = t;
 }
 
+// fills a sample_t so that its min and max are the given ones
+static void set_sample(struct sample_t *sample, int min, int max){
+  for (int i = 0; i < MAX_SAMPLE_VALS; i++) {
+    sample->values[i] = min;
+  }
+  sample->values[sample->idx] = max;
+  sample->min = min;
+  sample->max = max;
+}
+
 void set_torque_meas(int min, int max){
-  torque_meas.min = min;
-  torque_meas.max = max;
+  set_sample(&torque_meas, min, max);
 }
 
 int get_torque_meas_min(void){
@@ -121,8 +301,7 @@ int get_torque_meas_max(void){
 }
 
 void set_torque_driver(int min, int max){
-  torque_driver.min = min;
-  torque_driver.max = max;
+  set_sample(&torque_driver, min, max);
 }
 
 int get_torque_driver_min(void){
@@ -150,8 +329,7 @@ int get_desired_angle_last(void){
 }
 
 void set_angle_meas(int min, int max){
-  angle_meas.min = min;
-  angle_meas.max = max;
+  set_sample(&angle_meas, min, max);
 }
 
 int get_angle_meas_min(void){
@@ -185,6 +363,101 @@ bool get_honda_fwd_brake(void){
   return honda_fwd_brake;
 }
 
+// ***** float reference of the fixed point safety math *****
+
+// the float interpolation steer_angle_cmd_checks used before its lookups were converted to fixed point
+static float interpolate_float(struct lookup_t xy, float x) {
+  int size = sizeof(xy.x) / sizeof(xy.x[0]);
+  float ret = xy.y[size - 1];
+  if (x <= xy.x[0]) {
+    ret = xy.y[0];
+  } else {
+    for (int i=0; i < (size - 1); i++) {
+      if (x < xy.x[i+1]) {
+        float x0 = xy.x[i];
+        float y0 = xy.y[i];
+        float dx = xy.x[i+1] - x0;
+        float dy = xy.y[i+1] - y0;
+        dx = MAX(dx, 0.0001);
+        ret = (dy * (x - x0) / dx) + y0;
+        break;
+      }
+    }
+  }
+  return ret;
+}
+
+// angle rate limit of steer_angle_cmd_checks for a safety mode at a vehicle speed, in CAN units, from the
+// float lookups as before or the fixed point ones. lower is the limit towards the measured angle.
+int get_angle_rate_limit(uint16_t mode, bool up, bool lower, int speed, bool fixed){
+  const SteeringLimits *limits = NULL;
+  if (mode == SAFETY_FORD) {
+    limits = &FORD_STEERING_LIMITS;
+  } else if (mode == SAFETY_NISSAN) {
+    limits = &NISSAN_STEERING_LIMITS;
+  } else if (mode == SAFETY_TESLA) {
+    limits = &TESLA_STEERING_LIMITS;
+  } else {
+    limits = &TOYOTA_STEERING_LIMITS;
+  }
+
+  const struct lookup_t *lookup = up ? &limits->angle_rate_up_lookup : &limits->angle_rate_down_lookup;
+  int ret;
+  if (fixed) {
+    angle_rate_limits_init(limits);
+    const struct lookup_fixed_t *lookup_fixed = up ? &angle_rate_up_limits : &angle_rate_down_limits;
+    ret = interpolate_fixed(lookup_fixed, speed + (lower ? VEHICLE_SPEED_FACTOR : -VEHICLE_SPEED_FACTOR), lower);
+  } else {
+    ret = interpolate_float(*lookup, (speed / 100.0) + (lower ? 1. : -1.)) * limits->angle_deg_to_can;
+  }
+  return lower ? ret : (ret + 1);
+}
+
+// frames with the addresses and lengths of the mode's RX checks and random ones, all with random data,
+// through the mode's checksum kernel and its reference in checksum_reference.h. Returns the frames
+// the two disagree on, or -1 without a reference for the mode.
+int checksum_kernel_mismatches(uint16_t mode, uint16_t param, int frames, uint32_t seed) {
+  uint32_t (*reference)(const CANPacket_t *to_push) = NULL;
+  for (unsigned int i = 0U; i < CHECKSUM_REFERENCES_LEN; i++) {
+    if (CHECKSUM_REFERENCES[i].mode == mode) {
+      reference = CHECKSUM_REFERENCES[i].reference;
+    }
+  }
+  if ((reference == NULL) || (set_safety_hooks(mode, param) != 0)) {
+    return -1;
+  }
+
+  int mismatches = 0;
+  uint32_t state = seed;
+  for (int n = 0; n < frames; n++) {
+    CANPacket_t msg = {0};
+    state = (state * 1103515245U) + 12345U;
+    uint32_t r = state >> 8;
+    int checks = current_safety_config.rx_checks_len;
+    if (((r % 4U) != 0U) && (checks > 0)) {
+      const CanMsgCheck *m = &current_safety_config.rx_checks[(r >> 2) % (uint32_t)checks].msg[0];
+      msg.addr = m->addr;
+      for (uint8_t dlc = 0U; dlc < sizeof(dlc_to_len); dlc++) {
+        if (dlc_to_len[dlc] == m->len) {
+          msg.data_len_code = dlc;
+        }
+      }
+    } else {
+      msg.extended = (r >> 2) & 1U;
+      msg.addr = (r >> 3) & ((msg.extended != 0U) ? 0x1FFFFFFFU : 0x7FFU);
+      msg.data_len_code = 1U + ((r >> 12) % 15U);
+    }
+    for (int i = 0; i < GET_LEN(&msg); i++) {
+      state = (state * 1103515245U) + 12345U;
+      msg.data[i] = (uint8_t)(state >> 16);
+    }
+    if (current_hooks->compute_checksum(&msg) != reference(&msg)) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
 void init_tests(void){
   // get HW_TYPE from env variable set in test.sh
   if (getenv("HW_TYPE")) {
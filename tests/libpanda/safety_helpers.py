@@ -16,6 +16,7 @@ def setup_safety_helpers(ffi):
   bool get_brake_pressed_prev(void);
   bool get_regen_braking_prev(void);
   bool get_acc_main_on(void);
+  bool get_cruise_override(void);
   int get_vehicle_speed_min(void);
   int get_vehicle_speed_max(void);
   int get_vehicle_speed_last(void);
@@ -44,6 +45,13 @@ def setup_safety_helpers(ffi):
 
   void safety_tick_current_safety_config();
   bool safety_config_valid();
+  void set_safety_index_enabled(bool enabled);
+  bool safety_index_self_check(void);
+  bool safety_index_overflow_check(void);
+  bool safety_dispatch_overflow_check(void);
+  int safety_hook_addrs_check(void);
+  int get_angle_rate_limit(uint16_t mode, bool up, bool lower, int speed, bool fixed);
+  int checksum_kernel_mismatches(uint16_t mode, uint16_t param, int frames, uint32_t seed);
 
   void init_tests(void);
 
@@ -68,6 +76,7 @@ class PandaSafety(Protocol):
   def get_brake_pressed_prev(self) -> bool: ...
   def get_regen_braking_prev(self) -> bool: ...
   def get_acc_main_on(self) -> bool: ...
+  def get_cruise_override(self) -> bool: ...
   def get_vehicle_speed_min(self) -> int: ...
   def get_vehicle_speed_max(self) -> int: ...
   def get_vehicle_speed_last(self) -> int: ...
@@ -96,6 +105,13 @@ class PandaSafety(Protocol):
 
   def safety_tick_current_safety_config(self) -> None: ...
   def safety_config_valid(self) -> bool: ...
+  def set_safety_index_enabled(self, enabled: bool) -> None: ...
+  def safety_index_self_check(self) -> bool: ...
+  def safety_index_overflow_check(self) -> bool: ...
+  def safety_dispatch_overflow_check(self) -> bool: ...
+  def safety_hook_addrs_check(self) -> int: ...
+  def get_angle_rate_limit(self, mode: int, up: bool, lower: bool, speed: int, fixed: bool) -> int: ...
+  def checksum_kernel_mismatches(self, mode: int, param: int, frames: int, seed: int) -> int: ...
 
   def init_tests(self) -> None: ...
 
@@ -0,0 +1,219 @@
+// Emulated H7 SPI slave: the firmware SPI state machine in drivers/spi.h, with the DMA streams, CS
+// and the interrupt latency modeled, so the protocol's round trips and throughput can be measured
+// without a panda. Time is in ns. The slave only takes part in transfers that start while its SPI
+// is enabled, re-enabling it in the middle of a transfer (every DMA start does) drops the rest of
+// that transfer, and MISO reads 0xFF while the slave doesn't drive it. A slow handler holds up the
+// interrupt it runs in, the DMA it starts and the interrupts after it wait until it's done.
+
+const uint8_t spi_emu_uid[12] = {0x1U, 0x2U, 0x3U, 0x4U, 0x5U, 0x6U, 0x7U, 0x8U, 0x9U, 0xAU, 0xBU, 0xCU};
+
+// the SPI pandas are H7s
+#define STM32H7
+#define UID_BASE spi_emu_uid
+#include "drivers/spi.h"
+
+#define SPI_EMU_EVENTS 8U
+#define SPI_EMU_UNDERRUN 0xCDU
+#define SPI_EMU_UNDRIVEN 0xFFU
+
+typedef struct {
+  uint64_t time;
+  void (*handler)(void);
+} spi_emu_event_t;
+
+struct {
+  uint64_t now;
+  uint32_t byte_ns;
+  uint32_t irq_latency_ns;
+  bool cs;
+  bool synced;  // the slave is part of the current transfer
+  uint8_t *mosi;
+  uint16_t mosi_len;
+  uint16_t mosi_cnt;
+  bool mosi_en;
+  uint8_t *miso;
+  uint16_t miso_len;
+  uint16_t miso_cnt;
+  bool miso_en;
+  spi_emu_event_t events[SPI_EMU_EVENTS];
+  uint8_t events_len;
+  uint64_t busy_until;  // the running interrupt is done
+  uint64_t stall_ns;    // the handler of the running interrupt blocks it that long
+  bool stalled_mosi_en;
+  bool stalled_miso_en;
+  uint64_t control_ns;
+  uint32_t control_cnt;
+  uint32_t ep2_len;
+} spi_emu;
+
+// the rest of the firmware
+int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
+  spi_emu.control_cnt += 1U;
+  spi_emu.stall_ns += spi_emu.control_ns;
+  for (uint16_t i = 0U; i < req->length; i++) {
+    resp[i] = (uint8_t)(req->request + i);
+  }
+  return req->length;
+}
+
+void comms_endpoint2_write(const uint8_t *data, uint32_t len) {
+  (void)data;
+  spi_emu.ep2_len += len;
+}
+
+void puth4(unsigned int i) {
+  printf("%04x", i);
+}
+
+void hexdump(const void *a, int l) {
+  for (int i = 0; i < l; i++) {
+    printf("%02x ", ((const uint8_t *)a)[i]);
+  }
+  printf("\n");
+}
+
+static void spi_emu_post(void (*handler)(void)) {
+  if (spi_emu.events_len < SPI_EMU_EVENTS) {
+    spi_emu.events[spi_emu.events_len].time = spi_emu.now + spi_emu.irq_latency_ns;
+    spi_emu.events[spi_emu.events_len].handler = handler;
+    spi_emu.events_len++;
+  }
+}
+
+// the DMA a stalled interrupt started, once it's done
+static void spi_emu_unstall(uint64_t t) {
+  if ((spi_emu.stalled_mosi_en || spi_emu.stalled_miso_en) && (spi_emu.busy_until <= t)) {
+    if (spi_emu.cs) {
+      spi_emu.synced = false;
+    }
+    spi_emu.mosi_en = spi_emu.stalled_mosi_en;
+    spi_emu.miso_en = spi_emu.stalled_miso_en;
+    spi_emu.stalled_mosi_en = false;
+    spi_emu.stalled_miso_en = false;
+  }
+}
+
+// the interrupts due by t, in order
+static void spi_emu_run(uint64_t t) {
+  spi_emu_unstall(t);
+  while ((spi_emu.events_len > 0U) && (MAX(spi_emu.events[0].time, spi_emu.busy_until) <= t)) {
+    uint64_t start = MAX(spi_emu.events[0].time, spi_emu.busy_until);
+    void (*handler)(void) = spi_emu.events[0].handler;
+    spi_emu.events_len--;
+    for (uint8_t i = 0U; i < spi_emu.events_len; i++) {
+      spi_emu.events[i] = spi_emu.events[i + 1U];
+    }
+    spi_emu.stall_ns = 0U;
+    handler();
+    if (spi_emu.stall_ns > 0U) {
+      spi_emu.busy_until = start + spi_emu.stall_ns;
+      spi_emu.stalled_mosi_en = spi_emu.mosi_en;
+      spi_emu.stalled_miso_en = spi_emu.miso_en;
+      spi_emu.mosi_en = false;
+      spi_emu.miso_en = false;
+      spi_emu_unstall(t);
+    }
+  }
+}
+
+static void spi_emu_tx_done(void) {
+  spi_tx_done(false);
+}
+
+static void spi_emu_spe_toggle(void) {
+  if (spi_emu.cs) {
+    spi_emu.synced = false;
+  }
+}
+
+// low level SPI
+void llspi_init(void) {}
+
+void llspi_mosi_dma(uint8_t *addr, int len) {
+  spi_emu_spe_toggle();
+  spi_emu.mosi = addr;
+  spi_emu.mosi_len = len;
+  spi_emu.mosi_cnt = 0U;
+  spi_emu.mosi_en = true;
+}
+
+void llspi_miso_dma(uint8_t *addr, int len) {
+  spi_emu_spe_toggle();
+  spi_emu.miso = addr;
+  spi_emu.miso_len = len;
+  spi_emu.miso_cnt = 0U;
+  spi_emu.miso_en = true;
+}
+
+uint16_t llspi_mosi_dma_stop(void) {
+  spi_emu.mosi_en = false;
+  return spi_emu.mosi_cnt;
+}
+
+bool llspi_cs_active(void) {
+  return spi_emu.cs;
+}
+
+// host side
+void spi_emu_init(uint32_t byte_ns, uint32_t irq_latency_ns) {
+  (void)memset(&spi_emu, 0, sizeof(spi_emu));
+  spi_emu.byte_ns = byte_ns;
+  spi_emu.irq_latency_ns = irq_latency_ns;
+  spi_protocol_next = 2U;
+  spi_checksum_error_count = 0U;
+  spi_can_tx_ready = true;
+  spi_init();
+}
+
+// the host is busy for ns between transfers
+void spi_emu_idle(uint64_t ns) {
+  spi_emu.now += ns;
+  spi_emu_run(spi_emu.now);
+}
+
+// one transfer, framed by CS
+void spi_emu_xfer(const uint8_t *mosi, uint8_t *miso, uint32_t len) {
+  spi_emu.cs = true;
+  spi_emu.synced = true;
+  for (uint32_t i = 0U; i < len; i++) {
+    spi_emu_run(spi_emu.now);
+    spi_emu.now += spi_emu.byte_ns;
+
+    uint8_t out = SPI_EMU_UNDRIVEN;
+    if (spi_emu.synced) {
+      out = SPI_EMU_UNDERRUN;
+      if (spi_emu.miso_en) {
+        out = spi_emu.miso[spi_emu.miso_cnt];
+        spi_emu.miso_cnt++;
+        if (spi_emu.miso_cnt == spi_emu.miso_len) {
+          spi_emu.miso_en = false;
+          spi_emu_post(spi_emu_tx_done);
+        }
+      }
+      if (spi_emu.mosi_en) {
+        spi_emu.mosi[spi_emu.mosi_cnt] = mosi[i];
+        spi_emu.mosi_cnt++;
+        if (spi_emu.mosi_cnt == spi_emu.mosi_len) {
+          spi_emu.mosi_en = false;
+          spi_emu_post(spi_rx_done);
+        }
+      }
+    }
+    miso[i] = out;
+  }
+  spi_emu.cs = false;
+  spi_emu_post(spi_cs_done);
+}
+
+uint64_t spi_emu_time(void) {
+  return spi_emu.now;
+}
+
+// every control request blocks the interrupt it's handled in for ns
+void spi_emu_control_delay(uint64_t ns) {
+  spi_emu.control_ns = ns;
+}
+
+uint32_t spi_emu_control_cnt(void) {
+  return spi_emu.control_cnt;
+}
@@ -811,6 +811,49 @@ class PandaSafetyTest(PandaSafetyTestBase):
         if [addr, bus] not in self.TX_MSGS:
           self.assertFalse(self._tx(make_msg(bus, addr, 8)), f"allowed TX {addr=} {bus=}")
 
+  def test_safety_index(self):
+    # the hashed TX/RX lookups built by set_safety_hooks must match the reference scans,
+    # and with the index off the lookups fall back to the scans
+    for enabled in (True, False):
+      self.safety.set_safety_index_enabled(enabled)
+      self.assertTrue(self.safety.safety_index_self_check())
+    self.assertTrue(self.safety.safety_index_overflow_check())
+
+  def test_rx_dispatch(self):
+    # frames the RX dispatch table skips must be forwarded like the rest of their bus
+    for relay_malfunction in (False, True):
+      self.safety.set_relay_malfunction(relay_malfunction)
+      for bus in range(3):
+        for addr in self.SCANNED_ADDRS:
+          if not self.safety.safety_rx_dispatch(make_msg(bus, addr, 8)):
+            self.assertEqual(self.safety.safety_fwd_hook(bus, addr), self.safety.safety_fwd_default(bus), f"{addr=:#x} {bus=}")
+    self.assertTrue(self.safety.safety_dispatch_overflow_check())
+
+    # and must be frames the rx hook ignores, so every address it reads is dispatched
+    self.safety.set_relay_malfunction(False)
+    addr = self.safety.safety_hook_addrs_check()
+    self.assertEqual(addr, -1, f"rx hook reads {addr & 0x7FF:#x} on bus {addr >> 11}, missing from hook_addrs")
+
+  def test_hook_profile(self):
+    # every hook call is counted against the current safety mode
+    mode = self.safety.get_current_safety_mode()
+    profile = libpanda_py.ffi.new("safety_hook_profile *")
+    self.safety.safety_profile_reset()
+    for _ in range(10):
+      self._rx(make_msg(0, 0x123, 8))
+      self._tx(make_msg(0, 0x123, 8))
+      self.safety.safety_fwd_hook(0, 0x123)
+    for hook in range(3):
+      self.assertTrue(self.safety.safety_profile_get(mode, hook, profile))
+      self.assertEqual(profile.cnt, 10)
+      self.assertTrue(profile.min * 10 <= profile.sum <= profile.max * 10)
+    self.assertFalse(self.safety.safety_profile_get(mode, 3, profile))
+    self.assertFalse(self.safety.safety_profile_get(0xFFFF, 0, profile))
+
+    self.safety.safety_profile_reset()
+    self.assertTrue(self.safety.safety_profile_get(mode, 0, profile))
+    self.assertEqual((profile.cnt, profile.min, profile.max, profile.sum), (0, 0, 0, 0))
+
   def test_default_controls_not_allowed(self):
     self.assertFalse(self.safety.get_controls_allowed())
 
@@ -32,3 +32,9 @@ if [ -n "$INCOMPLETE_COVERAGE" ]; then
 else
   echo "SUCCESS: All checked files have 100% coverage!"
 fi
+
+# hook timings against a bench_safety -o results file from the same machine and build
+if [ -n "$BENCH_SAFETY_BASELINE" ]; then
+  ../libpanda/bench_safety -o bench_safety.json
+  python ../libpanda/bench_safety_compare.py "$BENCH_SAFETY_BASELINE" bench_safety.json
+fi
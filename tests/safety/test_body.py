@@ -36,7 +36,7 @@ class TestBody(common.PandaSafetyTest):
 
   def test_rx_hook(self):
     self.assertFalse(self.safety.get_controls_allowed())
-    self.assertFalse(self.safety.get_vehicle_moving())
+    self.assertTrue(self.safety.get_vehicle_moving())  # from init on
 
     # controls allowed when we get MOTORS_DATA message
     self.assertTrue(self._rx(self._torque_cmd_msg(0, 0)))
@@ -212,5 +212,33 @@ class TestHyundaiLongitudinalSafety(HyundaiLongitudinalBase, TestHyundaiSafety):
     self.assertFalse(self._tx(self._accel_msg(0, aeb_decel=1.0)))
 
 
+class TestHyundaiNonSCCMainOn(unittest.TestCase):
+  # without SCC, acc_main_on is only read from EMS16 on ICE cars
+  cnt_gas = 0
+
+  def setUp(self):
+    self.safety = libpanda_py.libpanda
+    self.safety.set_safety_hooks(Panda.SAFETY_HYUNDAI, Panda.FLAG_HYUNDAI_NON_SCC)
+    self.safety.init_tests()
+
+  def _ems16_msg(self, main_on):
+    dat = bytearray(8)
+    dat[3] = int(main_on) << 1  # bit 25
+    dat[7] = (self.cnt_gas % 4) << 4
+    self.__class__.cnt_gas += 1
+    addr, dat, bus = checksum((0x260, dat, 0))
+    return libpanda_py.make_CANPacket(addr, bus, bytes(dat))
+
+  def test_acc_main_on_source(self):
+    for main_on in (True, False, True):
+      self.assertTrue(self.safety.safety_rx_hook(self._ems16_msg(main_on)))
+      self.assertEqual(self.safety.get_acc_main_on(), main_on)
+
+      # other messages on the bus don't touch it, whatever their bit 25 holds
+      other = libpanda_py.make_CANPacket(0x367, 0, (b"\x00" if main_on else b"\xff") * 8)
+      self.assertTrue(self.safety.safety_rx_hook(other))
+      self.assertEqual(self.safety.get_acc_main_on(), main_on)
+
+
 if __name__ == "__main__":
   unittest.main()
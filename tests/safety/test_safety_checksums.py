@@ -0,0 +1,39 @@
+#!/usr/bin/env python3
+import unittest
+
+from panda import Panda
+from panda.tests.libpanda import libpanda_py
+
+# the safety modes with a table or word at a time checksum kernel, with their params
+KERNEL_MODES = (
+  (Panda.SAFETY_CHRYSLER, 0),
+  (Panda.SAFETY_CHRYSLER, Panda.FLAG_CHRYSLER_RAM_DT),
+  (Panda.SAFETY_HONDA_NIDEC, 0),
+  (Panda.SAFETY_HONDA_BOSCH, 0),
+  (Panda.SAFETY_HYUNDAI, 0),
+  (Panda.SAFETY_HYUNDAI, Panda.FLAG_HYUNDAI_CAMERA_SCC),
+  (Panda.SAFETY_SUBARU, 0),
+  (Panda.SAFETY_TOYOTA, 0),
+  (Panda.SAFETY_VOLKSWAGEN_MQB, 0),
+  (Panda.SAFETY_VOLKSWAGEN_PQ, 0),
+)
+
+
+class TestSafetyChecksums(unittest.TestCase):
+  """The checksum kernels against the byte and bit at a time checksums they replaced"""
+
+  def setUp(self):
+    self.safety = libpanda_py.libpanda
+    self.safety.init_tests()
+
+  def test_kernels(self):
+    for seed, (mode, param) in enumerate(KERNEL_MODES):
+      with self.subTest(mode=mode, param=param):
+        self.assertEqual(self.safety.checksum_kernel_mismatches(mode, param, 20000, seed + 1), 0)
+
+  def test_no_reference(self):
+    self.assertEqual(self.safety.checksum_kernel_mismatches(Panda.SAFETY_FORD, 0, 1, 1), -1)
+
+
+if __name__ == "__main__":
+  unittest.main()
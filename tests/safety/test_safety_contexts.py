@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+import time
+import unittest
+
+from panda import Panda
+from panda.tests.libpanda import libpanda_py
+
+MODES = [(Panda.SAFETY_TOYOTA, 0), (Panda.SAFETY_HONDA_NIDEC, 0), (Panda.SAFETY_HYUNDAI, 0), (Panda.SAFETY_GM, 0),
+         (Panda.SAFETY_FORD, 0), (Panda.SAFETY_ALLOUTPUT, 1), (Panda.SAFETY_ELM327, 0), (Panda.SAFETY_BODY, 0)]
+
+
+class TestSafetyContexts(unittest.TestCase):
+  def setUp(self):
+    self.safety = libpanda_py.libpanda
+    self.safety.set_safety_hooks(Panda.SAFETY_TOYOTA, 0)
+    self.safety.init_tests()
+    self.safety.set_controls_allowed(True)
+
+  def _run(self, n, workers, fn):
+    cb = libpanda_py.ffi.callback("void(uint32_t, void *)", fn)
+    self.assertEqual(self.safety.safety_contexts_run(n, workers, cb, libpanda_py.ffi.NULL), 0)
+
+  def test_contexts_isolated(self):
+    results = {}
+
+    def context(idx, _):
+      # every context starts from the power-on state
+      fresh = (self.safety.get_current_safety_mode(), self.safety.get_controls_allowed())
+
+      mode, param = MODES[idx % len(MODES)]
+      self.safety.set_safety_hooks(mode, param)
+      self.safety.set_controls_allowed(idx % 2 == 0)
+      self.safety.set_alternative_experience(idx)
+      # let the other contexts run in between
+      time.sleep(0.001)
+      results[idx] = (fresh, self.safety.get_current_safety_mode(), self.safety.get_current_safety_param(),
+                      self.safety.get_controls_allowed(), self.safety.get_alternative_experience())
+
+    n = 4 * len(MODES)
+    self._run(n, 4, context)
+    self.assertEqual(len(results), n)
+    for idx, (fresh, mode, param, controls_allowed, alternative_experience) in results.items():
+      self.assertEqual(fresh, (Panda.SAFETY_SILENT, False))
+      self.assertEqual((mode, param), MODES[idx % len(MODES)])
+      self.assertEqual(controls_allowed, idx % 2 == 0)
+      self.assertEqual(alternative_experience, idx)
+
+    # the calling thread's context is untouched
+    self.assertEqual(self.safety.get_current_safety_mode(), Panda.SAFETY_TOYOTA)
+    self.assertTrue(self.safety.get_controls_allowed())
+    self.assertEqual(self.safety.get_alternative_experience(), 0)
+
+  def test_contexts_run_all(self):
+    seen = []
+    self._run(0, 0, lambda idx, _: seen.append(idx))
+    self.assertEqual(seen, [])
+    self._run(10, 0, lambda idx, _: seen.append(idx))
+    self.assertEqual(sorted(seen), list(range(10)))
+
+
+if __name__ == "__main__":
+  unittest.main()
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+import random
+import unittest
+from collections import deque
+
+from panda import Panda
+from panda.tests.libpanda import libpanda_py
+
+MAX_SAMPLE_VALS = 6
+ANGLE_MODES = (Panda.SAFETY_FORD, Panda.SAFETY_NISSAN, Panda.SAFETY_TESLA, Panda.SAFETY_TOYOTA)
+
+
+def f32(x):
+  return float(libpanda_py.ffi.cast("float", x))
+
+
+class TestSafetyMath(unittest.TestCase):
+  """The integer and fixed point safety math against the float implementation it replaced"""
+
+  def setUp(self):
+    self.safety = libpanda_py.libpanda
+    self.safety.init_tests()
+
+  def test_sample(self):
+    # compare the ring buffer against a plain window of the last samples
+    random.seed(0)
+    sample = libpanda_py.ffi.new("struct sample_t *")
+    for _ in range(100):
+      self.safety.reset_sample(sample)
+      window = deque([0] * MAX_SAMPLE_VALS, maxlen=MAX_SAMPLE_VALS)
+      spread = random.choice((0, 2, 10, 1000))
+      margin = random.choice((0, 1, 5))
+      for _ in range(50):
+        val = random.randint(-spread, spread)
+        self.safety.update_sample_margin(sample, val, margin)
+        window.append(val)
+        self.assertEqual((sample.min, sample.max), (min(window) - margin, max(window) + margin))
+        self.assertEqual(self.safety.sample_last(sample), val)
+
+  def test_vehicle_speed(self):
+    # every raw speed of the modes, converted with the float math UPDATE_VEHICLE_SPEED used before
+    ROUND = self.safety.ROUND
+    modes = {
+      "toyota": (range(-4 * 6767, 4 * (0xFFFF - 6767) + 1), 5, 72, lambda r: ROUND(r / 4.0 * 0.01 / 3.6 * 100.0)),
+      "nissan": (range(2 * 0xFFFF + 1), 5, 72, lambda r: ROUND(r / 2.0 * 0.005 / 3.6 * 100.0)),
+      "ford": (range(0xFFFF + 1), 5, 18, lambda r: ROUND(r * 0.01 / 3.6 * 100.0)),
+      "subaru": (range(0x1FFF + 1), 57, 10, lambda r: ROUND(r * 0.057 * 100.0)),
+      "tesla": (range(-500, 0xFFF - 500 + 1), 447, 200, lambda r: ROUND(f32((r + 500) * 0.05 - 25) * 0.447 * 100.0)),
+    }
+    for name, (raw_range, num, den, speed_float) in modes.items():
+      for raw in raw_range:
+        self.assertEqual(self.safety.round_div(raw * num, den), speed_float(raw), f"{name} {raw=}")
+
+  def test_angle_rate_limits(self):
+    # the fixed point limits are never looser than the float ones: the rate away from the measured
+    # angle is at most the float one and the lower rate towards it at least. They only differ where
+    # the float math lands within its rounding error of an integer
+    for mode in ANGLE_MODES:
+      for up in (True, False):
+        for lower in (True, False):
+          speeds = range(-1000, 10000)
+          mismatches = 0
+          for speed in speeds:
+            limit_float = self.safety.get_angle_rate_limit(mode, up, lower, speed, False)
+            limit_fixed = self.safety.get_angle_rate_limit(mode, up, lower, speed, True)
+            msg = f"{mode=} {up=} {lower=} {speed=}"
+            if lower:
+              self.assertGreaterEqual(limit_fixed, limit_float, msg)
+            else:
+              self.assertLessEqual(limit_fixed, limit_float, msg)
+            self.assertLessEqual(abs(limit_fixed - limit_float), 1, msg)
+            mismatches += limit_fixed != limit_float
+          self.assertLess(mismatches / len(speeds), 0.005, f"{mode=} {up=} {lower=}")
+
+if __name__ == "__main__":
+  unittest.main()
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+import random
+import unittest
+
+from panda import Panda
+from panda.tests.libpanda import libpanda_py
+
+MODES = [(Panda.SAFETY_TOYOTA, 0), (Panda.SAFETY_HONDA_NIDEC, 0), (Panda.SAFETY_HYUNDAI, 0), (Panda.SAFETY_FORD, 0),
+         (Panda.SAFETY_ALLOUTPUT, 1)]
+
+
+class TestSafetyProfile(unittest.TestCase):
+  def setUp(self):
+    self.safety = libpanda_py.dlopen_profile()
+    self.safety.init_tests()
+
+  def test_hook_timings(self):
+    # frames replayed through the hooks take measurable time on the host clock
+    random.seed(0)
+    profile = libpanda_py.ffi.new("safety_hook_profile *")
+    for mode, param in MODES:
+      with self.subTest(mode=mode):
+        self.assertEqual(self.safety.set_safety_hooks(mode, param), 0)
+        self.safety.safety_profile_reset()
+        for _ in range(200):
+          bus = random.randint(0, 2)
+          addr = random.randint(0, 0x7FF)
+          msg = libpanda_py.make_CANPacket(addr, bus, random.randbytes(8))
+          self.safety.safety_rx_hook(msg)
+          self.safety.safety_tx_hook(msg)
+          self.safety.safety_fwd_hook(bus, addr)
+
+        for hook in range(3):
+          self.assertTrue(self.safety.safety_profile_get(mode, hook, profile))
+          self.assertEqual(profile.cnt, 200)
+          self.assertGreater(profile.max, 0)
+          self.assertGreater(profile.sum, 0)
+
+
+if __name__ == "__main__":
+  unittest.main()
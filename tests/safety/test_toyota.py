@@ -174,6 +174,13 @@ class TestToyotaSafetyTorque(TestToyotaSafetyBase, common.MotorTorqueSteeringSaf
     self.safety.set_safety_hooks(Panda.SAFETY_TOYOTA, self.EPS_SCALE)
     self.safety.init_tests()
 
+  def test_torque_meas_tolerance_constant(self):
+    # the rounding tolerance widens the measurements once, not once per frame
+    for _ in range(100):
+      self.assertTrue(self._rx(self._torque_meas_msg(0)))
+      self.assertEqual(self.safety.get_torque_meas_min(), -self.TORQUE_MEAS_TOLERANCE)
+      self.assertEqual(self.safety.get_torque_meas_max(), self.TORQUE_MEAS_TOLERANCE)
+
 
 class TestToyotaSafetyTorqueGasInterceptor(TestToyotaSafetyGasInterceptorBase, TestToyotaSafetyTorque):
   pass
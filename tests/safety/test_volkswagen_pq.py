@@ -160,6 +160,10 @@ class TestVolkswagenPqLongSafety(TestVolkswagenPqSafety, common.LongitudinalAcce
   def test_cruise_engaged_prev(self):
     pass
 
+  def test_cruise_override_at_init(self):
+    # stock cruise is overridden from init on, not from the first frame
+    self.assertTrue(self.safety.get_cruise_override())
+
   def test_set_and_resume_buttons(self):
     for button in ["set", "resume"]:
       # ACC main switch must be on, engage on falling edge
@@ -0,0 +1,323 @@
+// Native safety replay: replays logs converted by replay_log.py through the safety hooks and
+// prints the same RX/TX statistics as replay_drive.py for each of them. Every log runs in its own
+// safety context, so a route converted into one log per segment replays on all cores:
+//   ./replay route/*.prl
+//
+// usage: ./replay [-j N] [--mode N] [--param N] [--alternative-experience N] log.prl...
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "panda.c"
+#include "benchmark.h"
+#include "replay_log.h"
+
+#define REPLAY_ADDRS_MAX 512U
+
+typedef struct {
+  uint32_t addr;
+  uint32_t cnt;
+  uint32_t first_seen;
+} replay_addr_cnt;
+
+typedef struct {
+  replay_addr_cnt addrs[REPLAY_ADDRS_MAX];
+  uint32_t len;
+} replay_addr_set;
+
+typedef struct {
+  uint32_t rx_tot;
+  uint32_t rx_invalid;
+  bool safety_tick_rx_invalid;
+  uint32_t tx_tot;
+  uint32_t tx_blocked;
+  uint32_t tx_controls;
+  uint32_t tx_controls_blocked;
+  replay_addr_set invalid_addrs;
+  replay_addr_set blocked_addrs;
+} replay_stats;
+
+// per log, so per safety context
+static SAFETY_STATE replay_stats stats;
+
+typedef struct {
+  const char *fn;
+  char *out;
+  size_t out_len;
+  int ret;
+  uint32_t frames;
+} replay_job;
+
+typedef struct {
+  replay_job *jobs;
+  long mode;
+  long param;
+  long alternative_experience;
+} replay_args;
+
+static void addr_set_add(replay_addr_set *set, uint32_t addr) {
+  uint32_t i = 0U;
+  while ((i < set->len) && (set->addrs[i].addr != addr)) {
+    i++;
+  }
+  if (i == set->len) {
+    if (set->len == REPLAY_ADDRS_MAX) {
+      return;
+    }
+    set->addrs[i].addr = addr;
+    set->addrs[i].cnt = 0U;
+    set->addrs[i].first_seen = i;
+    set->len++;
+  }
+  set->addrs[i].cnt++;
+}
+
+static int cmp_addr(const void *a, const void *b) {
+  const replay_addr_cnt *x = a;
+  const replay_addr_cnt *y = b;
+  return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+// most common first, ties in the order first seen, like collections.Counter
+static int cmp_cnt(const void *a, const void *b) {
+  const replay_addr_cnt *x = a;
+  const replay_addr_cnt *y = b;
+  return (x->cnt != y->cnt) ? ((y->cnt > x->cnt) - (y->cnt < x->cnt)) : ((x->first_seen > y->first_seen) - (x->first_seen < y->first_seen));
+}
+
+static void print_addrs(FILE *out, const char *name, replay_addr_set *set, bool counts) {
+  qsort(set->addrs, set->len, sizeof(replay_addr_cnt), counts ? cmp_cnt : cmp_addr);
+  fprintf(out, "%s: %s", name, counts ? "Counter(" : ((set->len > 0U) ? "" : "set("));
+  for (uint32_t i = 0U; i < set->len; i++) {
+    fprintf(out, (i > 0U) ? ", %u" : "{%u", set->addrs[i].addr);
+    if (counts) {
+      fprintf(out, ": %u", set->addrs[i].cnt);
+    }
+  }
+  fprintf(out, "%s%s\n", (set->len > 0U) ? "}" : "", (counts || (set->len == 0U)) ? ")" : "");
+}
+
+static inline const replay_log_record *next_record(const replay_log_record *rec) {
+  uint32_t len = dlc_to_len[rec->data_len_code];
+  return (const replay_log_record *)((const uint8_t *)rec + sizeof(replay_log_record) + ((len + 7U) & ~7U));
+}
+
+// every record's header and padded data lie within the records, and the init record is one of them,
+// so next_record and fill_packet can walk the log unchecked
+static bool records_valid(const uint8_t *log, const replay_log_header *hdr) {
+  uint64_t end = sizeof(replay_log_header) + hdr->records_len;
+  uint64_t pos = sizeof(replay_log_header);
+  bool valid = true;
+  bool init_found = (hdr->init_offset == 0U);
+  while (valid && (pos < end)) {
+    const replay_log_record *rec = (const replay_log_record *)&log[pos];
+    valid = ((end - pos) >= sizeof(replay_log_record)) && (rec->data_len_code < sizeof(dlc_to_len));
+    if (valid) {
+      uint64_t len = sizeof(replay_log_record) + ((dlc_to_len[rec->data_len_code] + 7U) & ~7U);
+      valid = (end - pos) >= len;
+      init_found = init_found || (pos == hdr->init_offset);
+      pos += len;
+    }
+  }
+  return valid && init_found;
+}
+
+// the packet is reused, like a fresh one the bytes past the data length must read as zero
+static inline void fill_packet(CANPacket_t *pkt, const replay_log_record *rec) {
+  uint32_t len = dlc_to_len[rec->data_len_code];
+  uint32_t prev_len = dlc_to_len[pkt->data_len_code];
+  if (prev_len > len) {
+    (void)memset(&pkt->data[len], 0, prev_len - len);
+  }
+  pkt->extended = (rec->addr >= 0x800U) ? 1U : 0U;
+  pkt->addr = rec->addr;
+  pkt->data_len_code = rec->data_len_code;
+  pkt->bus = rec->bus;
+  (void)memcpy(pkt->data, &rec[1], len);
+}
+
+// same as init_segment in helpers.py: the segment starts mid-drive, so seed the last
+// requested steering from the first steering message openpilot sent
+static bool init_segment(const uint8_t *log, const replay_log_header *hdr) {
+  CANPacket_t to_send = {0};
+  fill_packet(&to_send, (const replay_log_record *)&log[hdr->init_offset]);
+  if (hdr->init_torque != 0) {
+    set_controls_allowed(true);
+    set_desired_torque_last(hdr->init_torque);
+  } else if (hdr->init_angle != 0) {
+    set_controls_allowed(true);
+    set_desired_angle_last(hdr->init_angle);
+    set_angle_meas(hdr->init_angle, hdr->init_angle);
+  } else {
+  }
+  return safety_tx_hook(&to_send);
+}
+
+static void replay(const uint8_t *log, const replay_log_header *hdr) {
+  const replay_log_record *rec = (const replay_log_record *)&log[sizeof(replay_log_header)];
+  const replay_log_record *end = (const replay_log_record *)&log[sizeof(replay_log_header) + hdr->records_len];
+  CANPacket_t pkt = {0};
+
+  while (rec < end) {
+    if ((rec->flags & REPLAY_FLAG_EVENT) != 0U) {
+      set_timer((uint32_t)((rec->time / 1000U) % 0xFFFFFFFFU));
+
+      // skip start and end of route, warm up/down period
+      if (((rec->time - hdr->start_time) > 1000000000U) && ((hdr->end_time - rec->time) > 1000000000U)) {
+        safety_tick_current_safety_config();
+        stats.safety_tick_rx_invalid |= !safety_config_valid();
+      }
+    }
+
+    if ((rec->flags & REPLAY_FLAG_NO_FRAME) == 0U) {
+      fill_packet(&pkt, rec);
+      if ((rec->flags & REPLAY_FLAG_TX) != 0U) {
+        if (!safety_tx_hook(&pkt)) {
+          stats.tx_blocked++;
+          stats.tx_controls_blocked += get_controls_allowed() ? 1U : 0U;
+          addr_set_add(&stats.blocked_addrs, rec->addr);
+        }
+        stats.tx_controls += get_controls_allowed() ? 1U : 0U;
+        stats.tx_tot++;
+      } else {
+        if (!safety_rx_hook(&pkt)) {
+          stats.rx_invalid++;
+          addr_set_add(&stats.invalid_addrs, rec->addr);
+        }
+        stats.rx_tot++;
+      }
+    }
+    rec = next_record(rec);
+  }
+}
+
+static int replay_file(const char *fn, FILE *out, const replay_args *args) {
+  int fd = open(fn, O_RDONLY);
+  struct stat st;
+  if ((fd < 0) || (fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(replay_log_header))) {
+    fprintf(stderr, "%s: can't read log\n", fn);
+    return 2;
+  }
+  const uint8_t *log = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  (void)close(fd);
+  if (log == MAP_FAILED) {
+    fprintf(stderr, "%s: can't map log\n", fn);
+    return 2;
+  }
+  (void)madvise((void *)log, st.st_size, MADV_SEQUENTIAL);
+
+  int ret = 2;
+  const replay_log_header *hdr = (const replay_log_header *)log;
+  long mode = (args->mode < 0) ? hdr->safety_mode : args->mode;
+  long param = (args->param < 0) ? hdr->safety_param : args->param;
+  long alternative_experience = (args->alternative_experience < 0) ? hdr->alternative_experience : args->alternative_experience;
+  if ((hdr->magic != REPLAY_LOG_MAGIC) || (hdr->version != REPLAY_LOG_VERSION)) {
+    fprintf(stderr, "%s: not a version %u replay log\n", fn, REPLAY_LOG_VERSION);
+  } else if ((hdr->records_len > ((size_t)st.st_size - sizeof(replay_log_header))) || !records_valid(log, hdr)) {
+    fprintf(stderr, "%s: truncated or corrupt replay log\n", fn);
+  } else if (set_safety_hooks((uint16_t)mode, (uint16_t)param) != 0) {
+    fprintf(stderr, "%s: invalid safety mode: %ld\n", fn, mode);
+  } else {
+    fprintf(out, "replaying %s with safety mode %ld, param %ld, alternative experience %ld\n", fn, mode, param, alternative_experience);
+    set_alternative_experience((int)alternative_experience);
+
+    if ((hdr->init_offset != 0U) && !init_segment(log, hdr)) {
+      fprintf(stderr, "%s: failed to initialize panda safety for segment\n", fn);
+    } else {
+      replay(log, hdr);
+
+      fprintf(out, "\nRX\n");
+      fprintf(out, "total rx msgs: %u\n", stats.rx_tot);
+      fprintf(out, "invalid rx msgs: %u\n", stats.rx_invalid);
+      fprintf(out, "safety tick rx invalid: %s\n", stats.safety_tick_rx_invalid ? "True" : "False");
+      print_addrs(out, "invalid addrs", &stats.invalid_addrs, false);
+      fprintf(out, "\nTX\n");
+      fprintf(out, "total openpilot msgs: %u\n", stats.tx_tot);
+      fprintf(out, "total msgs with controls allowed: %u\n", stats.tx_controls);
+      fprintf(out, "blocked msgs: %u\n", stats.tx_blocked);
+      fprintf(out, "blocked with controls allowed: %u\n", stats.tx_controls_blocked);
+      print_addrs(out, "blocked addrs", &stats.blocked_addrs, true);
+
+      bool ok = (stats.tx_controls_blocked == 0U) && (stats.rx_invalid == 0U) && !stats.safety_tick_rx_invalid;
+      ret = ok ? 0 : 1;
+    }
+  }
+
+  (void)munmap((void *)log, st.st_size);
+  return ret;
+}
+
+static void replay_context(uint32_t idx, void *arg) {
+  const replay_args *args = arg;
+  replay_job *job = &args->jobs[idx];
+  FILE *out = open_memstream(&job->out, &job->out_len);
+  job->ret = (out != NULL) ? replay_file(job->fn, out, args) : 2;
+  job->frames = stats.rx_tot + stats.tx_tot;
+  if (out != NULL) {
+    (void)fclose(out);
+  }
+}
+
+int main(int argc, char **argv) {
+  static const struct option options[] = {
+    {"jobs", required_argument, NULL, 'j'},
+    {"mode", required_argument, NULL, 'm'},
+    {"param", required_argument, NULL, 'p'},
+    {"alternative-experience", required_argument, NULL, 'a'},
+    {NULL, 0, NULL, 0},
+  };
+  replay_args args = {.jobs = NULL, .mode = -1, .param = -1, .alternative_experience = -1};
+  uint32_t workers = 0U;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "j:", options, NULL)) != -1) {
+    if (opt == 'j') {
+      workers = (uint32_t)strtoul(optarg, NULL, 0);
+    } else if (opt == 'm') {
+      args.mode = strtol(optarg, NULL, 0);
+    } else if (opt == 'p') {
+      args.param = strtol(optarg, NULL, 0);
+    } else if (opt == 'a') {
+      args.alternative_experience = strtol(optarg, NULL, 0);
+    } else {
+      return 2;
+    }
+  }
+  if (optind == argc) {
+    fprintf(stderr, "usage: %s [-j N] [--mode N] [--param N] [--alternative-experience N] log.prl...\n", argv[0]);
+    return 2;
+  }
+
+  uint32_t n = (uint32_t)(argc - optind);
+  args.jobs = calloc(n, sizeof(replay_job));
+  if (args.jobs == NULL) {
+    return 2;
+  }
+  for (uint32_t i = 0U; i < n; i++) {
+    args.jobs[i].fn = argv[optind + (int)i];
+    args.jobs[i].ret = 2;
+  }
+
+  uint64_t start = bench_nanos();
+  int ret = (safety_contexts_run(n, workers, replay_context, &args) == 0) ? 0 : 2;
+  uint64_t elapsed = bench_nanos() - start;
+
+  uint64_t frames = 0U;
+  for (uint32_t i = 0U; i < n; i++) {
+    if (args.jobs[i].out != NULL) {
+      (void)fwrite(args.jobs[i].out, 1, args.jobs[i].out_len, stdout);
+      free(args.jobs[i].out);
+    }
+    frames += args.jobs[i].frames;
+    ret = MAX(ret, args.jobs[i].ret);
+  }
+  free(args.jobs);
+
+  fprintf(stderr, "\n%llu frames in %.3f s, %.2f M frames/s\n", (unsigned long long)frames, (double)elapsed / 1e9,
+          (elapsed > 0U) ? ((1e3 * (double)frames) / (double)elapsed) : 0.0);
+  return ret;
+}
@@ -0,0 +1,44 @@
+// Binary CAN log for the native safety replay, written by replay_log.py.
+//
+// The file is a replay_log_header followed by records_len bytes of records. Every record is a
+// replay_log_record followed by its data, padded to 8 bytes, so the file can be mmap'd and walked
+// in place. A record flagged REPLAY_FLAG_EVENT starts a new log event (a can or sendcan message
+// in the original log), all following records up to the next event belong to it.
+
+#pragma once
+
+#include <stdint.h>
+
+#define REPLAY_LOG_MAGIC 0x474C5250U  // "PRLG"
+#define REPLAY_LOG_VERSION 1U
+
+#define REPLAY_FLAG_TX 1U        // sent by openpilot (sendcan), otherwise received from the car
+#define REPLAY_FLAG_EVENT 2U     // first record of a log event, carries the event's timestamp
+#define REPLAY_FLAG_NO_FRAME 4U  // event without any frames to replay, only ticks the safety
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t safety_mode;
+  uint16_t safety_param;
+  uint16_t reserved;
+  int32_t alternative_experience;
+  uint64_t start_time;   // logMonoTime of the first and last CAN event, in ns
+  uint64_t end_time;
+  uint64_t init_offset;  // file offset of the sendcan record that initializes a segment, 0 if none
+  int32_t init_torque;
+  int32_t init_angle;
+  uint64_t records_len;
+} replay_log_header;
+
+typedef struct {
+  uint64_t time;  // logMonoTime of the event, in ns
+  uint32_t addr;
+  uint8_t bus;
+  uint8_t data_len_code;
+  uint8_t flags;
+  uint8_t reserved;
+} replay_log_record;
+
+_Static_assert(sizeof(replay_log_header) == 56U, "replay_log_header must match replay_log.py");
+_Static_assert(sizeof(replay_log_record) == 16U, "replay_log_record must match replay_log.py");
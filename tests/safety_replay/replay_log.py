@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+import argparse
+import os
+import struct
+
+from panda import LEN_TO_DLC
+from panda.tests.safety_replay.helpers import package_can_msg, is_steering_msg, get_steer_value
+
+# see replay_log.h
+REPLAY_LOG_MAGIC = 0x474C5250
+REPLAY_LOG_VERSION = 1
+REPLAY_FLAG_TX = 1
+REPLAY_FLAG_EVENT = 2
+REPLAY_FLAG_NO_FRAME = 4
+
+HEADER = struct.Struct("<IHHHHiQQQiiQ")
+RECORD = struct.Struct("<QIBBBB")
+
+
+def pack_record(t, addr, bus, dat, flags):
+  pad = b"\x00" * (-len(dat) % 8)
+  return RECORD.pack(t, addr, bus, LEN_TO_DLC[len(dat)], flags, 0) + bytes(dat) + pad
+
+
+def write_replay_log(lr, fn, mode, param, alternative_experience, segment=False):
+  """Converts the CAN events of a log into the binary format the native replay reads."""
+  records = []
+  offset = HEADER.size
+  start_t, end_t = None, None
+  init_offset, init_torque, init_angle = 0, 0, 0
+
+  for msg in lr:
+    which = msg.which()
+    if which not in ('can', 'sendcan'):
+      continue
+
+    t = msg.logMonoTime
+    start_t = t if start_t is None else start_t
+    end_t = t
+    if which == 'sendcan':
+      frames = [(canmsg, REPLAY_FLAG_TX) for canmsg in msg.sendcan]
+    else:
+      # ignore msgs we sent
+      frames = [(canmsg, 0) for canmsg in msg.can if canmsg.src < 128]
+
+    if len(frames) == 0:
+      records.append(RECORD.pack(t, 0, 0, 0, REPLAY_FLAG_EVENT | REPLAY_FLAG_NO_FRAME, 0))
+      offset += RECORD.size
+    for i, (canmsg, flags) in enumerate(frames):
+      if segment and init_offset == 0 and flags == REPLAY_FLAG_TX and is_steering_msg(mode, param, canmsg.address):
+        init_offset = offset
+        init_torque, init_angle = get_steer_value(mode, param, package_can_msg(canmsg))
+      records.append(pack_record(t, canmsg.address, canmsg.src % 4, canmsg.dat, flags | (REPLAY_FLAG_EVENT if i == 0 else 0)))
+      offset += len(records[-1])
+
+  if start_t is None:
+    raise Exception("no CAN messages in log")
+
+  with open(fn, "wb") as f:
+    f.write(HEADER.pack(REPLAY_LOG_MAGIC, REPLAY_LOG_VERSION, mode, param, 0, alternative_experience,
+                        start_t, end_t, init_offset, init_torque, init_angle, offset - HEADER.size))
+    f.writelines(records)
+
+
+def get_safety_config(lr):
+  for msg in lr:
+    if msg.which() == 'carParams':
+      cp = msg.carParams
+      return cp.safetyConfigs[-1].safetyModel.raw, cp.safetyConfigs[-1].safetyParam, cp.alternativeExperience
+  return None
+
+if __name__ == "__main__":
+  from openpilot.tools.lib.logreader import LogReader
+
+  parser = argparse.ArgumentParser(description="Convert a route or segment into logs for the native safety replay, one per segment",
+                                   formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+  parser.add_argument("route_or_segment_name")
+  parser.add_argument("out_dir")
+  parser.add_argument("--mode", type=int, help="Override the safety mode from the log")
+  parser.add_argument("--param", type=int, help="Override the safety param from the log")
+  parser.add_argument("--alternative-experience", type=int, help="Override the alternative experience from the log")
+  args = parser.parse_args()
+
+  os.makedirs(args.out_dir, exist_ok=True)
+  identifiers = LogReader(args.route_or_segment_name).logreader_identifiers
+
+  # carParams isn't in every segment, keep the last one seen
+  config = None
+  for i, identifier in enumerate(identifiers):
+    lr = LogReader(identifier)
+    config = get_safety_config(lr) or config
+    if config is None and None in (args.mode, args.param, args.alternative_experience):
+      raise Exception("carParams not found in log. Set safety mode and param manually.")
+    mode, param, alternative_experience = (o if o is not None else c for o, c in
+                                           zip((args.mode, args.param, args.alternative_experience), config or (None, None, None)))
+
+    lr.reset()
+    fn = os.path.join(args.out_dir, f"{i:04d}.prl")
+    print(f"converting {identifier} to {fn}")
+    # every log can be replayed on its own, so each one starts from the segment init
+    write_replay_log(lr, fn, mode, param, alternative_experience, segment=True)
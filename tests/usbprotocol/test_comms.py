@@ -1,6 +1,8 @@
 #!/usr/bin/env python3
 import random
 import unittest
+from functools import reduce
+from operator import xor
 
 from panda import Panda, DLC_TO_LEN, USBPACKET_MAX_SIZE, pack_can_buffer, unpack_can_buffer
 from panda.tests.libpanda import libpanda_py
@@ -9,6 +11,13 @@ lpp = libpanda_py.libpanda
 
 CHUNK_SIZE = USBPACKET_MAX_SIZE
 TX_QUEUES = (lpp.tx1_q, lpp.tx2_q, lpp.tx3_q)
+# the firmware CANPacket_t is packed, but aligned(4), which cffi can't express
+CAN_PACKET_STRIDE = (libpanda_py.ffi.sizeof('CANPacket_t') + 3) & ~3
+
+
+def can_packet_array(n):
+  buf = libpanda_py.ffi.new(f'uint8_t[{n * CAN_PACKET_STRIDE}]')
+  return buf, [libpanda_py.ffi.cast('CANPacket_t *', buf + (i * CAN_PACKET_STRIDE)) for i in range(n)]
 
 
 def unpackage_can_msg(pkt):
@@ -44,12 +53,66 @@ class TestPandaComms(unittest.TestCase):
 
       assert unpackage_can_msg(can_pkt_rx) == message
 
+  def test_tx_queues_batch(self):
+    q = TX_QUEUES[0]
+    pkt = libpanda_py.ffi.new('CANPacket_t *')
+    while lpp.can_pop(q, pkt):
+      pass
+
+    # move the pointers close to the end of the buffer, so the batches wrap around
+    for _ in range(q.fifo_size - 10):
+      assert lpp.can_push(q, pkt)
+      assert lpp.can_pop(q, pkt)
+
+    msgs = random_can_messages(q.fifo_size + 10, bus=0)
+    _pkts_buf, pkts = can_packet_array(len(msgs))
+    for i, m in enumerate(msgs):
+      pkts[i][0] = libpanda_py.make_CANPacket(m[0], m[2], m[1])[0]
+
+    # one slot always stays empty
+    pushed = lpp.can_push_many(q, pkts[0], len(msgs))
+    assert pushed == q.fifo_size - 1
+    assert lpp.can_slots_empty(q) == 0
+
+    popped = []
+    _out_buf, out = can_packet_array(51)
+    while (n := lpp.can_pop_many(q, out[0], len(out))) > 0:
+      popped.extend(unpackage_can_msg(out[i]) for i in range(n))
+    assert popped == msgs[:pushed]
+
+  def test_rx_queue_packed(self):
+    rx_q = lpp.rx_q
+    pkt = libpanda_py.ffi.new('CANPacket_t *')
+    while lpp.can_packed_pop(rx_q, pkt):
+      pass
+
+    # classic frames only take up their wire size
+    free = lpp.can_packed_bytes_free(rx_q)
+    classic = libpanda_py.make_CANPacket(0x100, 0, b"\x01" * 8)
+    pushed = 0
+    while lpp.can_packed_push(rx_q, classic):
+      pushed += 1
+    assert pushed == free // 14
+    assert pushed > 4 * (rx_q.size // libpanda_py.ffi.sizeof('CANPacket_t'))
+
+    # mixed frame sizes come out in order, across the end of the buffer
+    while lpp.can_packed_pop(rx_q, pkt):
+      pass
+    for _ in range(3):
+      msgs = random_can_messages(5000, bus=0)
+      for m in msgs:
+        assert lpp.can_packed_push(rx_q, libpanda_py.make_CANPacket(m[0], m[2], m[1]))
+      popped = []
+      while lpp.can_packed_pop(rx_q, pkt):
+        popped.append(unpackage_can_msg(pkt))
+      assert popped == msgs
+
   def test_comms_reset_rx(self):
     # store some test messages in the queue
     test_msg = (0x100, b"test", 0)
     for _ in range(100):
       can_pkt_tx = libpanda_py.make_CANPacket(test_msg[0], test_msg[2], test_msg[1])
-      lpp.can_push(lpp.rx_q, can_pkt_tx)
+      lpp.can_packed_push(lpp.rx_q, can_pkt_tx)
 
     # read a small chunk such that we have some overflow
     TINY_CHUNK_SIZE = 6
@@ -74,6 +137,53 @@ class TestPandaComms(unittest.TestCase):
     for m in msgs:
       assert m == test_msg, "message buffer should contain valid test messages"
 
+  def test_comms_can_read_checksum(self):
+    # the XOR comes out of the copy, for every alignment of the queue and the buffer
+    random.seed(7)
+    msgs = random_can_messages(3000)
+    for m in msgs:
+      assert lpp.can_packed_push(lpp.rx_q, libpanda_py.make_CANPacket(m[0], m[2], m[1]))
+
+    buf = b""
+    max_len = 600
+    dat = libpanda_py.ffi.new(f"uint8_t[{max_len + 3}]")
+    checksum = libpanda_py.ffi.new("uint8_t *")
+    while True:
+      offset = random.randint(0, 3)
+      checksum[0] = start = random.getrandbits(8)
+      rx_len = lpp.comms_can_read_checksum(dat + offset, random.randint(1, max_len), checksum)
+      if rx_len == 0:
+        break
+      chunk = bytes(dat[offset:offset + rx_len])
+      assert checksum[0] == reduce(xor, chunk, start)
+      buf += chunk
+    assert unpack_can_buffer(buf) == (msgs, b"")
+
+  def test_can_receive_timestamps(self):
+    msgs = random_can_messages(2000)
+    expected = []
+    for i, m in enumerate(msgs):
+      # the host can switch timestamps on and off, queued frames keep their format
+      lpp.can_rx_timestamps = (i // 500) % 2 == 0
+      ts = random.getrandbits(32)
+      lpp.can_rx_push(libpanda_py.make_CANPacket(m[0], m[2], m[1]), ts)
+      expected.append((*m, ts if lpp.can_rx_timestamps else None))
+
+    buf = b""
+    dat = libpanda_py.ffi.new(f"uint8_t[{CHUNK_SIZE}]")
+    while (rx_len := lpp.comms_can_read(dat, CHUNK_SIZE)) > 0:
+      buf += bytes(dat[0:rx_len])
+    rx_msgs, overflow = unpack_can_buffer(buf, timestamps=True)
+    assert len(overflow) == 0
+    assert rx_msgs == expected
+
+    # compact unpacking drops the timestamps
+    assert unpack_can_buffer(buf)[0] == msgs
+
+    # a new connection starts without timestamps
+    lpp.comms_can_reset()
+    assert not lpp.can_rx_timestamps
+
   def test_comms_reset_tx(self):
     # store some test messages in the queue
     test_msg = (0x100, b"test", 0)
@@ -124,6 +234,363 @@ class TestPandaComms(unittest.TestCase):
           self.assertEqual(len(queue_msgs), len(msgs))
           self.assertEqual(queue_msgs, msgs)
 
+  def test_can_send_chunks(self):
+    # frames go straight from the transfers into the TX queues, whatever the transfer boundaries
+    random.seed(0)
+    lpp.set_safety_hooks(Panda.SAFETY_ALLOUTPUT, 0)
+    pkt = libpanda_py.ffi.new('CANPacket_t *')
+    sent, queued = [], []
+    for _ in range(200):
+      msgs = random_can_messages(100, bus=random.randint(0, 2))
+      buf = b"".join(pack_can_buffer(msgs))
+      pos = 0
+      while pos < len(buf):
+        chunk_len = min(random.randint(1, 2 * CHUNK_SIZE), len(buf) - pos)
+        lpp.comms_can_write(buf[pos:pos + chunk_len], chunk_len)
+        pos += chunk_len
+      sent.extend(msgs)
+      for q in TX_QUEUES:
+        while lpp.can_pop(q, pkt):
+          queued.append(unpackage_can_msg(pkt))
+    assert sorted(queued) == sorted(sent)
+
+    # rejected frames go back to the host, nothing is queued
+    lpp.set_safety_hooks(Panda.SAFETY_SILENT, 0)
+    msgs = random_can_messages(50, bus=1)
+    for buf in pack_can_buffer(msgs):
+      lpp.comms_can_write(buf, len(buf))
+    assert all(not lpp.can_pop(q, pkt) for q in TX_QUEUES)
+    rx = b""
+    dat = libpanda_py.ffi.new(f"uint8_t[{CHUNK_SIZE}]")
+    while (rx_len := lpp.comms_can_read(dat, CHUNK_SIZE)) > 0:
+      rx += bytes(dat[0:rx_len])
+    assert unpack_can_buffer(rx)[0] == [(addr, dat, bus + 192) for addr, dat, bus in msgs]
+
+  def test_can_send_malformed(self):
+    # a frame with a bad checksum or a length that doesn't match its DLC never reaches the TX hook or a queue
+    SAFETY_HOOK_TX = 1
+    lpp.set_safety_hooks(Panda.SAFETY_ALLOUTPUT, 0)
+    profile = libpanda_py.ffi.new("safety_hook_profile *")
+    pkt = libpanda_py.ffi.new('CANPacket_t *')
+    msg = (0x123, b"\x01" * 8, 0)
+    frame = pack_can_buffer([msg])[0]
+    bad_checksum = frame[:5] + bytes([frame[5] ^ 0xFF]) + frame[6:]
+    bad_data = frame[:-1] + bytes([frame[-1] ^ 0x01])
+    errors = lpp.can_tx_checksum_error_cnt(0)
+
+    lpp.safety_profile_reset()
+    for raw in (bad_checksum, bad_data, frame[:-1], frame + b"\x00"):
+      self.assertFalse(lpp.can_send_raw(raw, len(raw)))
+    lpp.comms_can_write(bad_checksum + frame, 2 * len(frame))
+
+    self.assertTrue(lpp.safety_profile_get(Panda.SAFETY_ALLOUTPUT, SAFETY_HOOK_TX, profile))
+    self.assertEqual(profile.cnt, 1)
+    self.assertEqual(lpp.can_tx_checksum_error_cnt(0), errors + 5)
+    queued = []
+    for q in TX_QUEUES:
+      while lpp.can_pop(q, pkt):
+        queued.append(unpackage_can_msg(pkt))
+    self.assertEqual(queued, [msg])
+    # and nothing goes back to the host as rejected
+    dat = libpanda_py.ffi.new(f"uint8_t[{CHUNK_SIZE}]")
+    self.assertEqual(lpp.comms_can_read(dat, CHUNK_SIZE), 0)
+
+  def test_can_send_priority(self):
+    CAN_TX_PRIO_HIGH, CAN_TX_PRIO_LOW = 0, 1
+    lpp.set_safety_hooks(Panda.SAFETY_ALLOUTPUT, 0)
+    lpp.can_tx_prio_clear()
+    for bus in range(3):
+      lpp.can_tx_clear(bus)
+
+    # a burst of diagnostics, then a control frame the host marked as high priority
+    assert lpp.can_tx_prio_set(0, 0x2e4, True)
+    bulk = [(0x7e0, bytes([i % 256] * 8), 0) for i in range(300)]
+    control = [(0x2e4, b"\x01" * 8, 0)]
+    packed = pack_can_buffer(bulk + control)
+    for buf in packed:
+      lpp.comms_can_write(buf, len(buf))
+
+    sent = []
+    pkt = libpanda_py.ffi.new('CANPacket_t *')
+    while lpp.can_tx_pop(0, pkt):
+      sent.append(unpackage_can_msg(pkt))
+    assert sent == control + bulk
+
+    # removing the address puts it back into the bulk queue
+    assert lpp.can_tx_prio_set(0, 0x2e4, False)
+    assert lpp.can_tx_priority(0, 0x2e4, 8) == CAN_TX_PRIO_LOW
+
+    # the safety mode's TX messages are high priority on their bus, with their length
+    lpp.set_safety_hooks(Panda.SAFETY_TOYOTA, 73)
+    assert lpp.can_tx_priority(0, 0x2e4, 5) == CAN_TX_PRIO_HIGH
+    assert lpp.can_tx_priority(0, 0x2e4, 8) == CAN_TX_PRIO_LOW
+    assert lpp.can_tx_priority(1, 0x2e4, 5) == CAN_TX_PRIO_LOW
+    assert lpp.can_tx_priority(0, 0x7e0, 8) == CAN_TX_PRIO_LOW
+
+    # the host's addresses match any length, and the table stays consistent as it changes
+    random.seed(5)
+    addrs = [(random.randint(0, 2), random.randint(1, (1 << 29) - 1)) for _ in range(16)]
+    for bus, addr in addrs:
+      assert lpp.can_tx_prio_set(bus, addr, True)
+    assert not lpp.can_tx_prio_set(0, 0x7e0, True)
+    for bus, addr in addrs[::2]:
+      assert lpp.can_tx_prio_set(bus, addr, False)
+    for i, (bus, addr) in enumerate(addrs):
+      assert lpp.can_tx_priority(bus, addr, random.choice(DLC_TO_LEN)) == (CAN_TX_PRIO_LOW if i % 2 == 0 else CAN_TX_PRIO_HIGH)
+    lpp.can_tx_prio_clear()
+    assert all(lpp.can_tx_priority(bus, addr, 8) == CAN_TX_PRIO_LOW for bus, addr in addrs)
+
+    # full high priority queue drops are counted per level
+    lpp.set_safety_hooks(Panda.SAFETY_ALLOUTPUT, 0)
+    assert lpp.can_tx_prio_set(1, 0x123, True)
+    drops = lpp.can_tx_prio_drop_cnt[1][CAN_TX_PRIO_HIGH]
+    packed = pack_can_buffer([(0x123, b"\x00" * 8, 1)] * 100)
+    for buf in packed:
+      lpp.comms_can_write(buf, len(buf))
+    queued = 0
+    while lpp.can_tx_pop(1, pkt):
+      queued += 1
+    assert queued + lpp.can_tx_prio_drop_cnt[1][CAN_TX_PRIO_HIGH] - drops == 100
+    assert lpp.can_tx_prio_drop_cnt[1][CAN_TX_PRIO_LOW] == 0
+
+    # the host is held off while a high priority queue can't take a transfer
+    packed = pack_can_buffer([(0x123, b"\x00" * 8, 1)] * 10)
+    for buf in packed:
+      lpp.comms_can_write(buf, len(buf))
+    lpp.spi_can_tx_ready = False
+    lpp.refresh_can_tx_slots_available()
+    assert not lpp.spi_can_tx_ready
+    while lpp.can_tx_pop(1, pkt):
+      pass
+    lpp.refresh_can_tx_slots_available()
+    assert lpp.spi_can_tx_ready
+    lpp.can_tx_prio_clear()
+
+  def test_can_send_mailbox(self):
+    lpp.set_safety_hooks(Panda.SAFETY_ALLOUTPUT, 0)
+    lpp.can_tx_mailbox_clear()
+    lpp.can_tx_clear(0)
+
+    # the bus is stalled for a second, while the host keeps sending a 100 Hz command next to diagnostics
+    def stalled_bus(mailbox):
+      assert lpp.can_tx_mailbox_set(0, 0x2e4, mailbox)
+      replaced = lpp.can_tx_replaced_cnt[0]
+      for tick in range(100):
+        msgs = [(0x7e0, b"\x00" * 8, 0), (0x2e4, tick.to_bytes(8, "little"), 0)]
+        for buf in pack_can_buffer(msgs):
+          lpp.comms_can_write(buf, len(buf))
+
+      # once the bus recovers, the first command to go out should be as fresh as possible
+      sent = []
+      pkt = libpanda_py.ffi.new('CANPacket_t *')
+      while lpp.can_tx_pop(0, pkt):
+        sent.append(unpackage_can_msg(pkt))
+      commands = [int.from_bytes(m[1], "little") for m in sent if m[0] == 0x2e4]
+      return commands, sent.index(next(m for m in sent if m[0] == 0x2e4)), lpp.can_tx_replaced_cnt[0] - replaced
+
+    commands, position, replaced = stalled_bus(False)
+    assert commands == list(range(100))
+    assert position == 1
+    assert replaced == 0
+    staleness = 99 - commands[0]
+
+    # the mailbox keeps the queue position of the first command, with the latest data
+    commands, position, replaced = stalled_bus(True)
+    assert commands == [99]
+    assert position == 1
+    assert replaced == 99
+    assert 99 - commands[0] == 0 < staleness
+
+    # the mailbox only replaces frames that are still queued
+    for tick in range(2):
+      for buf in pack_can_buffer([(0x2e4, bytes([tick]), 0)]):
+        lpp.comms_can_write(buf, len(buf))
+      pkt = libpanda_py.ffi.new('CANPacket_t *')
+      assert lpp.can_tx_pop(0, pkt)
+      assert unpackage_can_msg(pkt) == (0x2e4, bytes([tick]), 0)
+    lpp.can_tx_mailbox_clear()
+
+  def test_can_rx_filters(self):
+    elems = libpanda_py.ffi.new('can_rx_filter_elems_t *')
+    pkt = libpanda_py.ffi.new('CANPacket_t *')
+
+    def build(bus):
+      lpp.can_rx_filter_build(bus, elems)
+      return elems.std_reject, elems.ext_reject
+
+    def std_accepted():
+      return {addr for addr in range(0x800) if lpp.can_rx_filter_accepts(elems, False, addr)}
+
+    def dispatched(bus):
+      pkt.bus = bus
+      ret = set()
+      for addr in range(0x800):
+        pkt.addr = addr
+        if lpp.safety_rx_dispatch(pkt):
+          ret.add(addr)
+      return ret
+
+    for bus in range(3):
+      lpp.can_rx_filter_clear(bus)
+
+    # no filters, everything is received
+    lpp.set_safety_hooks(Panda.SAFETY_SILENT, 0)
+    assert build(1) == (False, False)
+
+    # only the filtered IDs, plus the ignition IDs on bus 0
+    ext_addr = 0x18DAF110
+    assert lpp.can_rx_filter_add(1, 0x123, 0x7FF, False)
+    assert lpp.can_rx_filter_add(1, 0x400, 0x7F0, False)
+    assert lpp.can_rx_filter_add(1, ext_addr, 0, True)
+    assert build(1) == (True, True)
+    assert std_accepted() == {0x123} | set(range(0x400, 0x410))
+    assert lpp.can_rx_filter_accepts(elems, True, ext_addr)
+    assert not lpp.can_rx_filter_accepts(elems, True, ext_addr + 1)
+
+    assert lpp.can_rx_filter_add(0, 0x123, 0x7FF, False)
+    assert build(0) == (True, True)
+    assert std_accepted() == {0x123} | dispatched(0)
+    assert dispatched(0) == {0x1F1, 0x348, 0x9E}
+
+    # the IDs a safety mode needs are always received, on a bus it forwards everything is
+    for mode, param in ((Panda.SAFETY_TOYOTA, 0), (Panda.SAFETY_HONDA_NIDEC, 0), (Panda.SAFETY_HYUNDAI_CANFD, 0),
+                        (Panda.SAFETY_FORD, 0), (Panda.SAFETY_ELM327, 0), (Panda.SAFETY_ALLOUTPUT, 0)):
+      lpp.set_safety_hooks(mode, param)
+      for bus in range(3):
+        std_reject, _ = build(bus)
+        if lpp.safety_fwd_default(bus) != -1:
+          assert not std_reject
+        assert dispatched(bus) <= std_accepted()
+        assert std_reject or len(std_accepted()) == 0x800
+
+    # more IDs than filter elements, the bus keeps receiving everything
+    lpp.set_safety_hooks(Panda.SAFETY_TOYOTA, 0)
+    lpp.can_rx_filter_clear(1)
+    for i in range(8):
+      assert lpp.can_rx_filter_add(1, 0x100 + i, 0x7FF, False)
+    assert not lpp.can_rx_filter_add(1, 0x200, 0x7FF, False)
+    assert len(dispatched(1)) > 4
+    assert build(1) == (False, True)
+    assert len(std_accepted()) == 0x800
+
+    lpp.set_safety_hooks(Panda.SAFETY_SILENT, 0)
+    lpp.can_rx_filter_clear(1)
+    for i in range(5):
+      assert lpp.can_rx_filter_add(1, 0x10000 + i, 0, True)
+    assert build(1) == (False, False)
+
+    # extended filters alone leave the standard IDs alone, the RX checks and ignition keep arriving
+    lpp.set_safety_hooks(Panda.SAFETY_GM, 0)
+    assert lpp.safety_fwd_default(0) == -1
+    lpp.can_rx_filter_clear(0)
+    assert lpp.can_rx_filter_add(0, ext_addr, 0, True)
+    assert build(0) == (False, True)
+    assert {0x184, 0x1F1} <= dispatched(0) <= std_accepted()
+    assert len(std_accepted()) == 0x800
+    assert not lpp.can_rx_filter_accepts(elems, True, ext_addr + 1)
+
+    for bus in range(3):
+      lpp.can_rx_filter_clear(bus)
+
+  def test_can_rx_fifo1_ids(self):
+    ids = libpanda_py.ffi.new('uint16_t[16]')
+
+    def fifo1_ids(bus):
+      return list(ids[0:lpp.can_rx_fifo1_ids(bus, ids)])
+
+    lpp.set_safety_hooks(Panda.SAFETY_SILENT, 0)
+    assert fifo1_ids(0) == []
+
+    # the RX check IDs of the bus, once each
+    lpp.set_safety_hooks(Panda.SAFETY_TOYOTA, 0)
+    assert fifo1_ids(0) == [0xaa, 0x260, 0x1D2, 0x224, 0x226]
+    assert fifo1_ids(1) == []
+    for mode, param in ((Panda.SAFETY_HONDA_NIDEC, 0), (Panda.SAFETY_HYUNDAI_CANFD, 0), (Panda.SAFETY_FORD, 0)):
+      lpp.set_safety_hooks(mode, param)
+      for bus in range(3):
+        bus_ids = fifo1_ids(bus)
+        assert len(bus_ids) == len(set(bus_ids)) <= 16
+        assert all(addr < 0x800 for addr in bus_ids)
+
+  def test_can_tx_hw_mailbox_pick(self):
+    # bxCAN sends the pending mailbox with the lowest ID first, the lowest mailbox on equal IDs
+    random.seed(0)
+    for _ in range(200):
+      queue = [(random.choice((0x100, 0x200, 0x300, 0x80)), n) for n in range(30)]
+      mailboxes = [None] * 3
+      sent = []
+      while len(queue) or any(mailboxes):
+        pending = sum(1 << i for i, m in enumerate(mailboxes) if m is not None)
+        ids = [m[0] if m is not None else 0 for m in mailboxes]
+        mb = lpp.can_tx_hw_mailbox_pick(pending, ids, queue[0][0]) if len(queue) else -1
+        if mb >= 0:
+          assert mailboxes[mb] is None
+          mailboxes[mb] = queue.pop(0)
+        else:
+          # the mailboxes only run empty if there's nothing to send
+          assert any(mailboxes)
+          i = min((m[0], i) for i, m in enumerate(mailboxes) if m is not None)[1]
+          sent.append(mailboxes[i])
+          mailboxes[i] = None
+      assert len(sent) == 30
+      for addr in (0x100, 0x200, 0x300, 0x80):
+        seq = [n for a, n in sent if a == addr]
+        assert seq == sorted(seq)
+
+  def test_can_rx_bottom_half(self):
+    rx_pkt = libpanda_py.ffi.new('CANPacket_t *')
+
+    def drain():
+      lpp.can_rx_process()
+      while lpp.can_packed_pop(lpp.rx_q, rx_pkt):
+        pass
+      for q in TX_QUEUES:
+        while lpp.can_pop(q, rx_pkt):
+          pass
+
+    lpp.set_safety_hooks(Panda.SAFETY_ALLOUTPUT, 0)
+    drain()
+
+    # staged frames reach the host in order, with the timestamp of the top half
+    lpp.can_rx_timestamps = True
+    msgs = random_can_messages(200, bus=1)
+    for i, m in enumerate(msgs):
+      assert lpp.can_rx_stage(libpanda_py.make_CANPacket(m[0], m[2], m[1]), 1000 + i)
+      if i % 50 == 49:
+        lpp.can_rx_process()
+
+    buf = b""
+    dat = libpanda_py.ffi.new(f"uint8_t[{CHUNK_SIZE}]")
+    while (rx_len := lpp.comms_can_read(dat, CHUNK_SIZE)) > 0:
+      buf += bytes(dat[0:rx_len])
+    rx_msgs, overflow = unpack_can_buffer(buf, timestamps=True)
+    assert len(overflow) == 0
+    assert rx_msgs == [(*m, 1000 + i) for i, m in enumerate(msgs)]
+
+    # forwarding happens in the bottom half too
+    lpp.set_safety_hooks(Panda.SAFETY_TOYOTA, 0)
+    for m in random_can_messages(20, bus=0):
+      assert lpp.can_rx_stage(libpanda_py.make_CANPacket(0x100, m[2], m[1]), 0)
+    lpp.can_rx_process()
+    fwd = 0
+    while lpp.can_pop(lpp.tx3_q, rx_pkt):
+      assert rx_pkt[0].addr == 0x100 and rx_pkt[0].bus == 0
+      fwd += 1
+    assert fwd == 20
+    lpp.comms_can_reset()
+
+    # the top half drops frames once the bottom half is a full staging buffer behind
+    drop_cnt = lpp.can_rx_staging_drop_cnt(1)
+    staged = 0
+    while lpp.can_rx_stage(libpanda_py.make_CANPacket(0x200, 1, b"drop"), 0):
+      staged += 1
+    assert not lpp.can_rx_stage(libpanda_py.make_CANPacket(0x200, 1, b"drop"), 0)
+    assert staged == 64
+    assert lpp.can_rx_staging_drop_cnt(1) == drop_cnt + 2
+    lpp.can_rx_process()
+    assert lpp.can_rx_stage(libpanda_py.make_CANPacket(0x200, 1, b"drop"), 0)
+    drain()
+
   def test_can_receive_usb(self):
     msgs = random_can_messages(50000)
     packets = [libpanda_py.make_CANPacket(m[0], m[2], m[1]) for m in msgs]
@@ -132,8 +599,8 @@ class TestPandaComms(unittest.TestCase):
     overflow_buf = b""
     while len(packets) > 0:
       # Push into queue
-      while lpp.can_slots_empty(lpp.rx_q) > 0 and len(packets) > 0:
-        lpp.can_push(lpp.rx_q, packets.pop(0))
+      while len(packets) > 0 and lpp.can_packed_push(lpp.rx_q, packets[0]):
+        packets.pop(0)
 
       # Simulate USB bulk IN chunks
       MAX_TRANSFER_SIZE = 16384
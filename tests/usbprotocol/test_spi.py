@@ -0,0 +1,310 @@
+#!/usr/bin/env python3
+import math
+import random
+import unittest
+from contextlib import contextmanager
+from unittest.mock import patch
+
+from panda import Panda, pack_can_buffer, unpack_can_buffer
+from panda.python.base import TIMEOUT
+from panda.python.spi import DEFAULT_BUFSIZ, PandaSpiHandle, PandaSpiNackResponse, XFER_SIZE
+from panda.tests.libpanda import libpanda_py
+from panda.tests.usbprotocol.test_comms import TX_QUEUES, random_can_messages, unpackage_can_msg
+
+lpp = libpanda_py.libpanda
+ffi = libpanda_py.ffi
+
+
+class EmulatedSpiDevice:
+  """
+  SpiDevice stand-in that clocks the transfers through the emulated panda SPI slave in libpanda,
+  see tests/libpanda/spi_emulation.h. Every transfer costs the host xfer_overhead_us of emulated
+  time before CS goes down, and the panda takes irq_latency_us to handle each DMA and CS interrupt.
+  Like spidev, transfers longer than max_xfer_len fail.
+  """
+
+  def __init__(self, speed=50e6, irq_latency_us=2.0, xfer_overhead_us=30.0, on_xfer=None, max_xfer_len=DEFAULT_BUFSIZ):
+    self.max_xfer_len = max_xfer_len
+    self.xfer_overhead_ns = int(xfer_overhead_us * 1e3)
+    self.on_xfer = on_xfer
+    self.xfers = 0
+    lpp.spi_emu_init(int(8e9 / speed), int(irq_latency_us * 1e3))
+
+  @contextmanager
+  def acquire(self):
+    yield self
+
+  def close(self):
+    pass
+
+  def xfer2(self, data):
+    if len(data) > self.max_xfer_len:
+      raise OverflowError(f"Argument list size exceeds {self.max_xfer_len} bytes.")
+    lpp.spi_emu_idle(self.xfer_overhead_ns)
+    mosi = bytes(data)
+    miso = ffi.new(f"uint8_t[{len(mosi)}]")
+    lpp.spi_emu_xfer(mosi, miso, len(mosi))
+    self.xfers += 1
+    if self.on_xfer is not None:
+      self.on_xfer()
+    return list(bytes(ffi.buffer(miso)))
+
+  xfer = xfer2
+
+  def readbytes(self, n):
+    return self.xfer2(bytes(n))
+
+  def writebytes(self, data):
+    self.xfer2(data)
+
+
+def emulated_handle(version, **kwargs):
+  handle = PandaSpiHandle(EmulatedSpiDevice(**kwargs))
+  handle.get_protocol_version()
+  handle.set_protocol_version(version)
+  return handle
+
+
+def emulated_panda(version, **kwargs):
+  # just what the CAN functions need
+  p = Panda.__new__(Panda)
+  p._handle = emulated_handle(version, **kwargs)
+  p.can_version = Panda.CAN_PACKET_VERSION
+  p.can_rx_overflow_buffer = b''
+  p._can_rx_timestamps = False
+  return p
+
+
+def push_rx_queue(msgs):
+  for addr, dat, bus in msgs:
+    assert lpp.can_packed_push(lpp.rx_q, libpanda_py.make_CANPacket(addr, bus, dat))
+
+
+def drain_rx_queue():
+  pkt = ffi.new('CANPacket_t *')
+  while lpp.can_packed_pop(lpp.rx_q, pkt):
+    pass
+
+
+def pop_tx_queues(n=None):
+  # the CAN buses sending, which lets the host send more
+  pkt = ffi.new('CANPacket_t *')
+  popped = []
+  for q in TX_QUEUES:
+    while ((n is None) or (len(popped) < n)) and lpp.can_pop(q, pkt):
+      popped.append(unpackage_can_msg(pkt))
+  lpp.refresh_can_tx_slots_available()
+  return popped
+
+
+class TestSpiProtocol(unittest.TestCase):
+  def setUp(self):
+    lpp.comms_can_reset()
+    lpp.set_safety_hooks(Panda.SAFETY_ALLOUTPUT, 0)
+    pop_tx_queues()
+    drain_rx_queue()
+
+  def test_version(self):
+    handle = emulated_handle(2)
+    dat = handle.get_protocol_version()
+    self.assertEqual(dat[:12], bytes(range(1, 13)))
+    self.assertEqual(dat[13], 0xcc)
+    self.assertEqual(dat[14], PandaSpiHandle.PROTOCOL_VERSION)
+
+    # and from v3, which switches the panda back to v2
+    handle.set_protocol_version(3)
+    self.assertEqual(handle.get_protocol_version(), dat)
+    self.assertEqual(handle.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, 2), b"\xd2\xd3")
+
+  def test_control(self):
+    for version in (2, 3):
+      with self.subTest(version=version):
+        handle = emulated_handle(version)
+        for length in (0, 1, 64, 300):
+          cnt = lpp.spi_emu_control_cnt()
+          xfers = handle.dev.xfers
+          dat = handle.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, length)
+          self.assertEqual(dat, bytes((0xd2 + i) & 0xFF for i in range(length)))
+          self.assertEqual(lpp.spi_emu_control_cnt(), cnt + 1)
+          if version == 3:
+            # the request, then the response, long ones after reading their length
+            self.assertEqual(handle.dev.xfers - xfers, 2 if length <= 64 else 3)
+        handle.controlWrite(Panda.REQUEST_OUT, 0xdc, 0, 0, b"")
+
+  def test_can(self):
+    random.seed(0)
+    for version in (2, 3):
+      with self.subTest(version=version):
+        handle = emulated_handle(version)
+        for _ in range(10):
+          msgs = random_can_messages(150, bus=random.randint(0, 2))
+          handle.bulkWrite(3, b"".join(pack_can_buffer(msgs)))
+          self.assertEqual(pop_tx_queues(), msgs)
+
+          msgs = random_can_messages(random.randint(1, 300), bus=1)
+          for addr, dat, bus in msgs:
+            self.assertTrue(lpp.can_packed_push(lpp.rx_q, libpanda_py.make_CANPacket(addr, bus, dat)))
+          xfers = handle.dev.xfers
+          rx = handle.bulkRead(1, 16384)
+          self.assertEqual(unpack_can_buffer(rx)[0], msgs)
+          if version == 3:
+            # a request for every spidev buffer of the batch, its length, then all of it
+            self.assertLessEqual(handle.dev.xfers - xfers, 3 * math.ceil((len(rx) + 1) / handle.max_rx_len))
+
+  def test_can_flow_control(self):
+    # the TX queues fill up while the pipelined chunks come in, the NACKed ones get sent again in order
+    random.seed(1)
+    popped: list = []
+    handle = emulated_handle(3, on_xfer=lambda: popped.extend(pop_tx_queues(20)))
+    msgs = random_can_messages(3000, bus=0)
+    handle.bulkWrite(3, b"".join(pack_can_buffer(msgs)))
+    popped.extend(pop_tx_queues())
+    self.assertEqual(popped, msgs)
+
+  def test_bad_checksum(self):
+    handle = emulated_handle(3)
+    errors = lpp.spi_checksum_error_count
+    with patch('panda.python.spi.PandaSpiHandle._calc_checksum', return_value=0):
+      with self.assertRaises(PandaSpiNackResponse):
+        handle.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, 10, timeout=20)
+    self.assertGreater(lpp.spi_checksum_error_count, errors)
+    self.assertEqual(handle.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, 2), b"\xd2\xd3")
+
+    with self.assertRaises(PandaSpiNackResponse):
+      handle.bulkWrite(20, b"abc", timeout=20)
+    self.assertEqual(handle.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, 2), b"\xd2\xd3")
+
+  def test_v2_master(self):
+    # another master on v2 switches the panda back, the v3 one switches it again
+    v3 = emulated_handle(3)
+    v2 = PandaSpiHandle(v3.dev)
+    for _ in range(3):
+      self.assertEqual(v2.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, 4), b"\xd2\xd3\xd4\xd5")
+      self.assertEqual(v3.controlRead(Panda.REQUEST_IN, 0xd3, 0, 0, 4), b"\xd3\xd4\xd5\xd6")
+      v2.get_protocol_version()
+      self.assertEqual(v3.controlRead(Panda.REQUEST_IN, 0xd4, 0, 0, 4), b"\xd4\xd5\xd6\xd7")
+
+  def test_irq_latency(self):
+    # the panda handles the end of a transfer a while after CS goes up, but before the next one
+    random.seed(2)
+    for version in (2, 3):
+      for latency_us in (0, 10, 25):
+        with self.subTest(version=version, latency_us=latency_us):
+          handle = emulated_handle(version, irq_latency_us=latency_us)
+          for length in (1, 200):
+            self.assertEqual(handle.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, length), bytes((0xd2 + i) & 0xFF for i in range(length)))
+          msgs = random_can_messages(100, bus=2)
+          handle.bulkWrite(3, b"".join(pack_can_buffer(msgs)))
+          self.assertEqual(pop_tx_queues(), msgs)
+
+  def test_slow_handler(self):
+    # a request the panda blocks on for longer than a few polls, like a flash sector erase, runs once.
+    # the master waits at least MIN_ACK_TIMEOUT_MS for it, in emulated time
+    for version in (2, 3):
+      with self.subTest(version=version):
+        handle = emulated_handle(version)
+        lpp.spi_emu_control_delay(int(50e6))
+        with patch('panda.python.spi.time.monotonic', lambda: lpp.spi_emu_time() * 1e-9):
+          for length, timeout in ((1, TIMEOUT), (200, TIMEOUT), (2, 20)):
+            cnt = lpp.spi_emu_control_cnt()
+            start = lpp.spi_emu_time()
+            dat = handle.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, length, timeout=timeout)
+            self.assertEqual(dat, bytes((0xd2 + i) & 0xFF for i in range(length)))
+            self.assertEqual(lpp.spi_emu_control_cnt(), cnt + 1)
+            self.assertGreater(lpp.spi_emu_time() - start, 50e6)
+        lpp.spi_emu_control_delay(0)
+
+  def test_can_exchange(self):
+    random.seed(4)
+    for version in (2, 3):
+      with self.subTest(version=version):
+        p = emulated_panda(version)
+        for tx_cnt, rx_cnt in ((0, 0), (1, 0), (0, 1), (20, 50), (150, 300), (0, 1000)):
+          tx = random_can_messages(tx_cnt, bus=random.randint(0, 2))
+          rx = random_can_messages(rx_cnt, bus=1)
+          push_rx_queue(rx)
+          got = p.can_exchange(tx)
+          # a call reads at most as much as can_recv
+          while len(got) < len(rx):
+            got += p.can_exchange([])
+          self.assertEqual(got, rx)
+          self.assertEqual(pop_tx_queues(), tx)
+
+  def test_can_exchange_flow_control(self):
+    # frames that don't fit wait on the host, the received ones still come in
+    random.seed(5)
+    p = emulated_panda(3)
+    tx = random_can_messages(10, bus=0)
+    rx = random_can_messages(10, bus=1)
+    push_rx_queue(rx)
+    lpp.spi_can_tx_ready = False
+    with self.assertRaises(PandaSpiNackResponse):
+      p.can_exchange(tx, timeout=5)
+    self.assertEqual(pop_tx_queues(), [])
+    self.assertEqual(p.can_exchange(tx), rx)
+    self.assertEqual(pop_tx_queues(), tx)
+
+  def test_can_exchange_xfers(self):
+    # a control loop cycle: a few frames out, a bunch in
+    random.seed(6)
+    for version in (2, 3):
+      p = emulated_panda(version)
+      tx = random_can_messages(10, bus=0)
+      rx = random_can_messages(60, bus=1)
+      counts = []
+      for cycle in (lambda: p.can_send_many(tx) or p.can_recv(), lambda: p.can_exchange(tx)):
+        push_rx_queue(rx)
+        xfers = p._handle.dev.xfers
+        self.assertEqual(cycle(), rx)
+        counts.append(p._handle.dev.xfers - xfers)
+        self.assertEqual(pop_tx_queues(), tx)
+      print(f"\nv{version} xfers per cycle: can_send_many + can_recv {counts[0]}, can_exchange {counts[1]}")
+      self.assertLess(counts[1], counts[0])
+
+  def test_xfer_len(self):
+    # 16kB of CAN in as few transfers as the spidev buffer allows
+    random.seed(7)
+    msgs = random_can_messages(1000, bus=1)
+    for max_xfer_len in (DEFAULT_BUFSIZ, 0x5000):
+      p = emulated_panda(3, max_xfer_len=max_xfer_len)
+      push_rx_queue(msgs[:500])
+      self.assertEqual(p.can_recv(), msgs[:500])
+      push_rx_queue(msgs[500:])
+      self.assertEqual(p.can_exchange([]), msgs[500:])
+
+  def test_throughput(self):
+    # transfers and emulated time per operation
+    random.seed(3)
+    msgs = random_can_messages(1000, bus=0)
+    can_data = b"".join(pack_can_buffer(msgs))
+    ops = {
+      "health": lambda h: h.controlRead(Panda.REQUEST_IN, 0xd2, 0, 0, Panda.HEALTH_STRUCT.size),
+      "can_recv": lambda h: h.bulkRead(1, XFER_SIZE),
+      "can_recv 16kB": lambda h: h.bulkRead(1, 16384),
+      "can_send 1 chunk": lambda h: h.bulkWrite(3, can_data[:XFER_SIZE]),
+      f"can_send {len(can_data) // XFER_SIZE + 1} chunks": lambda h: h.bulkWrite(3, can_data),
+    }
+
+    results = {}
+    for version in (2, 3):
+      handle = emulated_handle(version, on_xfer=pop_tx_queues)
+      for name, op in ops.items():
+        drain_rx_queue()
+        rx = [libpanda_py.make_CANPacket(addr, bus, dat) for addr, dat, bus in msgs[:120]]
+        xfers, start = handle.dev.xfers, lpp.spi_emu_time()
+        for _ in range(10):
+          for pkt in rx:
+            lpp.can_packed_push(lpp.rx_q, pkt)
+          op(handle)
+        results[(version, name)] = ((handle.dev.xfers - xfers) / 10, (lpp.spi_emu_time() - start) / 10e3)
+
+    print(f"\n{'':22} {'v2 xfers':>9} {'v2 us':>8} {'v3 xfers':>9} {'v3 us':>8}")
+    for name in ops:
+      (x2, t2), (x3, t3) = results[(2, name)], results[(3, name)]
+      print(f"{name:22} {x2:9.1f} {t2:8.1f} {x3:9.1f} {t3:8.1f}")
+      self.assertLess(x3, x2)
+      self.assertLess(t3, t2)
+
+
+if __name__ == "__main__":
+  unittest.main()